@@ -524,6 +524,39 @@ FI_ENUM(FREE_IMAGE_COLOR_CHANNEL) {
 	FICC_PHASE	= 9		//! Complex images: use phase
 };
 
+/** Pixel layouts.
+Constants used in FreeImage_ExportPixels.
+*/
+FI_ENUM(FREE_IMAGE_PIXEL_LAYOUT) {
+	FIPL_RGBA	= 0,	//! red, green, blue, alpha
+	FIPL_BGRA	= 1,	//! blue, green, red, alpha
+	FIPL_ARGB	= 2,	//! alpha, red, green, blue
+	FIPL_R		= 3,	//! red (or grey) only
+	FIPL_RG		= 4,	//! red, green
+	FIPL_RGB	= 5,	//! red, green, blue
+	FIPL_BGR	= 6		//! blue, green, red
+};
+
+/** Pixel component types.
+Constants used in FreeImage_ExportPixels.
+*/
+FI_ENUM(FREE_IMAGE_COMPONENT_TYPE) {
+	FICT_UINT8	= 0,	//! unsigned 8-bit, [0..255]
+	FICT_UINT16	= 1,	//! unsigned 16-bit, [0..65535]
+	FICT_HALF	= 2,	//! 16-bit IEEE floating point, [0..1] for standard images
+	FICT_FLOAT	= 3		//! 32-bit IEEE floating point, [0..1] for standard images
+};
+
+/** Blend modes of premultiplied images.
+Constants used in FreeImage_CompositeInto.
+*/
+FI_ENUM(FREE_IMAGE_BLEND_MODE) {
+	FIBM_OVER		= 0,	//! Porter-Duff source over destination
+	FIBM_MULTIPLY	= 1,	//! multiply the colors, composited over the destination
+	FIBM_SCREEN		= 2,	//! invert, multiply and invert the colors
+	FIBM_ADD		= 3		//! add the colors (Porter-Duff plus)
+};
+
 // Metadata support ---------------------------------------------------------
 
 /**
@@ -731,6 +764,7 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define PSD_DEFAULT         0
 #define PSD_CMYK			1		//! reads tags for separated CMYK (default is conversion to RGB)
 #define PSD_LAB				2		//! reads tags for CIELab (default is conversion to RGB)
+#define PSD_LAB_EXACT		4		//! convert CIELab to RGB with the exact formulas (slower, default uses tabulated transfer functions)
 #define PSD_NONE			0x0100	//! save without any compression
 #define PSD_RLE				0x0200	//! save using RLE compression
 #define PSD_PSB             0x2000  //! save using Adobe Large Document Format (use | to combine with other save flags)
@@ -740,6 +774,7 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define RAW_DISPLAY			2		//! load the file as RGB 24-bit
 #define RAW_HALFSIZE		4		//! output a half-size color image
 #define RAW_UNPROCESSED		8		//! output a FIT_UINT16 raw Bayer image
+#define RAW_PREVIEW_SIZE	16		//! load the largest embedded preview if its size is at least (flags >> 16) pixels, or default to a half-size RGB 24-bit image
 #define SGI_DEFAULT			0
 #define TARGA_DEFAULT       0
 #define TARGA_LOAD_RGB888   1       //! if set the loader converts RGB555 and ARGB8888 -> RGB888.
@@ -760,6 +795,8 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define XPM_DEFAULT			0
 #define WEBP_DEFAULT		0		//! save with good quality (75:1)
 #define WEBP_LOSSLESS		0x100	//! save in lossless mode
+#define WEBP_FAST			0x200	//! save using a faster compression method, sacrificing some compression ratio (use | to combine with other save flags)
+#define WEBP_ANIMATION_FRAME	0x400	//! save an image with FIMD_ANIMATION metadata as a one-frame animation, keeping its frame parameters (use | to combine with other save flags)
 #define JXR_DEFAULT			0		//! save with quality 80 and no chroma subsampling (4:4:4)
 #define JXR_LOSSLESS		0x0064	//! save lossless
 #define JXR_PROGRESSIVE		0x2000	//! save as a progressive-JXR (use | to combine with other save flags)
@@ -779,6 +816,22 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define FI_RESCALE_DEFAULT			0x00    //! default options; none of the following other options apply
 #define FI_RESCALE_TRUE_COLOR		0x01	//! for non-transparent greyscale images, convert to 24-bit if src bitdepth <= 8 (default is a 8-bit greyscale image). 
 #define FI_RESCALE_OMIT_METADATA	0x02	//! do not copy metadata to the rescaled image
+#define FI_RESCALE_LINEAR_LIGHT		0x04	//! for 8-bit greyscale, 24-bit, 32-bit, RGB16 and RGBA16 images, filter the sRGB decoded (linear light) values instead of the gamma encoded values
+
+// ExportPixels options ------------------------------------------------------
+// Constants used in FreeImage_ExportPixels
+
+#define FI_EXPORT_DEFAULT		0x00	//! bottom-up rows, straight alpha, no color space conversion
+#define FI_EXPORT_TOPDOWN		0x01	//! store the top row first
+#define FI_EXPORT_PREMULTIPLY	0x02	//! premultiply the color channels with alpha
+#define FI_EXPORT_LINEAR		0x04	//! convert the color channels from sRGB to linear light
+#define FI_EXPORT_PLANAR		0x08	//! store each channel in its own plane of height * pitch bytes, planes following each other
+
+// ConvertInto options -------------------------------------------------------
+// Constants used in FreeImage_ConvertInto
+
+#define FI_CONVERT_DEFAULT		0x00	//! convert the pixels only
+#define FI_CONVERT_METADATA		0x01	//! also copy the metadata and the resolution of the source image
 
 
 #ifdef __cplusplus
@@ -790,6 +843,11 @@ extern "C" {
 DLL_API void DLL_CALLCONV FreeImage_Initialise(BOOL load_local_plugins_only FI_DEFAULT(FALSE));
 DLL_API void DLL_CALLCONV FreeImage_DeInitialise(void);
 
+// Multithreading routines -------------------------------------------------
+
+DLL_API void DLL_CALLCONV FreeImage_SetThreadCount(unsigned count);
+DLL_API unsigned DLL_CALLCONV FreeImage_GetThreadCount(void);
+
 // Version routines ---------------------------------------------------------
 
 DLL_API const char *DLL_CALLCONV FreeImage_GetVersion(void);
@@ -1008,12 +1066,15 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertTo24Bits(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertTo32Bits(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ColorQuantize(FIBITMAP *dib, FREE_IMAGE_QUANTIZE quantize);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ColorQuantizeEx(FIBITMAP *dib, FREE_IMAGE_QUANTIZE quantize FI_DEFAULT(FIQ_WUQUANT), int PaletteSize FI_DEFAULT(256), int ReserveSize FI_DEFAULT(0), RGBQUAD *ReservePalette FI_DEFAULT(NULL));
+DLL_API BOOL DLL_CALLCONV FreeImage_ColorQuantizeBatch(FIBITMAP **src, FIBITMAP **dst, int count, FREE_IMAGE_QUANTIZE quantize FI_DEFAULT(FIQ_WUQUANT), int PaletteSize FI_DEFAULT(256), int ReserveSize FI_DEFAULT(0), RGBQUAD *ReservePalette FI_DEFAULT(NULL));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Threshold(FIBITMAP *dib, BYTE T);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Dither(FIBITMAP *dib, FREE_IMAGE_DITHER algorithm);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_DitherToPalette(FIBITMAP *dib, RGBQUAD *palette, int PaletteSize);
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertFromRawBits(BYTE *bits, int width, int height, int pitch, unsigned bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask, BOOL topdown FI_DEFAULT(FALSE));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertFromRawBitsEx(BOOL copySource, BYTE *bits, FREE_IMAGE_TYPE type, int width, int height, int pitch, unsigned bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask, BOOL topdown FI_DEFAULT(FALSE));
 DLL_API void DLL_CALLCONV FreeImage_ConvertToRawBits(BYTE *bits, FIBITMAP *dib, int pitch, unsigned bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask, BOOL topdown FI_DEFAULT(FALSE));
+DLL_API BOOL DLL_CALLCONV FreeImage_ExportPixels(FIBITMAP *dib, BYTE *bits, int pitch, FREE_IMAGE_PIXEL_LAYOUT layout, FREE_IMAGE_COMPONENT_TYPE component, int flags FI_DEFAULT(FI_EXPORT_DEFAULT));
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToFloat(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToRGBF(FIBITMAP *dib);
@@ -1023,8 +1084,12 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToRGB16(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToRGBA16(FIBITMAP *dib);
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear FI_DEFAULT(TRUE));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToStandardTypeRange(FIBITMAP *src, double min_value, double max_value);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToType(FIBITMAP *src, FREE_IMAGE_TYPE dst_type, BOOL scale_linear FI_DEFAULT(TRUE));
 
+DLL_API BOOL DLL_CALLCONV FreeImage_ConvertInto(FIBITMAP *dst, FIBITMAP *src, int flags FI_DEFAULT(FI_CONVERT_DEFAULT));
+DLL_API BOOL DLL_CALLCONV FreeImage_ConvertInPlace(FIBITMAP *dib, FREE_IMAGE_TYPE type, int bpp FI_DEFAULT(0));
+
 // Tone mapping operators ---------------------------------------------------
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ToneMapping(FIBITMAP *dib, FREE_IMAGE_TMO tmo, double first_param FI_DEFAULT(0), double second_param FI_DEFAULT(0));
@@ -1106,6 +1171,9 @@ DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformCombinedFromMemory(FIMEMORY* sr
 // rotation and flipping
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Rotate(FIBITMAP *dib, double angle, const void *bkcolor FI_DEFAULT(NULL));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_RotateEx(FIBITMAP *dib, double angle, double x_shift, double y_shift, double x_origin, double y_origin, BOOL use_mask);
+DLL_API BOOL DLL_CALLCONV FreeImage_RotateInto(FIBITMAP *dst, FIBITMAP *src, int angle, int flags FI_DEFAULT(FI_CONVERT_DEFAULT));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_AffineWarp(FIBITMAP *dib, const double matrix[6], int dst_width, int dst_height, FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_BILINEAR), const void *bkcolor FI_DEFAULT(NULL));
+DLL_API BOOL DLL_CALLCONV FreeImage_AffineWarpInto(FIBITMAP *dst, FIBITMAP *src, const double matrix[6], FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_BILINEAR), const void *bkcolor FI_DEFAULT(NULL));
 DLL_API BOOL DLL_CALLCONV FreeImage_FlipHorizontal(FIBITMAP *dib);
 DLL_API BOOL DLL_CALLCONV FreeImage_FlipVertical(FIBITMAP *dib);
 
@@ -1114,6 +1182,12 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Rescale(FIBITMAP *dib, int dst_width, i
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_MakeThumbnail(FIBITMAP *dib, int max_pixel_size, BOOL convert FI_DEFAULT(TRUE));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_RescaleRect(FIBITMAP *dib, int dst_width, int dst_height, int left, int top, int right, int bottom, FREE_IMAGE_FILTER filter FI_DEFAULT(FILTER_CATMULLROM), unsigned flags FI_DEFAULT(0));
 
+// convolution and blur
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Convolve(FIBITMAP *dib, const float *kernel_x, int size_x, const float *kernel_y, int size_y);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_GaussianBlur(FIBITMAP *dib, double sigma);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_BoxBlur(FIBITMAP *dib, int radius_x, int radius_y);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_UnsharpMask(FIBITMAP *dib, double sigma, double amount, double threshold FI_DEFAULT(0));
+
 // color manipulation routines (point operations)
 DLL_API BOOL DLL_CALLCONV FreeImage_AdjustCurve(FIBITMAP *dib, BYTE *LUT, FREE_IMAGE_COLOR_CHANNEL channel);
 DLL_API BOOL DLL_CALLCONV FreeImage_AdjustGamma(FIBITMAP *dib, double gamma);
@@ -1121,6 +1195,9 @@ DLL_API BOOL DLL_CALLCONV FreeImage_AdjustBrightness(FIBITMAP *dib, double perce
 DLL_API BOOL DLL_CALLCONV FreeImage_AdjustContrast(FIBITMAP *dib, double percentage);
 DLL_API BOOL DLL_CALLCONV FreeImage_Invert(FIBITMAP *dib);
 DLL_API BOOL DLL_CALLCONV FreeImage_GetHistogram(FIBITMAP *dib, DWORD *histo, FREE_IMAGE_COLOR_CHANNEL channel FI_DEFAULT(FICC_BLACK));
+DLL_API BOOL DLL_CALLCONV FreeImage_GetHistograms(FIBITMAP *dib, DWORD **histograms, const FREE_IMAGE_COLOR_CHANNEL *channels, int count);
+DLL_API int DLL_CALLCONV FreeImage_GetStatistics(FIBITMAP *dib, double *min_value, double *max_value, double *mean, double *stddev);
+DLL_API BOOL DLL_CALLCONV FreeImage_GetPercentiles(FIBITMAP *dib, const double *percentiles, double *values, int count);
 DLL_API int DLL_CALLCONV FreeImage_GetAdjustColorsLookupTable(BYTE *LUT, double brightness, double contrast, double gamma, BOOL invert);
 DLL_API BOOL DLL_CALLCONV FreeImage_AdjustColors(FIBITMAP *dib, double brightness, double contrast, double gamma, BOOL invert FI_DEFAULT(FALSE));
 DLL_API unsigned DLL_CALLCONV FreeImage_ApplyColorMapping(FIBITMAP *dib, RGBQUAD *srccolors, RGBQUAD *dstcolors, unsigned count, BOOL ignore_alpha, BOOL swap);
@@ -1133,6 +1210,8 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_GetChannel(FIBITMAP *dib, FREE_IMAGE_CO
 DLL_API BOOL DLL_CALLCONV FreeImage_SetChannel(FIBITMAP *dst, FIBITMAP *src, FREE_IMAGE_COLOR_CHANNEL channel);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_GetComplexChannel(FIBITMAP *src, FREE_IMAGE_COLOR_CHANNEL channel);
 DLL_API BOOL DLL_CALLCONV FreeImage_SetComplexChannel(FIBITMAP *dst, FIBITMAP *src, FREE_IMAGE_COLOR_CHANNEL channel);
+DLL_API int DLL_CALLCONV FreeImage_SplitChannels(FIBITMAP *src, FIBITMAP **channels);
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_MergeChannels(FIBITMAP **channels, int count);
 
 // copy / paste / composite routines
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Copy(FIBITMAP *dib, int left, int top, int right, int bottom);
@@ -1141,6 +1220,8 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_CreateView(FIBITMAP *dib, unsigned left
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg FI_DEFAULT(FALSE), RGBQUAD *appBkColor FI_DEFAULT(NULL), FIBITMAP *bg FI_DEFAULT(NULL));
 DLL_API BOOL DLL_CALLCONV FreeImage_PreMultiplyWithAlpha(FIBITMAP *dib);
+DLL_API BOOL DLL_CALLCONV FreeImage_UnPreMultiplyWithAlpha(FIBITMAP *dib);
+DLL_API BOOL DLL_CALLCONV FreeImage_CompositeInto(FIBITMAP *dst, FIBITMAP *src, int left, int top, FREE_IMAGE_BLEND_MODE mode FI_DEFAULT(FIBM_OVER), int opacity FI_DEFAULT(255));
 
 // background filling routines
 DLL_API BOOL DLL_CALLCONV FreeImage_FillBackground(FIBITMAP *dib, const void *color, int options FI_DEFAULT(0));
@@ -658,6 +658,81 @@ FreeImage_GetBits(FIBITMAP *dib) {
 	return (BYTE *)lp;
 }
 
+BYTE *
+GetPixelFormatBits(FIBITMAP *dib, unsigned bpp, BOOL need_masks, unsigned *pitch) {
+	if(!FreeImage_HasPixels(dib)) {
+		return NULL;
+	}
+
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned line = CalculateLine(width, bpp);
+	const BOOL header_only = fih->external_bits ? TRUE : FALSE;
+
+	// the header of the new format must fit in the memory block, and its pixels too unless they are user provided
+	const size_t old_size = FreeImage_GetInternalImageSize(header_only, width, height, FreeImage_GetBPP(dib), FreeImage_HasRGBMasks(dib));
+	const size_t new_size = FreeImage_GetInternalImageSize(header_only, width, height, bpp, need_masks);
+	if((new_size == 0) || (new_size > old_size)) {
+		return NULL;
+	}
+
+	if(fih->external_bits) {
+		// user provided pixels keep their location and pitch
+		if(line > fih->external_pitch) {
+			return NULL;
+		}
+		*pitch = fih->external_pitch;
+		return fih->external_bits;
+	}
+
+	// same computation as FreeImage_GetBits
+	size_t lp = (size_t)FreeImage_GetInfoHeader(dib);
+	lp += sizeof(BITMAPINFOHEADER) + sizeof(RGBQUAD) * CalculateUsedPaletteEntries(bpp);
+	lp += need_masks ? sizeof(DWORD) * 3 : 0;
+	lp += (lp % FIBITMAP_ALIGNMENT ? FIBITMAP_ALIGNMENT - lp % FIBITMAP_ALIGNMENT : 0);
+	*pitch = CalculatePitch(line);
+	return (BYTE *)lp;
+}
+
+void
+SetPixelFormat(FIBITMAP *dib, FREE_IMAGE_TYPE type, unsigned bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask) {
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+	const BOOL need_masks = ((type == FIT_BITMAP) && (bpp == 16)) ? TRUE : FALSE;
+
+	fih->type = type;
+
+	fih->transparent = FALSE;
+	fih->transparency_count = 0;
+	memset(fih->transparent_table, 0xff, 256);
+
+	BITMAPINFOHEADER *bih = FreeImage_GetInfoHeader(dib);
+	bih->biCompression = need_masks ? BI_BITFIELDS : BI_RGB;
+	bih->biBitCount = (WORD)bpp;
+	bih->biClrUsed = CalculateUsedPaletteEntries(bpp);
+	bih->biClrImportant = bih->biClrUsed;
+
+	if(bih->biClrUsed) {
+		// build a default greyscale palette
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+		CREATE_GREYSCALE_PALETTE(pal, bih->biClrUsed);
+	}
+
+	if(need_masks) {
+		FREEIMAGERGBMASKS *masks = FreeImage_GetRGBMasks(dib);
+		masks->red_mask = red_mask;
+		masks->green_mask = green_mask;
+		masks->blue_mask = blue_mask;
+	}
+}
+
+void
+SetExternalBits(FIBITMAP *dib, BYTE *bits, unsigned height) {
+	FREEIMAGEHEADER *fih = (FREEIMAGEHEADER *)dib->data;
+	fih->external_bits = bits;
+	FreeImage_GetInfoHeader(dib)->biHeight = (LONG)height;
+}
+
 // ----------------------------------------------------------
 //  DIB information functions
 // ----------------------------------------------------------
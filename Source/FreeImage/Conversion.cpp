@@ -26,6 +26,7 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "Quantizers.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 
@@ -135,22 +136,23 @@ _convertCMYKtoRGBA(unsigned width, unsigned height, BYTE* line_start, unsigned p
 	const BOOL hasBlack = (samplesperpixel > 3) ? TRUE : FALSE;
 	const T MAX_VAL = std::numeric_limits<T>::max();
 		
-	T K = 0;
-	for(unsigned y = 0; y < height; y++) {
-		T *line = (T*)line_start;
-
-		for(unsigned x = 0; x < width; x++) {
-			if(hasBlack) {
-				K = line[FI_RGBA_ALPHA];			
-				line[FI_RGBA_ALPHA] = MAX_VAL; // TODO write the first extra channel as alpha!
-			}			
-			
-			CMYKToRGB<T>(line[0], line[1], line[2], K, line);
-			
-			line += samplesperpixel;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		T K = 0;
+		for(unsigned y = first_row; y < last_row; y++) {
+			T *line = (T*)(line_start + (size_t)y * pitch);
+
+			for(unsigned x = 0; x < width; x++) {
+				if(hasBlack) {
+					K = line[FI_RGBA_ALPHA];			
+					line[FI_RGBA_ALPHA] = MAX_VAL; // TODO write the first extra channel as alpha!
+				}			
+				
+				CMYKToRGB<T>(line[0], line[1], line[2], K, line);
+				
+				line += samplesperpixel;
+			}
 		}
-		line_start += pitch;
-	}
+	});
 }
 
 BOOL 
@@ -282,28 +284,119 @@ CIELabToRGB(float L, float a, float b, T *rgb) {
 	assignRGB(red, green, blue, rgb);
 }
 
+/**
+Tabulated CIELab -> RGB conversion. 
+The conversion is split into the inverse CIELab companding function (applied to X, Y, Z), 
+the XYZ -> linear RGB matrix and the sRGB companding function (applied to R, G, B). 
+The two 1D functions are tabulated and linearly interpolated, which replaces the six powf calls 
+of CIELabToRGB with table lookups. The result is within one level of CIELabToRGB.
+(A 3D table of the whole conversion, interpolated between its nodes, is much less accurate 
+because of the clipping to the RGB gamut).
+*/
+class LabToRGBTable {
+private:
+	//! number of intervals of the CIELab table
+	static const int LAB_SIZE = 4096;
+	//! range of the CIELab table input, covers L in [0..100], a and b in [-128..128]
+	static const float LAB_MIN;
+	static const float LAB_MAX;
+	//! number of intervals of the sRGB table
+	static const int SRGB_SIZE = 16384;
+
+	float _lab[LAB_SIZE + 2];
+	float _srgb[SRGB_SIZE + 2];
+
+	static double Interpolate(const float *table, double x) {
+		const int i = (int)x;
+		return table[i] + (x - i) * (table[i + 1] - table[i]);
+	}
+
+public:
+	LabToRGBTable() {
+		for(int i = 0; i <= LAB_SIZE + 1; i++) {
+			const double var = LAB_MIN + i * (double)(LAB_MAX - LAB_MIN) / LAB_SIZE;
+			const double pow_3 = var * var * var;
+			_lab[i] = (float)((pow_3 > 0.008856) ? pow_3 : (var - 16. / 116.) / 7.787);
+		}
+		const float exponent = 1.F / 2.4F;
+		for(int i = 0; i <= SRGB_SIZE + 1; i++) {
+			const float var = MIN(1.F, (float)i / SRGB_SIZE);
+			_srgb[i] = (var > 0.0031308F) ? 1.055F * powf(var, exponent) - 0.055F : 12.92F * var;
+			_srgb[i] = CLAMP(_srgb[i], 0.F, 1.F);
+		}
+		// saturated values must give the max value, as in CIELabToRGB
+		_srgb[SRGB_SIZE] = _srgb[SRGB_SIZE + 1] = 1.F;
+	}
+
+	/**
+	Convert a CIELab color to RGB values in [0..1]
+	*/
+	void Convert(float L, float a, float b, float *rgb) const {
+		// computed in double : the XYZ -> RGB matrix cancels large terms for saturated colors, 
+		// and float rounding there is worth more than one 16-bit level
+		const double lab_scale = LAB_SIZE / (double)(LAB_MAX - LAB_MIN);
+
+		const double var_Y = (L + 16.) / 116.;
+		const double var_X = a / 500. + var_Y;
+		const double var_Z = var_Y - b / 200.;
+
+		// reference white D65 (Observer= 2)
+		const double X = 0.95047 * Interpolate(_lab, CLAMP((var_X - LAB_MIN) * lab_scale, 0., (double)LAB_SIZE));
+		const double Y = Interpolate(_lab, CLAMP((var_Y - LAB_MIN) * lab_scale, 0., (double)LAB_SIZE));
+		const double Z = 1.08883 * Interpolate(_lab, CLAMP((var_Z - LAB_MIN) * lab_scale, 0., (double)LAB_SIZE));
+
+		const double R = X *  3.2406 + Y * -1.5372 + Z * -0.4986;
+		const double G = X * -0.9689 + Y *  1.8758 + Z *  0.0415;
+		const double B = X *  0.0557 + Y * -0.2040 + Z *  1.0570;
+
+		rgb[0] = (float)Interpolate(_srgb, CLAMP(R, 0., 1.) * SRGB_SIZE);
+		rgb[1] = (float)Interpolate(_srgb, CLAMP(G, 0., 1.) * SRGB_SIZE);
+		rgb[2] = (float)Interpolate(_srgb, CLAMP(B, 0., 1.) * SRGB_SIZE);
+	}
+
+	/**
+	Get the tables, built on first use
+	*/
+	static const LabToRGBTable& Get() {
+		static const LabToRGBTable s_table;
+		return s_table;
+	}
+};
+
+const float LabToRGBTable::LAB_MIN = -0.625F;
+const float LabToRGBTable::LAB_MAX = 1.875F;
+
 template<class T>
 static void 
-_convertLABtoRGB(unsigned width, unsigned height, BYTE* line_start, unsigned pitch, unsigned samplesperpixel) {
+_convertLABtoRGB(unsigned width, unsigned height, BYTE* line_start, unsigned pitch, unsigned samplesperpixel, BOOL exact) {
 	const unsigned max_val = std::numeric_limits<T>::max();
 	const float sL = 100.F / max_val;
 	const float sa = 256.F / max_val;
 	const float sb = 256.F / max_val;
-	
-	for(unsigned y = 0; y < height; y++) {
-		T *line = (T*)line_start;
 
-		for(unsigned x = 0; x < width; x++) {
-			CIELabToRGB(line[0]* sL, line[1]* sa - 128.F, line[2]* sb - 128.F, line);
-			
-			line += samplesperpixel;
+	const LabToRGBTable *table = exact ? NULL : &LabToRGBTable::Get();
+	
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			T *line = (T*)(line_start + (size_t)y * pitch);
+
+			for(unsigned x = 0; x < width; x++) {
+				if(table) {
+					float rgb[3];
+					table->Convert(line[0] * sL, line[1] * sa - 128.F, line[2] * sb - 128.F, rgb);
+					assignRGB((T)(rgb[0] * max_val), (T)(rgb[1] * max_val), (T)(rgb[2] * max_val), line);
+				} else {
+					CIELabToRGB(line[0]* sL, line[1]* sa - 128.F, line[2]* sb - 128.F, line);
+				}
+				
+				line += samplesperpixel;
+			}
 		}
-		line_start += pitch;
-	}
+	});
 }
 
 BOOL
-ConvertLABtoRGB(FIBITMAP* dib) {
+ConvertLABtoRGB(FIBITMAP* dib, BOOL exact) {
 	if(!FreeImage_HasPixels(dib)) {
 		return FALSE;
 	}
@@ -326,10 +419,10 @@ ConvertLABtoRGB(FIBITMAP* dib) {
 	unsigned samplesperpixel = FreeImage_GetLine(dib) / width / channelSize;
 			
 	if(channelSize == 1) {
-		_convertLABtoRGB<BYTE>(width, height, line_start, pitch, samplesperpixel);
+		_convertLABtoRGB<BYTE>(width, height, line_start, pitch, samplesperpixel, exact);
 	}
 	else {
-		_convertLABtoRGB<WORD>(width, height, line_start, pitch, samplesperpixel);
+		_convertLABtoRGB<WORD>(width, height, line_start, pitch, samplesperpixel, exact);
 	}
 
 	return TRUE;	
@@ -435,6 +528,208 @@ FreeImage_ColorQuantizeEx(FIBITMAP *dib, FREE_IMAGE_QUANTIZE quantize, int Palet
 	return NULL;
 }
 
+// ----------------------------------------------------------
+//   Batch quantization
+// ----------------------------------------------------------
+
+/**
+Maximum number of pixels of the image used to train the NeuQuant network of a batch
+*/
+static const unsigned BATCH_SAMPLE_PIXELS = 512 * 512;
+
+/**
+Build a 24-bit image with evenly spaced pixels of all the images of a batch.
+The last scanline is completed with the first pixels of the sample.
+*/
+static FIBITMAP*
+BuildBatchSample(FIBITMAP **src, int count) {
+	UINT64 total = 0;
+	for(int i = 0; i < count; i++) {
+		total += (UINT64)FreeImage_GetWidth(src[i]) * FreeImage_GetHeight(src[i]);
+	}
+	const UINT64 step = (total + BATCH_SAMPLE_PIXELS - 1) / BATCH_SAMPLE_PIXELS;
+	const unsigned sample_count = (unsigned)((total + step - 1) / step);
+	const unsigned width = MIN(sample_count, 1024U);
+	const unsigned height = (sample_count + width - 1) / width;
+
+	FIBITMAP *sample = FreeImage_Allocate(width, height, 24);
+	if(!sample) {
+		return NULL;
+	}
+
+	// take a pixel every 'step' pixels, the images being read one after the other in scanline order
+	unsigned n = 0;
+	UINT64 position = 0, next = 0;
+	for(int i = 0; i < count; i++) {
+		const unsigned src_width = FreeImage_GetWidth(src[i]);
+		const unsigned src_height = FreeImage_GetHeight(src[i]);
+		const unsigned bytespp = FreeImage_GetLine(src[i]) / src_width;
+		for(unsigned y = 0; y < src_height; y++, position += src_width) {
+			const BYTE *src_bits = FreeImage_GetScanLine(src[i], y);
+			for(; next < position + src_width; next += step, n++) {
+				const BYTE *pixel = src_bits + (unsigned)(next - position) * bytespp;
+				BYTE *dst_bits = FreeImage_GetScanLine(sample, n / width) + 3 * (n % width);
+				dst_bits[FI_RGBA_BLUE] = pixel[FI_RGBA_BLUE];
+				dst_bits[FI_RGBA_GREEN] = pixel[FI_RGBA_GREEN];
+				dst_bits[FI_RGBA_RED] = pixel[FI_RGBA_RED];
+			}
+		}
+	}
+	for(; n < width * height; n++) {
+		const unsigned k = n - sample_count;
+		memcpy(FreeImage_GetScanLine(sample, n / width) + 3 * (n % width), FreeImage_GetScanLine(sample, k / width) + 3 * (k % width), 3);
+	}
+
+	return sample;
+}
+
+/**
+Map the images of a batch to the nearest colors of a palette. The scanlines of all images are mapped in parallel.
+*/
+static void
+MapBatch(FIBITMAP **src, FIBITMAP **dst, int count, const RGBQUAD *palette, int size) {
+	const NearestColorMap map(palette, size);
+
+	std::vector<unsigned> first_row(count + 1, 0);
+	unsigned max_width = 1;
+	for(int i = 0; i < count; i++) {
+		const unsigned width = FreeImage_GetWidth(src[i]);
+		const unsigned height = FreeImage_GetHeight(src[i]);
+		dst[i] = FreeImage_Allocate(width, height, 8);
+		if(!dst[i]) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+		memcpy(FreeImage_GetPalette(dst[i]), palette, size * sizeof(RGBQUAD));
+		first_row[i + 1] = first_row[i] + height;
+		max_width = MAX(max_width, width);
+	}
+
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + max_width - 1) / max_width;
+	ParallelFor(first_row[count], min_rows, [&](unsigned first, unsigned last) {
+		// image of the first row of the range
+		int i = (int)(std::upper_bound(first_row.begin(), first_row.end(), first) - first_row.begin()) - 1;
+		for(unsigned row = first; row < last; row++) {
+			while(row >= first_row[i + 1]) {
+				i++;
+			}
+			const unsigned y = row - first_row[i];
+			const unsigned width = FreeImage_GetWidth(src[i]);
+			map.MapLine(FreeImage_GetScanLine(dst[i], y), FreeImage_GetScanLine(src[i], y), width, FreeImage_GetLine(src[i]) / width);
+		}
+	});
+}
+
+/**
+Quantize a batch of images, such as the frames of an animation, to a single palette.
+The palette is built from the colors of all images, then all images are mapped to it.
+@param src Input 24-bit or 32-bit images
+@param dst Array of count pointers, receiving the quantized 8-bit images, all with the same palette
+@param count Number of images
+@param quantize Quantizer used to build the palette :
+FIQ_WUQUANT builds the palette from the histogram of all images,
+FIQ_NNQUANT trains the network with a sample of the pixels of all images, then maps the images to the nearest colors,
+FIQ_LFPQUANT succeeds when all images have no more than PaletteSize colors altogether
+@param PaletteSize Size of the palette, in [2..256]
+@param ReserveSize Number of reserved palette entries
+@param ReservePalette Reserved palette entries
+@return Returns TRUE if successful, FALSE otherwise (and all dst pointers are NULL)
+@see FreeImage_ColorQuantizeEx
+*/
+BOOL DLL_CALLCONV
+FreeImage_ColorQuantizeBatch(FIBITMAP **src, FIBITMAP **dst, int count, FREE_IMAGE_QUANTIZE quantize, int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette) {
+	if(!src || !dst || (count <= 0)) {
+		return FALSE;
+	}
+	if( PaletteSize < 2 ) PaletteSize = 2;
+	if( PaletteSize > 256 ) PaletteSize = 256;
+	if( ReserveSize < 0 ) ReserveSize = 0;
+	if( ReserveSize > PaletteSize ) ReserveSize = PaletteSize;
+
+	for(int i = 0; i < count; i++) {
+		dst[i] = NULL;
+	}
+	for(int i = 0; i < count; i++) {
+		const unsigned bpp = FreeImage_GetBPP(src[i]);
+		if(!FreeImage_HasPixels(src[i]) || (FreeImage_GetImageType(src[i]) != FIT_BITMAP) || ((bpp != 24) && (bpp != 32))) {
+			return FALSE;
+		}
+	}
+
+	try {
+		switch(quantize) {
+			case FIQ_WUQUANT :
+			{
+				WuQuantizer Q;
+				for(int i = 0; i < count; i++) {
+					Q.AddImage(src[i]);
+				}
+				Q.BuildPalette(PaletteSize, ReserveSize, ReservePalette);
+				for(int i = 0; i < count; i++) {
+					dst[i] = Q.Map(src[i]);
+				}
+				break;
+			}
+			case FIQ_NNQUANT :
+			{
+				FIBITMAP *sample = BuildBatchSample(src, count);
+				if(!sample) {
+					throw FI_MSG_ERROR_MEMORY;
+				}
+				NNQuantizer Q(PaletteSize);
+				FIBITMAP *quantized = Q.Quantize(sample, ReserveSize, ReservePalette);
+				FreeImage_Unload(sample);
+				if(!quantized) {
+					throw FI_MSG_ERROR_MEMORY;
+				}
+				RGBQUAD palette[256];
+				memcpy(palette, FreeImage_GetPalette(quantized), sizeof(palette));
+				FreeImage_Unload(quantized);
+
+				MapBatch(src, dst, count, palette, PaletteSize);
+				break;
+			}
+			case FIQ_LFPQUANT :
+			{
+				// the color table of the quantizer is shared by all images,
+				// the index of a color never changes once added
+				LFPQuantizer Q(PaletteSize);
+				for(int i = 0; i < count; i++) {
+					dst[i] = Q.Quantize(src[i], (i == 0) ? ReserveSize : 0, ReservePalette);
+					if(!dst[i]) {
+						break;
+					}
+				}
+				if(dst[count - 1]) {
+					for(int i = 0; i < count - 1; i++) {
+						memcpy(FreeImage_GetPalette(dst[i]), FreeImage_GetPalette(dst[count - 1]), 256 * sizeof(RGBQUAD));
+					}
+				}
+				break;
+			}
+		}
+	} catch(const char *message) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, message);
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+	}
+
+	BOOL bSuccess = TRUE;
+	for(int i = 0; i < count; i++) {
+		bSuccess = bSuccess && (dst[i] != NULL);
+	}
+	for(int i = 0; i < count; i++) {
+		if(bSuccess) {
+			// copy metadata from src to dst
+			FreeImage_CloneMetadata(dst[i], src[i]);
+		} else {
+			FreeImage_Unload(dst[i]);
+			dst[i] = NULL;
+		}
+	}
+
+	return bSuccess;
+}
+
 // ==========================================================
 
 FIBITMAP * DLL_CALLCONV
@@ -559,3 +854,310 @@ FreeImage_ConvertToRawBits(BYTE *bits, FIBITMAP *dib, int pitch, unsigned bpp, u
 		}
 	}
 }
+
+// ==========================================================
+//   Conversion into existing images
+// ==========================================================
+
+FIBITMAP* 
+AllocateConversionTarget(FIBITMAP *target, FIBITMAP *src, FREE_IMAGE_TYPE type, int bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask) {
+	if(target) {
+		RGBQUAD *pal = FreeImage_GetPalette(target);
+		if(pal) {
+			// the conversions expect the palette of a new image
+			memset(pal, 0, FreeImage_GetColorsUsed(target) * sizeof(RGBQUAD));
+			if(bpp == 8) {
+				CREATE_GREYSCALE_PALETTE(pal, 256);
+			}
+		}
+		return target;
+	}
+
+	FIBITMAP *dst = FreeImage_AllocateT(type, FreeImage_GetWidth(src), FreeImage_GetHeight(src), bpp, red_mask, green_mask, blue_mask);
+	if(dst) {
+		// copy metadata from src to dst
+		FreeImage_CloneMetadata(dst, src);
+	}
+	return dst;
+}
+
+FIBITMAP* 
+CopyConversionSource(FIBITMAP *target, FIBITMAP *src) {
+	if(!target) {
+		return FreeImage_Clone(src);
+	}
+	if((FreeImage_GetImageType(target) != FreeImage_GetImageType(src)) || (FreeImage_GetBPP(target) != FreeImage_GetBPP(src))) {
+		// not a conversion to the format of target
+		return NULL;
+	}
+
+	const unsigned height = FreeImage_GetHeight(src);
+	const unsigned line = FreeImage_GetLine(src);
+	for(unsigned y = 0; y < height; y++) {
+		memcpy(FreeImage_GetScanLine(target, y), FreeImage_GetScanLine(src, y), line);
+	}
+
+	const unsigned colors = FreeImage_GetColorsUsed(src);
+	if(colors) {
+		memcpy(FreeImage_GetPalette(target), FreeImage_GetPalette(src), colors * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(target, FreeImage_GetTransparencyTable(src), FreeImage_GetTransparencyCount(src));
+		FreeImage_SetTransparent(target, FreeImage_IsTransparent(src));
+	}
+
+	return target;
+}
+
+typedef FIBITMAP* (*ConvertIntoProc)(FIBITMAP *dib, FIBITMAP *target);
+
+/**
+Get the conversion routine writing images of a given format
+@param type Target image type
+@param bpp Target bit depth
+@param rgb565 For 16-bit FIT_BITMAP targets, TRUE for the RGB565 layout, FALSE for the RGB555 layout
+@return Returns NULL if there is no conversion to this format
+*/
+static ConvertIntoProc
+GetConvertIntoProc(FREE_IMAGE_TYPE type, unsigned bpp, BOOL rgb565) {
+	switch(type) {
+		case FIT_BITMAP:
+			switch(bpp) {
+				case 4:
+					return ConvertTo4Bits;
+				case 8:
+					return ConvertTo8Bits;
+				case 16:
+					return rgb565 ? ConvertTo16Bits565 : ConvertTo16Bits555;
+				case 24:
+					return ConvertTo24Bits;
+				case 32:
+					return ConvertTo32Bits;
+			}
+			break;
+		case FIT_UINT16:
+			return ConvertToUINT16;
+		case FIT_FLOAT:
+			return ConvertToFloat;
+		case FIT_RGB16:
+			return ConvertToRGB16;
+		case FIT_RGBA16:
+			return ConvertToRGBA16;
+		case FIT_RGBF:
+			return ConvertToRGBF;
+		case FIT_RGBAF:
+			return ConvertToRGBAF;
+		default:
+			break;
+	}
+	return NULL;
+}
+
+/**
+Convert an image into an existing image, without allocating a new image. 
+The conversion is the one of the FreeImage_ConvertToXXX function of the format of dst 
+(e.g. FreeImage_ConvertTo24Bits for a 24-bit dst, FreeImage_ConvertToRGBF for a FIT_RGBF dst). 
+@param dst Destination image, of the size of src
+@param src Source image
+@param flags FI_CONVERT_DEFAULT, or FI_CONVERT_METADATA to copy the metadata of src
+@return Returns TRUE if successful, returns FALSE if the conversion is not supported
+*/
+BOOL DLL_CALLCONV
+FreeImage_ConvertInto(FIBITMAP *dst, FIBITMAP *src, int flags) {
+	if(!FreeImage_HasPixels(dst) || !FreeImage_HasPixels(src) || (dst == src)) {
+		return FALSE;
+	}
+	if((FreeImage_GetWidth(dst) != FreeImage_GetWidth(src)) || (FreeImage_GetHeight(dst) != FreeImage_GetHeight(src))) {
+		return FALSE;
+	}
+
+	ConvertIntoProc convert = GetConvertIntoProc(FreeImage_GetImageType(dst), FreeImage_GetBPP(dst), IS_FORMAT_RGB565(dst));
+	if(!convert || (convert(src, dst) != dst)) {
+		return FALSE;
+	}
+
+	if((flags & FI_CONVERT_METADATA) == FI_CONVERT_METADATA) {
+		FreeImage_CloneMetadata(dst, src);
+	}
+
+	return TRUE;
+}
+
+/**
+Get the number of source rows to convert before the row y of an in-place conversion can be written, 
+i.e. the rows starting below the end of the new row, and at least y + 1 rows. 
+*/
+static unsigned
+NeededSourceRows(unsigned y, const BYTE *src_bits, unsigned src_pitch, const BYTE *dst_bits, unsigned dst_pitch, unsigned line, unsigned height) {
+	const BYTE *row_end = dst_bits + (size_t)y * dst_pitch + line;
+	unsigned needed = y + 1;
+	if(row_end > src_bits) {
+		needed = MAX(needed, (unsigned)MIN((size_t)height, ((size_t)(row_end - src_bits) + src_pitch - 1) / src_pitch));
+	}
+	return needed;
+}
+
+/**
+Convert an image to a pixel format of the same or a smaller size, in its own memory. 
+Rows are converted by bands into a small buffer, then moved to their new location 
+once no unconverted row overlaps it. 
+16-bit FIT_BITMAP targets are not supported, use FreeImage_ConvertInto instead. 
+@param dib Image to convert
+@param type Target image type
+@param bpp Target bit depth for FIT_BITMAP targets (4, 8, 24 or 32), ignored otherwise
+@return Returns TRUE if successful, returns FALSE if the conversion is not supported or if the new format does not fit in the memory of dib
+*/
+BOOL DLL_CALLCONV
+FreeImage_ConvertInPlace(FIBITMAP *dib, FREE_IMAGE_TYPE type, int bpp) {
+	if(!FreeImage_HasPixels(dib)) {
+		return FALSE;
+	}
+
+	switch(type) {
+		case FIT_BITMAP:
+			if((bpp != 4) && (bpp != 8) && (bpp != 24) && (bpp != 32)) {
+				return FALSE;
+			}
+			break;
+		case FIT_UINT16:
+			bpp = 8 * sizeof(WORD);
+			break;
+		case FIT_FLOAT:
+			bpp = 8 * sizeof(float);
+			break;
+		case FIT_RGB16:
+			bpp = 8 * sizeof(FIRGB16);
+			break;
+		case FIT_RGBA16:
+			bpp = 8 * sizeof(FIRGBA16);
+			break;
+		case FIT_RGBF:
+			bpp = 8 * sizeof(FIRGBF);
+			break;
+		case FIT_RGBAF:
+			bpp = 8 * sizeof(FIRGBAF);
+			break;
+		default:
+			return FALSE;
+	}
+
+	const FREE_IMAGE_TYPE src_type = FreeImage_GetImageType(dib);
+	const unsigned src_bpp = FreeImage_GetBPP(dib);
+	if((src_type == type) && (src_bpp == (unsigned)bpp)) {
+		return TRUE;
+	}
+	if((unsigned)bpp > src_bpp) {
+		// the pixel size must not grow
+		return FALSE;
+	}
+
+	ConvertIntoProc convert = GetConvertIntoProc(type, bpp, FALSE);
+
+	unsigned dst_pitch = 0;
+	BYTE *dst_bits = GetPixelFormatBits(dib, bpp, FALSE, &dst_pitch);
+	if(!convert || !dst_bits) {
+		return FALSE;
+	}
+
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned src_pitch = FreeImage_GetPitch(dib);
+	BYTE *src_bits = FreeImage_GetBits(dib);
+	const unsigned line = CalculateLine(width, bpp);
+	const unsigned band_pitch = CalculatePitch(line);
+	const unsigned band_rows = CLAMP((1U << 20) / band_pitch, 1U, height);
+
+	// save the parts of the header the new pixels may overwrite
+	RGBQUAD palette[256];
+	BYTE table[256];
+	const unsigned colors = FreeImage_GetColorsUsed(dib);
+	if(colors) {
+		memcpy(palette, FreeImage_GetPalette(dib), colors * sizeof(RGBQUAD));
+	}
+	memcpy(table, FreeImage_GetTransparencyTable(dib), 256);
+	const int transparency_count = FreeImage_GetTransparencyCount(dib);
+	const BOOL transparent = FreeImage_IsTransparent(dib);
+	const unsigned red_mask = FreeImage_GetRedMask(dib);
+	const unsigned green_mask = FreeImage_GetGreenMask(dib);
+	const unsigned blue_mask = FreeImage_GetBlueMask(dib);
+	const WORD icc_flags = FreeImage_GetICCProfile(dib)->flags;
+
+	// converted rows waiting to be moved, reserved up front so that no allocation fails once pixels are moved
+	std::vector<BYTE> pending;
+	{
+		size_t max_rows = 0;
+		unsigned read = 0;
+		for(unsigned y = 0; y < height; y++) {
+			const unsigned needed = NeededSourceRows(y, src_bits, src_pitch, dst_bits, dst_pitch, line, height);
+			if(read < needed) {
+				read += MIN(height - read, MAX(needed - read, band_rows));
+			}
+			max_rows = MAX(max_rows, (size_t)(read - y));
+		}
+		try {
+			pending.reserve(max_rows * band_pitch);
+		} catch(std::bad_alloc &) {
+			FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+			return FALSE;
+		}
+	}
+
+	// headers of the source and converted bands, pointed to each band in turn
+	FIBITMAP *src_band = FreeImage_AllocateHeaderForBits(src_bits, src_pitch, src_type, width, band_rows, src_bpp, red_mask, green_mask, blue_mask);
+	FIBITMAP *dst_band = FreeImage_AllocateHeaderForBits(pending.data(), band_pitch, type, width, band_rows, bpp, 0, 0, 0);
+	if(!src_band || !dst_band) {
+		FreeImage_Unload(src_band);
+		FreeImage_Unload(dst_band);
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return FALSE;
+	}
+	if(colors) {
+		memcpy(FreeImage_GetPalette(src_band), palette, colors * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(src_band, table, transparency_count);
+		FreeImage_SetTransparent(src_band, transparent);
+	}
+	FreeImage_GetICCProfile(src_band)->flags = icc_flags;
+
+	RGBQUAD new_palette[256];
+	const unsigned new_colors = CalculateUsedPaletteEntries(bpp);
+
+	unsigned first_pending = 0;
+	unsigned read = 0;
+	for(unsigned y = 0; y < height; y++) {
+		const unsigned needed = NeededSourceRows(y, src_bits, src_pitch, dst_bits, dst_pitch, line, height);
+		if(read < needed) {
+			const unsigned count = MIN(height - read, MAX(needed - read, band_rows));
+
+			// drop the rows already moved, then convert the next band after the pending rows
+			pending.erase(pending.begin(), pending.begin() + (size_t)(y - first_pending) * band_pitch);
+			first_pending = y;
+			const size_t offset = pending.size();
+			pending.resize(offset + (size_t)count * band_pitch);
+
+			SetExternalBits(src_band, src_bits + (size_t)read * src_pitch, count);
+			SetExternalBits(dst_band, &pending[offset], count);
+			if(convert(src_band, dst_band) != dst_band) {
+				// a conversion only fails on an unsupported format, i.e. on the first band, before pixels are moved
+				FreeImage_Unload(src_band);
+				FreeImage_Unload(dst_band);
+				FreeImage_OutputMessageProc(FIF_UNKNOWN, "FreeImage_ConvertInPlace: conversion failed");
+				return FALSE;
+			}
+			if(new_colors) {
+				memcpy(new_palette, FreeImage_GetPalette(dst_band), new_colors * sizeof(RGBQUAD));
+			}
+
+			read += count;
+		}
+
+		memcpy(dst_bits + (size_t)y * dst_pitch, &pending[(size_t)(y - first_pending) * band_pitch], line);
+	}
+
+	FreeImage_Unload(src_band);
+	FreeImage_Unload(dst_band);
+
+	SetPixelFormat(dib, type, bpp, 0, 0, 0);
+	if(new_colors) {
+		memcpy(FreeImage_GetPalette(dib), new_palette, new_colors * sizeof(RGBQUAD));
+	}
+
+	return TRUE;
+}
@@ -23,6 +23,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //  internal conversions X to 16 bits (565)
@@ -64,7 +66,9 @@ void DLL_CALLCONV
 FreeImage_ConvertLine8To16_565(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette) {
 	WORD *new_bits = (WORD *)target;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert8To16_565(target, source, width_in_pixels, palette);
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		RGBQUAD *grab_palette = palette + source[cols];
 
 		new_bits[cols] = RGB565(grab_palette->rgbBlue, grab_palette->rgbGreen, grab_palette->rgbRed);
@@ -76,7 +80,9 @@ FreeImage_ConvertLine16_555_To16_565(BYTE *target, BYTE *source, int width_in_pi
 	WORD *src_bits = (WORD *)source;
 	WORD *new_bits = (WORD *)target;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16_555_To16_565(target, source, width_in_pixels);
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB565((((src_bits[cols] & FI16_555_BLUE_MASK) >> FI16_555_BLUE_SHIFT) * 0xFF) / 0x1F,
 			                    (((src_bits[cols] & FI16_555_GREEN_MASK) >> FI16_555_GREEN_SHIFT) * 0xFF) / 0x1F,
 								(((src_bits[cols] & FI16_555_RED_MASK) >> FI16_555_RED_SHIFT) * 0xFF) / 0x1F);
@@ -87,7 +93,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine24To16_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *new_bits = (WORD *)target;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert24To16_565(target, source, width_in_pixels);
+	source += 3 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB565(source[FI_RGBA_BLUE], source[FI_RGBA_GREEN], source[FI_RGBA_RED]);
 
 		source += 3;
@@ -98,7 +107,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine32To16_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *new_bits = (WORD *)target;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert32To16_565(target, source, width_in_pixels);
+	source += 4 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB565(source[FI_RGBA_BLUE], source[FI_RGBA_GREEN], source[FI_RGBA_RED]);
 
 		source += 4;
@@ -109,8 +121,8 @@ FreeImage_ConvertLine32To16_565(BYTE *target, BYTE *source, int width_in_pixels)
 //   smart convert X to 16 bits (565)
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertTo16Bits565(FIBITMAP *dib) {
+FIBITMAP *
+ConvertTo16Bits565(FIBITMAP *dib, FIBITMAP *target) {
 	if(!FreeImage_HasPixels(dib) || (FreeImage_GetImageType(dib) != FIT_BITMAP)) return NULL;
 
 	const int width = FreeImage_GetWidth(dib);
@@ -120,85 +132,98 @@ FreeImage_ConvertTo16Bits565(FIBITMAP *dib) {
 	if(bpp == 16) {
 		if ((FreeImage_GetRedMask(dib) == FI16_555_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_555_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_555_BLUE_MASK)) {
 			// RGB 555
-			FIBITMAP *new_dib = FreeImage_Allocate(width, height, 16, FI16_565_RED_MASK, FI16_565_GREEN_MASK, FI16_565_BLUE_MASK);
+			FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 16, FI16_565_RED_MASK, FI16_565_GREEN_MASK, FI16_565_BLUE_MASK);
 			if(new_dib == NULL) {
 				return NULL;
 			}
-			for (int rows = 0; rows < height; rows++) {
-				FreeImage_ConvertLine16_555_To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-			}
-
-			// copy metadata from src to dst
-			FreeImage_CloneMetadata(new_dib, dib);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for (unsigned rows = first_row; rows < last_row; rows++) {
+					FreeImage_ConvertLine16_555_To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+				}
+			});
 
 			return new_dib;
 		} else {
 			// RGB 565
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 		}
 	}
 	else {
 		// other bpp cases => convert to RGB 565
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 16, FI16_565_RED_MASK, FI16_565_GREEN_MASK, FI16_565_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 16, FI16_565_RED_MASK, FI16_565_GREEN_MASK, FI16_565_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		switch (bpp) {
 			case 1 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine1To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine1To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 
 				return new_dib;
 			}
 
 			case 4 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine4To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine4To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 
 				return new_dib;
 			}
 
 			case 8 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine8To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine8To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 
 				return new_dib;
 			}
 
 			case 24 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine24To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine24To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 
 				return new_dib;
 			}
 
 			case 32 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine32To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine32To16_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 
 				return new_dib;
 			}
 
 			default :
 				// unreachable code ...
-				FreeImage_Unload(new_dib);
+				if(new_dib != target) {
+					FreeImage_Unload(new_dib);
+				}
 				break;
 		}
 	}
 
 	return NULL;
 }
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertTo16Bits565(FIBITMAP *dib) {
+	return ConvertTo16Bits565(dib, NULL);
+}
@@ -24,6 +24,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //  internal conversions X to 24 bits
@@ -68,7 +70,10 @@ FreeImage_ConvertLine4To24(BYTE *target, BYTE *source, int width_in_pixels, RGBQ
 
 void DLL_CALLCONV
 FreeImage_ConvertLine8To24(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette) {
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert8To24(target, source, width_in_pixels, palette);
+	target += 3 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_BLUE] = palette[source[cols]].rgbBlue;
 		target[FI_RGBA_GREEN] = palette[source[cols]].rgbGreen;
 		target[FI_RGBA_RED] = palette[source[cols]].rgbRed;
@@ -81,7 +86,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine16To24_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To24_555(target, source, width_in_pixels);
+	target += 3 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_555_RED_MASK) >> FI16_555_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_555_GREEN_MASK) >> FI16_555_GREEN_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_555_BLUE_MASK) >> FI16_555_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -94,7 +102,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine16To24_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To24_565(target, source, width_in_pixels);
+	target += 3 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_565_RED_MASK) >> FI16_565_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -105,7 +116,11 @@ FreeImage_ConvertLine16To24_565(BYTE *target, BYTE *source, int width_in_pixels)
 
 void DLL_CALLCONV
 FreeImage_ConvertLine32To24(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert32To24(target, source, width_in_pixels);
+	target += 3 * done;
+	source += 4 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_BLUE] = source[FI_RGBA_BLUE];
 		target[FI_RGBA_GREEN] = source[FI_RGBA_GREEN];
 		target[FI_RGBA_RED] = source[FI_RGBA_RED];
@@ -119,8 +134,8 @@ FreeImage_ConvertLine32To24(BYTE *target, BYTE *source, int width_in_pixels) {
 //   smart convert X to 24 bits
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
+FIBITMAP *
+ConvertTo24Bits(FIBITMAP *dib, FIBITMAP *target) {
 	if(!FreeImage_HasPixels(dib)) return NULL;
 
 	const unsigned bpp = FreeImage_GetBPP(dib);
@@ -135,118 +150,132 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 
 	if(image_type == FIT_BITMAP) {
 		if(bpp == 24) {
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 		}
 
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		switch(bpp) {
 			case 1 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine1To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));					
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine1To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));					
+					}
+				});
 				return new_dib;
 			}
 
 			case 4 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine4To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine4To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 				return new_dib;
 			}
 				
 			case 8 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine8To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine8To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 				return new_dib;
 			}
 
 			case 16 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
-						FreeImage_ConvertLine16To24_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					} else {
-						// includes case where all the masks are 0
-						FreeImage_ConvertLine16To24_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+							FreeImage_ConvertLine16To24_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						} else {
+							// includes case where all the masks are 0
+							FreeImage_ConvertLine16To24_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						}
 					}
-				}
+				});
 				return new_dib;
 			}
 
 			case 32 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine32To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine32To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 				return new_dib;
 			}
 		}
 	
 	} else if(image_type == FIT_RGB16) {
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		const unsigned src_pitch = FreeImage_GetPitch(dib);
 		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
 		const BYTE *src_bits = FreeImage_GetBits(dib);
 		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
-			const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
-			RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_bits;
-			for(int cols = 0; cols < width; cols++) {
-				dst_pixel[cols].rgbtRed   = (BYTE)(src_pixel[cols].red   >> 8);
-				dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
-				dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			const BYTE *src_line = src_bits + first_row * src_pitch;
+			BYTE *dst_line = dst_bits + first_row * dst_pitch;
+			for (unsigned rows = first_row; rows < last_row; rows++) {
+				const FIRGB16 *src_pixel = (FIRGB16*)src_line;
+				RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_line;
+				for(int cols = 0; cols < width; cols++) {
+					dst_pixel[cols].rgbtRed   = (BYTE)(src_pixel[cols].red   >> 8);
+					dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
+					dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
+				}
+				src_line += src_pitch;
+				dst_line += dst_pitch;
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}
+		});
 
 		return new_dib;
 
 	} else if(image_type == FIT_RGBA16) {
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		const unsigned src_pitch = FreeImage_GetPitch(dib);
 		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
 		const BYTE *src_bits = FreeImage_GetBits(dib);
 		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
-			const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
-			RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_bits;
-			for(int cols = 0; cols < width; cols++) {
-				dst_pixel[cols].rgbtRed   = (BYTE)(src_pixel[cols].red   >> 8);
-				dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
-				dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			const BYTE *src_line = src_bits + first_row * src_pitch;
+			BYTE *dst_line = dst_bits + first_row * dst_pitch;
+			for (unsigned rows = first_row; rows < last_row; rows++) {
+				const FIRGBA16 *src_pixel = (FIRGBA16*)src_line;
+				RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_line;
+				for(int cols = 0; cols < width; cols++) {
+					dst_pixel[cols].rgbtRed   = (BYTE)(src_pixel[cols].red   >> 8);
+					dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
+					dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
+				}
+				src_line += src_pitch;
+				dst_line += dst_pitch;
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}		
+		});
 
 		return new_dib;
 	}
 
 	return NULL;
 }
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
+	return ConvertTo24Bits(dib, NULL);
+}
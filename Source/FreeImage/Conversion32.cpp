@@ -24,6 +24,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //  internal conversions X to 32 bits
@@ -69,7 +71,10 @@ FreeImage_ConvertLine4To32(BYTE *target, BYTE *source, int width_in_pixels, RGBQ
 
 void DLL_CALLCONV
 FreeImage_ConvertLine8To32(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette) {
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert8To32(target, source, width_in_pixels, palette);
+	target += 4 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_BLUE]	= palette[source[cols]].rgbBlue;
 		target[FI_RGBA_GREEN]	= palette[source[cols]].rgbGreen;
 		target[FI_RGBA_RED]		= palette[source[cols]].rgbRed;
@@ -82,7 +87,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine16To32_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To32_555(target, source, width_in_pixels);
+	target += 4 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_555_RED_MASK) >> FI16_555_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_555_GREEN_MASK) >> FI16_555_GREEN_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_555_BLUE_MASK) >> FI16_555_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -95,7 +103,10 @@ void DLL_CALLCONV
 FreeImage_ConvertLine16To32_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To32_565(target, source, width_in_pixels);
+	target += 4 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_565_RED_MASK) >> FI16_565_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -120,7 +131,11 @@ The bug occurs in release mode only, when the image height is equal to 537
 */
 void DLL_CALLCONV
 FreeImage_ConvertLine24To32(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert24To32(target, source, width_in_pixels);
+	target += 4 * done;
+	source += 3 * done;
+
+	for (int cols = done; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = source[FI_RGBA_RED];
 		target[FI_RGBA_GREEN] = source[FI_RGBA_GREEN];
 		target[FI_RGBA_BLUE]  = source[FI_RGBA_BLUE];
@@ -184,8 +199,8 @@ FreeImage_ConvertLine8To32MapTransparency(BYTE *target, BYTE *source, int width_
 
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
+FIBITMAP *
+ConvertTo32Bits(FIBITMAP *dib, FIBITMAP *target) {
 	if(!FreeImage_HasPixels(dib)) return NULL;
 
 	const int bpp = FreeImage_GetBPP(dib);
@@ -201,30 +216,31 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 	if(image_type == FIT_BITMAP) {
 
 		if(bpp == 32) {
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 		}
 
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		BOOL bIsTransparent = FreeImage_IsTransparent(dib);
 
 		switch(bpp) {
 			case 1:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine1To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine1To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+						}
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine1To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine1To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+						}
+					});
 				}
 
 				return new_dib;
@@ -233,13 +249,17 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 			case 4:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine4To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine4To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+						}
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine4To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine4To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+						}
+					});
 				}
 
 				return new_dib;
@@ -248,13 +268,17 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 			case 8:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine8To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine8To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+						}
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine8To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine8To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+						}
+					});
 				}
 
 				return new_dib;
@@ -262,84 +286,95 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 
 			case 16:
 			{
-				for (int rows = 0; rows < height; rows++) {
-					if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
-						FreeImage_ConvertLine16To32_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					} else {
-						// includes case where all the masks are 0
-						FreeImage_ConvertLine16To32_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+							FreeImage_ConvertLine16To32_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						} else {
+							// includes case where all the masks are 0
+							FreeImage_ConvertLine16To32_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						}
 					}
-				}
+				});
 
 				return new_dib;
 			}
 
 			case 24:
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine24To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine24To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 
 				return new_dib;
 			}
 		}
 
 	} else if(image_type == FIT_RGB16) {
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		const unsigned src_pitch = FreeImage_GetPitch(dib);
 		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
 		const BYTE *src_bits = FreeImage_GetBits(dib);
 		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
-			const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
-			RGBQUAD *dst_pixel = (RGBQUAD*)dst_bits;
-			for(int cols = 0; cols < width; cols++) {
-				dst_pixel[cols].rgbRed		= (BYTE)(src_pixel[cols].red   >> 8);
-				dst_pixel[cols].rgbGreen	= (BYTE)(src_pixel[cols].green >> 8);
-				dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
-				dst_pixel[cols].rgbReserved = (BYTE)0xFF;
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			const BYTE *src_line = src_bits + first_row * src_pitch;
+			BYTE *dst_line = dst_bits + first_row * dst_pitch;
+			for (unsigned rows = first_row; rows < last_row; rows++) {
+				const FIRGB16 *src_pixel = (FIRGB16*)src_line;
+				RGBQUAD *dst_pixel = (RGBQUAD*)dst_line;
+				for(int cols = 0; cols < width; cols++) {
+					dst_pixel[cols].rgbRed		= (BYTE)(src_pixel[cols].red   >> 8);
+					dst_pixel[cols].rgbGreen	= (BYTE)(src_pixel[cols].green >> 8);
+					dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
+					dst_pixel[cols].rgbReserved = (BYTE)0xFF;
+				}
+				src_line += src_pitch;
+				dst_line += dst_pitch;
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}
+		});
 
 		return new_dib;
 
 	} else if(image_type == FIT_RGBA16) {
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		const unsigned src_pitch = FreeImage_GetPitch(dib);
 		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
 		const BYTE *src_bits = FreeImage_GetBits(dib);
 		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
-			const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
-			RGBQUAD *dst_pixel = (RGBQUAD*)dst_bits;
-			for(int cols = 0; cols < width; cols++) {
-				dst_pixel[cols].rgbRed		= (BYTE)(src_pixel[cols].red   >> 8);
-				dst_pixel[cols].rgbGreen	= (BYTE)(src_pixel[cols].green >> 8);
-				dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
-				dst_pixel[cols].rgbReserved = (BYTE)(src_pixel[cols].alpha >> 8);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			const BYTE *src_line = src_bits + first_row * src_pitch;
+			BYTE *dst_line = dst_bits + first_row * dst_pitch;
+			for (unsigned rows = first_row; rows < last_row; rows++) {
+				const FIRGBA16 *src_pixel = (FIRGBA16*)src_line;
+				RGBQUAD *dst_pixel = (RGBQUAD*)dst_line;
+				for(int cols = 0; cols < width; cols++) {
+					dst_pixel[cols].rgbRed		= (BYTE)(src_pixel[cols].red   >> 8);
+					dst_pixel[cols].rgbGreen	= (BYTE)(src_pixel[cols].green >> 8);
+					dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
+					dst_pixel[cols].rgbReserved = (BYTE)(src_pixel[cols].alpha >> 8);
+				}
+				src_line += src_pitch;
+				dst_line += dst_pitch;
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}		
+		});
 
 		return new_dib;
 	}
 	
 	return NULL;
 }
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
+	return ConvertTo32Bits(dib, NULL);
+}
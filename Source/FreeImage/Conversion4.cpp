@@ -21,6 +21,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //  internal conversions X to 4 bits
@@ -138,8 +139,8 @@ FreeImage_ConvertLine32To4(BYTE *target, BYTE *source, int width_in_pixels) {
 //   smart convert X to 4 bits
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
+FIBITMAP *
+ConvertTo4Bits(FIBITMAP *dib, FIBITMAP *target) {
 	if(!FreeImage_HasPixels(dib)) return NULL;
 
 	const int bpp = FreeImage_GetBPP(dib);
@@ -147,15 +148,12 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 	if(bpp != 4) {
 		const int width  = FreeImage_GetWidth(dib);
 		const int height = FreeImage_GetHeight(dib);
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 4);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 4);
 
 		if(new_dib == NULL) {
 			return NULL;
 		}
 
-		// copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		// Build a greyscale palette (*always* needed for image processing)
 
 		RGBQUAD *new_pal = FreeImage_GetPalette(new_dib);
@@ -189,9 +187,11 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 
 				// Expand and copy the bitmap data
 
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine1To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine1To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 				return new_dib;
 			}
 
@@ -199,9 +199,11 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 			{
 				// Expand and copy the bitmap data
 
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine8To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine8To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
+					}
+				});
 				return new_dib;
 			}
 
@@ -209,13 +211,15 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 			{
 				// Expand and copy the bitmap data
 
-				for (int rows = 0; rows < height; rows++) {
-					if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
-						FreeImage_ConvertLine16To4_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					} else {
-						FreeImage_ConvertLine16To4_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+							FreeImage_ConvertLine16To4_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						} else {
+							FreeImage_ConvertLine16To4_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						}
 					}
-				}
+				});
 				
 				return new_dib;
 			}
@@ -224,9 +228,11 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 			{
 				// Expand and copy the bitmap data
 
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine24To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine24To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
+					}
+				});
 				return new_dib;
 			}
 
@@ -234,13 +240,20 @@ FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
 			{
 				// Expand and copy the bitmap data
 
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine32To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for (unsigned rows = first_row; rows < last_row; rows++) {
+						FreeImage_ConvertLine32To4(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+					}
+				});
 				return new_dib;
 			}
 		}
 	}
 
-	return FreeImage_Clone(dib);
+	return CopyConversionSource(target, dib);
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertTo4Bits(FIBITMAP *dib) {
+	return ConvertTo4Bits(dib, NULL);
 }
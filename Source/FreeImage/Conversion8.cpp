@@ -25,6 +25,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //  internal conversions X to 8 bits
@@ -57,7 +59,9 @@ FreeImage_ConvertLine4To8(BYTE *target, BYTE *source, int width_in_pixels) {
 void DLL_CALLCONV
 FreeImage_ConvertLine16To8_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	const WORD *const bits = (WORD *)source;
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To8_555(target, source, width_in_pixels);
+
+	for (unsigned cols = (unsigned)done; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY((((bits[cols] & FI16_555_RED_MASK) >> FI16_555_RED_SHIFT) * 0xFF) / 0x1F,
 			                (((bits[cols] & FI16_555_GREEN_MASK) >> FI16_555_GREEN_SHIFT) * 0xFF) / 0x1F,
 							(((bits[cols] & FI16_555_BLUE_MASK) >> FI16_555_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -67,7 +71,9 @@ FreeImage_ConvertLine16To8_555(BYTE *target, BYTE *source, int width_in_pixels)
 void DLL_CALLCONV
 FreeImage_ConvertLine16To8_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	const WORD *const bits = (WORD *)source;
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert16To8_565(target, source, width_in_pixels);
+
+	for (unsigned cols = (unsigned)done; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY((((bits[cols] & FI16_565_RED_MASK) >> FI16_565_RED_SHIFT) * 0xFF) / 0x1F,
 			        (((bits[cols] & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F,
 					(((bits[cols] & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -76,7 +82,10 @@ FreeImage_ConvertLine16To8_565(BYTE *target, BYTE *source, int width_in_pixels)
 
 void DLL_CALLCONV
 FreeImage_ConvertLine24To8(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert24To8(target, source, width_in_pixels);
+	source += 3 * done;
+
+	for (unsigned cols = (unsigned)done; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY(source[FI_RGBA_RED], source[FI_RGBA_GREEN], source[FI_RGBA_BLUE]);
 		source += 3;
 	}
@@ -84,7 +93,10 @@ FreeImage_ConvertLine24To8(BYTE *target, BYTE *source, int width_in_pixels) {
 
 void DLL_CALLCONV
 FreeImage_ConvertLine32To8(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int done = GetLineKernels().convert32To8(target, source, width_in_pixels);
+	source += 4 * done;
+
+	for (unsigned cols = (unsigned)done; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY(source[FI_RGBA_RED], source[FI_RGBA_GREEN], source[FI_RGBA_BLUE]);
 		source += 4;
 	}
@@ -94,8 +106,8 @@ FreeImage_ConvertLine32To8(BYTE *target, BYTE *source, int width_in_pixels) {
 //   smart convert X to 8 bits
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
+FIBITMAP *
+ConvertTo8Bits(FIBITMAP *dib, FIBITMAP *target) {
 	if (!FreeImage_HasPixels(dib)) {
 		return NULL;
 	}
@@ -113,14 +125,11 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 		const unsigned height = FreeImage_GetHeight(dib);
 
 		// Allocate a destination image
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 8);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 8);
 		if (new_dib == NULL) {
 			return NULL;
 		}
 
-		// Copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		// Palette of destination image has already been initialized
 		RGBQUAD *new_pal = FreeImage_GetPalette(new_dib);
 
@@ -143,9 +152,11 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 					}
 
 					// Expand and copy the bitmap data
-					for (unsigned rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine1To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine1To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						}
+					});
 					return new_dib;
 				}
 
@@ -157,9 +168,11 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 					}
 
 					// Expand and copy the bitmap data
-					for (unsigned rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine4To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine4To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
+						}
+					});
 					return new_dib;
 				}
 
@@ -167,13 +180,17 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 				{
 					// Expand and copy the bitmap data
 					if (IS_FORMAT_RGB565(dib)) {
-						for (unsigned rows = 0; rows < height; rows++) {
-							FreeImage_ConvertLine16To8_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-						}
+						ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+							for (unsigned rows = first_row; rows < last_row; rows++) {
+								FreeImage_ConvertLine16To8_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+							}
+						});
 					} else {
-						for (unsigned rows = 0; rows < height; rows++) {
-							FreeImage_ConvertLine16To8_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-						}
+						ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+							for (unsigned rows = first_row; rows < last_row; rows++) {
+								FreeImage_ConvertLine16To8_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+							}
+						});
 					}
 					return new_dib;
 				}
@@ -181,18 +198,22 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 				case 24 :
 				{
 					// Expand and copy the bitmap data
-					for (unsigned rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine24To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine24To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);					
+						}
+					});
 					return new_dib;
 				}
 
 				case 32 :
 				{
 					// Expand and copy the bitmap data
-					for (unsigned rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine32To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					}
+					ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+						for (unsigned rows = first_row; rows < last_row; rows++) {
+							FreeImage_ConvertLine32To8(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
+						}
+					});
 					return new_dib;
 				}
 			}
@@ -204,25 +225,34 @@ FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
 			const BYTE *src_bits = FreeImage_GetBits(dib);
 			BYTE *dst_bits = FreeImage_GetBits(new_dib);
 
-			for (unsigned rows = 0; rows < height; rows++) {
-				const WORD *const src_pixel = (WORD*)src_bits;
-				BYTE *dst_pixel = (BYTE*)dst_bits;
-				for(unsigned cols = 0; cols < width; cols++) {
-					dst_pixel[cols] = (BYTE)(src_pixel[cols] >> 8);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for (unsigned rows = first_row; rows < last_row; rows++) {
+					const WORD *const src_pixel = (WORD*)src_line;
+					BYTE *dst_pixel = (BYTE*)dst_line;
+					for(unsigned cols = 0; cols < width; cols++) {
+						dst_pixel[cols] = (BYTE)(src_pixel[cols] >> 8);
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 			return new_dib;
 		} 
 
 	} // bpp != 8
 
-	return FreeImage_Clone(dib);
+	return CopyConversionSource(target, dib);
 }
 
 FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToGreyscale(FIBITMAP *dib) {
+FreeImage_ConvertTo8Bits(FIBITMAP *dib) {
+	return ConvertTo8Bits(dib, NULL);
+}
+
+FIBITMAP *
+ConvertToGreyscale(FIBITMAP *dib, FIBITMAP *target) {
 	if (!FreeImage_HasPixels(dib)) {
 		return NULL;
 	}
@@ -235,14 +265,11 @@ FreeImage_ConvertToGreyscale(FIBITMAP *dib) {
 		const unsigned width  = FreeImage_GetWidth(dib);
 		const unsigned height = FreeImage_GetHeight(dib);
 
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 8);
+		FIBITMAP *new_dib = AllocateConversionTarget(target, dib, FIT_BITMAP, 8);
 		if (new_dib == NULL) {
 			return NULL;
 		}
 
-		// Copy metadata from src to dst
-		FreeImage_CloneMetadata(new_dib, dib);
-
 		// Create a greyscale palette
 		BYTE grey_pal[256];
 		const RGBQUAD *pal = FreeImage_GetPalette(dib);
@@ -261,39 +288,51 @@ FreeImage_ConvertToGreyscale(FIBITMAP *dib) {
 		switch(bpp) {
 			case 1:
 			{
-				for (unsigned y = 0; y < height; y++) {
-					for (unsigned x = 0; x < width; x++) {
-						const unsigned pixel = (src_bits[x >> 3] & (0x80 >> (x & 0x07))) != 0;
-						dst_bits[x] = grey_pal[pixel];
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					const BYTE *src_line = src_bits + first_row * src_pitch;
+					BYTE *dst_line = dst_bits + first_row * dst_pitch;
+					for (unsigned y = first_row; y < last_row; y++) {
+						for (unsigned x = 0; x < width; x++) {
+							const unsigned pixel = (src_line[x >> 3] & (0x80 >> (x & 0x07))) != 0;
+							dst_line[x] = grey_pal[pixel];
+						}
+						src_line += src_pitch;
+						dst_line += dst_pitch;
 					}
-					src_bits += src_pitch;
-					dst_bits += dst_pitch;
-				}
+				});
 			}
 			break;
 
 			case 4:
 			{
-				for (unsigned y = 0; y < height; y++) {
-					for (unsigned x = 0; x < width; x++) {
-						const unsigned pixel = x & 0x01 ? src_bits[x >> 1] & 0x0F : src_bits[x >> 1] >> 4;
-						dst_bits[x] = grey_pal[pixel];
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					const BYTE *src_line = src_bits + first_row * src_pitch;
+					BYTE *dst_line = dst_bits + first_row * dst_pitch;
+					for (unsigned y = first_row; y < last_row; y++) {
+						for (unsigned x = 0; x < width; x++) {
+							const unsigned pixel = x & 0x01 ? src_line[x >> 1] & 0x0F : src_line[x >> 1] >> 4;
+							dst_line[x] = grey_pal[pixel];
+						}
+						src_line += src_pitch;
+						dst_line += dst_pitch;
 					}
-					src_bits += src_pitch;
-					dst_bits += dst_pitch;
-				}
+				});
 			}
 			break;
 
 			case 8:
 			{
-				for (unsigned y = 0; y < height; y++) {
-					for (unsigned x = 0; x < width; x++) {
-						dst_bits[x] = grey_pal[src_bits[x]];
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					const BYTE *src_line = src_bits + first_row * src_pitch;
+					BYTE *dst_line = dst_bits + first_row * dst_pitch;
+					for (unsigned y = first_row; y < last_row; y++) {
+						for (unsigned x = 0; x < width; x++) {
+							dst_line[x] = grey_pal[src_line[x]];
+						}
+						src_line += src_pitch;
+						dst_line += dst_pitch;
 					}
-					src_bits += src_pitch;
-					dst_bits += dst_pitch;
-				}
+				});
 			}
 			break;
 		}
@@ -301,5 +340,10 @@ FreeImage_ConvertToGreyscale(FIBITMAP *dib) {
 	} 
 	
 	// Convert the bitmap to 8-bit greyscale
-	return FreeImage_ConvertTo8Bits(dib);
+	return ConvertTo8Bits(dib, target);
+}
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToGreyscale(FIBITMAP *dib) {
+	return ConvertToGreyscale(dib, NULL);
 }
@@ -0,0 +1,559 @@
+// ==========================================================
+// Fused pixel export routines
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "../SIMD.h"
+#include "../TransferFunctions.h"
+#include "../OpenEXR/Half/half.h"
+
+// ----------------------------------------------------------
+//   Layouts
+// ----------------------------------------------------------
+
+//! number of channels of each FREE_IMAGE_PIXEL_LAYOUT
+static const unsigned s_layout_channels[] = { 4, 4, 4, 1, 2, 3, 3 };
+
+//! source channel (0 = red, 1 = green, 2 = blue, 3 = alpha) of each target channel, for each FREE_IMAGE_PIXEL_LAYOUT
+static const unsigned s_layout_order[][4] = {
+	{ 0, 1, 2, 3 },	// FIPL_RGBA
+	{ 2, 1, 0, 3 },	// FIPL_BGRA
+	{ 3, 0, 1, 2 },	// FIPL_ARGB
+	{ 0, 0, 0, 0 },	// FIPL_R
+	{ 0, 1, 0, 0 },	// FIPL_RG
+	{ 0, 1, 2, 0 },	// FIPL_RGB
+	{ 2, 1, 0, 0 }	// FIPL_BGR
+};
+
+//! size in bytes of each FREE_IMAGE_COMPONENT_TYPE
+static const unsigned s_component_size[] = { 1, 2, 2, 4 };
+
+// ----------------------------------------------------------
+//   Row decoding
+// ----------------------------------------------------------
+
+/**
+Convert a FIT_BITMAP scanline to 32-bit pixels, as FreeImage_ConvertTo32Bits
+*/
+static void
+ConvertRowTo32(FIBITMAP *dib, BYTE *scanline, BYTE *target, int width, BOOL bIsTransparent) {
+	switch(FreeImage_GetBPP(dib)) {
+		case 1:
+			if(bIsTransparent) {
+				FreeImage_ConvertLine1To32MapTransparency(target, scanline, width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+			} else {
+				FreeImage_ConvertLine1To32(target, scanline, width, FreeImage_GetPalette(dib));
+			}
+			break;
+		case 4:
+			if(bIsTransparent) {
+				FreeImage_ConvertLine4To32MapTransparency(target, scanline, width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+			} else {
+				FreeImage_ConvertLine4To32(target, scanline, width, FreeImage_GetPalette(dib));
+			}
+			break;
+		case 8:
+			if(bIsTransparent) {
+				FreeImage_ConvertLine8To32MapTransparency(target, scanline, width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+			} else {
+				FreeImage_ConvertLine8To32(target, scanline, width, FreeImage_GetPalette(dib));
+			}
+			break;
+		case 16:
+			if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+				FreeImage_ConvertLine16To32_565(target, scanline, width);
+			} else {
+				FreeImage_ConvertLine16To32_555(target, scanline, width);
+			}
+			break;
+		case 24:
+			FreeImage_ConvertLine24To32(target, scanline, width);
+			break;
+		case 32:
+			memcpy(target, scanline, width * 4);
+			break;
+	}
+}
+
+/**
+Convert count components to floats, decoded to linear light when transfer is not NULL
+*/
+template <class T> static void
+ComponentsToFloat(float *target, const T *source, unsigned count, float scale, const TransferFunction *transfer) {
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = (float)source[i] * scale;
+	}
+	if(transfer) {
+		transfer->DecodeLine(target, target, count);
+	}
+}
+
+template <> void
+ComponentsToFloat<BYTE>(float *target, const BYTE *source, unsigned count, float scale, const TransferFunction *transfer) {
+	if(transfer) {
+		transfer->DecodeLine(target, source, count);
+		return;
+	}
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = (float)source[i] * scale;
+	}
+}
+
+template <> void
+ComponentsToFloat<WORD>(float *target, const WORD *source, unsigned count, float scale, const TransferFunction *transfer) {
+	if(transfer) {
+		transfer->DecodeLine(target, source, count);
+		return;
+	}
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = (float)source[i] * scale;
+	}
+}
+
+/**
+Convert a greyscale scanline to RGBA floats
+*/
+template <class T> static void
+GreyRowToFloat(const BYTE *scanline, float *rgba, unsigned width, float scale, const TransferFunction *transfer) {
+	// convert the values at the start of the row, then spread them from the end
+	ComponentsToFloat<T>(rgba, (const T*)scanline, width, scale, transfer);
+	for(unsigned x = width; x-- > 0; ) {
+		const float value = rgba[x];
+		float *p = rgba + 4 * x;
+		p[0] = value;
+		p[1] = value;
+		p[2] = value;
+		p[3] = 1.0F;
+	}
+}
+
+/**
+Convert a RGB or RGBA scanline to RGBA floats, the alpha channel is not decoded
+*/
+template <class T> static void
+ColorRowToFloat(const BYTE *scanline, float *rgba, unsigned width, unsigned channels, float scale, const TransferFunction *transfer) {
+	const T *src = (const T*)scanline;
+	// convert the components at the start of the row, then spread them from the end
+	ComponentsToFloat<T>(rgba, src, width * channels, scale, transfer);
+	for(unsigned x = width; x-- > 0; ) {
+		const float *q = rgba + x * channels;
+		const float red = q[0];
+		const float green = q[1];
+		const float blue = q[2];
+		float *p = rgba + 4 * x;
+		p[0] = red;
+		p[1] = green;
+		p[2] = blue;
+		p[3] = (channels == 4) ? (float)src[4 * x + 3] * scale : 1.0F;
+	}
+}
+
+// ----------------------------------------------------------
+//   Row encoding
+// ----------------------------------------------------------
+
+static inline BYTE
+FloatToByte(float value) {
+	return (BYTE)(CLAMP(value, 0.0F, 1.0F) * 255.0F + 0.5F);
+}
+
+static inline WORD
+FloatToWord(float value) {
+	return (WORD)(CLAMP(value, 0.0F, 1.0F) * 65535.0F + 0.5F);
+}
+
+/**
+Write a row of RGBA floats in a target layout
+*/
+template <class T, T (*Convert)(float)> static void
+EncodeRow(const float *rgba, BYTE *target, unsigned width, unsigned channels, const unsigned *order) {
+	T *dst = (T*)target;
+	if(channels == 4) {
+		for(unsigned x = 0; x < width; x++, rgba += 4, dst += 4) {
+			dst[0] = Convert(rgba[order[0]]);
+			dst[1] = Convert(rgba[order[1]]);
+			dst[2] = Convert(rgba[order[2]]);
+			dst[3] = Convert(rgba[order[3]]);
+		}
+	} else {
+		for(unsigned x = 0; x < width; x++, rgba += 4) {
+			for(unsigned c = 0; c < channels; c++) {
+				*dst++ = Convert(rgba[order[c]]);
+			}
+		}
+	}
+}
+
+/**
+Write a row of RGBA floats to planes : plane c receives the target channel c
+*/
+template <class T, T (*Convert)(float)> static void
+EncodePlanes(const float *rgba, BYTE *const *planes, unsigned first, unsigned width, unsigned channels, const unsigned *order) {
+	for(unsigned c = 0; c < channels; c++) {
+		T *dst = (T*)planes[c];
+		const float *src = rgba + order[c];
+		for(unsigned x = first; x < width; x++) {
+			dst[x] = Convert(src[4 * x]);
+		}
+	}
+}
+
+static inline WORD
+FloatToHalf(float value) {
+	return half(value).bits();
+}
+
+static inline float
+FloatToFloat(float value) {
+	return value;
+}
+
+// ----------------------------------------------------------
+//   Export
+// ----------------------------------------------------------
+
+/**
+Export a FIT_BITMAP image as 8-bit components, working on bytes
+*/
+static BOOL
+ExportBitmapBytes(FIBITMAP *dib, BYTE *bits, unsigned pitch, unsigned channels, const unsigned *order, BOOL bTopDown, BOOL bPremultiply, BOOL bPlanar) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	const BOOL bIsTransparent = FreeImage_IsTransparent(dib);
+
+	// premultiplying opaque pixels is a no-op
+	if((bpp != 32) && !bIsTransparent) {
+		bPremultiply = FALSE;
+	}
+
+	// the planar output has a scratch plane for the channels not exported
+	BYTE *buffer = (BYTE*)malloc(width * (bPlanar ? 5 : 4));
+	if(!buffer) {
+		return FALSE;
+	}
+	BYTE *scratch = buffer + width * 4;
+	const size_t plane_size = (size_t)height * pitch;
+
+	// target byte order, from the FreeImage 32-bit pixel layout
+	const unsigned fi_index[4] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE, FI_RGBA_ALPHA };
+	BYTE byte_order[4];
+	for(unsigned c = 0; c < 4; c++) {
+		byte_order[c] = (BYTE)fi_index[order[c]];
+	}
+
+	const FILineKernels& kernels = GetLineKernels();
+
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *scanline = FreeImage_GetScanLine(dib, bTopDown ? height - 1 - y : y);
+		BYTE *dst = bits + (size_t)y * pitch;
+
+		// 32-bit source pixels
+		BYTE *pixels = buffer;
+		if(bpp == 32) {
+			pixels = bPremultiply ? buffer : scanline;
+		} else {
+			ConvertRowTo32(dib, scanline, buffer, width, bIsTransparent);
+		}
+
+		if(bPremultiply) {
+			const int done = kernels.premultiply32(buffer, (bpp == 32) ? scanline : buffer, width);
+			const BYTE *src = ((bpp == 32) ? scanline : buffer) + 4 * done;
+			BYTE *p = buffer + 4 * done;
+			for(unsigned x = done; x < width; x++, src += 4, p += 4) {
+				const BYTE alpha = src[FI_RGBA_ALPHA];
+				p[FI_RGBA_BLUE] = (BYTE)( (alpha * (WORD)src[FI_RGBA_BLUE] + 127) / 255 );
+				p[FI_RGBA_GREEN] = (BYTE)( (alpha * (WORD)src[FI_RGBA_GREEN] + 127) / 255 );
+				p[FI_RGBA_RED] = (BYTE)( (alpha * (WORD)src[FI_RGBA_RED] + 127) / 255 );
+				p[FI_RGBA_ALPHA] = alpha;
+			}
+		}
+
+		if(bPlanar) {
+			// plane c receives the source byte byte_order[c]
+			BYTE *planes[4] = { scratch, scratch, scratch, scratch };
+			for(unsigned c = 0; c < channels; c++) {
+				planes[byte_order[c]] = bits + c * plane_size + (size_t)y * pitch;
+			}
+			const unsigned done = (unsigned)kernels.split32(planes, pixels, (int)width);
+			for(unsigned c = 0; c < channels; c++) {
+				BYTE *p = bits + c * plane_size + (size_t)y * pitch;
+				const BYTE *src = pixels + byte_order[c];
+				for(unsigned x = done; x < width; x++) {
+					p[x] = src[4 * x];
+				}
+			}
+		} else if(channels == 4) {
+			const int done = kernels.shuffle32(dst, pixels, width, byte_order);
+			const BYTE *src = pixels + 4 * done;
+			BYTE *p = dst + 4 * done;
+			for(unsigned x = done; x < width; x++, src += 4, p += 4) {
+				p[0] = src[byte_order[0]];
+				p[1] = src[byte_order[1]];
+				p[2] = src[byte_order[2]];
+				p[3] = src[byte_order[3]];
+			}
+		} else {
+			const BYTE *src = pixels;
+			for(unsigned x = 0; x < width; x++, src += 4) {
+				for(unsigned c = 0; c < channels; c++) {
+					*dst++ = src[byte_order[c]];
+				}
+			}
+		}
+	}
+
+	free(buffer);
+
+	return TRUE;
+}
+
+/**
+Export any image through a row of RGBA floats
+*/
+static BOOL
+ExportFloat(FIBITMAP *dib, BYTE *bits, unsigned pitch, unsigned channels, const unsigned *order, FREE_IMAGE_COMPONENT_TYPE component, BOOL bTopDown, BOOL bPremultiply, BOOL bLinear, BOOL bPlanar) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const BOOL bIsTransparent = FreeImage_IsTransparent(dib);
+
+	// the planar float output has a scratch plane for the channels not exported
+	float *rgba = (float*)malloc(width * (bPlanar ? 5 : 4) * sizeof(float));
+	BYTE *buffer = (image_type == FIT_BITMAP) ? (BYTE*)malloc(width * 4) : NULL;
+	if(!rgba || ((image_type == FIT_BITMAP) && !buffer)) {
+		free(rgba);
+		free(buffer);
+		return FALSE;
+	}
+
+	const FILineKernels& kernels = GetLineKernels();
+	const size_t plane_size = (size_t)height * pitch;
+
+	const TransferFunction *transfer = NULL;
+	if(bLinear) {
+		try {
+			transfer = &TransferFunction::sRGB();
+		} catch(std::bad_alloc &) {
+			free(rgba);
+			free(buffer);
+			return FALSE;
+		}
+	}
+
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *scanline = FreeImage_GetScanLine(dib, bTopDown ? height - 1 - y : y);
+		BYTE *dst = bits + (size_t)y * pitch;
+
+		// decode, standard images are mapped to [0..1]
+		switch(image_type) {
+			case FIT_BITMAP:
+			{
+				BYTE *pixels = buffer;
+				if(FreeImage_GetBPP(dib) == 32) {
+					pixels = scanline;
+				} else {
+					ConvertRowTo32(dib, scanline, buffer, width, bIsTransparent);
+				}
+				ComponentsToFloat<BYTE>(rgba, pixels, width * 4, 1.0F / 255, transfer);
+				float *p = rgba;
+				for(unsigned x = 0; x < width; x++, pixels += 4, p += 4) {
+					const float red = p[FI_RGBA_RED];
+					const float green = p[FI_RGBA_GREEN];
+					const float blue = p[FI_RGBA_BLUE];
+					p[0] = red;
+					p[1] = green;
+					p[2] = blue;
+					p[3] = (float)pixels[FI_RGBA_ALPHA] * (1.0F / 255);
+				}
+				break;
+			}
+			case FIT_UINT16:
+				GreyRowToFloat<WORD>(scanline, rgba, width, 1.0F / 65535, transfer);
+				break;
+			case FIT_INT16:
+				GreyRowToFloat<short>(scanline, rgba, width, 1.0F / 32767, transfer);
+				break;
+			case FIT_UINT32:
+				GreyRowToFloat<DWORD>(scanline, rgba, width, (float)(1.0 / 4294967295.0), transfer);
+				break;
+			case FIT_INT32:
+				GreyRowToFloat<LONG>(scanline, rgba, width, (float)(1.0 / 2147483647.0), transfer);
+				break;
+			case FIT_FLOAT:
+				GreyRowToFloat<float>(scanline, rgba, width, 1.0F, transfer);
+				break;
+			case FIT_DOUBLE:
+				GreyRowToFloat<double>(scanline, rgba, width, 1.0F, transfer);
+				break;
+			case FIT_RGB16:
+				ColorRowToFloat<WORD>(scanline, rgba, width, 3, 1.0F / 65535, transfer);
+				break;
+			case FIT_RGBA16:
+				ColorRowToFloat<WORD>(scanline, rgba, width, 4, 1.0F / 65535, transfer);
+				break;
+			case FIT_RGBF:
+				ColorRowToFloat<float>(scanline, rgba, width, 3, 1.0F, transfer);
+				break;
+			case FIT_RGBAF:
+				ColorRowToFloat<float>(scanline, rgba, width, 4, 1.0F, transfer);
+				break;
+			default:
+				break;
+		}
+
+		if(bPremultiply) {
+			float *p = rgba;
+			for(unsigned x = 0; x < width; x++, p += 4) {
+				p[0] *= p[3];
+				p[1] *= p[3];
+				p[2] *= p[3];
+			}
+		}
+
+		if(bPlanar) {
+			BYTE *planes[4];
+			for(unsigned c = 0; c < channels; c++) {
+				planes[c] = bits + c * plane_size + (size_t)y * pitch;
+			}
+			unsigned done = 0;
+			if(component == FICT_FLOAT) {
+				// plane c receives the RGBA float order[c]
+				BYTE *split_planes[4];
+				for(unsigned k = 0; k < 4; k++) {
+					split_planes[k] = (BYTE*)(rgba + width * 4);
+				}
+				for(unsigned c = 0; c < channels; c++) {
+					split_planes[order[c]] = planes[c];
+				}
+				done = (unsigned)kernels.split128(split_planes, (const BYTE*)rgba, (int)width);
+			}
+			switch(component) {
+				case FICT_UINT8:
+					EncodePlanes<BYTE, FloatToByte>(rgba, planes, done, width, channels, order);
+					break;
+				case FICT_UINT16:
+					EncodePlanes<WORD, FloatToWord>(rgba, planes, done, width, channels, order);
+					break;
+				case FICT_HALF:
+					EncodePlanes<WORD, FloatToHalf>(rgba, planes, done, width, channels, order);
+					break;
+				case FICT_FLOAT:
+					EncodePlanes<float, FloatToFloat>(rgba, planes, done, width, channels, order);
+					break;
+			}
+			continue;
+		}
+
+		// encode
+		switch(component) {
+			case FICT_UINT8:
+				EncodeRow<BYTE, FloatToByte>(rgba, dst, width, channels, order);
+				break;
+			case FICT_UINT16:
+				EncodeRow<WORD, FloatToWord>(rgba, dst, width, channels, order);
+				break;
+			case FICT_HALF:
+				EncodeRow<WORD, FloatToHalf>(rgba, dst, width, channels, order);
+				break;
+			case FICT_FLOAT:
+				EncodeRow<float, FloatToFloat>(rgba, dst, width, channels, order);
+				break;
+		}
+	}
+
+	free(rgba);
+	free(buffer);
+
+	return TRUE;
+}
+
+/**
+Write the pixels of an image to a caller supplied buffer, converting them in a single pass
+(no intermediate image is created).
+Standard images (FIT_BITMAP) are converted as with FreeImage_ConvertTo32Bits. Integer images
+are mapped to [0..1] using the range of their type and float images are written unchanged,
+except when converted to 8- or 16-bit components, where values are clamped to [0..1].
+Greyscale images are exported with R = G = B.
+@param dib Input image, of any type but FIT_COMPLEX
+@param bits Output buffer, of at least height * pitch bytes, or channels * height * pitch bytes with FI_EXPORT_PLANAR
+@param pitch Size in bytes of an output row, at least width * channels * component size. 
+With FI_EXPORT_PLANAR, size in bytes of a row of a plane, at least width * component size
+@param layout Output channel order
+@param component Output component type. 16-bit, half and float components use the native byte order
+@param flags A combination of FI_EXPORT_xxx flags
+@return Returns TRUE if successful, FALSE otherwise
+@see FI_EXPORT_TOPDOWN, FI_EXPORT_PREMULTIPLY, FI_EXPORT_LINEAR, FI_EXPORT_PLANAR
+*/
+BOOL DLL_CALLCONV
+FreeImage_ExportPixels(FIBITMAP *dib, BYTE *bits, int pitch, FREE_IMAGE_PIXEL_LAYOUT layout, FREE_IMAGE_COMPONENT_TYPE component, int flags) {
+	if(!FreeImage_HasPixels(dib) || !bits) {
+		return FALSE;
+	}
+	if((layout < FIPL_RGBA) || (layout > FIPL_BGR) || (component < FICT_UINT8) || (component > FICT_FLOAT)) {
+		return FALSE;
+	}
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	switch(image_type) {
+		case FIT_BITMAP:
+			switch(FreeImage_GetBPP(dib)) {
+				case 1:
+				case 4:
+				case 8:
+				case 16:
+				case 24:
+				case 32:
+					break;
+				default:
+					return FALSE;
+			}
+			break;
+		case FIT_UINT16:
+		case FIT_INT16:
+		case FIT_UINT32:
+		case FIT_INT32:
+		case FIT_FLOAT:
+		case FIT_DOUBLE:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+		case FIT_RGBF:
+		case FIT_RGBAF:
+			break;
+		default:
+			return FALSE;
+	}
+
+	const unsigned channels = s_layout_channels[layout];
+	const unsigned *order = s_layout_order[layout];
+	const BOOL bPlanar = (flags & FI_EXPORT_PLANAR) ? TRUE : FALSE;
+	const unsigned line_size = FreeImage_GetWidth(dib) * (bPlanar ? 1 : channels) * s_component_size[component];
+	if((pitch <= 0) || ((unsigned)pitch < line_size)) {
+		return FALSE;
+	}
+
+	const BOOL bTopDown = (flags & FI_EXPORT_TOPDOWN) ? TRUE : FALSE;
+	const BOOL bPremultiply = (flags & FI_EXPORT_PREMULTIPLY) ? TRUE : FALSE;
+	const BOOL bLinear = (flags & FI_EXPORT_LINEAR) ? TRUE : FALSE;
+
+	if((image_type == FIT_BITMAP) && (component == FICT_UINT8) && !bLinear) {
+		return ExportBitmapBytes(dib, bits, (unsigned)pitch, channels, order, bTopDown, bPremultiply, bPlanar);
+	}
+
+	return ExportFloat(dib, bits, (unsigned)pitch, channels, order, component, bTopDown, bPremultiply, bLinear, bPlanar);
+}
@@ -21,13 +21,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to Float
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToFloat(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToFloat(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -57,7 +58,7 @@ FreeImage_ConvertToFloat(FIBITMAP *dib) {
 			break;
 		case FIT_FLOAT:
 			// float type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 		default:
 			return NULL;
 	}
@@ -67,7 +68,7 @@ FreeImage_ConvertToFloat(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_FLOAT, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_FLOAT);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -75,9 +76,6 @@ FreeImage_ConvertToFloat(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to float
 
 	const unsigned src_pitch = FreeImage_GetPitch(src);
@@ -89,98 +87,122 @@ FreeImage_ConvertToFloat(FIBITMAP *dib) {
 	switch(src_type) {
 		case FIT_BITMAP:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE *src_pixel = (BYTE*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x] = (float)(src_pixel[x]) / 255;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE *src_pixel = (BYTE*)src_line;
+					float *dst_pixel = (float*)dst_line;
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x] = (float)(src_pixel[x]) / 255;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_UINT16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const WORD *src_pixel = (WORD*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x] = (float)(src_pixel[x]) / 65535;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const WORD *src_pixel = (WORD*)src_line;
+					float *dst_pixel = (float*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x] = (float)(src_pixel[x]) / 65535;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGB16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue) / 65535.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGB16 *src_pixel = (FIRGB16*)src_line;
+					float *dst_pixel = (float*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue) / 65535.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBA16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue) / 65535.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBA16 *src_pixel = (FIRGBA16*)src_line;
+					float *dst_pixel = (float*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue) / 65535.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBF:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBF *src_pixel = (FIRGBF*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert (assume pixel values are in the range [0..1])
-					dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
-					dst_pixel[x] = CLAMP(dst_pixel[x], 0.0F, 1.0F);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBF *src_pixel = (FIRGBF*)src_line;
+					float *dst_pixel = (float*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert (assume pixel values are in the range [0..1])
+						dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
+						dst_pixel[x] = CLAMP(dst_pixel[x], 0.0F, 1.0F);
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBAF:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBAF *src_pixel = (FIRGBAF*)src_bits;
-				float *dst_pixel = (float*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert (assume pixel values are in the range [0..1])
-					dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
-					dst_pixel[x] = CLAMP(dst_pixel[x], 0.0F, 1.0F);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBAF *src_pixel = (FIRGBAF*)src_line;
+					float *dst_pixel = (float*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert (assume pixel values are in the range [0..1])
+						dst_pixel[x] = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
+						dst_pixel[x] = CLAMP(dst_pixel[x], 0.0F, 1.0F);
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 	}
@@ -192,3 +214,8 @@ FreeImage_ConvertToFloat(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToFloat(FIBITMAP *dib) {
+	return ConvertToFloat(dib, NULL);
+}
+
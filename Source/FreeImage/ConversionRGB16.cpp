@@ -21,13 +21,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to RGB16
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToRGB16(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToRGB16(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -54,7 +55,7 @@ FreeImage_ConvertToRGB16(FIBITMAP *dib) {
 			break;
 		case FIT_RGB16:
 			// RGB16 type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 			break;
 		case FIT_RGBA16:
 			// allow conversion from 64-bit RGBA (ignore the alpha channel)
@@ -69,7 +70,7 @@ FreeImage_ConvertToRGB16(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_RGB16, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_RGB16);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -77,9 +78,6 @@ FreeImage_ConvertToRGB16(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to RGB16
 
 	switch(src_type) {
@@ -88,46 +86,52 @@ FreeImage_ConvertToRGB16(FIBITMAP *dib) {
 			// Calculate the number of bytes per pixel (1 for 8-bit, 3 for 24-bit or 4 for 32-bit)
 			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
 
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
-				FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					dst_bits[x].red   = src_bits[FI_RGBA_RED] << 8;
-					dst_bits[x].green = src_bits[FI_RGBA_GREEN] << 8;
-					dst_bits[x].blue  = src_bits[FI_RGBA_BLUE] << 8;
-					src_bits += bytespp;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
+					FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						dst_bits[x].red   = src_bits[FI_RGBA_RED] << 8;
+						dst_bits[x].green = src_bits[FI_RGBA_GREEN] << 8;
+						dst_bits[x].blue  = src_bits[FI_RGBA_BLUE] << 8;
+						src_bits += bytespp;
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_UINT16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y);
-				FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert by copying greyscale channel to each R, G, B channels
-					dst_bits[x].red   = src_bits[x];
-					dst_bits[x].green = src_bits[x];
-					dst_bits[x].blue  = src_bits[x];
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y);
+					FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert by copying greyscale channel to each R, G, B channels
+						dst_bits[x].red   = src_bits[x];
+						dst_bits[x].green = src_bits[x];
+						dst_bits[x].blue  = src_bits[x];
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBA16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBA16 *src_bits = (FIRGBA16*)FreeImage_GetScanLine(src, y);
-				FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert and skip alpha channel
-					dst_bits[x].red   = src_bits[x].red;
-					dst_bits[x].green = src_bits[x].green;
-					dst_bits[x].blue  = src_bits[x].blue;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBA16 *src_bits = (FIRGBA16*)FreeImage_GetScanLine(src, y);
+					FIRGB16 *dst_bits = (FIRGB16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert and skip alpha channel
+						dst_bits[x].red   = src_bits[x].red;
+						dst_bits[x].green = src_bits[x].green;
+						dst_bits[x].blue  = src_bits[x].blue;
+					}
 				}
-			}
+			});
 		}
 		break;
 
@@ -142,3 +146,8 @@ FreeImage_ConvertToRGB16(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToRGB16(FIBITMAP *dib) {
+	return ConvertToRGB16(dib, NULL);
+}
+
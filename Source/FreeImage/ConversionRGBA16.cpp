@@ -21,13 +21,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to RGBA16
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToRGBA16(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -58,7 +59,7 @@ FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
 			break;
 		case FIT_RGBA16:
 			// RGBA16 type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 			break;
 		default:
 			return NULL;
@@ -69,7 +70,7 @@ FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_RGBA16, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_RGBA16);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -77,9 +78,6 @@ FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to RGBA16
 
 	switch(src_type) {
@@ -88,49 +86,55 @@ FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
 			// Calculate the number of bytes per pixel (4 for 32-bit)
 			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
 
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
-				FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					dst_bits[x].red		= src_bits[FI_RGBA_RED] << 8;
-					dst_bits[x].green	= src_bits[FI_RGBA_GREEN] << 8;
-					dst_bits[x].blue	= src_bits[FI_RGBA_BLUE] << 8;
-					dst_bits[x].alpha	= src_bits[FI_RGBA_ALPHA] << 8;
-					src_bits += bytespp;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
+					FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						dst_bits[x].red		= src_bits[FI_RGBA_RED] << 8;
+						dst_bits[x].green	= src_bits[FI_RGBA_GREEN] << 8;
+						dst_bits[x].blue	= src_bits[FI_RGBA_BLUE] << 8;
+						dst_bits[x].alpha	= src_bits[FI_RGBA_ALPHA] << 8;
+						src_bits += bytespp;
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_UINT16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y);
-				FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert by copying greyscale channel to each R, G, B channels
-					dst_bits[x].red   = src_bits[x];
-					dst_bits[x].green = src_bits[x];
-					dst_bits[x].blue  = src_bits[x];
-					dst_bits[x].alpha = 0xFFFF;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y);
+					FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert by copying greyscale channel to each R, G, B channels
+						dst_bits[x].red   = src_bits[x];
+						dst_bits[x].green = src_bits[x];
+						dst_bits[x].blue  = src_bits[x];
+						dst_bits[x].alpha = 0xFFFF;
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_RGB16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGB16 *src_bits = (FIRGB16*)FreeImage_GetScanLine(src, y);
-				FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert pixels directly, while adding a "dummy" alpha of 1.0
-					dst_bits[x].red   = src_bits[x].red;
-					dst_bits[x].green = src_bits[x].green;
-					dst_bits[x].blue  = src_bits[x].blue;
-					dst_bits[x].alpha = 0xFFFF;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGB16 *src_bits = (FIRGB16*)FreeImage_GetScanLine(src, y);
+					FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert pixels directly, while adding a "dummy" alpha of 1.0
+						dst_bits[x].red   = src_bits[x].red;
+						dst_bits[x].green = src_bits[x].green;
+						dst_bits[x].blue  = src_bits[x].blue;
+						dst_bits[x].alpha = 0xFFFF;
+					}
 				}
-			}
+			});
 		}
 		break;
 
@@ -145,3 +149,8 @@ FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToRGBA16(FIBITMAP *dib) {
+	return ConvertToRGBA16(dib, NULL);
+}
+
@@ -22,13 +22,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to RGBAF
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToRGBAF(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -72,7 +73,7 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			break;
 		case FIT_RGBAF:
 			// RGBAF type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 			break;
 		default:
 			return NULL;
@@ -83,7 +84,7 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_RGBAF, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_RGBAF);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -91,9 +92,6 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to RGBAF
 
 	const unsigned src_pitch = FreeImage_GetPitch(src);
@@ -108,22 +106,26 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE *src_pixel = (BYTE*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
-					dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
-					dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
-					dst_pixel->alpha = (float)(src_pixel[FI_RGBA_ALPHA]) / 255.0F;
-
-					src_pixel += bytespp;
-					dst_pixel++;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE *src_pixel = (BYTE*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
+						dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
+						dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
+						dst_pixel->alpha = (float)(src_pixel[FI_RGBA_ALPHA]) / 255.0F;
+
+						src_pixel += bytespp;
+						dst_pixel++;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -132,21 +134,25 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const WORD *src_pixel = (WORD*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					const float dst_value = (float)src_pixel[x] / 65535.0F;
-					dst_pixel[x].red   = dst_value;
-					dst_pixel[x].green = dst_value;
-					dst_pixel[x].blue  = dst_value;
-					dst_pixel[x].alpha = 1.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const WORD *src_pixel = (WORD*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						const float dst_value = (float)src_pixel[x] / 65535.0F;
+						dst_pixel[x].red   = dst_value;
+						dst_pixel[x].green = dst_value;
+						dst_pixel[x].blue  = dst_value;
+						dst_pixel[x].alpha = 1.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -155,20 +161,24 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
-					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
-					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
-					dst_pixel[x].alpha = 1.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGB16 *src_pixel = (FIRGB16*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
+						dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
+						dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+						dst_pixel[x].alpha = 1.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -177,20 +187,24 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
-					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
-					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
-					dst_pixel[x].alpha = (float)(src_pixel[x].alpha) / 65535.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBA16 *src_pixel = (FIRGBA16*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
+						dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
+						dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+						dst_pixel[x].alpha = (float)(src_pixel[x].alpha) / 65535.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -199,22 +213,26 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const float *src_pixel = (float*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert by copying greyscale channel to each R, G, B channels
-					// assume float values are in [0..1]
-					const float value = CLAMP(src_pixel[x], 0.0F, 1.0F);
-					dst_pixel[x].red   = value;
-					dst_pixel[x].green = value;
-					dst_pixel[x].blue  = value;
-					dst_pixel[x].alpha = 1.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const float *src_pixel = (float*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert by copying greyscale channel to each R, G, B channels
+						// assume float values are in [0..1]
+						const float value = CLAMP(src_pixel[x], 0.0F, 1.0F);
+						dst_pixel[x].red   = value;
+						dst_pixel[x].green = value;
+						dst_pixel[x].blue  = value;
+						dst_pixel[x].alpha = 1.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -223,20 +241,24 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBF *src_pixel = (FIRGBF*)src_bits;
-				FIRGBAF *dst_pixel = (FIRGBAF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert pixels directly, while adding a "dummy" alpha of 1.0
-					dst_pixel[x].red   = CLAMP(src_pixel[x].red, 0.0F, 1.0F);
-					dst_pixel[x].green = CLAMP(src_pixel[x].green, 0.0F, 1.0F);
-					dst_pixel[x].blue  = CLAMP(src_pixel[x].blue, 0.0F, 1.0F);
-					dst_pixel[x].alpha = 1.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBF *src_pixel = (FIRGBF*)src_line;
+					FIRGBAF *dst_pixel = (FIRGBAF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert pixels directly, while adding a "dummy" alpha of 1.0
+						dst_pixel[x].red   = CLAMP(src_pixel[x].red, 0.0F, 1.0F);
+						dst_pixel[x].green = CLAMP(src_pixel[x].green, 0.0F, 1.0F);
+						dst_pixel[x].blue  = CLAMP(src_pixel[x].blue, 0.0F, 1.0F);
+						dst_pixel[x].alpha = 1.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 	}
@@ -248,3 +270,8 @@ FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToRGBAF(FIBITMAP *dib) {
+	return ConvertToRGBAF(dib, NULL);
+}
+
@@ -21,13 +21,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to RGBF
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToRGBF(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToRGBF(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -71,7 +72,7 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			break;
 		case FIT_RGBF:
 			// RGBF type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 			break;
 		default:
 			return NULL;
@@ -82,7 +83,7 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_RGBF, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_RGBF);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -90,9 +91,6 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to RGBF
 
 	const unsigned src_pitch = FreeImage_GetPitch(src);
@@ -107,21 +105,25 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE   *src_pixel = (BYTE*)src_bits;
-				FIRGBF *dst_pixel = (FIRGBF*)dst_bits;
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
-					dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
-					dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
-
-					src_pixel += bytespp;
-					dst_pixel ++;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE   *src_pixel = (BYTE*)src_line;
+					FIRGBF *dst_pixel = (FIRGBF*)dst_line;
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
+						dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
+						dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
+
+						src_pixel += bytespp;
+						dst_pixel ++;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -130,20 +132,24 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const WORD *src_pixel = (WORD*)src_bits;
-				FIRGBF *dst_pixel = (FIRGBF*)dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					const float dst_value = (float)src_pixel[x] / 65535.0F;
-					dst_pixel[x].red   = dst_value;
-					dst_pixel[x].green = dst_value;
-					dst_pixel[x].blue  = dst_value;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const WORD *src_pixel = (WORD*)src_line;
+					FIRGBF *dst_pixel = (FIRGBF*)dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						const float dst_value = (float)src_pixel[x] / 65535.0F;
+						dst_pixel[x].red   = dst_value;
+						dst_pixel[x].green = dst_value;
+						dst_pixel[x].blue  = dst_value;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -152,19 +158,23 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGB16 *src_pixel = (FIRGB16*) src_bits;
-				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
-					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
-					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGB16 *src_pixel = (FIRGB16*) src_line;
+					FIRGBF  *dst_pixel = (FIRGBF*)  dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
+						dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
+						dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -173,19 +183,23 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBA16 *src_pixel = (FIRGBA16*) src_bits;
-				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
-					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
-					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBA16 *src_pixel = (FIRGBA16*) src_line;
+					FIRGBF  *dst_pixel = (FIRGBF*)  dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and scale to the range [0..1]
+						dst_pixel[x].red   = (float)(src_pixel[x].red)   / 65535.0F;
+						dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
+						dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -194,21 +208,25 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const float *src_pixel = (float*) src_bits;
-				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert by copying greyscale channel to each R, G, B channels
-					// assume float values are in [0..1]
-					const float value = CLAMP(src_pixel[x], 0.0F, 1.0F);
-					dst_pixel[x].red   = value;
-					dst_pixel[x].green = value;
-					dst_pixel[x].blue  = value;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const float *src_pixel = (float*) src_line;
+					FIRGBF  *dst_pixel = (FIRGBF*)  dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert by copying greyscale channel to each R, G, B channels
+						// assume float values are in [0..1]
+						const float value = CLAMP(src_pixel[x], 0.0F, 1.0F);
+						dst_pixel[x].red   = value;
+						dst_pixel[x].green = value;
+						dst_pixel[x].blue  = value;
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
@@ -217,19 +235,23 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBAF *src_pixel = (FIRGBAF*) src_bits;
-				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
-
-				for(unsigned x = 0; x < width; x++) {
-					// convert and skip alpha channel
-					dst_pixel[x].red   = CLAMP(src_pixel[x].red, 0.0F, 1.0F);
-					dst_pixel[x].green = CLAMP(src_pixel[x].green, 0.0F, 1.0F);
-					dst_pixel[x].blue  = CLAMP(src_pixel[x].blue, 0.0F, 1.0F);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				const BYTE *src_line = src_bits + first_row * src_pitch;
+				BYTE *dst_line = dst_bits + first_row * dst_pitch;
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBAF *src_pixel = (FIRGBAF*) src_line;
+					FIRGBF  *dst_pixel = (FIRGBF*)  dst_line;
+
+					for(unsigned x = 0; x < width; x++) {
+						// convert and skip alpha channel
+						dst_pixel[x].red   = CLAMP(src_pixel[x].red, 0.0F, 1.0F);
+						dst_pixel[x].green = CLAMP(src_pixel[x].green, 0.0F, 1.0F);
+						dst_pixel[x].blue  = CLAMP(src_pixel[x].blue, 0.0F, 1.0F);
+					}
+					src_line += src_pitch;
+					dst_line += dst_pitch;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 	}
@@ -241,3 +263,8 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToRGBF(FIBITMAP *dib) {
+	return ConvertToRGBF(dib, NULL);
+}
+
@@ -22,6 +22,10 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
+#include "../SIMD.h"
+
+#include <vector>
 
 // ----------------------------------------------------------
 
@@ -52,34 +56,77 @@ CONVERT_TYPE<Tdst, Tsrc>::convert(FIBITMAP *src, FREE_IMAGE_TYPE dst_type) {
 
 	// convert from src_type to dst_type
 	
-	for(unsigned y = 0; y < height; y++) {
-		const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-		Tdst *dst_bits = reinterpret_cast<Tdst*>(FreeImage_GetScanLine(dst, y));
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+			Tdst *dst_bits = reinterpret_cast<Tdst*>(FreeImage_GetScanLine(dst, y));
 
-		for(unsigned x = 0; x < width; x++) {
-			*dst_bits++ = static_cast<Tdst>(*src_bits++);
+			for(unsigned x = 0; x < width; x++) {
+				*dst_bits++ = static_cast<Tdst>(*src_bits++);
+			}
 		}
-	}
+	});
 
 	return dst;
 }
 
 
+/** Find the min and max value of an array of values.
+	The loop is written so that it can be vectorized by the compiler.
+*/
+template<class T> static void
+FindMinMax(const T *bits, unsigned count, T& min, T& max) {
+	T l_min = bits[0], l_max = bits[0];
+	for(unsigned x = 1; x < count; x++) {
+		const T value = bits[x];
+		l_min = (value < l_min) ? value : l_min;
+		l_max = (value > l_max) ? value : l_max;
+	}
+	min = l_min;
+	max = l_max;
+}
+
+template<> void
+FindMinMax<float>(const float *bits, unsigned count, float& min, float& max) {
+	float l_min = bits[0], l_max = bits[0];
+	const unsigned done = GetLineKernels().minmaxFloat(bits, (int)count, &l_min, &l_max);
+	for(unsigned x = done; x < count; x++) {
+		const float value = bits[x];
+		l_min = (value < l_min) ? value : l_min;
+		l_max = (value > l_max) ? value : l_max;
+	}
+	min = l_min;
+	max = l_max;
+}
+
+template<> void
+FindMinMax<double>(const double *bits, unsigned count, double& min, double& max) {
+	double l_min = bits[0], l_max = bits[0];
+	const unsigned done = GetLineKernels().minmaxDouble(bits, (int)count, &l_min, &l_max);
+	for(unsigned x = done; x < count; x++) {
+		const double value = bits[x];
+		l_min = (value < l_min) ? value : l_min;
+		l_max = (value > l_max) ? value : l_max;
+	}
+	min = l_min;
+	max = l_max;
+}
+
 /** Convert a greyscale image of type Tsrc to a 8-bit grayscale dib.
 	Conversion is done using either a linear scaling from [min, max] to [0, 255]
 	or a rounding from src_pixel to (BYTE) MIN(255, MAX(0, q)) where int q = int(src_pixel + 0.5); 
+	The [min, max] range is either given by the caller or found with a parallel scan of the image.
 */
 template<class Tsrc>
 class CONVERT_TO_BYTE
 {
 public:
-	FIBITMAP* convert(FIBITMAP *src, BOOL scale_linear);
+	FIBITMAP* convert(FIBITMAP *src, BOOL scale_linear, const double *range = NULL);
 };
 
 template<class Tsrc> FIBITMAP* 
-CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear) {
+CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear, const double *range) {
 	FIBITMAP *dst = NULL;
-	unsigned x, y;
 
 	unsigned width	= FreeImage_GetWidth(src);
 	unsigned height = FreeImage_GetHeight(src);
@@ -99,44 +146,68 @@ CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear) {
 
 	// convert the src image to dst
 	// (FIBITMAP are stored upside down)
-	if(scale_linear) {
+	if(scale_linear && range) {
+		const double min = range[0];
+		const double scale = 255 / (range[1] - min);
+
+		// scale to 8-bit, values outside of the range are clipped
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+				for(unsigned x = 0; x < width; x++) {
+					double value = scale * ((double)src_bits[x] - min) + 0.5;
+					value = (value < 0) ? 0 : value;
+					value = (value > 255) ? 255 : value;
+					dst_bits[x] = (BYTE)value;
+				}
+			}
+		});
+	} else if(scale_linear) {
 		Tsrc max, min;
-		double scale;
 
-		// find the min and max value of the image
-		Tsrc l_min, l_max;
+		// find the min and max value of each line, then of the image
+		std::vector<Tsrc> line_min(height), line_max(height);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const Tsrc *bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+				FindMinMax(bits, width, line_min[y], line_max[y]);
+			}
+		});
 		min = 255, max = 0;
-		for(y = 0; y < height; y++) {
-			Tsrc *bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			MAXMIN(bits, width, l_max, l_min);
-			if(l_max > max) max = l_max;
-			if(l_min < min) min = l_min;
+		for(unsigned y = 0; y < height; y++) {
+			if(line_max[y] > max) max = line_max[y];
+			if(line_min[y] < min) min = line_min[y];
 		}
 		if(max == min) {
 			max = 255; min = 0;
 		}
 
 		// compute the scaling factor
-		scale = 255 / (double)(max - min);
+		const double scale = 255 / (double)(max - min);
 
 		// scale to 8-bit
-		for(y = 0; y < height; y++) {
-			Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
-			for(x = 0; x < width; x++) {
-				dst_bits[x] = (BYTE)( scale * (src_bits[x] - min) + 0.5);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+				for(unsigned x = 0; x < width; x++) {
+					dst_bits[x] = (BYTE)( scale * (src_bits[x] - min) + 0.5);
+				}
 			}
-		}
+		});
 	} else {
-		for(y = 0; y < height; y++) {
-			Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
-			for(x = 0; x < width; x++) {
-				// rounding
-				int q = int(src_bits[x] + 0.5);
-				dst_bits[x] = (BYTE) MIN(255, MAX(0, q));
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+				for(unsigned x = 0; x < width; x++) {
+					// rounding
+					int q = int(src_bits[x] + 0.5);
+					dst_bits[x] = (BYTE) MIN(255, MAX(0, q));
+				}
 			}
-		}
+		});
 	}
 
 	return dst;
@@ -165,15 +236,17 @@ CONVERT_TO_COMPLEX<Tsrc>::convert(FIBITMAP *src) {
 
 	// convert from src_type to FIT_COMPLEX
 	
-	for(unsigned y = 0; y < height; y++) {
-		const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-		FICOMPLEX *dst_bits = (FICOMPLEX *)FreeImage_GetScanLine(dst, y);
-
-		for(unsigned x = 0; x < width; x++) {
-			dst_bits[x].r = (double)src_bits[x];
-			dst_bits[x].i = 0;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			const Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
+			FICOMPLEX *dst_bits = (FICOMPLEX *)FreeImage_GetScanLine(dst, y);
+
+			for(unsigned x = 0; x < width; x++) {
+				dst_bits[x].r = (double)src_bits[x];
+				dst_bits[x].i = 0;
+			}
 		}
-	}
+	});
 
 	return dst;
 }
@@ -232,9 +305,10 @@ by rounding each float pixel to an integer between [0..255].
 For complex images, the magnitude is extracted as a double image, then converted according to the scale parameter. 
 @param image Image to convert
 @param scale_linear Linear scaling / rounding switch
+@param range Linear scaling range as {min, max}, or NULL to use the image min and max
 */
-FIBITMAP* DLL_CALLCONV
-FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
+static FIBITMAP*
+ConvertToStandardType(FIBITMAP *src, BOOL scale_linear, const double *range) {
 	FIBITMAP *dst = NULL;
 
 	if(!src) return NULL;
@@ -248,22 +322,22 @@ FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
 			dst = FreeImage_Clone(src);
 			break;
 		case FIT_UINT16:	// array of unsigned short: unsigned 16-bit
-			dst = convertUShortToByte.convert(src, scale_linear);
+			dst = convertUShortToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_INT16:		// array of short: signed 16-bit
-			dst = convertShortToByte.convert(src, scale_linear);
+			dst = convertShortToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_UINT32:	// array of unsigned long: unsigned 32-bit
-			dst = convertULongToByte.convert(src, scale_linear);
+			dst = convertULongToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_INT32:		// array of long: signed 32-bit
-			dst = convertLongToByte.convert(src, scale_linear);
+			dst = convertLongToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_FLOAT:		// array of float: 32-bit
-			dst = convertFloatToByte.convert(src, scale_linear);
+			dst = convertFloatToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_DOUBLE:	// array of double: 64-bit
-			dst = convertDoubleToByte.convert(src, scale_linear);
+			dst = convertDoubleToByte.convert(src, scale_linear, range);
 			break;
 		case FIT_COMPLEX:	// array of FICOMPLEX: 2 x 64-bit
 			{
@@ -271,7 +345,7 @@ FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
 				FIBITMAP *dib_double = FreeImage_GetComplexChannel(src, FICC_MAG);
 				if(dib_double) {
 					// Convert to a standard bitmap (linear scaling)
-					dst = convertDoubleToByte.convert(dib_double, scale_linear);
+					dst = convertDoubleToByte.convert(dib_double, scale_linear, range);
 					// Free image of type FIT_DOUBLE
 					FreeImage_Unload(dib_double);
 				}
@@ -297,7 +371,34 @@ FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
 	return dst;
 }
 
+/** Convert image of any type to a standard 8-bit greyscale image.
+@see ConvertToStandardType
+*/
+FIBITMAP* DLL_CALLCONV
+FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
+	return ConvertToStandardType(src, scale_linear, NULL);
+}
 
+/** Convert image of any type to a standard 8-bit greyscale image, 
+by scaling linearly the [min_value, max_value] range to [0..255]. 
+Pixels outside of the range are clipped to 0 or 255. 
+Unlike FreeImage_ConvertToStandardType, the image is not scanned for its min and max value, 
+so that a precomputed or a clipped range (e.g. from percentiles) can be used. 
+For standard images, a clone of the input image is returned.
+@param src Image to convert
+@param min_value Value mapped to 0
+@param max_value Value mapped to 255, must be greater than min_value
+@return Returns the converted image if successful, returns NULL otherwise
+*/
+FIBITMAP* DLL_CALLCONV
+FreeImage_ConvertToStandardTypeRange(FIBITMAP *src, double min_value, double max_value) {
+	if(!(max_value > min_value) || ((max_value - min_value) > DBL_MAX)) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "FreeImage_ConvertToStandardTypeRange: invalid [min_value, max_value] range");
+		return NULL;
+	}
+	const double range[2] = { min_value, max_value };
+	return ConvertToStandardType(src, TRUE, range);
+}
 
 // ----------------------------------------------------------
 //   smart convert X to Y
@@ -21,13 +21,14 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   smart convert X to UINT16
 // ----------------------------------------------------------
 
-FIBITMAP * DLL_CALLCONV
-FreeImage_ConvertToUINT16(FIBITMAP *dib) {
+FIBITMAP *
+ConvertToUINT16(FIBITMAP *dib, FIBITMAP *target) {
 	FIBITMAP *src = NULL;
 	FIBITMAP *dst = NULL;
 
@@ -50,7 +51,7 @@ FreeImage_ConvertToUINT16(FIBITMAP *dib) {
 		}
 		case FIT_UINT16:
 			// UINT16 type : clone the src
-			return FreeImage_Clone(dib);
+			return CopyConversionSource(target, dib);
 			break;
 		case FIT_RGB16:
 			// allow conversion from 48-bit RGB
@@ -69,7 +70,7 @@ FreeImage_ConvertToUINT16(FIBITMAP *dib) {
 	const unsigned width = FreeImage_GetWidth(src);
 	const unsigned height = FreeImage_GetHeight(src);
 
-	dst = FreeImage_AllocateT(FIT_UINT16, width, height);
+	dst = AllocateConversionTarget(target, src, FIT_UINT16);
 	if(!dst) {
 		if(src != dib) {
 			FreeImage_Unload(src);
@@ -77,47 +78,50 @@ FreeImage_ConvertToUINT16(FIBITMAP *dib) {
 		return NULL;
 	}
 
-	// copy metadata from src to dst
-	FreeImage_CloneMetadata(dst, src);
-
 	// convert from src type to UINT16
 
 	switch(src_type) {
 		case FIT_BITMAP:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
-				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					dst_bits[x] = src_bits[x] << 8;
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const BYTE *src_bits = (BYTE*)FreeImage_GetScanLine(src, y);
+					WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						dst_bits[x] = src_bits[x] << 8;
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_RGB16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGB16 *src_bits = (FIRGB16*)FreeImage_GetScanLine(src, y);
-				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert to grey
-					dst_bits[x] = (WORD)LUMA_REC709(src_bits[x].red, src_bits[x].green, src_bits[x].blue);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGB16 *src_bits = (FIRGB16*)FreeImage_GetScanLine(src, y);
+					WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert to grey
+						dst_bits[x] = (WORD)LUMA_REC709(src_bits[x].red, src_bits[x].green, src_bits[x].blue);
+					}
 				}
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBA16:
 		{
-			for(unsigned y = 0; y < height; y++) {
-				const FIRGBA16 *src_bits = (FIRGBA16*)FreeImage_GetScanLine(src, y);
-				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
-				for(unsigned x = 0; x < width; x++) {
-					// convert to grey
-					dst_bits[x] = (WORD)LUMA_REC709(src_bits[x].red, src_bits[x].green, src_bits[x].blue);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const FIRGBA16 *src_bits = (FIRGBA16*)FreeImage_GetScanLine(src, y);
+					WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
+					for(unsigned x = 0; x < width; x++) {
+						// convert to grey
+						dst_bits[x] = (WORD)LUMA_REC709(src_bits[x].red, src_bits[x].green, src_bits[x].blue);
+					}
 				}
-			}
+			});
 		}
 		break;
 
@@ -132,3 +136,8 @@ FreeImage_ConvertToUINT16(FIBITMAP *dib) {
 	return dst;
 }
 
+FIBITMAP * DLL_CALLCONV
+FreeImage_ConvertToUINT16(FIBITMAP *dib) {
+	return ConvertToUINT16(dib, NULL);
+}
+
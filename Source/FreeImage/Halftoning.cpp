@@ -25,105 +25,288 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "Quantizers.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
 
 static const int WHITE = 255;
 static const int BLACK = 0;
 
+// ==========================================================
+// Internal helpers
+//
+
+/**
+Read the scanlines of an image as 8-bit greyscale values, as FreeImage_ConvertToGreyscale would.
+24-bit, 32-bit and 8-bit greyscale images are read a scanline at a time,
+other images are first converted to a greyscale copy.
+*/
+class GreyScanLines {
+private:
+	FIBITMAP *_dib;
+	FIBITMAP *_grey;
+	unsigned _bpp;
+
+public:
+	GreyScanLines(FIBITMAP *dib) : _dib(dib), _grey(NULL), _bpp(FreeImage_GetBPP(dib)) {
+		const BOOL is_direct = (FreeImage_GetImageType(dib) == FIT_BITMAP) && 
+			((_bpp == 24) || (_bpp == 32) || ((_bpp == 8) && (FreeImage_GetColorType(dib) == FIC_MINISBLACK)));
+		if(!is_direct) {
+			_grey = FreeImage_ConvertToGreyscale(dib);
+			_dib = _grey;
+			_bpp = 8;
+		}
+	}
+
+	~GreyScanLines() {
+		if(_grey) {
+			FreeImage_Unload(_grey);
+		}
+	}
+
+	BOOL IsValid() const {
+		return (_dib != NULL);
+	}
+
+	/**
+	Get a greyscale scanline
+	@param y Scanline index
+	@param buffer Scanline buffer, used when the scanline needs a conversion
+	@return Returns buffer or the scanline of the image
+	*/
+	const BYTE* GetLine(unsigned y, BYTE *buffer) const {
+		switch(_bpp) {
+			case 24:
+				FreeImage_ConvertLine24To8(buffer, FreeImage_GetScanLine(_dib, y), FreeImage_GetWidth(_dib));
+				return buffer;
+			case 32:
+				FreeImage_ConvertLine32To8(buffer, FreeImage_GetScanLine(_dib, y), FreeImage_GetWidth(_dib));
+				return buffer;
+			default:
+				return FreeImage_GetScanLine(_dib, y);
+		}
+	}
+
+	/**
+	Get a greyscale pixel
+	*/
+	BYTE GetPixel(unsigned x, unsigned y) const {
+		BYTE value;
+		switch(_bpp) {
+			case 24:
+				FreeImage_ConvertLine24To8(&value, FreeImage_GetScanLine(_dib, y) + 3 * x, 1);
+				return value;
+			case 32:
+				FreeImage_ConvertLine32To8(&value, FreeImage_GetScanLine(_dib, y) + 4 * x, 1);
+				return value;
+			default:
+				return FreeImage_GetScanLine(_dib, y)[x];
+		}
+	}
+};
+
+/**
+Convert a 8-bit scanline to a 1-bit scanline : bit x is set when bits8[x] >= threshold[x]
+*/
+static void
+ThresholdLine(BYTE *bits1, const BYTE *bits8, const BYTE *threshold, unsigned width) {
+	unsigned x = (unsigned)GetLineKernels().threshold8To1(bits1, bits8, threshold, (int)width);
+	for(; x < width; x++) {
+		if(bits8[x] < threshold[x]) {
+			// Set bit(x, y) to 0
+			bits1[x >> 3] &= (0xFF7F >> (x & 0x7));
+		} else {
+			// Set bit(x, y) to 1
+			bits1[x >> 3] |= (0x80 >> (x & 0x7));
+		}
+	}
+}
+
+/**
+Parallel scheduling of an error diffusion.
+Rows are processed from left to right, and pixel x of a row may be processed once pixel x + 1 
+of the previous row is done : a row starts as soon as the previous row is a block of pixels ahead.
+Rows are claimed in order, so that the oldest row in progress never waits. Each thread works 
+on one row at a time, thus row y may use the error buffer y % GetSlotCount().
+*/
+class RowWavefront {
+private:
+	//! number of pixels processed between two progress updates
+	static const unsigned BLOCK_SIZE = 128;
+
+	unsigned _width, _height, _first_row;
+	unsigned _task_count;
+	std::atomic<unsigned> _next_row;
+	//! _progress[y] is the number of pixels of row y already processed
+	std::unique_ptr<std::atomic<unsigned>[]> _progress;
+
+public:
+	/**
+	@param width Image width
+	@param height Image height
+	@param first_row First row to process, the previous rows are done
+	*/
+	RowWavefront(unsigned width, unsigned height, unsigned first_row) : _width(width), _height(height), _first_row(first_row), _next_row(first_row), _progress(new std::atomic<unsigned>[height]) {
+		for(unsigned y = 0; y < height; y++) {
+			_progress[y] = (y < first_row) ? width : 0;
+		}
+		const unsigned rows = (height > first_row) ? height - first_row : 0;
+		const BOOL is_parallel = ((UINT64)width * rows >= FI_PARALLEL_MIN_PIXELS) && (width >= 2 * BLOCK_SIZE);
+		_task_count = is_parallel ? MAX(1U, MIN(GetParallelism(), rows)) : 1;
+	}
+
+	/** Number of threads processing rows */
+	unsigned GetTaskCount() const {
+		return _task_count;
+	}
+
+	/** Number of rows in use at once, including the previous row of the oldest row */
+	unsigned GetSlotCount() const {
+		return _task_count + 1;
+	}
+
+	/** End of the block of pixels starting at x, in a row ending at end */
+	unsigned GetBlockEnd(unsigned x, unsigned end) const {
+		return MIN(x + BLOCK_SIZE, end);
+	}
+
+	/** Wait until the previous row of row y is done on [0, x) */
+	void Wait(unsigned y, unsigned x) const {
+		if(y > _first_row) {
+			x = MIN(x, _width);
+			while(_progress[y - 1].load(std::memory_order_acquire) < x) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	/** Record that row y is done on [0, x) */
+	void Done(unsigned y, unsigned x) {
+		_progress[y].store(x, std::memory_order_release);
+	}
+
+	/**
+	Run row(y, task) for all rows, task being the index of the calling thread in [0, GetTaskCount()).
+	The row function must not throw.
+	*/
+	void Run(const std::function<void(unsigned, unsigned)>& row) {
+		ParallelRun(_task_count, [&](unsigned task) {
+			for(;;) {
+				const unsigned y = _next_row++;
+				if(y >= _height) {
+					break;
+				}
+				row(y, task);
+				Done(y, _width);
+			}
+		});
+	}
+};
+
+// ==========================================================
 // Floyd & Steinberg error diffusion dithering
+//
+
 // This algorithm use the following filter
 //          *   7
 //      3   5   1     (1/16)
-static FIBITMAP* FloydSteinberg(FIBITMAP *dib) {
+// The borders are dithered first, then the rows are processed as a wavefront
+//
+static void FloydSteinberg(const GreyScanLines& input, FIBITMAP *new_dib) {
 
 #define RAND(RN) (((seed = 1103515245 * seed + 12345) >> 12) % (RN))
 #define INITERR(X, Y) (((int) X) - (((int) Y) ? WHITE : BLACK) + ((WHITE/2)-((int)X)) / 2)
 
 	int seed = 0;
-	int x, y, p, pixel, threshold, error;
-	int width, height, pitch;
-	BYTE *bits, *new_bits;
-	FIBITMAP *new_dib = NULL;
+	int p, pixel, threshold, error;
+	const unsigned width = FreeImage_GetWidth(new_dib);
+	const unsigned height = FreeImage_GetHeight(new_dib);
 
-	// allocate a 8-bit DIB
-	width = FreeImage_GetWidth(dib);
-	height = FreeImage_GetHeight(dib);
-	pitch = FreeImage_GetPitch(dib);
-	new_dib = FreeImage_Allocate(width, height, 8);
-	if(NULL == new_dib) return NULL;
+	RowWavefront wavefront(width, height, 1);
+	const unsigned task_count = wavefront.GetTaskCount();
+	const unsigned slot_count = wavefront.GetSlotCount();
 
-	// allocate space for error arrays
-	int *lerr = (int*)malloc (width * sizeof(int));
-	int *cerr = (int*)malloc (width * sizeof(int));
-	memset(lerr, 0, width * sizeof(int));
-	memset(cerr, 0, width * sizeof(int));
+	// dithered pixels are 0 or 255, and converted to 1-bit with a 128 threshold
+	std::vector<BYTE> half(width, 128);
+	std::vector<BYTE> left(height), right(height);
+	std::vector<int> errors(slot_count * width);
+	std::vector<BYTE> buffers(task_count * width), new_lines(task_count * width);
 
 	// left border
 	error = 0;
-	for(y = 0; y < height; y++) {
-		bits = FreeImage_GetScanLine(dib, y);
-		new_bits = FreeImage_GetScanLine(new_dib, y);
-
+	for(unsigned y = 0; y < height; y++) {
 		threshold = (WHITE / 2 + RAND(129) - 64);
-		pixel = bits[0] + error;
+		pixel = input.GetPixel(0, y) + error;
 		p = (pixel > threshold) ? WHITE : BLACK;
 		error = pixel - p;
-		new_bits[0] = (BYTE)p;
+		left[y] = (BYTE)p;
 	}
 	// right border
 	error = 0;
-	for(y = 0; y < height; y++) {
-		bits = FreeImage_GetScanLine(dib, y);
-		new_bits = FreeImage_GetScanLine(new_dib, y);
-
+	for(unsigned y = 0; y < height; y++) {
 		threshold = (WHITE / 2 + RAND(129) - 64);
-		pixel = bits[width-1] + error;
+		pixel = input.GetPixel(width - 1, y) + error;
 		p = (pixel > threshold) ? WHITE : BLACK;
 		error = pixel - p;
-		new_bits[width-1] = (BYTE)p;
+		right[y] = (BYTE)p;
 	}
 	// top border
-	bits = FreeImage_GetBits(dib);
-	new_bits = FreeImage_GetBits(new_dib);
-	error = 0;
-	for(x = 0; x < width; x++) {
-		threshold = (WHITE / 2 + RAND(129) - 64);
-		pixel = bits[x] + error;
-		p = (pixel > threshold) ? WHITE : BLACK;
-		error = pixel - p;
-		new_bits[x] = (BYTE)p;
-		lerr[x] = INITERR(bits[x], p);
+	{
+		const BYTE *bits = input.GetLine(0, &buffers[0]);
+		BYTE *new_bits = &new_lines[0];
+		int *lerr = &errors[0];
+		error = 0;
+		for(unsigned x = 0; x < width; x++) {
+			threshold = (WHITE / 2 + RAND(129) - 64);
+			pixel = bits[x] + error;
+			p = (pixel > threshold) ? WHITE : BLACK;
+			error = pixel - p;
+			new_bits[x] = (BYTE)p;
+			lerr[x] = INITERR(bits[x], p);
+		}
+		ThresholdLine(FreeImage_GetScanLine(new_dib, 0), new_bits, &half[0], width);
 	}
 
 	// interior bits
-	for(y = 1; y < height; y++) {
-		// scan left to right
-		bits = FreeImage_GetScanLine(dib, y);
-		new_bits = FreeImage_GetScanLine(new_dib, y);
+	wavefront.Run([&](unsigned y, unsigned task) {
+		const BYTE *bits = input.GetLine(y, &buffers[task * width]);
+		BYTE *new_bits = &new_lines[task * width];
+		const int *lerr = &errors[((y - 1) % slot_count) * width];
+		int *cerr = &errors[(y % slot_count) * width];
 
-	    cerr[0] = INITERR(bits[0], new_bits[0]);
-		for(x = 1; x < width - 1; x++) {
-			error = (lerr[x-1] + 5 * lerr[x] + 3 * lerr[x+1] + 7 * cerr[x-1]) / 16;
-			pixel = bits[x] + error;
-			if(pixel > (WHITE / 2)) {		
-				new_bits[x] = WHITE;
-				cerr[x] = pixel - WHITE; 
-			} else {
-				new_bits[x] = BLACK;
-				cerr[x] = pixel - BLACK; 
+		new_bits[0] = left[y];
+		new_bits[width - 1] = right[y];
+
+		// scan left to right
+		cerr[0] = INITERR(bits[0], new_bits[0]);
+		for(unsigned x = 1; x < width - 1; ) {
+			const unsigned end = wavefront.GetBlockEnd(x, width - 1);
+			wavefront.Wait(y, end + 1);
+			for(; x < end; x++) {
+				const int error = (lerr[x-1] + 5 * lerr[x] + 3 * lerr[x+1] + 7 * cerr[x-1]) / 16;
+				const int pixel = bits[x] + error;
+				if(pixel > (WHITE / 2)) {
+					new_bits[x] = WHITE;
+					cerr[x] = pixel - WHITE;
+				} else {
+					new_bits[x] = BLACK;
+					cerr[x] = pixel - BLACK;
+				}
 			}
+			wavefront.Done(y, x);
 		}
 		// set errors for ends of the row
-		cerr[0] = INITERR (bits[0], new_bits[0]);
-		cerr[width - 1] = INITERR (bits[width - 1], new_bits[width - 1]);
-
-		// swap error buffers
-		int *terr = lerr; lerr = cerr; cerr = terr;
-	}
+		cerr[width - 1] = INITERR(bits[width - 1], new_bits[width - 1]);
 
-	free(lerr);
-	free(cerr);
+		ThresholdLine(FreeImage_GetScanLine(new_dib, y), new_bits, &half[0], width);
+	});
 
-	return new_dib;
+#undef RAND
+#undef INITERR
 }
 
 // ==========================================================
@@ -159,43 +342,34 @@ static int dithervalue(int x, int y, int size) {
 
 // Ordered dithering with a Bayer matrix of size 2^order by 2^order
 //
-static FIBITMAP* OrderedDispersedDot(FIBITMAP *dib, int order) {
-	int x, y;
-	int width, height;
-	BYTE *bits, *new_bits;
-	FIBITMAP *new_dib = NULL;
-
-	// allocate a 8-bit DIB
-	width = FreeImage_GetWidth(dib);
-	height = FreeImage_GetHeight(dib);
-	new_dib = FreeImage_Allocate(width, height, 8);
-	if(NULL == new_dib) return NULL;
+static void OrderedDispersedDot(const GreyScanLines& input, FIBITMAP *new_dib, int order) {
+	const unsigned width = FreeImage_GetWidth(new_dib);
+	const unsigned height = FreeImage_GetHeight(new_dib);
 
 	// build the dithering matrix
 	int l = (1 << order);	// square of dither matrix order; the dimensions of the matrix
-	BYTE *matrix = (BYTE*)malloc(l*l * sizeof(BYTE));
+	std::vector<BYTE> matrix(l*l);
 	for(int i = 0; i < l*l; i++) {
 		// according to "Purdue University: Digital Image Processing Laboratory: Image Halftoning, April 30th, 2006
 		matrix[i] = (BYTE)( 255 * (((double)dithervalue(i / l, i % l, order) + 0.5) / (l*l)) );
 	}
 
-	// perform the dithering
-	for(y = 0; y < height; y++) {
-		// scan left to right
-		bits = FreeImage_GetScanLine(dib, y);
-		new_bits = FreeImage_GetScanLine(new_dib, y);
-		for(x = 0; x < width; x++) {
-			if(bits[x] > matrix[(x % l) + l * (y % l)]) {
-				new_bits[x] = WHITE;
-			} else {
-				new_bits[x] = BLACK;
-			}
+	// expand the matrix to one threshold line per matrix row :
+	// a pixel is white when greater than the matrix value (at most 254)
+	std::vector<BYTE> thresholds(l * width);
+	for(int y = 0; y < l; y++) {
+		for(unsigned x = 0; x < width; x++) {
+			thresholds[y * width + x] = (BYTE)(matrix[(x % l) + l * y] + 1);
 		}
 	}
 
-	free(matrix);
-
-	return new_dib;
+	// perform the dithering
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		std::vector<BYTE> buffer(width);
+		for(unsigned y = first_row; y < last_row; y++) {
+			ThresholdLine(FreeImage_GetScanLine(new_dib, y), input.GetLine(y, &buffer[0]), &thresholds[(y % l) * width], width);
+		}
+	});
 }
 
 // ==========================================================
@@ -207,7 +381,7 @@ static FIBITMAP* OrderedDispersedDot(FIBITMAP *dib, int order) {
 // See also : The newsprint web site at http://www.cl.cam.ac.uk/~and1000/newsprint/
 // for more technical info on this dithering technique
 //
-static FIBITMAP* OrderedClusteredDot(FIBITMAP *dib, int order) {
+static void OrderedClusteredDot(const GreyScanLines& input, FIBITMAP *new_dib, int order) {
 	// Order-3 clustered dithering matrix.
 	int cluster3[] = {
 	  9,11,10, 8, 6, 7,
@@ -250,16 +424,8 @@ static FIBITMAP* OrderedClusteredDot(FIBITMAP *dib, int order) {
 	   62, 55, 47, 37, 36, 46, 54, 61, 65, 72, 80, 90, 91, 81, 73, 66
 	};
 
-	int x, y, pixel;
-	int width, height;
-	BYTE *bits, *new_bits;
-	FIBITMAP *new_dib = NULL;
-
-	// allocate a 8-bit DIB
-	width = FreeImage_GetWidth(dib);
-	height = FreeImage_GetHeight(dib);
-	new_dib = FreeImage_Allocate(width, height, 8);
-	if(NULL == new_dib) return NULL;
+	const unsigned width = FreeImage_GetWidth(new_dib);
+	const unsigned height = FreeImage_GetHeight(new_dib);
 
 	// select the dithering matrix
 	int *matrix = NULL;
@@ -274,119 +440,137 @@ static FIBITMAP* OrderedClusteredDot(FIBITMAP *dib, int order) {
 			matrix = &cluster8[0];
 			break;
 		default:
-			return NULL;
+			return;
 	}
 
 	// scale the dithering matrix
 	int l = 2 * order;
 	int scale = 256 / (l * order);
-	for(y = 0; y < l; y++) {
-		for(x = 0; x < l; x++) {
+	for(int y = 0; y < l; y++) {
+		for(int x = 0; x < l; x++) {
 			matrix[y*l + x] *= scale;
 		}
 	}
 
+	// expand the matrix to one threshold line per matrix row
+	std::vector<BYTE> thresholds(l * width);
+	for(int y = 0; y < l; y++) {
+		for(unsigned x = 0; x < width; x++) {
+			thresholds[y * width + x] = (BYTE)matrix[y + l * (x % l)];
+		}
+	}
+
 	// perform the dithering
-	for(y = 0; y < height; y++) {
-		// scan left to right
-		bits = FreeImage_GetScanLine(dib, y);
-		new_bits = FreeImage_GetScanLine(new_dib, y);
-		for(x = 0; x < width; x++) {
-			pixel = bits[x];
-			if(pixel >= matrix[(y % l) + l * (x % l)]) {
-				new_bits[x] = WHITE;
-			} else {
-				new_bits[x] = BLACK;
-			}
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		std::vector<BYTE> buffer(width);
+		for(unsigned y = first_row; y < last_row; y++) {
+			ThresholdLine(FreeImage_GetScanLine(new_dib, y), input.GetLine(y, &buffer[0]), &thresholds[(y % l) * width], width);
 		}
+	});
+}
+
+// ==========================================================
+// Monochrome conversion helpers
+//
+
+/**
+Clone a 1-bit dib, with a monochrome palette if needed
+*/
+static FIBITMAP* CloneMonochrome(FIBITMAP *dib) {
+	FIBITMAP *new_dib = FreeImage_Clone(dib);
+	if(NULL == new_dib) return NULL;
+	if(FreeImage_GetColorType(new_dib) == FIC_PALETTE) {
+		// Build a monochrome palette
+		RGBQUAD *pal = FreeImage_GetPalette(new_dib);
+		pal[0].rgbRed = pal[0].rgbGreen = pal[0].rgbBlue = 0;
+		pal[1].rgbRed = pal[1].rgbGreen = pal[1].rgbBlue = 255;
 	}
+	return new_dib;
+}
 
+/**
+Allocate a 1-bit dib with a monochrome palette, with the size of dib
+*/
+static FIBITMAP* AllocateMonochrome(FIBITMAP *dib) {
+	FIBITMAP *new_dib = FreeImage_Allocate(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), 1);
+	if(NULL == new_dib) return NULL;
+	// Build a monochrome palette
+	RGBQUAD *pal = FreeImage_GetPalette(new_dib);
+	pal[0].rgbRed = pal[0].rgbGreen = pal[0].rgbBlue = 0;
+	pal[1].rgbRed = pal[1].rgbGreen = pal[1].rgbBlue = 255;
 	return new_dib;
 }
 
+/**
+Check that a dib can be read as 8-bit greyscale
+*/
+static BOOL IsGreyscaleInput(FIBITMAP *dib) {
+	switch(FreeImage_GetBPP(dib)) {
+		case 4:
+		case 8:
+		case 16:
+		case 24:
+		case 32:
+			return TRUE;
+	}
+	return FALSE;
+}
 
 // ==========================================================
 // Halftoning function
 //
 FIBITMAP * DLL_CALLCONV
 FreeImage_Dither(FIBITMAP *dib, FREE_IMAGE_DITHER algorithm) {
-	FIBITMAP *input = NULL, *dib8 = NULL;
-
 	if(!FreeImage_HasPixels(dib)) return NULL;
 
-	const unsigned bpp = FreeImage_GetBPP(dib);
-
-	if(bpp == 1) {
+	if(FreeImage_GetBPP(dib) == 1) {
 		// Just clone the dib and adjust the palette if needed
-		FIBITMAP *new_dib = FreeImage_Clone(dib);
-		if(NULL == new_dib) return NULL;
-		if(FreeImage_GetColorType(new_dib) == FIC_PALETTE) {
-			// Build a monochrome palette
-			RGBQUAD *pal = FreeImage_GetPalette(new_dib);
-			pal[0].rgbRed = pal[0].rgbGreen = pal[0].rgbBlue = 0;
-			pal[1].rgbRed = pal[1].rgbGreen = pal[1].rgbBlue = 255;
-		}
-		return new_dib;
+		return CloneMonochrome(dib);
 	}
 
-	// Convert the input dib to a 8-bit greyscale dib
-	//
-	switch(bpp) {
-		case 8:
-			if(FreeImage_GetColorType(dib) == FIC_MINISBLACK) {
-				input = dib;
-			} else {
-				input = FreeImage_ConvertToGreyscale(dib);
-			} 
-			break;
-		case 4:
-		case 16:
-		case 24:
-		case 32:
-			input = FreeImage_ConvertToGreyscale(dib);
-			break;			
-	}
-	if(NULL == input) return NULL;
+	// Read the input dib as 8-bit greyscale
+	if(!IsGreyscaleInput(dib)) return NULL;
 
-	// Apply the dithering algorithm
-	switch(algorithm) {
-		case FID_FS:
-			dib8 = FloydSteinberg(input);
-			break;
-		case FID_BAYER4x4:
-			dib8 = OrderedDispersedDot(input, 2);
-			break;
-		case FID_BAYER8x8:
-			dib8 = OrderedDispersedDot(input, 3);
-			break;
-		case FID_BAYER16x16:
-			dib8 = OrderedDispersedDot(input, 4);
-			break;
-		case FID_CLUSTER6x6:
-			dib8 = OrderedClusteredDot(input, 3);
-			break;
-		case FID_CLUSTER8x8:
-			dib8 = OrderedClusteredDot(input, 4);
-			break;
-		case FID_CLUSTER16x16:
-			dib8 = OrderedClusteredDot(input, 8);
-			break;
-	}
-	if(input != dib) {
-		FreeImage_Unload(input);
-	}
+	FIBITMAP *new_dib = NULL;
 
-	// Build a greyscale palette (needed by threshold)
-	RGBQUAD *grey_pal = FreeImage_GetPalette(dib8);
-	for(int i = 0; i < 256; i++) {
-		grey_pal[i].rgbRed	= (BYTE)i;
-		grey_pal[i].rgbGreen = (BYTE)i;
-		grey_pal[i].rgbBlue	= (BYTE)i;
-	}
+	try {
+		const GreyScanLines input(dib);
+		if(!input.IsValid()) return NULL;
+
+		new_dib = AllocateMonochrome(dib);
+		if(NULL == new_dib) return NULL;
 
-	// Convert to 1-bit
-	FIBITMAP *new_dib = FreeImage_Threshold(dib8, 128);
-	FreeImage_Unload(dib8);
+		// Apply the dithering algorithm, straight to 1-bit
+		switch(algorithm) {
+			case FID_FS:
+				FloydSteinberg(input, new_dib);
+				break;
+			case FID_BAYER4x4:
+				OrderedDispersedDot(input, new_dib, 2);
+				break;
+			case FID_BAYER8x8:
+				OrderedDispersedDot(input, new_dib, 3);
+				break;
+			case FID_BAYER16x16:
+				OrderedDispersedDot(input, new_dib, 4);
+				break;
+			case FID_CLUSTER6x6:
+				OrderedClusteredDot(input, new_dib, 3);
+				break;
+			case FID_CLUSTER8x8:
+				OrderedClusteredDot(input, new_dib, 4);
+				break;
+			case FID_CLUSTER16x16:
+				OrderedClusteredDot(input, new_dib, 8);
+				break;
+			default:
+				FreeImage_Unload(new_dib);
+				return NULL;
+		}
+	} catch(std::bad_alloc &) {
+		FreeImage_Unload(new_dib);
+		return NULL;
+	}
 
 	// copy metadata from src to dst
 	FreeImage_CloneMetadata(new_dib, dib);
@@ -399,71 +583,41 @@ FreeImage_Dither(FIBITMAP *dib, FREE_IMAGE_DITHER algorithm) {
 //
 FIBITMAP * DLL_CALLCONV
 FreeImage_Threshold(FIBITMAP *dib, BYTE T) {
-	FIBITMAP *dib8 = NULL;
-
 	if(!FreeImage_HasPixels(dib)) return NULL;
 
-	const unsigned bpp = FreeImage_GetBPP(dib);
-
-	if(bpp == 1) {
+	if(FreeImage_GetBPP(dib) == 1) {
 		// Just clone the dib and adjust the palette if needed
-		FIBITMAP *new_dib = FreeImage_Clone(dib);
-		if(NULL == new_dib) return NULL;
-		if(FreeImage_GetColorType(new_dib) == FIC_PALETTE) {
-			// Build a monochrome palette
-			RGBQUAD *pal = FreeImage_GetPalette(new_dib);
-			pal[0].rgbRed = pal[0].rgbGreen = pal[0].rgbBlue = 0;
-			pal[1].rgbRed = pal[1].rgbGreen = pal[1].rgbBlue = 255;
-		}
-		return new_dib;
+		return CloneMonochrome(dib);
 	}
 
-	// Convert the input dib to a 8-bit greyscale dib
-	//
-	switch(bpp) {
-		case 8:
-			if(FreeImage_GetColorType(dib) == FIC_MINISBLACK) {
-				dib8 = dib;
-			} else {
-				dib8 = FreeImage_ConvertToGreyscale(dib);
-			} 
-			break;
-		case 4:
-		case 16:
-		case 24:
-		case 32:
-			dib8 = FreeImage_ConvertToGreyscale(dib);
-			break;			
-	}
-	if(NULL == dib8) return NULL;
+	// Read the input dib as 8-bit greyscale
+	if(!IsGreyscaleInput(dib)) return NULL;
 
-	// Allocate a new 1-bit DIB
-	int width = FreeImage_GetWidth(dib);
-	int height = FreeImage_GetHeight(dib);
-	FIBITMAP *new_dib = FreeImage_Allocate(width, height, 1);
-	if(NULL == new_dib) return NULL;
-	// Build a monochrome palette
-	RGBQUAD *pal = FreeImage_GetPalette(new_dib);
-	pal[0].rgbRed = pal[0].rgbGreen = pal[0].rgbBlue = 0;
-	pal[1].rgbRed = pal[1].rgbGreen = pal[1].rgbBlue = 255;
+	FIBITMAP *new_dib = NULL;
+
+	try {
+		const GreyScanLines input(dib);
+		if(!input.IsValid()) return NULL;
+
+		// Allocate a new 1-bit DIB
+		new_dib = AllocateMonochrome(dib);
+		if(NULL == new_dib) return NULL;
 
-	// Perform the thresholding
-	//
-	for(int y = 0; y < height; y++) {
-		BYTE *bits8 = FreeImage_GetScanLine(dib8, y);
-		BYTE *bits1 = FreeImage_GetScanLine(new_dib, y);
-		for(int x = 0; x < width; x++) {
-			if(bits8[x] < T) {
-				// Set bit(x, y) to 0
-				bits1[x >> 3] &= (0xFF7F >> (x & 0x7));
-			} else {
-				// Set bit(x, y) to 1
-				bits1[x >> 3] |= (0x80 >> (x & 0x7));
+		// Perform the thresholding
+		//
+		const unsigned width = FreeImage_GetWidth(dib);
+		const unsigned height = FreeImage_GetHeight(dib);
+		const std::vector<BYTE> threshold(width, T);
+
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			std::vector<BYTE> buffer(width);
+			for(unsigned y = first_row; y < last_row; y++) {
+				ThresholdLine(FreeImage_GetScanLine(new_dib, y), input.GetLine(y, &buffer[0]), &threshold[0], width);
 			}
-		}
-	}
-	if(dib8 != dib) {
-		FreeImage_Unload(dib8);
+		});
+	} catch(std::bad_alloc &) {
+		FreeImage_Unload(new_dib);
+		return NULL;
 	}
 
 	// copy metadata from src to dst
@@ -472,3 +626,81 @@ FreeImage_Threshold(FIBITMAP *dib, BYTE T) {
 	return new_dib;
 }
 
+// ==========================================================
+// Color error diffusion
+//
+
+/**
+Map a 24-bit or 32-bit image to a palette, with a Floyd & Steinberg diffusion of the color error. 
+The rows are processed in parallel as a wavefront.
+@param dib Input 24-bit or 32-bit image
+@param palette Palette to map to
+@param PaletteSize Number of palette entries, in [1..256]
+@return Returns a 8-bit image using the palette if successful, NULL otherwise
+@see FreeImage_ColorQuantizeEx
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_DitherToPalette(FIBITMAP *dib, RGBQUAD *palette, int PaletteSize) {
+	if(!FreeImage_HasPixels(dib) || !palette || (PaletteSize < 1) || (PaletteSize > 256)) return NULL;
+
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	if((FreeImage_GetImageType(dib) != FIT_BITMAP) || ((bpp != 24) && (bpp != 32))) return NULL;
+
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bytespp = bpp / 8;
+
+	FIBITMAP *new_dib = FreeImage_Allocate(width, height, 8);
+	if(NULL == new_dib) return NULL;
+	memcpy(FreeImage_GetPalette(new_dib), palette, PaletteSize * sizeof(RGBQUAD));
+
+	try {
+		const NearestColorMap map(palette, PaletteSize);
+		RowWavefront wavefront(width, height, 0);
+		const unsigned slot_count = wavefront.GetSlotCount();
+
+		// RGB errors of a row, with a zero pixel on each side. 
+		// Row y uses slot (y + 1), the zero slot 0 is the previous row of row 0
+		const unsigned stride = 3 * (width + 2);
+		std::vector<int> errors(slot_count * stride, 0);
+
+		wavefront.Run([&](unsigned y, unsigned) {
+			const BYTE *bits = FreeImage_GetScanLine(dib, y);
+			BYTE *new_bits = FreeImage_GetScanLine(new_dib, y);
+			const int *lerr = &errors[(y % slot_count) * stride] + 3;
+			int *cerr = &errors[((y + 1) % slot_count) * stride] + 3;
+
+			cerr[-3] = cerr[-2] = cerr[-1] = 0;
+			cerr[3 * width] = cerr[3 * width + 1] = cerr[3 * width + 2] = 0;
+
+			for(unsigned x = 0; x < width; ) {
+				const unsigned end = wavefront.GetBlockEnd(x, width);
+				wavefront.Wait(y, end + 1);
+				for(; x < end; x++) {
+					const BYTE *pixel = bits + x * bytespp;
+					const int source[3] = { pixel[FI_RGBA_RED], pixel[FI_RGBA_GREEN], pixel[FI_RGBA_BLUE] };
+					int value[3];
+					for(int c = 0; c < 3; c++) {
+						const int k = 3 * x + c;
+						const int error = (lerr[k - 3] + 5 * lerr[k] + 3 * lerr[k + 3] + 7 * cerr[k - 3]) / 16;
+						value[c] = CLAMP(source[c] + error, 0, 255);
+					}
+					const BYTE index = map.GetIndex((BYTE)value[0], (BYTE)value[1], (BYTE)value[2]);
+					new_bits[x] = index;
+					cerr[3 * x] = value[0] - palette[index].rgbRed;
+					cerr[3 * x + 1] = value[1] - palette[index].rgbGreen;
+					cerr[3 * x + 2] = value[2] - palette[index].rgbBlue;
+				}
+				wavefront.Done(y, x);
+			}
+		});
+	} catch(std::bad_alloc &) {
+		FreeImage_Unload(new_dib);
+		return NULL;
+	}
+
+	// copy metadata from src to dst
+	FreeImage_CloneMetadata(new_dib, dib);
+
+	return new_dib;
+}
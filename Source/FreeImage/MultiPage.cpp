@@ -143,6 +143,17 @@ ReplaceExtension(std::string& dst_filename, const std::string& src_filename, con
 	}
 }
 
+/**
+Get the save flags used to store a page in the cache
+@param cache_fif Format used by the cache
+@return Returns flags ensuring a lossless compression, keeping the animation parameters of the page
+*/
+inline int
+GetCacheSaveFlags(FREE_IMAGE_FORMAT cache_fif) {
+	// default WebP compression is lossy
+	return (cache_fif == FIF_WEBP) ? (WEBP_LOSSLESS | WEBP_ANIMATION_FRAME) : 0;
+}
+
 } //< ns
 
 
@@ -593,7 +604,7 @@ FreeImage_SavePageToBlock(MULTIBITMAPHEADER *header, FIBITMAP *data) {
 		return res;
 	}
 	// save the file to memory
-	if(!FreeImage_SaveToMemory(header->cache_fif, data, hmem, 0)) {
+	if(!FreeImage_SaveToMemory(header->cache_fif, data, hmem, GetCacheSaveFlags(header->cache_fif))) {
 		FreeImage_CloseMemory(hmem);
 		return res;
 	}
@@ -751,7 +762,7 @@ FreeImage_UnlockPage(FIMULTIBITMAP *bitmap, FIBITMAP *page, BOOL changed) {
 				// open a memory handle
 				FIMEMORY *hmem = FreeImage_OpenMemory();
 				// save the page to memory
-				FreeImage_SaveToMemory(header->cache_fif, page, hmem, 0);
+				FreeImage_SaveToMemory(header->cache_fif, page, hmem, GetCacheSaveFlags(header->cache_fif));
 				// get the buffer from the memory stream
 				FreeImage_AcquireMemory(hmem, &compressed_data, &compressed_size);
 
@@ -0,0 +1,128 @@
+// ==========================================================
+// NearestColorMap class implementation
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "Quantizers.h"
+#include "FreeImage.h"
+#include "Utilities.h"
+
+/**
+ * Squared distances between the palette components and the cells of one axis.
+ * @param component the palette components
+ * @param size the number of palette entries
+ * @param cell_shift the size of a cell, as a shift of the 8-bit components
+ * @param near receives the distance of entry e to the nearest value of cell c at [c * 256 + e]
+ * @param far receives the distance of entry e to the farthest value of cell c at [c * 256 + e]
+ */
+static void
+AxisDistances(const int *component, int size, int cell_shift, int *near, int *far) {
+	const int cell_count = 256 >> cell_shift;
+	for (int c = 0; c < cell_count; ++c) {
+		const int lo = c << cell_shift;
+		const int hi = lo + (1 << cell_shift) - 1;
+		for (int e = 0; e < size; ++e) {
+			const int v = component[e];
+			const int d_near = (v < lo) ? (lo - v) : ((v > hi) ? (v - hi) : 0);
+			const int d_far = MAX(v - lo, hi - v);
+			near[c * 256 + e] = d_near * d_near;
+			far[c * 256 + e] = d_far * d_far;
+		}
+	}
+}
+
+NearestColorMap::NearestColorMap(const RGBQUAD *palette, int size) {
+	for (int e = 0; e < size; ++e) {
+		m_red[e] = palette[e].rgbRed;
+		m_green[e] = palette[e].rgbGreen;
+		m_blue[e] = palette[e].rgbBlue;
+	}
+
+	std::vector<int> near_r(GRID_SIZE * 256), far_r(GRID_SIZE * 256);
+	std::vector<int> near_g(GRID_SIZE * 256), far_g(GRID_SIZE * 256);
+	std::vector<int> near_b(GRID_SIZE * 256), far_b(GRID_SIZE * 256);
+	AxisDistances(m_red, size, CELL_SHIFT, &near_r[0], &far_r[0]);
+	AxisDistances(m_green, size, CELL_SHIFT, &near_g[0], &far_g[0]);
+	AxisDistances(m_blue, size, CELL_SHIFT, &near_b[0], &far_b[0]);
+
+	m_first.resize(GRID_SIZE * GRID_SIZE * GRID_SIZE + 1);
+	m_candidates.reserve(GRID_SIZE * GRID_SIZE * GRID_SIZE * 8);
+
+	unsigned cell = 0;
+	for (int r = 0; r < GRID_SIZE; ++r) {
+		for (int g = 0; g < GRID_SIZE; ++g) {
+			for (int b = 0; b < GRID_SIZE; ++b, ++cell) {
+				const int *nr = &near_r[r * 256], *ng = &near_g[g * 256], *nb = &near_b[b * 256];
+				const int *fr = &far_r[r * 256], *fg = &far_g[g * 256], *fb = &far_b[b * 256];
+
+				// any color of the cell is at most at 'bound' from some entry
+				int bound = fr[0] + fg[0] + fb[0];
+				for (int e = 1; e < size; ++e) {
+					bound = MIN(bound, fr[e] + fg[e] + fb[e]);
+				}
+
+				m_first[cell] = (unsigned)m_candidates.size();
+				for (int e = 0; e < size; ++e) {
+					if (nr[e] + ng[e] + nb[e] <= bound) {
+						m_candidates.push_back((BYTE)e);
+					}
+				}
+			}
+		}
+	}
+	m_first[cell] = (unsigned)m_candidates.size();
+}
+
+BYTE NearestColorMap::GetIndex(BYTE red, BYTE green, BYTE blue) const {
+	const unsigned cell = (((red >> CELL_SHIFT) * GRID_SIZE) + (green >> CELL_SHIFT)) * GRID_SIZE + (blue >> CELL_SHIFT);
+	const BYTE *candidate = &m_candidates[m_first[cell]];
+	const BYTE *last = &m_candidates[0] + m_first[cell + 1];
+
+	BYTE best = *candidate;
+	int best_distance = INT_MAX;
+	for (; candidate < last; ++candidate) {
+		const int e = *candidate;
+		const int dr = m_red[e] - red;
+		const int dg = m_green[e] - green;
+		const int db = m_blue[e] - blue;
+		const int distance = dr * dr + dg * dg + db * db;
+		if (distance < best_distance) {
+			best_distance = distance;
+			best = (BYTE)e;
+		}
+	}
+	return best;
+}
+
+void NearestColorMap::MapLine(BYTE *target, const BYTE *source, unsigned width, unsigned bytespp) const {
+	if (width == 0) {
+		return;
+	}
+	// neighbour pixels often have the same color
+	BYTE last_red = source[FI_RGBA_RED], last_green = source[FI_RGBA_GREEN], last_blue = source[FI_RGBA_BLUE];
+	BYTE last_index = GetIndex(last_red, last_green, last_blue);
+	for (unsigned x = 0; x < width; ++x) {
+		const BYTE red = source[FI_RGBA_RED], green = source[FI_RGBA_GREEN], blue = source[FI_RGBA_BLUE];
+		if ((red != last_red) || (green != last_green) || (blue != last_blue)) {
+			last_red = red;
+			last_green = green;
+			last_blue = blue;
+			last_index = GetIndex(red, green, blue);
+		}
+		target[x] = last_index;
+		source += bytespp;
+	}
+}
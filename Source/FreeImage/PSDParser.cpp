@@ -28,6 +28,7 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "PSDParser.h"
+#include "../ThreadPool.h"
 
 #include "../Metadata/FreeImageTag.h"
 
@@ -92,6 +93,15 @@ enum {
 
 #define SAFE_DELETE_ARRAY(_p_) { if (NULL != (_p_)) { delete [] (_p_); (_p_) = NULL; } }
 
+/**
+Minimum size of the uncompressed RLE data (in bytes) for decoding it with several threads
+*/
+#define PSD_PARALLEL_MIN_BYTES	(256 * 256)
+/**
+Minimum number of RLE lines decoded by a thread
+*/
+#define PSD_LINES_PER_TASK		64
+
 // --------------------------------------------------------------------------
 
 template <int N>
@@ -160,6 +170,111 @@ psdReadSize(FreeImageIO *io, fi_handle handle, const psdHeaderInfo& header) {
 	}
 }
 
+/**
+Skip nBytes from the current position of the stream
+*/
+static bool
+psdSkip(FreeImageIO *io, fi_handle handle, UINT64 nBytes) {
+	// Hack to handle large PSB files without using fseeko().
+	if (sizeof(long) < sizeof(UINT64)) {
+		const long offset = 0x10000000;
+		while (nBytes > offset) {
+			if (io->seek_proc(handle, offset, SEEK_CUR) != 0) {
+				return false;
+			}
+			nBytes -= offset;
+		}
+	}
+	if (nBytes > 0) {
+		if (io->seek_proc(handle, (long)nBytes, SEEK_CUR) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+Move to an absolute position of the stream
+*/
+static bool
+psdSeek(FreeImageIO *io, fi_handle handle, UINT64 nPosition) {
+	if (io->seek_proc(handle, 0, SEEK_SET) != 0) {
+		return false;
+	}
+	return psdSkip(io, handle, nPosition);
+}
+
+/**
+Read nBytes from the stream. Missing bytes (truncated file) are set to zero. 
+*/
+static void
+psdReadData(FreeImageIO *io, fi_handle handle, BYTE *data, size_t nBytes) {
+	const size_t chunk = 0x10000000;
+	size_t nRead = 0;
+	while (nRead < nBytes) {
+		const unsigned count = (unsigned)MIN(chunk, nBytes - nRead);
+		const unsigned n = io->read_proc(data + nRead, 1, count, handle);
+		nRead += n;
+		if (n < count) {
+			break;
+		}
+	}
+	if (nRead < nBytes) {
+		memset(data + nRead, 0, nBytes - nRead);
+	}
+}
+
+/**
+Undo the horizontal differencing of a channel compressed with PSDP_COMPRESSION_ZIP_PREDICTION. 
+Samples are big endian. 32-bit lines are stored as 4 planes of bytes (most significant bytes first), 
+they are interleaved back into samples. 
+*/
+static void
+psdUnpredict(BYTE *data, unsigned width, unsigned height, unsigned bytes) {
+	switch (bytes) {
+		case 1:
+			for (unsigned y = 0; y < height; y++) {
+				BYTE *line = data + (size_t)y * width;
+				for (unsigned x = 1; x < width; x++) {
+					line[x] = (BYTE)(line[x] + line[x - 1]);
+				}
+			}
+			break;
+		case 2:
+			for (unsigned y = 0; y < height; y++) {
+				BYTE *line = data + (size_t)y * width * 2;
+				WORD prev = (WORD)((line[0] << 8) | line[1]);
+				for (unsigned x = 1; x < width; x++) {
+					const WORD v = (WORD)(((line[2*x] << 8) | line[2*x + 1]) + prev);
+					line[2*x] = (BYTE)(v >> 8);
+					line[2*x + 1] = (BYTE)(v & 0xFF);
+					prev = v;
+				}
+			}
+			break;
+		case 4:
+		{
+			std::vector<BYTE> samples((size_t)width * 4);
+			for (unsigned y = 0; y < height; y++) {
+				BYTE *line = data + (size_t)y * width * 4;
+				for (unsigned i = 1; i < width * 4; i++) {
+					line[i] = (BYTE)(line[i] + line[i - 1]);
+				}
+				for (unsigned x = 0; x < width; x++) {
+					samples[4*x]     = line[x];
+					samples[4*x + 1] = line[width + x];
+					samples[4*x + 2] = line[2*width + x];
+					samples[4*x + 3] = line[3*width + x];
+				}
+				if (width > 0) {
+					memcpy(line, &samples[0], (size_t)width * 4);
+				}
+			}
+		}
+		break;
+	}
+}
+
 // --------------------------------------------------------------------------
 
 template <int N>
@@ -1031,6 +1146,12 @@ BOOL invertColor(FIBITMAP* dib) {
 
 //---------------------------------------------------------------------------
 
+psdLayerRecord::psdLayerRecord() : _Top(0), _Left(0), _Bottom(0), _Right(0), _Opacity(255), _Clipping(0), _Flags(0) {
+	memcpy(_BlendMode, "norm", 4);
+}
+
+//---------------------------------------------------------------------------
+
 psdParser::psdParser() {
 	_bThumbnailFilled = false;
 	_bDisplayInfoFilled = false;
@@ -1042,6 +1163,8 @@ psdParser::psdParser() {
 	_TransparentIndex = -1;
 	_fi_flags = 0;
 	_fi_format_id = FIF_UNKNOWN;
+	_bReadLayers = false;
+	_bLayersFilled = false;
 }
 
 psdParser::~psdParser() {
@@ -1061,27 +1184,198 @@ unsigned psdParser::GetChannelOffset(FIBITMAP* bitmap, unsigned c) const {
 }
 
 bool psdParser::ReadLayerAndMaskInfoSection(FreeImageIO *io, fi_handle handle)	{
-	bool bSuccess = true;
+	const UINT64 nTotalBytes = psdReadSize(io, handle, _headerInfo);
 
-	UINT64 nTotalBytes = psdReadSize(io, handle, _headerInfo);
+	if (!_bReadLayers || nTotalBytes == 0) {
+		return psdSkip(io, handle, nTotalBytes);
+	}
 
-	// Hack to handle large PSB files without using fseeko().
-	if (sizeof(long) < sizeof(UINT64)) {
-		const long offset = 0x10000000;
-		while (nTotalBytes > offset) {
-			if (io->seek_proc(handle, offset, SEEK_CUR) != 0) {
-				bSuccess = false;
+	const UINT64 nSectionEnd = (UINT64)io->tell_proc(handle) + nTotalBytes;
+
+	const UINT64 nLayerInfoBytes = psdReadSize(io, handle, _headerInfo);
+	if (nLayerInfoBytes > 0) {
+		if (!ReadLayerInfo(io, handle, nLayerInfoBytes)) {
+			return false;
+		}
+	} else {
+		// 16- and 32-bit files store their layers as additional layer information ('Lr16', 'Lr32'), 
+		// following the global layer mask info
+		UINT64 nPosition = (UINT64)io->tell_proc(handle);
+		BYTE IntValue[4];
+		if ((nPosition + 4 <= nSectionEnd) && (io->read_proc(IntValue, sizeof(IntValue), 1, handle) == 1)) {
+			nPosition += 4 + psdGetLongValue(IntValue, sizeof(IntValue));
+		}
+		while (nPosition + 12 <= nSectionEnd) {
+			BYTE Signature[4];
+			BYTE Key[4];
+			if (!psdSeek(io, handle, nPosition)) {
+				return false;
+			}
+			if ((io->read_proc(Signature, sizeof(Signature), 1, handle) != 1) || (io->read_proc(Key, sizeof(Key), 1, handle) != 1)) {
+				return false;
+			}
+			if ((memcmp(Signature, "8BIM", 4) != 0) && (memcmp(Signature, "8B64", 4) != 0)) {
+				break;
+			}
+			// some keys have a 8-byte length in PSB files
+			static const char *psb_long_keys[] = { "LMsk", "Lr16", "Lr32", "Layr", "Mt16", "Mt32", "Mtrn", "Alph", "FMsk", "lnk2", "FEid", "FXid", "PxSD", NULL };
+			bool bLongLength = false;
+			if (_headerInfo._Version == 2) {
+				for (int i = 0; psb_long_keys[i] != NULL; i++) {
+					if (memcmp(Key, psb_long_keys[i], 4) == 0) {
+						bLongLength = true;
+						break;
+					}
+				}
+			}
+			UINT64 nLength = 0;
+			if (bLongLength) {
+				BYTE LongValue[8];
+				if (io->read_proc(LongValue, sizeof(LongValue), 1, handle) != 1) {
+					return false;
+				}
+				nLength = psdGetLongValue(LongValue, sizeof(LongValue));
+			} else {
+				if (io->read_proc(IntValue, sizeof(IntValue), 1, handle) != 1) {
+					return false;
+				}
+				nLength = psdGetLongValue(IntValue, sizeof(IntValue));
+			}
+			if ((memcmp(Key, "Lr16", 4) == 0) || (memcmp(Key, "Lr32", 4) == 0) || (memcmp(Key, "Layr", 4) == 0)) {
+				if (!ReadLayerInfo(io, handle, nLength)) {
+					return false;
+				}
 				break;
 			}
-			nTotalBytes -= offset;
+			nPosition = (UINT64)io->tell_proc(handle) + ((nLength + 3) & ~(UINT64)3);
+		}
+	}
+
+	return psdSeek(io, handle, nSectionEnd);
+}
+
+bool psdParser::ReadLayerInfo(FreeImageIO *io, fi_handle handle, UINT64 length) {
+	const UINT64 nLayerInfoEnd = (UINT64)io->tell_proc(handle) + length;
+
+	BYTE ShortValue[2];
+	if (io->read_proc(ShortValue, sizeof(ShortValue), 1, handle) != 1) {
+		return false;
+	}
+	// a negative layer count means that the first alpha channel contains the transparency data for the merged result
+	short nLayers = (short)psdGetValue(ShortValue, sizeof(ShortValue));
+	if (nLayers < 0) {
+		nLayers = -nLayers;
+	}
+
+	std::vector<psdLayerRecord> layers(nLayers);
+	for (short i = 0; i < nLayers; i++) {
+		if (!ReadLayerRecord(io, handle, layers[i])) {
+			return false;
 		}
 	}
-	if (bSuccess && nTotalBytes > 0) {
-		if (io->seek_proc(handle, (long)nTotalBytes, SEEK_CUR) != 0)
-			bSuccess = false;
+
+	// the channel image data follows the layer records, in the same order
+	UINT64 nOffset = (UINT64)io->tell_proc(handle);
+	for (short i = 0; i < nLayers; i++) {
+		std::vector<psdLayerChannel>& channels = layers[i]._ChannelInfo;
+		for (size_t c = 0; c < channels.size(); c++) {
+			channels[c]._Offset = nOffset;
+			nOffset += channels[c]._Length;
+		}
+	}
+	if (nOffset > nLayerInfoEnd) {
+		return false;
+	}
+
+	// keep the layers with pixels (layer groups have none)
+	_layers.clear();
+	for (short i = 0; i < nLayers; i++) {
+		if ((layers[i].GetWidth() > 0) && (layers[i].GetHeight() > 0)) {
+			_layers.push_back(layers[i]);
+		}
 	}
 
-	return bSuccess;
+	return true;
+}
+
+bool psdParser::ReadLayerRecord(FreeImageIO *io, fi_handle handle, psdLayerRecord& layer) {
+	BYTE IntValue[4];
+	BYTE ShortValue[2];
+
+	int rect[4];
+	for (int i = 0; i < 4; i++) {
+		if (io->read_proc(IntValue, sizeof(IntValue), 1, handle) != 1) {
+			return false;
+		}
+		rect[i] = (int)psdGetLongValue(IntValue, sizeof(IntValue));
+	}
+	layer._Top = rect[0];
+	layer._Left = rect[1];
+	layer._Bottom = rect[2];
+	layer._Right = rect[3];
+
+	if (io->read_proc(ShortValue, sizeof(ShortValue), 1, handle) != 1) {
+		return false;
+	}
+	const unsigned nChannels = psdGetValue(ShortValue, sizeof(ShortValue));
+	layer._ChannelInfo.resize(nChannels);
+	for (unsigned c = 0; c < nChannels; c++) {
+		if (io->read_proc(ShortValue, sizeof(ShortValue), 1, handle) != 1) {
+			return false;
+		}
+		layer._ChannelInfo[c]._ID = (short)psdGetValue(ShortValue, sizeof(ShortValue));
+		layer._ChannelInfo[c]._Length = psdReadSize(io, handle, _headerInfo);
+	}
+
+	BYTE Signature[4];
+	if (io->read_proc(Signature, sizeof(Signature), 1, handle) != 1) {
+		return false;
+	}
+	if (memcmp(Signature, "8BIM", 4) != 0) {
+		return false;
+	}
+	if (io->read_proc(layer._BlendMode, sizeof(layer._BlendMode), 1, handle) != 1) {
+		return false;
+	}
+
+	// opacity, clipping, flags, filler
+	BYTE Properties[4];
+	if (io->read_proc(Properties, sizeof(Properties), 1, handle) != 1) {
+		return false;
+	}
+	layer._Opacity = Properties[0];
+	layer._Clipping = Properties[1];
+	layer._Flags = Properties[2];
+
+	// extra data : layer mask data, blending ranges, layer name and additional layer information
+	if (io->read_proc(IntValue, sizeof(IntValue), 1, handle) != 1) {
+		return false;
+	}
+	const DWORD nExtraBytes = psdGetLongValue(IntValue, sizeof(IntValue));
+	const UINT64 nExtraEnd = (UINT64)io->tell_proc(handle) + nExtraBytes;
+
+	for (int i = 0; i < 2; i++) {
+		// layer mask data, then blending ranges
+		if (io->read_proc(IntValue, sizeof(IntValue), 1, handle) != 1) {
+			return false;
+		}
+		if (!psdSkip(io, handle, psdGetLongValue(IntValue, sizeof(IntValue)))) {
+			return false;
+		}
+	}
+
+	// layer name, Pascal string padded to a multiple of 4 bytes
+	BYTE nNameLength = 0;
+	if (io->read_proc(&nNameLength, 1, 1, handle) != 1) {
+		return false;
+	}
+	char Name[256];
+	if ((nNameLength > 0) && (io->read_proc(Name, nNameLength, 1, handle) != 1)) {
+		return false;
+	}
+	layer._Name.assign(Name, nNameLength);
+
+	return psdSeek(io, handle, nExtraEnd);
 }
 
 bool psdParser::ReadImageResources(FreeImageIO *io, fi_handle handle, LONG length) {
@@ -1321,9 +1615,13 @@ void psdParser::UnpackRLE(BYTE* line, const BYTE* rle_line, BYTE* line_end, unsi
 			// (len + 1) bytes of data are copied
 			++len;
 
+			// assert we don't read beyond the packed data
+			len = MIN(len, (int)srcSize);
+
 			// assert we don't write beyound eol
-			memcpy(line, rle_line, line + len > line_end ? line_end - line : len);
-			line += len;
+			const int count = MIN(len, (int)(line_end - line));
+			memcpy(line, rle_line, count);
+			line += count;
 			rle_line += len;
 			srcSize -= len;
 		}
@@ -1335,9 +1633,14 @@ void psdParser::UnpackRLE(BYTE* line, const BYTE* rle_line, BYTE* line_end, unsi
 			len ^= 0xFF; // same as (-len + 1) & 0xFF
 			len += 2;    //
 
+			if (srcSize == 0) {
+				break;
+			}
+
 			// assert we don't write beyound eol
-			memset(line, *rle_line++, line + len > line_end ? line_end - line : len);
-			line += len;
+			const int count = MIN(len, (int)(line_end - line));
+			memset(line, *rle_line++, count);
+			line += count;
 			srcSize--;
 		}
 		else if ( 128 == len ) {
@@ -1346,6 +1649,58 @@ void psdParser::UnpackRLE(BYTE* line, const BYTE* rle_line, BYTE* line_end, unsi
 	}//< rle_line
 }
 
+void psdParser::UnpackRLEPlanes(const std::vector<PSDRLEPlane>& planes, unsigned nHeight, unsigned lineSize, unsigned dstPitch, unsigned dstBpp, unsigned bytes) {
+	// lines of all planes, numbered as plane * nHeight + h
+	const size_t line_count = planes.size() * nHeight;
+	if (line_count == 0) {
+		return;
+	}
+
+	// the byte count of each compressed line is known up front, any line can be located without 
+	// decoding the previous ones : runs of consecutive lines are decoded in parallel
+	unsigned task_count = 1;
+	if (line_count * lineSize >= PSD_PARALLEL_MIN_BYTES) {
+		task_count = (unsigned)MIN<size_t>(GetParallelism(), (line_count + PSD_LINES_PER_TASK - 1) / PSD_LINES_PER_TASK);
+	}
+
+	auto unpack = [&](unsigned task) {
+		const size_t first = line_count * task / task_count;
+		const size_t last = line_count * (task + 1) / task_count;
+
+		std::vector<BYTE> line(lineSize);
+
+		// locate the first line of the run
+		size_t p = first / nHeight;
+		unsigned h = (unsigned)(first % nHeight);
+		size_t offset = 0;
+		for (unsigned k = 0; k < h; k++) {
+			offset += planes[p].lineSizes[k];
+		}
+
+		for (size_t index = first; index < last; index++) {
+			const PSDRLEPlane& plane = planes[p];
+
+			// - uncompress line, a truncated plane gives truncated lines -
+			const size_t available = (offset < plane.size) ? plane.size - offset : 0;
+			const unsigned rleLineSize = (unsigned)MIN<size_t>(plane.lineSizes[h], available);
+
+			UnpackRLE(&line[0], plane.src + offset, &line[0] + lineSize, rleLineSize);
+
+			// - write line to destination -
+			ReadImageLine(plane.dst - (size_t)h * dstPitch, &line[0], lineSize, dstBpp, bytes);//<*** flipped
+
+			offset += plane.lineSizes[h];
+			if (++h == nHeight) {
+				h = 0;
+				offset = 0;
+				p++;
+			}
+		}
+	};
+
+	ParallelRun(task_count, unpack);
+}
+
 FIBITMAP* psdParser::ReadImageData(FreeImageIO *io, fi_handle handle) {
 	if (handle == NULL) {
 		return NULL;
@@ -1527,80 +1882,48 @@ FIBITMAP* psdParser::ReadImageData(FreeImageIO *io, fi_handle handle) {
 #endif
 			}
 
-			DWORD largestRLELine = 0;
-			for(unsigned ch = 0; ch < nChannels; ++ch) {
-				for(unsigned h = 0; h < nHeight; ++h) {
-					const unsigned index = ch * nHeight + h;
+			// @todo write to extra channels
+			const unsigned nPlanes = MIN(nChannels, dstChannels);
 
-					if(largestRLELine < rleLineSizeList[index]) {
-						largestRLELine = rleLineSizeList[index];
-					}
+			// Read the RLE data of all planes at once, then uncompress the planes in parallel
+
+			std::vector<PSDRLEPlane> planes(nPlanes);
+			size_t rleDataSize = 0;
+			for (unsigned ch = 0; ch < nPlanes; ch++) {
+				planes[ch].dst = dst_first_line + GetChannelOffset(bitmap, ch) * bytes;
+				planes[ch].lineSizes = &rleLineSizeList[ch * nHeight];
+				planes[ch].size = 0;
+				for(unsigned h = 0; h < nHeight; ++h) {
+					planes[ch].size += planes[ch].lineSizes[h];
 				}
+				rleDataSize += planes[ch].size;
 			}
 
-			BYTE* rle_line_start = new (std::nothrow) BYTE[largestRLELine];
-			if(!rle_line_start) {
+			BYTE* rle_data = new (std::nothrow) BYTE[rleDataSize + 1];
+			if(!rle_data) {
 				FreeImage_Unload(bitmap);
 				SAFE_DELETE_ARRAY(line_start);
 				SAFE_DELETE_ARRAY(rleLineSizeList);
 				throw std::bad_alloc();
 			}
+			psdReadData(io, handle, rle_data, rleDataSize);
 
-			// Read the RLE data
-			for (unsigned ch = 0; ch < nChannels; ch++) {
-				if(ch >= dstChannels) {
-					// @todo write to extra channels
-					break;
-				}
-				const BYTE* const line_end = line_start + lineSize;
-
-				const unsigned channelOffset = GetChannelOffset(bitmap, ch) * bytes;
-
-				BYTE* dst_line_start = dst_first_line + channelOffset;
-				for(unsigned h = 0; h < nHeight; ++h, dst_line_start -= dstLineSize) {//<*** flipped
-					const unsigned index = ch * nHeight + h;
-
-					// - read and uncompress line -
-
-					const DWORD rleLineSize = rleLineSizeList[index];
-
-					io->read_proc(rle_line_start, rleLineSize, 1, handle);
-
-					// - write line to destination -
+			const BYTE* src = rle_data;
+			for (unsigned ch = 0; ch < nPlanes; ch++) {
+				planes[ch].src = src;
+				src += planes[ch].size;
+			}
 
-					UnpackRLE(line_start, rle_line_start, line_start + lineSize, rleLineSize);
-					ReadImageLine(dst_line_start, line_start, lineSize, dstBpp, bytes);
-				}//< h
-			}//< ch
+			UnpackRLEPlanes(planes, nHeight, lineSize, dstLineSize, dstBpp, bytes);
 
 			SAFE_DELETE_ARRAY(line_start);
 			SAFE_DELETE_ARRAY(rleLineSizeList);
-			SAFE_DELETE_ARRAY(rle_line_start);
+			SAFE_DELETE_ARRAY(rle_data);
 		}
 		break;
 
-		/*
-		 * If layer data is ever supported, do something like this:
-		 * Compressed size comes from layer info section.
-		 * Prediction means unzip, then each pixel value is a delta from the previous pixel.
-		 * Horizontally only.
-		 */
-		/*
-		case PSDP_COMPRESSION_ZIP: // ZIP without prediction
-		case PSDP_COMPRESSION_ZIP_PREDICTION: // ZIP with prediction
-			{
-				BYTE *compressed = NULL;
-				size_t compressedSize = 0;
-				BYTE *uncompressed = new (std::nothrow) BYTE[nHeight * lineSize];
-				if(!uncompressed) {
-					FreeImage_Unload(bitmap);
-					SAFE_DELETE_ARRAY(line_start);
-					throw std::bad_alloc();
-				}
-				DWORD size = FreeImage_ZLibGUnzip(uncompressed, nHeight * lineSize, compressed, compressedSize);
-			}
-			break;
-		*/
+		// PSDP_COMPRESSION_ZIP and PSDP_COMPRESSION_ZIP_PREDICTION are handled by ReadLayerChannels
+
 		default: // Unknown format
 			break;
 
@@ -1646,7 +1969,7 @@ FIBITMAP* psdParser::ReadImageData(FreeImageIO *io, fi_handle handle) {
 		}
 	}
 	else if ( mode == PSDP_LAB && !((_fi_flags & PSD_LAB) == PSD_LAB)) {
-		ConvertLABtoRGB(bitmap);
+		ConvertLABtoRGB(bitmap, (_fi_flags & PSD_LAB_EXACT) == PSD_LAB_EXACT);
 	}
 	else {
 		if (needPalette && FreeImage_GetPalette(bitmap)) {
@@ -1668,6 +1991,271 @@ FIBITMAP* psdParser::ReadImageData(FreeImageIO *io, fi_handle handle) {
 	return bitmap;
 }
 
+void psdParser::ReadLayerChannels(FreeImageIO *io, fi_handle handle, const psdLayerRecord& layer, const std::vector<short>& channelIDs, FIBITMAP *bitmap, const std::vector<unsigned>& channelOffsets) {
+	const unsigned nWidth = layer.GetWidth();
+	const unsigned nHeight = layer.GetHeight();
+	const unsigned bytes = _headerInfo._BitsPerChannel / 8;
+	const unsigned lineSize = nWidth * bytes;
+
+	const unsigned dstBpp = FreeImage_GetBPP(bitmap) / 8;
+	const unsigned dstLineSize = FreeImage_GetPitch(bitmap);
+	BYTE* const dst_first_line = FreeImage_GetScanLine(bitmap, nHeight - 1);//<*** flipped
+
+	// compressed data of each channel, RLE channels are uncompressed together
+	std::vector<std::vector<BYTE> > channelData(channelIDs.size());
+	std::vector<std::vector<DWORD> > rleLineSizeList(channelIDs.size());
+	std::vector<PSDRLEPlane> planes;
+
+	for (size_t i = 0; i < channelIDs.size(); i++) {
+		const psdLayerChannel *channel = NULL;
+		for (size_t c = 0; c < layer._ChannelInfo.size(); c++) {
+			if (layer._ChannelInfo[c]._ID == channelIDs[i]) {
+				channel = &layer._ChannelInfo[c];
+				break;
+			}
+		}
+		if (!channel || (channel->_Length < 2)) {
+			// missing channel, leave it black
+			continue;
+		}
+
+		if (!psdSeek(io, handle, channel->_Offset)) {
+			throw "Error in layer data";
+		}
+		WORD nCompression = 0;
+		if (io->read_proc(&nCompression, sizeof(nCompression), 1, handle) != 1) {
+			throw "Error in layer data";
+		}
+#ifndef FREEIMAGE_BIGENDIAN
+		SwapShort(&nCompression);
+#endif
+
+		std::vector<BYTE>& data = channelData[i];
+		data.resize((size_t)(channel->_Length - 2));
+		psdReadData(io, handle, data.data(), data.size());
+
+		BYTE* const dst_line_start = dst_first_line + channelOffsets[i];
+
+		switch (nCompression) {
+			case PSDP_COMPRESSION_NONE: // raw data
+			{
+				for (unsigned h = 0; (h < nHeight) && ((size_t)(h + 1) * lineSize <= data.size()); ++h) {
+					ReadImageLine(dst_line_start - (size_t)h * dstLineSize, &data[(size_t)h * lineSize], lineSize, dstBpp, bytes);//<*** flipped
+				}
+			}
+			break;
+
+			case PSDP_COMPRESSION_RLE: // RLE compression, preceeded by the byte count of each line
+			{
+				const unsigned nCountSize = (_headerInfo._Version == 1) ? 2 : 4;
+				const size_t nCountBytes = (size_t)nHeight * nCountSize;
+				if (data.size() < nCountBytes) {
+					throw "Error in layer data";
+				}
+				std::vector<DWORD>& lineSizes = rleLineSizeList[i];
+				lineSizes.resize(nHeight);
+				for (unsigned h = 0; h < nHeight; ++h) {
+					lineSizes[h] = (nCountSize == 2) ? psdGetValue(&data[h * 2], 2) : psdGetLongValue(&data[h * 4], 4);
+				}
+				PSDRLEPlane plane;
+				plane.dst = dst_line_start;
+				plane.src = data.data() + nCountBytes;
+				plane.size = data.size() - nCountBytes;
+				plane.lineSizes = &lineSizes[0];
+				planes.push_back(plane);
+			}
+			break;
+
+			case PSDP_COMPRESSION_ZIP: // ZIP without prediction
+			case PSDP_COMPRESSION_ZIP_PREDICTION: // ZIP with prediction
+			{
+				std::vector<BYTE> uncompressed((size_t)nHeight * lineSize);
+				if (FreeImage_ZLibUncompress(&uncompressed[0], (DWORD)uncompressed.size(), data.data(), (DWORD)data.size()) != uncompressed.size()) {
+					throw "Error in layer data";
+				}
+				if (nCompression == PSDP_COMPRESSION_ZIP_PREDICTION) {
+					psdUnpredict(&uncompressed[0], nWidth, nHeight, bytes);
+				}
+				for (unsigned h = 0; h < nHeight; ++h) {
+					ReadImageLine(dst_line_start - (size_t)h * dstLineSize, &uncompressed[(size_t)h * lineSize], lineSize, dstBpp, bytes);//<*** flipped
+				}
+			}
+			break;
+
+			default: // Unknown format
+				FreeImage_OutputMessageProc(_fi_format_id, "Unsupported compression %d", nCompression);
+				break;
+		}
+	}
+
+	UnpackRLEPlanes(planes, nHeight, lineSize, dstLineSize, dstBpp, bytes);
+}
+
+FIBITMAP* psdParser::ReadLayerData(FreeImageIO *io, fi_handle handle, const psdLayerRecord& layer) {
+	bool header_only = (_fi_flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
+
+	const unsigned nWidth = layer.GetWidth();
+	const unsigned nHeight = layer.GetHeight();
+	const unsigned depth = _headerInfo._BitsPerChannel;
+	const unsigned bytes = depth / 8;
+	const short mode = _headerInfo._ColourMode;
+
+	bool bHasAlpha = false;
+	for (size_t c = 0; c < layer._ChannelInfo.size(); c++) {
+		if (layer._ChannelInfo[c]._ID == -1) {
+			bHasAlpha = true;
+		}
+	}
+
+	unsigned nColourChannels = 0;
+	switch (mode) {
+		case PSDP_DUOTONE:
+		case PSDP_GRAYSCALE:
+			nColourChannels = 1;
+			break;
+		case PSDP_RGB:
+		case PSDP_LAB:
+			nColourChannels = 3;
+			break;
+		case PSDP_CMYK:
+			nColourChannels = 4;
+			break;
+		default:
+			throw "Unsupported color mode";
+			break;
+	}
+	if (depth != 8 && depth != 16 && depth != 32) {
+		throw "Unsupported bit depth";
+	}
+
+	// build output buffer, greyscale layers with a transparency mask are loaded as RGBA
+
+	const unsigned dstCh = bHasAlpha ? 4 : nColourChannels;
+
+	FREE_IMAGE_TYPE image_type = FIT_BITMAP;
+	if (depth == 16) {
+		image_type = (dstCh == 1) ? FIT_UINT16 : ((dstCh == 3) ? FIT_RGB16 : FIT_RGBA16);
+	} else if (depth == 32) {
+		image_type = (dstCh == 1) ? FIT_FLOAT : ((dstCh == 3) ? FIT_RGBF : FIT_RGBAF);
+	}
+	FIBITMAP *bitmap = FreeImage_AllocateHeaderT(header_only, image_type, nWidth, nHeight, depth * dstCh);
+	if (!bitmap) {
+		throw FI_MSG_ERROR_DIB_MEMORY;
+	}
+	if (header_only) {
+		return bitmap;
+	}
+
+	try {
+		// colour channels (CMYK transparency is read after the conversion to RGB)
+		std::vector<short> channelIDs;
+		std::vector<unsigned> channelOffsets;
+		for (unsigned c = 0; c < nColourChannels; c++) {
+			channelIDs.push_back((short)c);
+			channelOffsets.push_back(GetChannelOffset(bitmap, c) * bytes);
+		}
+		if (bHasAlpha && (mode != PSDP_CMYK)) {
+			channelIDs.push_back(-1);
+			channelOffsets.push_back(3 * bytes);
+		}
+		ReadLayerChannels(io, handle, layer, channelIDs, bitmap, channelOffsets);
+
+		// --- Further process the bitmap ---
+
+		if (mode == PSDP_CMYK) {
+			// CMYK values are "inverted", invert them back
+			FreeImage_Invert(bitmap);
+
+			if ((_fi_flags & PSD_CMYK) == PSD_CMYK) {
+				// keep as CMYK, the transparency mask is dropped
+			} else {
+				// convert to RGB
+				ConvertCMYKtoRGBA(bitmap);
+
+				// The ICC Profile is no longer valid
+				_iccProfile.clear();
+
+				if (bHasAlpha) {
+					channelIDs.assign(1, -1);
+					channelOffsets.assign(1, 3 * bytes);
+					ReadLayerChannels(io, handle, layer, channelIDs, bitmap, channelOffsets);
+				} else {
+					FIBITMAP* t = RemoveAlphaChannel(bitmap);
+					if (t) {
+						FreeImage_Unload(bitmap);
+						bitmap = t;
+					} // else: silently fail
+				}
+			}
+		}
+		else if (mode == PSDP_LAB && !((_fi_flags & PSD_LAB) == PSD_LAB)) {
+			ConvertLABtoRGB(bitmap, (_fi_flags & PSD_LAB_EXACT) == PSD_LAB_EXACT);
+		}
+		else if ((nColourChannels == 1) && (dstCh == 4)) {
+			// copy the grey channel to the green and blue channels
+			const unsigned dstBpp = FreeImage_GetBPP(bitmap) / 8;
+			for (unsigned y = 0; y < nHeight; y++) {
+				BYTE *pixel = FreeImage_GetScanLine(bitmap, y);
+				for (unsigned x = 0; x < nWidth; x++, pixel += dstBpp) {
+					memcpy(pixel + bytes, pixel, bytes);
+					memcpy(pixel + 2 * bytes, pixel, bytes);
+				}
+			}
+		}
+	} catch(...) {
+		FreeImage_Unload(bitmap);
+		throw;
+	}
+
+	return bitmap;
+}
+
+void psdParser::SetImageInfo(FIBITMAP *Bitmap, bool bDocumentMetadata) {
+	// set resolution info
+	unsigned res_x = 2835;	// 72 dpi
+	unsigned res_y = 2835;	// 72 dpi
+	if (_bResolutionInfoFilled) {
+		_resolutionInfo.GetResolutionInfo(res_x, res_y);
+	}
+	FreeImage_SetDotsPerMeterX(Bitmap, res_x);
+	FreeImage_SetDotsPerMeterY(Bitmap, res_y);
+
+	// set ICC profile
+	if(NULL != _iccProfile._ProfileData) {
+		FreeImage_CreateICCProfile(Bitmap, _iccProfile._ProfileData, _iccProfile._ProfileSize);
+		if ((_fi_flags & PSD_CMYK) == PSD_CMYK) {
+			short mode = _headerInfo._ColourMode;
+			if((mode == PSDP_CMYK) || (mode == PSDP_MULTICHANNEL)) {
+				FreeImage_GetICCProfile(Bitmap)->flags |= FIICC_COLOR_IS_CMYK;
+			}
+		}
+	}
+
+	if (!bDocumentMetadata) {
+		return;
+	}
+
+	// Metadata
+	if(NULL != _iptc._Data) {
+		read_iptc_profile(Bitmap, _iptc._Data, _iptc._Size);
+	}
+	if(NULL != _exif1._Data) {
+		psd_read_exif_profile(Bitmap, _exif1._Data, _exif1._Size);
+		psd_read_exif_profile_raw(Bitmap, _exif1._Data, _exif1._Size);
+	} else if(NULL != _exif3._Data) {
+		// I have not found any files with this resource.
+		// Assume that we only want one Exif resource.
+		assert(false);
+		psd_read_exif_profile(Bitmap, _exif3._Data, _exif3._Size);
+		psd_read_exif_profile_raw(Bitmap, _exif3._Data, _exif3._Size);
+	}
+
+	// XMP metadata
+	if(NULL != _xmp._Data) {
+		psd_set_xmp_profile(Bitmap, _xmp._Data, _xmp._Size);
+	}
+}
+
 bool psdParser::WriteLayerAndMaskInfoSection(FreeImageIO *io, fi_handle handle)	{
 	// Short section with no layers.
 	BYTE IntValue[4];
@@ -1968,48 +2556,99 @@ FIBITMAP* psdParser::Load(FreeImageIO *io, fi_handle handle, int s_format_id, in
 			throw("Error in Image Data");
 		}
 
-		// set resolution info
-		if(NULL != Bitmap) {
-			unsigned res_x = 2835;	// 72 dpi
-			unsigned res_y = 2835;	// 72 dpi
-			if (_bResolutionInfoFilled) {
-				_resolutionInfo.GetResolutionInfo(res_x, res_y);
-			}
-			FreeImage_SetDotsPerMeterX(Bitmap, res_x);
-			FreeImage_SetDotsPerMeterY(Bitmap, res_y);
+		// set resolution info, ICC profile and metadata
+		SetImageInfo(Bitmap, true);
+
+	} catch(const char *text) {
+		FreeImage_OutputMessageProc(s_format_id, text);
+	}
+	catch(const std::exception& e) {
+		FreeImage_OutputMessageProc(s_format_id, "%s", e.what());
+	}
+
+	return Bitmap;
+}
+
+int psdParser::ReadLayers(FreeImageIO *io, fi_handle handle, int s_format_id) {
+	if (_bLayersFilled) {
+		return (int)_layers.size();
+	}
+
+	_fi_format_id = s_format_id;
+	_bLayersFilled = true;
+
+	try {
+		if (NULL == handle) {
+			throw("Cannot open file");
 		}
 
-		// set ICC profile
-		if(NULL != _iccProfile._ProfileData) {
-			FreeImage_CreateICCProfile(Bitmap, _iccProfile._ProfileData, _iccProfile._ProfileSize);
-			if ((flags & PSD_CMYK) == PSD_CMYK) {
-				short mode = _headerInfo._ColourMode;
-				if((mode == PSDP_CMYK) || (mode == PSDP_MULTICHANNEL)) {
-					FreeImage_GetICCProfile(Bitmap)->flags |= FIICC_COLOR_IS_CMYK;
-				}
-			}
+		if (!_headerInfo.Read(io, handle)) {
+			throw("Error in header");
 		}
 
-		// Metadata
-		if(NULL != _iptc._Data) {
-			read_iptc_profile(Bitmap, _iptc._Data, _iptc._Size);
+		if (!_colourModeData.Read(io, handle)) {
+			throw("Error in ColourMode Data");
 		}
-		if(NULL != _exif1._Data) {
-			psd_read_exif_profile(Bitmap, _exif1._Data, _exif1._Size);
-			psd_read_exif_profile_raw(Bitmap, _exif1._Data, _exif1._Size);
-		} else if(NULL != _exif3._Data) {
-			// I have not found any files with this resource.
-			// Assume that we only want one Exif resource.
-			assert(false);
-			psd_read_exif_profile(Bitmap, _exif3._Data, _exif3._Size);
-			psd_read_exif_profile_raw(Bitmap, _exif3._Data, _exif3._Size);
+
+		if (!ReadImageResources(io, handle)) {
+			throw("Error in Image Resource");
 		}
 
-		// XMP metadata
-		if(NULL != _xmp._Data) {
-			psd_set_xmp_profile(Bitmap, _xmp._Data, _xmp._Size);
+		_bReadLayers = true;
+		if (!ReadLayerAndMaskInfoSection(io, handle)) {
+			throw("Error in Layer Info");
+		}
+
+	} catch(const char *text) {
+		_layers.clear();
+		FreeImage_OutputMessageProc(s_format_id, text);
+	}
+	catch(const std::exception& e) {
+		_layers.clear();
+		FreeImage_OutputMessageProc(s_format_id, "%s", e.what());
+	}
+
+	return (int)_layers.size();
+}
+
+FIBITMAP* psdParser::LoadLayer(FreeImageIO *io, fi_handle handle, int layer, int s_format_id, int flags) {
+	FIBITMAP *Bitmap = NULL;
+
+	try {
+		if ((layer < 0) || (layer >= ReadLayers(io, handle, s_format_id))) {
+			throw("Invalid layer index");
 		}
 
+		_fi_flags = flags;
+		_fi_format_id = s_format_id;
+
+		const psdLayerRecord& record = _layers[layer];
+
+		Bitmap = ReadLayerData(io, handle, record);
+
+		// set resolution info and ICC profile
+		SetImageInfo(Bitmap, false);
+
+		// layer properties
+		char value[512];
+
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.Name", record._Name.c_str());
+
+		sprintf(value, "%d", record._Left);
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.Left", value);
+
+		sprintf(value, "%d", record._Top);
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.Top", value);
+
+		sprintf(value, "%d", record._Opacity);
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.Opacity", value);
+
+		sprintf(value, "%.4s", record._BlendMode);
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.BlendMode", value);
+
+		sprintf(value, "%d", (record._Flags & 0x02) ? 0 : 1);
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, Bitmap, "Layer.Visible", value);
+
 	} catch(const char *text) {
 		FreeImage_OutputMessageProc(s_format_id, text);
 	}
@@ -282,6 +282,50 @@ public:
 	bool Write(FreeImageIO *io, fi_handle handle, int ID);
 };
 
+/**
+Table 1-13: Channel information of a layer record. 
+*/
+class psdLayerChannel {
+public:
+	short _ID;			//! Channel ID: 0 = red, 1 = green, etc.; -1 = transparency mask; -2 = user supplied layer mask; -3 = real user supplied layer mask.
+	UINT64 _Length;		//! Length of the channel image data, including the 2-byte compression method.
+	UINT64 _Offset;		//! Position of the channel image data in the stream.
+public:
+	psdLayerChannel() : _ID(0), _Length(0), _Offset(0) {}
+};
+
+/**
+Table 1-12: Layer record. 
+Only the fields used by the loader are kept, the layer pixels are read on demand. 
+*/
+class psdLayerRecord {
+public:
+	int _Top;			//! Rectangle containing the contents of the layer
+	int _Left;
+	int _Bottom;
+	int _Right;
+	std::vector<psdLayerChannel> _ChannelInfo;
+	char _BlendMode[4];	//! Blend mode key, e.g. 'norm' = normal, 'mul ' = multiply, ...
+	BYTE _Opacity;		//! 0 = transparent ... 255 = opaque
+	BYTE _Clipping;		//! 0 = base, 1 = non-base
+	BYTE _Flags;		//! bit 0 = transparency protected; bit 1 = hidden; ...
+	std::string _Name;	//! Layer name (Pascal string)
+public:
+	psdLayerRecord();
+	int GetWidth() const { return _Right - _Left; }
+	int GetHeight() const { return _Bottom - _Top; }
+};
+
+/**
+RLE compressed plane of the image data or of a layer channel
+*/
+typedef struct tagPSDRLEPlane {
+	BYTE *dst;					//! First output line of the plane
+	const BYTE *src;			//! Compressed lines
+	size_t size;				//! Size of the compressed lines, in bytes
+	const DWORD *lineSizes;		//! Byte count of each compressed line
+} PSDRLEPlane;
+
 /**
 PSD loader
 */
@@ -310,14 +354,24 @@ private:
 
 	int _fi_flags;
 	int _fi_format_id;
+
+	bool _bReadLayers;					//! Parse the layer records when reading the Layer and Mask Information section
+	bool _bLayersFilled;				//! The layer records have been read
+	std::vector<psdLayerRecord> _layers;	//! Layers with pixels, from bottom to top
 	
 private:
 	unsigned GetChannelOffset(FIBITMAP* bitmap, unsigned c) const;
-	/**	Actually ignore it */
+	/**	Read the layer records if _bReadLayers is set, skip the section otherwise */
 	bool ReadLayerAndMaskInfoSection(FreeImageIO *io, fi_handle handle);
+	bool ReadLayerInfo(FreeImageIO *io, fi_handle handle, UINT64 length);
+	bool ReadLayerRecord(FreeImageIO *io, fi_handle handle, psdLayerRecord& layer);
 	void ReadImageLine(BYTE* dst, const BYTE* src, unsigned lineSize, unsigned dstBpp, unsigned bytes);
 	void UnpackRLE(BYTE* dst, const BYTE* src, BYTE* dst_end, unsigned srcSize);
+	void UnpackRLEPlanes(const std::vector<PSDRLEPlane>& planes, unsigned nHeight, unsigned lineSize, unsigned dstPitch, unsigned dstBpp, unsigned bytes);
 	FIBITMAP* ReadImageData(FreeImageIO *io, fi_handle handle);
+	void ReadLayerChannels(FreeImageIO *io, fi_handle handle, const psdLayerRecord& layer, const std::vector<short>& channelIDs, FIBITMAP *bitmap, const std::vector<unsigned>& channelOffsets);
+	FIBITMAP* ReadLayerData(FreeImageIO *io, fi_handle handle, const psdLayerRecord& layer);
+	void SetImageInfo(FIBITMAP *bitmap, bool bDocumentMetadata);
 	bool WriteLayerAndMaskInfoSection(FreeImageIO *io, fi_handle handle);
 	void WriteImageLine(BYTE* dst, const BYTE* src, unsigned lineSize, unsigned srcBpp, unsigned bytes);
 	unsigned PackRLE(BYTE* line_start, const BYTE* src_line, unsigned srcSize);
@@ -328,6 +382,15 @@ public:
 	~psdParser();
 	FIBITMAP* Load(FreeImageIO *io, fi_handle handle, int s_format_id, int flags=0);
 	bool Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data);
+	/**
+	Read the file sections up to the layer records, without reading any pixels. 
+	@return Returns the number of layers with pixels
+	*/
+	int ReadLayers(FreeImageIO *io, fi_handle handle, int s_format_id);
+	/**
+	Load a single layer, layers are numbered from 0 (bottom layer) to ReadLayers() - 1
+	*/
+	FIBITMAP* LoadLayer(FreeImageIO *io, fi_handle handle, int layer, int s_format_id, int flags=0);
 	/** Also used by the TIFF plugin */
 	bool ReadImageResources(FreeImageIO *io, fi_handle handle, LONG length=0);
 	/** Used by the TIFF plugin */
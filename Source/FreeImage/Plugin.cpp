@@ -38,6 +38,7 @@
 #include "Utilities.h"
 #include "FreeImageIO.h"
 #include "Plugin.h"
+#include "../ThreadPool.h"
 
 #include "../Metadata/FreeImageTag.h"
 
@@ -347,6 +348,9 @@ FreeImage_DeInitialise() {
 
 	if (s_plugin_reference_count == 0) {
 		delete s_plugins;
+
+		ReleaseRAWProcessors();
+		StopParallelWorkers();
 	}
 }
 
@@ -21,6 +21,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ==========================================================
 // Plugin Interface
@@ -48,6 +49,15 @@ static int s_format_id;
 #define RGBE_DATA_GREEN  1
 #define RGBE_DATA_BLUE   2
 
+// size of the buffer used when reading pixels
+#define RGBE_READ_BUFFER_SIZE	0x10000
+
+// number of scanlines encoded by an encoding task
+#define RGBE_ROWS_PER_TASK		16
+
+// minimum image size (in pixels) for which scanlines are encoded in parallel
+#define RGBE_PARALLEL_MIN_PIXELS	(256 * 256)
+
 // ----------------------------------------------------------
 #ifdef _WIN32
 #pragma pack(push, 1)
@@ -76,21 +86,120 @@ typedef enum {
 	rgbe_memory_error
 } rgbe_error_code;
 
+// ----------------------------------------------------------
+
+/**
+Table of the scale factors 2^(e - (128+8)) used to convert rgbe pixels to float pixels. 
+A zero exponent is mapped to a zero scale factor, i.e. to a black pixel. 
+*/
+class rgbeExponentTable {
+public:
+	float scale[256];
+
+	rgbeExponentTable() {
+		scale[0] = 0;
+		for(int e = 1; e < 256; e++) {
+			scale[e] = (float)ldexp(1.0, e - (int)(128+8));
+		}
+	}
+};
+
+static const rgbeExponentTable s_exponent_table;
+
+/**
+Buffered reader, used to decode the pixels without calling the I/O read function for each RLE run. 
+Unused bytes are given back to the stream when the reader is destroyed. 
+*/
+class rgbeReader {
+private:
+	FreeImageIO *_io;
+	fi_handle _handle;
+	BYTE *_buffer;
+	unsigned _start;	// position of the next byte to be read
+	unsigned _end;		// end of the valid data
+
+	/**
+	Read more data into the buffer
+	@param count Number of bytes needed
+	@return Returns TRUE if at least count bytes are available, returns FALSE otherwise
+	*/
+	BOOL fill(unsigned count) {
+		if(_start > 0) {
+			memmove(_buffer, _buffer + _start, _end - _start);
+			_end -= _start;
+			_start = 0;
+		}
+		_end += _io->read_proc(_buffer + _end, 1, RGBE_READ_BUFFER_SIZE - _end, _handle);
+		return (_end >= count) ? TRUE : FALSE;
+	}
+
+public:
+	rgbeReader(FreeImageIO *io, fi_handle handle) : _io(io), _handle(handle), _start(0), _end(0) {
+		_buffer = (BYTE*)malloc(RGBE_READ_BUFFER_SIZE * sizeof(BYTE));
+	}
+
+	~rgbeReader() {
+		if(_end > _start) {
+			_io->seek_proc(_handle, -(long)(_end - _start), SEEK_CUR);
+		}
+		free(_buffer);
+	}
+
+	BOOL isValid() const {
+		return (_buffer != NULL) ? TRUE : FALSE;
+	}
+
+	/**
+	Get the next bytes from the stream
+	@param count Number of bytes to be read, must not exceed RGBE_READ_BUFFER_SIZE
+	@return Returns a pointer to the bytes, valid until the next read, or NULL if the end of the stream was reached
+	*/
+	inline const BYTE* next(unsigned count) {
+		if((_end - _start < count) && !fill(count)) {
+			return NULL;
+		}
+		const BYTE *bytes = _buffer + _start;
+		_start += count;
+		return bytes;
+	}
+
+	/**
+	Copy the next bytes from the stream
+	@param dst Destination buffer
+	@param count Number of bytes to be read
+	@return Returns TRUE if successful, returns FALSE otherwise
+	*/
+	BOOL read(BYTE *dst, unsigned count) {
+		while(count > 0) {
+			const unsigned chunk = MIN(count, (unsigned)RGBE_READ_BUFFER_SIZE);
+			const BYTE *bytes = next(chunk);
+			if(!bytes) {
+				return FALSE;
+			}
+			memcpy(dst, bytes, chunk);
+			dst += chunk;
+			count -= chunk;
+		}
+		return TRUE;
+	}
+};
+
 // ----------------------------------------------------------
 // Prototypes
 // ----------------------------------------------------------
 
 static BOOL rgbe_Error(rgbe_error_code error_code, const char *msg);
 static BOOL rgbe_GetLine(FreeImageIO *io, fi_handle handle, char *buffer, int length);
-static inline void rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf);
-static inline void rgbe_RGBEToFloat(FIRGBF *rgbf, BYTE rgbe[4]);
+static inline void rgbe_FloatToRGBE(BYTE rgbe[4], const FIRGBF *rgbf);
+static void rgbe_RGBEToFloat(FIRGBF *data, const BYTE *rgbe, unsigned numpixels);
+static void rgbe_PlanarRGBEToFloat(FIRGBF *data, const BYTE *buffer, unsigned numpixels);
 static BOOL rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *height, rgbeHeaderInfo *header_info);
 static BOOL rgbe_WriteHeader(FreeImageIO *io, fi_handle handle, unsigned width, unsigned height, rgbeHeaderInfo *info);
-static BOOL rgbe_ReadPixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels);
-static BOOL rgbe_WritePixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels);
-static BOOL rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanline_width, unsigned num_scanlines);
-static BOOL rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes);
-static BOOL rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, unsigned num_scanlines);
+static BOOL rgbe_ReadPixels(rgbeReader& reader, FIRGBF *data, unsigned numpixels, BYTE *buffer);
+static BOOL rgbe_ReadPixels_RLE(rgbeReader& reader, FIRGBF *data, int scanline_width, BYTE *buffer);
+static unsigned rgbe_EncodeBytes_RLE(const BYTE *data, int numbytes, BYTE *output);
+static unsigned rgbe_EncodeScanline(const FIRGBF *data, unsigned scanline_width, BYTE *buffer, BYTE *output);
+static BOOL rgbe_WriteScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *dib);
 static BOOL rgbe_ReadMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info);
 static BOOL rgbe_WriteMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info);
 
@@ -140,10 +249,11 @@ rgbe_GetLine(FreeImageIO *io, fi_handle handle, char *buffer, int length) {
 
 /**
 Standard conversion from float pixels to rgbe pixels. 
-Note: you can remove the "inline"s if your compiler complains about it 
+The exponent is read from the bits of the largest component, which is a normal float 
+whenever the pixel is not black. This gives the same result as using frexp. 
 */
 static inline void 
-rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf) {
+rgbe_FloatToRGBE(BYTE rgbe[4], const FIRGBF *rgbf) {
 	float v = rgbf->red;
 	if (rgbf->green > v) {
 		v = rgbf->green;
@@ -155,8 +265,16 @@ rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf) {
 		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
 	}
 	else {
-		int e;
-		v = (float)(frexp(v, &e) * 256.0 / v);
+		union {
+			float f;
+			DWORD i;
+		} bits;
+		// v = m * 2^e with m in [0.5, 1)
+		bits.f = v;
+		const int e = (int)((bits.i >> 23) & 0xFF) - 126;
+		// scale the components by 2^(8 - e)
+		bits.i = (DWORD)(8 - e + 127) << 23;
+		v = bits.f;
 		rgbe[0] = (BYTE) (rgbf->red * v);
 		rgbe[1] = (BYTE) (rgbf->green * v);
 		rgbe[2] = (BYTE) (rgbf->blue * v);
@@ -168,17 +286,42 @@ rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf) {
 Standard conversion from rgbe to float pixels. 
 Note: Ward uses ldexp(col+0.5,exp-(128+8)). 
 However we wanted pixels in the range [0,1] to map back into the range [0,1].
+@param data Output float pixels
+@param rgbe Input rgbe pixels
+@param numpixels Number of pixels to convert
 */
-static inline void 
-rgbe_RGBEToFloat(FIRGBF *rgbf, BYTE rgbe[4]) {
-	if (rgbe[3]) {   // nonzero pixel
-		const float f = (float)(ldexp(1.0, rgbe[3] - (int)(128+8)));
-		rgbf->red   = rgbe[0] * f;
-		rgbf->green = rgbe[1] * f;
-		rgbf->blue  = rgbe[2] * f;
+static void 
+rgbe_RGBEToFloat(FIRGBF *data, const BYTE *rgbe, unsigned numpixels) {
+	const float *scale = s_exponent_table.scale;
+
+	for(unsigned x = 0; x < numpixels; x++) {
+		const float f = scale[rgbe[3]];
+		data[x].red   = rgbe[0] * f;
+		data[x].green = rgbe[1] * f;
+		data[x].blue  = rgbe[2] * f;
+		rgbe += 4;
 	}
-	else {
-		rgbf->red = rgbf->green = rgbf->blue = 0;
+}
+
+/**
+Conversion from a RLE decoded scanline to float pixels. 
+@param data Output float pixels
+@param buffer Input scanline, stored as a red, a green, a blue and an exponent plane
+@param numpixels Number of pixels to convert
+*/
+static void 
+rgbe_PlanarRGBEToFloat(FIRGBF *data, const BYTE *buffer, unsigned numpixels) {
+	const float *scale = s_exponent_table.scale;
+	const BYTE *red = buffer;
+	const BYTE *green = buffer + numpixels;
+	const BYTE *blue = buffer + 2 * numpixels;
+	const BYTE *exponent = buffer + 3 * numpixels;
+
+	for(unsigned x = 0; x < numpixels; x++) {
+		const float f = scale[exponent[x]];
+		data[x].red   = red[x] * f;
+		data[x].green = green[x] * f;
+		data[x].blue  = blue[x] * f;
 	}
 }
 
@@ -328,127 +471,91 @@ rgbe_WriteMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info) {
 
 /** 
 Simple read routine. Will not correctly handle run length encoding 
+@param reader Input stream
+@param data Output float pixels
+@param numpixels Number of pixels to read
+@param buffer Work buffer of at least 4 * numpixels bytes
 */
 static BOOL 
-rgbe_ReadPixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels) {
-  BYTE rgbe[4];
-
-  for(unsigned x = 0; x < numpixels; x++) {
-	if(io->read_proc(rgbe, 1, sizeof(rgbe), handle) < 1) {
+rgbe_ReadPixels(rgbeReader& reader, FIRGBF *data, unsigned numpixels, BYTE *buffer) {
+	if(!reader.read(buffer, 4 * numpixels)) {
 		return rgbe_Error(rgbe_read_error, NULL);
 	}
-	rgbe_RGBEToFloat(&data[x], rgbe);
-  }
+	rgbe_RGBEToFloat(data, buffer, numpixels);
 
-  return TRUE;
+	return TRUE;
 }
 
 /**
- Simple write routine that does not use run length encoding. 
- These routines can be made faster by allocating a larger buffer and
- fread-ing and fwrite-ing the data in larger chunks.
+Read a scanline, using run length decoding if the scanline is encoded
+@param reader Input stream
+@param data Output float pixels
+@param scanline_width Number of pixels in the scanline
+@param buffer Work buffer of at least 4 * scanline_width bytes
 */
 static BOOL 
-rgbe_WritePixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels) {
-  BYTE rgbe[4];
-
-  for(unsigned x = 0; x < numpixels; x++) {
-	  rgbe_FloatToRGBE(rgbe, &data[x]);
-	  if (io->write_proc(rgbe, sizeof(rgbe), 1, handle) < 1) {
-		  return rgbe_Error(rgbe_write_error, NULL);
-	  }
-  }
-
-  return TRUE;
-}
-
-static BOOL 
-rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanline_width, unsigned num_scanlines) {
-	BYTE rgbe[4], *scanline_buffer, *ptr, *ptr_end;
-	int i, count;
-	BYTE buf[2];
+rgbe_ReadPixels_RLE(rgbeReader& reader, FIRGBF *data, int scanline_width, BYTE *buffer) {
+	BYTE *ptr, *ptr_end;
+	int count;
 	
 	if ((scanline_width < 8)||(scanline_width > 0x7fff)) {
 		// run length encoding is not allowed so read flat
-		return rgbe_ReadPixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	scanline_buffer = NULL;
-	// read in each successive scanline 
-	while(num_scanlines > 0) {
-		if(io->read_proc(rgbe, 1, sizeof(rgbe), handle) < 1) {
-			free(scanline_buffer);
-			return rgbe_Error(rgbe_read_error,NULL);
-		}
-		if((rgbe[0] != 2) || (rgbe[1] != 2) || (rgbe[2] & 0x80)) {
-			// this file is not run length encoded
-			rgbe_RGBEToFloat(data, rgbe);
-			data ++;
-			free(scanline_buffer);
-			return rgbe_ReadPixels(io, handle, data, scanline_width * num_scanlines - 1);
-		}
-		if((((int)rgbe[2]) << 8 | rgbe[3]) != scanline_width) {
-			free(scanline_buffer);
-			return rgbe_Error(rgbe_format_error,"wrong scanline width");
+		return rgbe_ReadPixels(reader, data, scanline_width, buffer);
+	}
+
+	const BYTE *rgbe = reader.next(4);
+	if(!rgbe) {
+		return rgbe_Error(rgbe_read_error,NULL);
+	}
+	if((rgbe[0] != 2) || (rgbe[1] != 2) || (rgbe[2] & 0x80)) {
+		// this scanline is not run length encoded
+		memcpy(buffer, rgbe, 4);
+		if(!reader.read(buffer + 4, 4 * (scanline_width - 1))) {
+			return rgbe_Error(rgbe_read_error, NULL);
 		}
-		if(scanline_buffer == NULL) {
-			scanline_buffer = (BYTE*)malloc(sizeof(BYTE) * 4 * scanline_width);
-			if(scanline_buffer == NULL) {
-				return rgbe_Error(rgbe_memory_error, "unable to allocate buffer space");
+		rgbe_RGBEToFloat(data, buffer, scanline_width);
+		return TRUE;
+	}
+	if((((int)rgbe[2]) << 8 | rgbe[3]) != scanline_width) {
+		return rgbe_Error(rgbe_format_error,"wrong scanline width");
+	}
+	
+	ptr = &buffer[0];
+	// read each of the four channels for the scanline into the buffer
+	for(int i = 0; i < 4; i++) {
+		ptr_end = &buffer[(i+1)*scanline_width];
+		while(ptr < ptr_end) {
+			const BYTE *buf = reader.next(2);
+			if(!buf) {
+				return rgbe_Error(rgbe_read_error, NULL);
 			}
-		}
-		
-		ptr = &scanline_buffer[0];
-		// read each of the four channels for the scanline into the buffer
-		for(i = 0; i < 4; i++) {
-			ptr_end = &scanline_buffer[(i+1)*scanline_width];
-			while(ptr < ptr_end) {
-				if(io->read_proc(buf, 1, 2 * sizeof(BYTE), handle) < 1) {
-					free(scanline_buffer);
-					return rgbe_Error(rgbe_read_error, NULL);
+			if(buf[0] > 128) {
+				// a run of the same value
+				count = buf[0] - 128;
+				if(count > ptr_end - ptr) {
+					return rgbe_Error(rgbe_format_error, "bad scanline data");
 				}
-				if(buf[0] > 128) {
-					// a run of the same value
-					count = buf[0] - 128;
-					if((count == 0) || (count > ptr_end - ptr)) {
-						free(scanline_buffer);
-						return rgbe_Error(rgbe_format_error, "bad scanline data");
-					}
-					while (count-- > 0) {
-						*ptr++ = buf[1];
-					}
+				memset(ptr, buf[1], count);
+				ptr += count;
+			}
+			else {
+				// a non-run
+				count = buf[0];
+				if((count == 0) || (count > ptr_end - ptr)) {
+					return rgbe_Error(rgbe_format_error, "bad scanline data");
 				}
-				else {
-					// a non-run
-					count = buf[0];
-					if((count == 0) || (count > ptr_end - ptr)) {
-						free(scanline_buffer);
-						return rgbe_Error(rgbe_format_error, "bad scanline data");
-					}
-					*ptr++ = buf[1];
-					if(--count > 0) {
-						if(io->read_proc(ptr, 1, sizeof(BYTE) * count, handle) < 1) {
-							free(scanline_buffer);
-							return rgbe_Error(rgbe_read_error, NULL);
-						}
-						ptr += count;
+				*ptr++ = buf[1];
+				if(--count > 0) {
+					if(!reader.read(ptr, count)) {
+						return rgbe_Error(rgbe_read_error, NULL);
 					}
+					ptr += count;
 				}
 			}
 		}
-		// now convert data from buffer into floats
-		for(i = 0; i < scanline_width; i++) {
-			rgbe[0] = scanline_buffer[i];
-			rgbe[1] = scanline_buffer[i+scanline_width];
-			rgbe[2] = scanline_buffer[i+2*scanline_width];
-			rgbe[3] = scanline_buffer[i+3*scanline_width];
-			rgbe_RGBEToFloat(data, rgbe);
-			data ++;
-		}
-
-		num_scanlines--;
 	}
-
-	free(scanline_buffer);
+	// now convert data from buffer into floats
+	rgbe_PlanarRGBEToFloat(data, buffer, scanline_width);
 	
 	return TRUE;
 }
@@ -458,13 +565,16 @@ rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanlin
  Run length encoding adds considerable complexity but does 
  save some space.  For each scanline, each channel (r,g,b,e) is 
  encoded separately for better compression. 
- @return Returns TRUE if successful, returns FALSE otherwise
+ @param data Input bytes
+ @param numbytes Number of input bytes
+ @param output Output buffer, at least 2 * numbytes bytes long
+ @return Returns the number of bytes written to the output buffer
 */
-static BOOL 
-rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes) {
+static unsigned 
+rgbe_EncodeBytes_RLE(const BYTE *data, int numbytes, BYTE *output) {
 	static const int MINRUNLENGTH = 4;
 	int cur, beg_run, run_count, old_run_count, nonrun_count;
-	BYTE buf[2];
+	BYTE *out = output;
 	
 	cur = 0;
 	while(cur < numbytes) {
@@ -481,11 +591,8 @@ rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes)
 		}
 		// if data before next big run is a short run then write it as such 
 		if ((old_run_count > 1)&&(old_run_count == beg_run - cur)) {
-			buf[0] = (BYTE)(128 + old_run_count);   // write short run
-			buf[1] = data[cur];
-			if (io->write_proc(buf, 2 * sizeof(BYTE), 1, handle) < 1) {
-				return rgbe_Error(rgbe_write_error, NULL);
-			}
+			*out++ = (BYTE)(128 + old_run_count);   // write short run
+			*out++ = data[cur];
 			cur = beg_run;
 		}
 		// write out bytes until we reach the start of the next run 
@@ -494,76 +601,133 @@ rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes)
 			if (nonrun_count > 128) {
 				nonrun_count = 128;
 			}
-			buf[0] = (BYTE)nonrun_count;
-			if (io->write_proc(buf, sizeof(buf[0]), 1, handle) < 1) {
-				return rgbe_Error(rgbe_write_error, NULL);
-			}
-			if (io->write_proc(&data[cur], sizeof(data[0]) * nonrun_count, 1, handle) < 1) {
-				return rgbe_Error(rgbe_write_error, NULL);
-			}
+			*out++ = (BYTE)nonrun_count;
+			memcpy(out, &data[cur], nonrun_count);
+			out += nonrun_count;
 			cur += nonrun_count;
 		}
 		// write out next run if one was found 
 		if (run_count >= MINRUNLENGTH) {
-			buf[0] = (BYTE)(128 + run_count);
-			buf[1] = data[beg_run];
-			if (io->write_proc(buf, sizeof(buf[0]) * 2, 1, handle) < 1) {
-				return rgbe_Error(rgbe_write_error, NULL);
-			}
+			*out++ = (BYTE)(128 + run_count);
+			*out++ = data[beg_run];
 			cur += run_count;
 		}
 	}
 	
-	return TRUE;
+	return (unsigned)(out - output);
 }
 
-static BOOL 
-rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, unsigned num_scanlines) {
-	BYTE rgbe[4];
-	BYTE *buffer;
-	
+/**
+Maximum size of an encoded scanline
+@param scanline_width Number of pixels in the scanline
+@return Returns the maximum number of bytes written by rgbe_EncodeScanline
+*/
+static inline size_t 
+rgbe_MaxEncodedScanlineSize(unsigned scanline_width) {
+	// 4 bytes header, then each channel takes at most twice its size
+	return 4 + 8 * (size_t)scanline_width;
+}
+
+/**
+Encode a scanline, using run length encoding when allowed
+@param data Input float pixels
+@param scanline_width Number of pixels in the scanline
+@param buffer Work buffer of at least 4 * scanline_width bytes
+@param output Output buffer of at least rgbe_MaxEncodedScanlineSize(scanline_width) bytes
+@return Returns the number of bytes written to the output buffer
+*/
+static unsigned 
+rgbe_EncodeScanline(const FIRGBF *data, unsigned scanline_width, BYTE *buffer, BYTE *output) {
 	if ((scanline_width < 8)||(scanline_width > 0x7fff)) {
 		// run length encoding is not allowed so write flat
-		return rgbe_WritePixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	buffer = (BYTE*)malloc(sizeof(BYTE) * 4 * scanline_width);
-	if (buffer == NULL) {
-		// no buffer space so write flat 
-		return rgbe_WritePixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	while(num_scanlines-- > 0) {
-		rgbe[0] = (BYTE)2;
-		rgbe[1] = (BYTE)2;
-		rgbe[2] = (BYTE)(scanline_width >> 8);
-		rgbe[3] = (BYTE)(scanline_width & 0xFF);
-		if(io->write_proc(rgbe, sizeof(rgbe), 1, handle) < 1) {
-			free(buffer);
-			return rgbe_Error(rgbe_write_error, NULL);
-		}
 		for(unsigned x = 0; x < scanline_width; x++) {
-			rgbe_FloatToRGBE(rgbe, data);
-			buffer[x] = rgbe[0];
-			buffer[x+scanline_width] = rgbe[1];
-			buffer[x+2*scanline_width] = rgbe[2];
-			buffer[x+3*scanline_width] = rgbe[3];
-			data ++;
+			rgbe_FloatToRGBE(&output[4 * x], &data[x]);
 		}
-		// write out each of the four channels separately run length encoded
-		// first red, then green, then blue, then exponent
-		for(int i = 0; i < 4; i++) {
-			BOOL bOK = rgbe_WriteBytes_RLE(io, handle, &buffer[i*scanline_width], scanline_width);
-			if(!bOK) {
-				free(buffer);
-				return bOK;
+		return 4 * scanline_width;
+	}
+
+	output[0] = (BYTE)2;
+	output[1] = (BYTE)2;
+	output[2] = (BYTE)(scanline_width >> 8);
+	output[3] = (BYTE)(scanline_width & 0xFF);
+
+	BYTE rgbe[4];
+	for(unsigned x = 0; x < scanline_width; x++) {
+		rgbe_FloatToRGBE(rgbe, &data[x]);
+		buffer[x] = rgbe[0];
+		buffer[x+scanline_width] = rgbe[1];
+		buffer[x+2*scanline_width] = rgbe[2];
+		buffer[x+3*scanline_width] = rgbe[3];
+	}
+	// encode each of the four channels separately
+	// first red, then green, then blue, then exponent
+	unsigned size = 4;
+	for(int i = 0; i < 4; i++) {
+		size += rgbe_EncodeBytes_RLE(&buffer[i*scanline_width], scanline_width, &output[size]);
+	}
+	
+	return size;
+}
+
+/**
+Encode and write the image scanlines. 
+Scanlines are encoded independently of each other : groups of scanlines are 
+encoded in parallel by a set of tasks, then written in order to the stream. 
+@param io FreeImage IO
+@param handle FreeImage IO handle
+@param dib Input image
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+static BOOL 
+rgbe_WriteScanlines(FreeImageIO *io, fi_handle handle, FIBITMAP *dib) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const size_t max_size = rgbe_MaxEncodedScanlineSize(width);
+
+	// number of encoding tasks running in parallel
+	unsigned task_count = 1;
+	if((size_t)width * height >= RGBE_PARALLEL_MIN_PIXELS) {
+		task_count = MIN(GetParallelism(), (height + RGBE_ROWS_PER_TASK - 1) / RGBE_ROWS_PER_TASK);
+	}
+	const unsigned batch_rows = task_count * RGBE_ROWS_PER_TASK;
+
+	// work buffers and encoded scanlines of each task
+	std::vector<BYTE> buffer;
+	std::vector<BYTE> output;
+	std::vector<unsigned> output_size(batch_rows);
+	try {
+		buffer.resize(task_count * 4 * (size_t)width);
+		output.resize(batch_rows * max_size);
+	} catch(std::bad_alloc&) {
+		return rgbe_Error(rgbe_memory_error, "unable to allocate buffer space");
+	}
+
+	for(unsigned first_row = 0; first_row < height; first_row += batch_rows) {
+		// encode the scanlines [first_row + task * RGBE_ROWS_PER_TASK, first_row + (task + 1) * RGBE_ROWS_PER_TASK)
+		auto encode = [&](unsigned task) {
+			for(unsigned k = task * RGBE_ROWS_PER_TASK; k < (task + 1) * RGBE_ROWS_PER_TASK; k++) {
+				const unsigned y = first_row + k;
+				if(y >= height) {
+					break;
+				}
+				const FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
+				output_size[k] = rgbe_EncodeScanline(scanline, width, &buffer[task * 4 * (size_t)width], &output[k * max_size]);
+			}
+		};
+
+		ParallelRun(task_count, encode);
+
+		// write the encoded scanlines
+		for(unsigned k = 0; (k < batch_rows) && (first_row + k < height); k++) {
+			if(io->write_proc(&output[k * max_size], output_size[k], 1, handle) < 1) {
+				return rgbe_Error(rgbe_write_error, NULL);
 			}
 		}
 	}
-	free(buffer);
 	
 	return TRUE;
 }
 
-
 // ----------------------------------------------------------
 
 
@@ -659,15 +823,25 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		}
 
 		// read the image pixels and fill the dib
+
+		rgbeReader reader(io, handle);
+		BYTE *buffer = (BYTE*)malloc(4 * width * sizeof(BYTE));
+		if(!reader.isValid() || !buffer) {
+			free(buffer);
+			throw FI_MSG_ERROR_MEMORY;
+		}
 		
 		for(unsigned y = 0; y < height; y++) {
 			FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
-			if(!rgbe_ReadPixels_RLE(io, handle, scanline, width, 1)) {
+			if(!rgbe_ReadPixels_RLE(reader, scanline, width, buffer)) {
+				free(buffer);
 				FreeImage_Unload(dib);
 				return NULL;
 			}
 		}
 
+		free(buffer);
+
 	}
 	catch(const char *text) {
 		if(dib != NULL) {
@@ -706,14 +880,7 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 	// write each scanline
 
-	for(unsigned y = 0; y < height; y++) {
-		FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
-		if(!rgbe_WritePixels_RLE(io, handle, scanline, width, 1)) {
-			return FALSE;
-		}
-	}
-
-	return TRUE;
+	return rgbe_WriteScanlines(io, handle, dib);
 }
 
 // ==========================================================
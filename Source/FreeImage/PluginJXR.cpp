@@ -21,6 +21,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 #include "../Metadata/FreeImageTag.h"
 
 #include "../LibJXR/jxrgluelib/JXRGlue.h"
@@ -85,6 +86,14 @@ _jxr_io_EOS(WMPStream* pWS) {
     return (fileRemaining > 0);
 }
 
+/**
+EOS function used with in-memory streams, must be consistent with _jxr_io_EOS
+*/
+static Bool 
+_jxr_mem_EOS(WMPStream* pWS) {
+	return (pWS->state.buf.cbBuf > pWS->state.buf.cbCur);
+}
+
 static ERR 
 _jxr_io_Close(WMPStream** ppWS) {
 	WMPStream *pWS = *ppWS;
@@ -1008,21 +1017,52 @@ SetDecoderParameters(PKImageDecode *pDecoder, int flags) {
 }
 
 /**
-Copy or convert & copy decoded pixels into the dib
+Use the JPEG XR resolution scalability to decode a reduced size image. 
+The codec can decode an image at 1/2, 1/4, 1/8 or 1/16 of its size, 
+the largest reduction giving an image at least as large as the requested size is used. 
+@param pDecoder Decoder handle
+@param requested_size Requested image size in pixels (largest side)
+@param width [in] Image width, [out] decoded image width
+@param height [in] Image height, [out] decoded image height
+@return Returns the scale factor used by the decoder (1, 2, 4, 8 or 16)
+*/
+static int 
+SetDecoderScale(PKImageDecode *pDecoder, int requested_size, int *width, int *height) {
+	const int size = MAX(*width, *height);
+	int scale = 1;
+
+	while((scale < 16) && ((size + 2 * scale - 1) / (2 * scale) >= requested_size)) {
+		scale <<= 1;
+	}
+	if(scale > 1) {
+		*width = (*width + scale - 1) / scale;
+		*height = (*height + scale - 1) / scale;
+		// the decoder computes the scale factor from the thumbnail size
+		pDecoder->WMP.wmiI.cThumbnailWidth = *width;
+		pDecoder->WMP.wmiI.cThumbnailHeight = *height;
+	}
+
+	return scale;
+}
+
+/**
+Copy or convert & copy decoded pixels into a band of the dib. 
+Lines are stored in the usual graphic order (top-down), the dib has to be flipped afterwards. 
 @param pDecoder Decoder handle
 @param out_guid_format Target guid format
 @param dib Output dib
-@param width Image width
-@param height Image height
+@param first_line Index of the first dib line receiving the decoded pixels
+@param width Band width
+@param height Band height
 @return Returns 0 if successful, returns ERR otherwise
 */
 static ERR
-CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP *dib, int width, int height) {
+DecodeBand(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP *dib, int first_line, int width, int height) {
 	PKFormatConverter *pConverter = NULL;	// pixel format converter
 	ERR error_code = 0;	// error code as returned by the interface
 	BYTE *pb = NULL;	// local buffer used for pixel format conversion
 	
-	// image dimensions
+	// band dimensions (relative to the decoder region of interest)
 	const PKRect rect = {0, 0, width, height};
 
 	try {
@@ -1037,7 +1077,7 @@ CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP
 			// no conversion, load bytes "as is" ...
 
 			// get a pointer to dst pixel data
-			BYTE *dib_bits = FreeImage_GetBits(dib);
+			BYTE *dib_bits = FreeImage_GetScanLine(dib, first_line);
 
 			// get dst pitch (count of BYTE for stride)
 			const unsigned cbStride = FreeImage_GetPitch(dib);			
@@ -1088,7 +1128,7 @@ CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP
 			const size_t line_size = FreeImage_GetLine(dib);
 			for(int y = 0; y < height; y++) {
 				BYTE *src_bits = (BYTE*)(pb + y * cbStride);
-				BYTE *dst_bits = (BYTE*)FreeImage_GetScanLine(dib, y);
+				BYTE *dst_bits = (BYTE*)FreeImage_GetScanLine(dib, first_line + y);
 				memcpy(dst_bits, src_bits, line_size);
 			}
 			
@@ -1098,24 +1138,6 @@ CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP
 			// free the pixel format converter
 			PKFormatConverter_Release(&pConverter);
 		}
-
-		// FreeImage DIB are upside-down relative to usual graphic conventions
-		FreeImage_FlipVertical(dib);
-
-		// post-processing ...
-		// -------------------
-
-		// swap RGB as needed
-
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-		if(IsEqualGUID(out_guid_format, GUID_PKPixelFormat24bppRGB) || IsEqualGUID(out_guid_format, GUID_PKPixelFormat32bppRGB)) {
-			SwapRedBlue32(dib);
-		}
-#elif FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB
-		if(IsEqualGUID(out_guid_format, GUID_PKPixelFormat24bppBGR) || IsEqualGUID(out_guid_format, GUID_PKPixelFormat32bppBGR)) {
-			SwapRedBlue32(dib);
-		}
-#endif
 		
 		return WMP_errSuccess;
 
@@ -1129,6 +1151,189 @@ CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP
 	}
 }
 
+/**
+Post-process decoded pixels (vertical flip and RGB swapping)
+@param out_guid_format Target guid format
+@param dib Output dib
+*/
+static void 
+PostProcessPixels(PKPixelFormatGUID out_guid_format, FIBITMAP *dib) {
+	// FreeImage DIB are upside-down relative to usual graphic conventions
+	FreeImage_FlipVertical(dib);
+
+	// swap RGB as needed
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	if(IsEqualGUID(out_guid_format, GUID_PKPixelFormat24bppRGB) || IsEqualGUID(out_guid_format, GUID_PKPixelFormat32bppRGB)) {
+		SwapRedBlue32(dib);
+	}
+#elif FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_RGB
+	if(IsEqualGUID(out_guid_format, GUID_PKPixelFormat24bppBGR) || IsEqualGUID(out_guid_format, GUID_PKPixelFormat32bppBGR)) {
+		SwapRedBlue32(dib);
+	}
+#endif
+}
+
+/**
+Copy or convert & copy decoded pixels into the dib
+@param pDecoder Decoder handle
+@param out_guid_format Target guid format
+@param dib Output dib
+@param width Image width
+@param height Image height
+@return Returns 0 if successful, returns ERR otherwise
+*/
+static ERR
+CopyPixels(PKImageDecode *pDecoder, PKPixelFormatGUID out_guid_format, FIBITMAP *dib, int width, int height) {
+	ERR error_code = DecodeBand(pDecoder, out_guid_format, dib, 0, width, height);
+	if(error_code < 0) {
+		return error_code;
+	}
+
+	// post-processing ...
+	PostProcessPixels(out_guid_format, dib);
+
+	return WMP_errSuccess;
+}
+
+// --------------------------------------------------------------------------
+
+/**
+Minimum image size (in pixels) for which tiles are decoded in parallel
+*/
+static const size_t JXR_PARALLEL_MIN_PIXELS = 512 * 512;
+
+/**
+Band of tiles decoded by a worker thread
+*/
+typedef struct tagJXRBand {
+	int first_line;		//! first line of the band (top-down order)
+	int height;			//! number of lines in the band
+	ERR error_code;		//! decoding result
+} JXRBand;
+
+/**
+Decode a band of the image using a private decoder attached to an in-memory copy of the stream. 
+The band is decoded as a JPEG XR region of interest, the decoder skips the entropy decoding of 
+the tiles located outside of this region. 
+@param data In-memory copy of the JPEG XR stream
+@param size Size of the stream in bytes
+@param flags FreeImage load flags
+@param out_guid_format Target guid format
+@param dib Output dib
+@param width Image width
+@param band Band to be decoded
+@return Returns 0 if successful, returns ERR otherwise
+*/
+static ERR
+DecodeBandFromMemory(BYTE *data, size_t size, int flags, PKPixelFormatGUID out_guid_format, FIBITMAP *dib, int width, const JXRBand *band) {
+	WMPStream *pStream = NULL;		// memory stream
+	PKImageDecode *pDecoder = NULL;	// band decoder
+
+	ERR error_code = CreateWS_Memory(&pStream, data, size);
+	if(error_code < 0) {
+		return error_code;
+	}
+	pStream->EOS = _jxr_mem_EOS;
+	error_code = PKImageDecode_Create_WMP(&pDecoder);
+	if(error_code >= 0) {
+		error_code = pDecoder->Initialize(pDecoder, pStream);
+		if(error_code >= 0) {
+			SetDecoderParameters(pDecoder, flags);
+			// decode the band as a region of interest
+			pDecoder->WMP.wmiI.cROILeftX = 0;
+			pDecoder->WMP.wmiI.cROITopY = band->first_line;
+			pDecoder->WMP.wmiI.cROIWidth = width;
+			pDecoder->WMP.wmiI.cROIHeight = band->height;
+
+			error_code = DecodeBand(pDecoder, out_guid_format, dib, band->first_line, width, band->height);
+		}
+		pDecoder->Release(&pDecoder);
+	}
+	pStream->Close(&pStream);
+
+	return error_code;
+}
+
+/**
+Copy or convert & copy decoded pixels into the dib, decoding horizontal tiles in parallel. 
+Rows of tiles are independently coded, they are grouped into one band per worker thread. 
+@param io FreeImage IO
+@param handle FreeImage IO handle
+@param pDecoder Decoder handle, initialized with the image header
+@param flags FreeImage load flags
+@param out_guid_format Target guid format
+@param dib Output dib
+@param width Image width
+@param height Image height
+@return Returns 0 if successful, returns ERR otherwise
+*/
+static ERR
+CopyPixelsInParallel(FreeImageIO *io, fi_handle handle, PKImageDecode *pDecoder, int flags, PKPixelFormatGUID out_guid_format, FIBITMAP *dib, int width, int height) {
+	const CWMIStrCodecParam *wmiSCP = &pDecoder->WMP.wmiSCP;
+
+	// number of horizontal tiles
+	const int tile_rows = (int)wmiSCP->cNumOfSliceMinus1H + 1;
+	// number of bands
+	const int band_count = MIN(tile_rows, (int)GetParallelism());
+
+	if((band_count < 2) || ((size_t)width * height < JXR_PARALLEL_MIN_PIXELS) || (pDecoder->WMP.wmiI.oOrientation != O_NONE)) {
+		return CopyPixels(pDecoder, out_guid_format, dib, width, height);
+	}
+
+	// split the image along tile boundaries (given in macroblocks)
+	std::vector<JXRBand> bands;
+	for(int i = 0; i < band_count; i++) {
+		const int first_tile = (i * tile_rows) / band_count;
+		const int last_tile = ((i + 1) * tile_rows) / band_count;
+		const int first_line = MIN((int)wmiSCP->uiTileY[first_tile] * 16, height);
+		const int last_line = (last_tile < tile_rows) ? MIN((int)wmiSCP->uiTileY[last_tile] * 16, height) : height;
+		if(last_line > first_line) {
+			JXRBand band = { first_line, last_line - first_line, WMP_errSuccess };
+			bands.push_back(band);
+		}
+	}
+	if(bands.size() < 2) {
+		return CopyPixels(pDecoder, out_guid_format, dib, width, height);
+	}
+
+	// each worker needs its own stream : load the whole stream into memory
+	// (stream offsets are absolute, see _jxr_io_SetPos)
+	if(io->seek_proc(handle, 0, SEEK_END) != 0) {
+		return WMP_errFileIO;
+	}
+	const long size = io->tell_proc(handle);
+	if((size <= 0) || (io->seek_proc(handle, 0, SEEK_SET) != 0)) {
+		return WMP_errFileIO;
+	}
+	BYTE *data = (BYTE*)malloc(size * sizeof(BYTE));
+	if(!data) {
+		return WMP_errOutOfMemory;
+	}
+	if(io->read_proc(data, 1, (unsigned)size, handle) != (unsigned)size) {
+		free(data);
+		return WMP_errFileIO;
+	}
+
+	// decode the bands
+	ParallelRun((unsigned)bands.size(), [&](unsigned i) {
+		bands[i].error_code = DecodeBandFromMemory(data, (size_t)size, flags, out_guid_format, dib, width, &bands[i]);
+	});
+
+	free(data);
+
+	for(size_t i = 0; i < bands.size(); i++) {
+		if(bands[i].error_code < 0) {
+			return bands[i].error_code;
+		}
+	}
+
+	// post-processing ...
+	PostProcessPixels(out_guid_format, dib);
+
+	return WMP_errSuccess;
+}
+
 // --------------------------------------------------------------------------
 
 static FIBITMAP * DLL_CALLCONV
@@ -1173,6 +1378,13 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		// get image dimensions
 		pDecoder->GetSize(pDecoder, &width, &height);
 
+		// decode a reduced size image if requested
+		int scale = 1;
+		const int requested_size = flags >> 16;	// requested user size in pixels
+		if(requested_size > 0) {
+			scale = SetDecoderScale(pDecoder, requested_size, &width, &height);
+		}
+
 		// allocate dst image
 		{			
 			dib = FreeImage_AllocateHeaderT(header_only, image_type, width, height, bpp, red_mask, green_mask, blue_mask);
@@ -1211,7 +1423,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		}
 		
 		// copy pixels into the dib, perform pixel conversion if needed
-		error_code = CopyPixels(pDecoder, guid_format, dib, width, height);
+		if((scale == 1) && (pDecoder->WMP.wmiSCP.cNumOfSliceMinus1H > 0)) {
+			// the image is made of several rows of tiles, decode them in parallel
+			error_code = CopyPixelsInParallel(io, handle, pDecoder, flags, guid_format, dib, width, height);
+		} else {
+			error_code = CopyPixels(pDecoder, guid_format, dib, width, height);
+		}
 		JXR_CHECK(error_code);
 
 		// free the decoder
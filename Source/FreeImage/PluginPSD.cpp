@@ -106,12 +106,47 @@ SupportsNoPixels() {
 
 // ----------------------------------------------------------
 
+static void * DLL_CALLCONV
+Open(FreeImageIO *io, fi_handle handle, BOOL read) {
+	if(read) {
+		// the layer records are read on first use, see PageCount and Load
+		return new(std::nothrow) psdParser();
+	}
+	return NULL;
+}
+
+static void DLL_CALLCONV
+Close(FreeImageIO *io, fi_handle handle, void *data) {
+	psdParser *parser = (psdParser*)data;
+	delete parser;
+}
+
+/**
+Page 0 is the composite image, pages 1 to N are the layers with pixels, from bottom to top
+*/
+static int DLL_CALLCONV
+PageCount(FreeImageIO *io, fi_handle handle, void *data) {
+	psdParser *parser = (psdParser*)data;
+	if(!parser) {
+		return 1;
+	}
+	return 1 + parser->ReadLayers(io, handle, s_format_id);
+}
+
+// ----------------------------------------------------------
+
 static FIBITMAP * DLL_CALLCONV
 Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	if(!handle) {
 		return NULL;
 	}
 	try {
+		if((page > 0) && data) {
+			// a layer is decoded only when its page is requested
+			psdParser *layers = (psdParser*)data;
+			return layers->LoadLayer(io, handle, page - 1, s_format_id, flags);
+		}
+
 		psdParser parser;
 
 		FIBITMAP *dib = parser.Load(io, handle, s_format_id, flags);
@@ -154,9 +189,9 @@ InitPSD(Plugin *plugin, int format_id) {
 	plugin->description_proc = Description;
 	plugin->extension_proc = Extension;
 	plugin->regexpr_proc = NULL;
-	plugin->open_proc = NULL;
-	plugin->close_proc = NULL;
-	plugin->pagecount_proc = NULL;
+	plugin->open_proc = Open;
+	plugin->close_proc = Close;
+	plugin->pagecount_proc = PageCount;
 	plugin->pagecapability_proc = NULL;
 	plugin->load_proc = Load;
 	plugin->save_proc = Save;
@@ -34,6 +34,64 @@
 
 static int s_format_id;
 
+// ----------------------------------------------------------
+//   Plugin data
+// ----------------------------------------------------------
+
+// disposal methods, as used by the FIMD_ANIMATION "DisposalMethod" tag (see PluginGIF)
+#define WEBP_ANIM_DISPOSAL_LEAVE		1
+#define WEBP_ANIM_DISPOSAL_BACKGROUND	2
+
+// blend methods, as used by the FIMD_ANIMATION "BlendMethod" tag
+#define WEBP_ANIM_BLEND_ALPHA			0
+#define WEBP_ANIM_BLEND_NONE			1
+
+/**
+Data returned by Open and shared by the other plugin functions
+*/
+typedef struct tagWebPMuxData {
+	//! MUX object
+	WebPMux *mux;
+	//! TRUE if the MUX object was created from an input stream
+	BOOL read;
+	//! number of animation frames added to the MUX object (multi-page saving)
+	int frame_count;
+} WebPMuxData;
+
+// ----------------------------------------------------------
+//   Metadata helpers
+// ----------------------------------------------------------
+
+static BOOL 
+WebP_SetAnimationTag(FIBITMAP *dib, const char *key, WORD id, FREE_IMAGE_MDTYPE type, DWORD count, DWORD length, const void *value) {
+	BOOL bResult = FALSE;
+	FITAG *tag = FreeImage_CreateTag();
+	if(tag) {
+		FreeImage_SetTagKey(tag, key);
+		FreeImage_SetTagID(tag, id);
+		FreeImage_SetTagType(tag, type);
+		FreeImage_SetTagCount(tag, count);
+		FreeImage_SetTagLength(tag, length);
+		FreeImage_SetTagValue(tag, value);
+		// get the tag description
+		TagLib& s = TagLib::instance();
+		FreeImage_SetTagDescription(tag, s.getTagDescription(TagLib::ANIMATION, id));
+		// store the tag
+		bResult = FreeImage_SetMetadata(FIMD_ANIMATION, dib, key, tag);
+		FreeImage_DeleteTag(tag);
+	}
+	return bResult;
+}
+
+static const void * 
+WebP_GetAnimationTagValue(FIBITMAP *dib, const char *key, FREE_IMAGE_MDTYPE type) {
+	FITAG *tag = NULL;
+	if(FreeImage_GetMetadata(FIMD_ANIMATION, dib, key, &tag) && (FreeImage_GetTagType(tag) == type)) {
+		return FreeImage_GetTagValue(tag);
+	}
+	return NULL;
+}
+
 // ----------------------------------------------------------
 //   Helpers for the load function
 // ----------------------------------------------------------
@@ -191,17 +249,58 @@ Open(FreeImageIO *io, fi_handle handle, BOOL read) {
 			return NULL;
 		}
 	}
+
+	WebPMuxData *mux_data = (WebPMuxData*)malloc(sizeof(WebPMuxData));
+	if(!mux_data) {
+		WebPMuxDelete(mux);
+		return NULL;
+	}
+	mux_data->mux = mux;
+	mux_data->read = read;
+	mux_data->frame_count = 0;
 	
-	return mux;
+	return mux_data;
 }
 
 static void DLL_CALLCONV
 Close(FreeImageIO *io, fi_handle handle, void *data) {
-	WebPMux *mux = (WebPMux*)data;
+	WebPMuxData *mux_data = (WebPMuxData*)data;
+	if(mux_data == NULL) {
+		return;
+	}
+	WebPMux *mux = mux_data->mux;
+
+	if(!mux_data->read && (mux_data->frame_count > 0)) {
+		// multi-page saving : write the animation to the output stream
+		WebPData output_data = { 0 };
+		if(WebPMuxAssemble(mux, &output_data) != WEBP_MUX_OK) {
+			FreeImage_OutputMessageProc(s_format_id, "Failed to create webp output file");
+		}
+		else if(io->write_proc((void*)output_data.bytes, 1, (unsigned)output_data.size, handle) != output_data.size) {
+			FreeImage_OutputMessageProc(s_format_id, "Failed to write webp output file");
+		}
+		WebPDataClear(&output_data);
+	}
+
 	if(mux != NULL) {
 		// free the MUX object
 		WebPMuxDelete(mux);
 	}
+	free(mux_data);
+}
+
+// ----------------------------------------------------------
+
+static int DLL_CALLCONV
+PageCount(FreeImageIO *io, fi_handle handle, void *data) {
+	WebPMuxData *mux_data = (WebPMuxData*)data;
+	if(mux_data && mux_data->mux) {
+		int frame_count = 0;
+		if((WebPMuxNumChunks(mux_data->mux, WEBP_CHUNK_ANMF, &frame_count) == WEBP_MUX_OK) && (frame_count > 0)) {
+			return frame_count;
+		}
+	}
+	return 1;
 }
 
 // ----------------------------------------------------------
@@ -344,9 +443,13 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		return NULL;
 	}
 
+	if(page == -1) {
+		page = 0;
+	}
+
 	try {
 		// get the MUX object
-		mux = (WebPMux*)data;
+		mux = data ? ((WebPMuxData*)data)->mux : NULL;
 		if(!mux) {
 			throw (1);
 		}
@@ -358,8 +461,8 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			throw (1);
 		}
 
-		// get image data
-		error_status = WebPMuxGetFrame(mux, 1, &webp_frame);
+		// get image data (frames are numbered from 1)
+		error_status = WebPMuxGetFrame(mux, page + 1, &webp_frame);
 
 		if(error_status == WEBP_MUX_OK) {
 			// decode the data (can be limited to the header if flags uses FIF_LOAD_NOPIXELS)
@@ -367,6 +470,44 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			if(!dib) {
 				throw (1);
 			}
+
+			// get animation parameters
+			if(webp_flags & ANIMATION_FLAG) {
+				if(page == 0) {
+					// logical screen
+					int canvas_width = 0, canvas_height = 0;
+					if(WebPMuxGetCanvasSize(mux, &canvas_width, &canvas_height) == WEBP_MUX_OK) {
+						WORD logical_width = (WORD)canvas_width;
+						WORD logical_height = (WORD)canvas_height;
+						WebP_SetAnimationTag(dib, "LogicalWidth", ANIMTAG_LOGICALWIDTH, FIDT_SHORT, 1, 2, &logical_width);
+						WebP_SetAnimationTag(dib, "LogicalHeight", ANIMTAG_LOGICALHEIGHT, FIDT_SHORT, 1, 2, &logical_height);
+					}
+					WebPMuxAnimParams anim_params;
+					if(WebPMuxGetAnimationParams(mux, &anim_params) == WEBP_MUX_OK) {
+						// 0 means infinite looping
+						LONG loop = (LONG)anim_params.loop_count;
+						WebP_SetAnimationTag(dib, "Loop", ANIMTAG_LOOP, FIDT_LONG, 1, 4, &loop);
+						// background color is stored as [Blue, Green, Red, Alpha]
+						RGBQUAD bkcolor;
+						bkcolor.rgbBlue = (BYTE)(anim_params.bgcolor & 0xFF);
+						bkcolor.rgbGreen = (BYTE)((anim_params.bgcolor >> 8) & 0xFF);
+						bkcolor.rgbRed = (BYTE)((anim_params.bgcolor >> 16) & 0xFF);
+						bkcolor.rgbReserved = (BYTE)((anim_params.bgcolor >> 24) & 0xFF);
+						FreeImage_SetBackgroundColor(dib, &bkcolor);
+					}
+				}
+				// frame parameters
+				WORD left = (WORD)webp_frame.x_offset;
+				WORD top = (WORD)webp_frame.y_offset;
+				LONG frame_time = (LONG)webp_frame.duration;
+				BYTE disposal_method = (webp_frame.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) ? WEBP_ANIM_DISPOSAL_BACKGROUND : WEBP_ANIM_DISPOSAL_LEAVE;
+				BYTE blend_method = (webp_frame.blend_method == WEBP_MUX_NO_BLEND) ? WEBP_ANIM_BLEND_NONE : WEBP_ANIM_BLEND_ALPHA;
+				WebP_SetAnimationTag(dib, "FrameLeft", ANIMTAG_FRAMELEFT, FIDT_SHORT, 1, 2, &left);
+				WebP_SetAnimationTag(dib, "FrameTop", ANIMTAG_FRAMETOP, FIDT_SHORT, 1, 2, &top);
+				WebP_SetAnimationTag(dib, "FrameTime", ANIMTAG_FRAMETIME, FIDT_LONG, 1, 4, &frame_time);
+				WebP_SetAnimationTag(dib, "DisposalMethod", ANIMTAG_DISPOSALMETHOD, FIDT_BYTE, 1, 1, &disposal_method);
+				WebP_SetAnimationTag(dib, "BlendMethod", ANIMTAG_BLENDMETHOD, FIDT_BYTE, 1, 1, &blend_method);
+			}
 			
 			// get ICC profile
 			if(webp_flags & ICCP_FLAG) {
@@ -422,6 +563,30 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 // --------------------------------------------------------------------------
 
+/**
+Pad a frame whose offsets are odd, as the WebP container stores the frame offsets divided by 2. 
+The frame is converted to 32-bit and widened by a transparent column on the left and / or 
+a transparent row on the top, so that its offsets can be aligned down without changing the blended result 
+(a frame disposed to the background also clears the added column or row).
+@param dib The frame to pad
+@param pad_x Number of columns added on the left, 0 or 1
+@param pad_y Number of rows added on the top, 0 or 1
+@return Returns the padded frame if successful, returns NULL otherwise
+*/
+static FIBITMAP*
+PadFrame(FIBITMAP *dib, int pad_x, int pad_y) {
+	FIBITMAP *padded = FreeImage_Allocate(FreeImage_GetWidth(dib) + pad_x, FreeImage_GetHeight(dib) + pad_y, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+	if(!padded) {
+		return NULL;
+	}
+	// the allocated pixels are transparent black, the frame is copied over them
+	if(!FreeImage_Paste(padded, dib, pad_x, pad_y, 256)) {
+		FreeImage_Unload(padded);
+		return NULL;
+	}
+	return padded;
+}
+
 /**
 Encode a FIBITMAP to a WebP image
 @param hmem Memory output stream, containing on return the encoded image
@@ -471,7 +636,9 @@ EncodeImage(FIMEMORY *hmem, FIBITMAP *dib, int flags) {
 		WebPConfigInit(&config);
 
 		// quality/speed trade-off (0=fast, 6=slower-better)
-		config.method = 6;
+		config.method = ((flags & WEBP_FAST) == WEBP_FAST) ? 2 : 6;
+		// use multi-threaded encoding, if available
+		config.thread_level = 1;
 
 		if((flags & WEBP_LOSSLESS) == WEBP_LOSSLESS) {
 			// lossless encoding
@@ -567,10 +734,55 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		return FALSE;
 	}
 
+	WebPMuxData *mux_data = (WebPMuxData*)data;
+
+	// a single image with animation parameters is saved as a one-frame animation when asked to
+	// (this keeps these parameters when the image is cached by the multi-page API)
+	const BOOL single_image = (page == -1);
+	if(single_image && ((flags & WEBP_ANIMATION_FRAME) == WEBP_ANIMATION_FRAME) && (FreeImage_GetMetadataCount(FIMD_ANIMATION, dib) > 0)) {
+		page = 0;
+	}
+
+	// animation frame parameters
+	WebPMuxFrameInfo webp_frame;
+	memset(&webp_frame, 0, sizeof(WebPMuxFrameInfo));
+	webp_frame.id = WEBP_CHUNK_ANMF;
+	webp_frame.duration = 100;
+	webp_frame.dispose_method = WEBP_MUX_DISPOSE_NONE;
+	webp_frame.blend_method = WEBP_MUX_BLEND;
+	if(page != -1) {
+		const void *value = NULL;
+		if((value = WebP_GetAnimationTagValue(dib, "FrameLeft", FIDT_SHORT)) != NULL) {
+			webp_frame.x_offset = *(WORD*)value;
+		}
+		if((value = WebP_GetAnimationTagValue(dib, "FrameTop", FIDT_SHORT)) != NULL) {
+			webp_frame.y_offset = *(WORD*)value;
+		}
+		if((value = WebP_GetAnimationTagValue(dib, "FrameTime", FIDT_LONG)) != NULL) {
+			webp_frame.duration = *(LONG*)value;
+		}
+		if((value = WebP_GetAnimationTagValue(dib, "DisposalMethod", FIDT_BYTE)) != NULL) {
+			if(*(BYTE*)value == WEBP_ANIM_DISPOSAL_BACKGROUND) {
+				webp_frame.dispose_method = WEBP_MUX_DISPOSE_BACKGROUND;
+			}
+		}
+		if((value = WebP_GetAnimationTagValue(dib, "BlendMethod", FIDT_BYTE)) != NULL) {
+			if(*(BYTE*)value == WEBP_ANIM_BLEND_NONE) {
+				webp_frame.blend_method = WEBP_MUX_NO_BLEND;
+			}
+		}
+	}
+	// the WebP container stores the offsets divided by 2 : odd offsets are aligned down, the frame being padded
+	const int pad_x = webp_frame.x_offset & 1;
+	const int pad_y = webp_frame.y_offset & 1;
+	webp_frame.x_offset -= pad_x;
+	webp_frame.y_offset -= pad_y;
+	FIBITMAP *padded = NULL;
+
 	try {
 
 		// get the MUX object
-		mux = (WebPMux*)data;
+		mux = mux_data->mux;
 		if(!mux) {
 			return FALSE;
 		}
@@ -578,17 +790,37 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		// --- prepare image data ---
 
 		// encode image as a WebP blob
+		if(pad_x || pad_y) {
+			padded = PadFrame(dib, pad_x, pad_y);
+			if(!padded) {
+				throw (1);
+			}
+		}
 		hmem = FreeImage_OpenMemory();
-		if(!hmem || !EncodeImage(hmem, dib, flags)) {
+		if(!hmem || !EncodeImage(hmem, padded ? padded : dib, flags)) {
 			throw (1);
 		}
+		if(padded) {
+			FreeImage_Unload(padded);
+			padded = NULL;
+		}
 		// store the blob into the mux
 		BYTE *data = NULL;
 		DWORD data_size = 0;
 		FreeImage_AcquireMemory(hmem, &data, &data_size);
 		webp_image.bytes = data;
 		webp_image.size = data_size;
-		error_status = WebPMuxSetImage(mux, &webp_image, copy_data);
+		if(page == -1) {
+			// single image
+			error_status = WebPMuxSetImage(mux, &webp_image, copy_data);
+		} else {
+			// animation frame (the mux will be written when closing the stream)
+			webp_frame.bitstream = webp_image;
+			error_status = WebPMuxPushFrame(mux, &webp_frame, copy_data);
+			if((error_status == WEBP_MUX_OK) && !single_image) {
+				mux_data->frame_count++;
+			}
+		}
 		// no longer needed since copy_data == 1
 		FreeImage_CloseMemory(hmem);
 		hmem = NULL;
@@ -596,49 +828,91 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			throw (1);
 		}
 
-		// --- set metadata ---
+		// --- set animation parameters (taken from the first page) ---
+
+		if(page == 0) {
+			WebPMuxAnimParams anim_params;
+			anim_params.loop_count = 0;
+			anim_params.bgcolor = 0xFFFFFFFF;
+
+			const void *value = NULL;
+			if((value = WebP_GetAnimationTagValue(dib, "Loop", FIDT_LONG)) != NULL) {
+				anim_params.loop_count = *(LONG*)value;
+			}
+			RGBQUAD bkcolor;
+			if(FreeImage_GetBackgroundColor(dib, &bkcolor)) {
+				anim_params.bgcolor = ((uint32_t)bkcolor.rgbReserved << 24) | ((uint32_t)bkcolor.rgbRed << 16) | ((uint32_t)bkcolor.rgbGreen << 8) | (uint32_t)bkcolor.rgbBlue;
+			}
+			error_status = WebPMuxSetAnimationParams(mux, &anim_params);
+			if(error_status != WEBP_MUX_OK) {
+				throw (1);
+			}
+
+			// use the logical screen as the canvas, if the first frame fits into it
+			const unsigned frame_right = webp_frame.x_offset + pad_x + FreeImage_GetWidth(dib);
+			const unsigned frame_bottom = webp_frame.y_offset + pad_y + FreeImage_GetHeight(dib);
+			const void *logical_width = WebP_GetAnimationTagValue(dib, "LogicalWidth", FIDT_SHORT);
+			const void *logical_height = WebP_GetAnimationTagValue(dib, "LogicalHeight", FIDT_SHORT);
+			if(logical_width && logical_height && (frame_right <= *(WORD*)logical_width) && (frame_bottom <= *(WORD*)logical_height)) {
+				WebPMuxSetCanvasSize(mux, (int)*(WORD*)logical_width, (int)*(WORD*)logical_height);
+			} else if(single_image) {
+				// otherwise, the one-frame animation of a single image uses the frame extent, 
+				// as libwebp stores a one-frame animation without canvas as a still image
+				WebPMuxSetCanvasSize(mux, (int)frame_right, (int)frame_bottom);
+			}
+		}
+
+		// --- set metadata (taken from the first page) ---
+
+		if(page <= 0) {
 		
-		// set ICC color profile
-		{
-			FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
-			if (iccProfile->size && iccProfile->data) {
-				WebPData icc_profile;
-				icc_profile.bytes = (uint8_t*)iccProfile->data;
-				icc_profile.size = (size_t)iccProfile->size;
-				error_status = WebPMuxSetChunk(mux, "ICCP", &icc_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
+			// set ICC color profile
+			{
+				FIICCPROFILE *iccProfile = FreeImage_GetICCProfile(dib);
+				if (iccProfile->size && iccProfile->data) {
+					WebPData icc_profile;
+					icc_profile.bytes = (uint8_t*)iccProfile->data;
+					icc_profile.size = (size_t)iccProfile->size;
+					error_status = WebPMuxSetChunk(mux, "ICCP", &icc_profile, copy_data);
+					if(error_status != WEBP_MUX_OK) {
+						throw (1);
+					}
 				}
 			}
-		}
 
-		// set XMP metadata
-		{
-			FITAG *tag = NULL;
-			if(FreeImage_GetMetadata(FIMD_XMP, dib, g_TagLib_XMPFieldName, &tag)) {
-				WebPData xmp_profile;
-				xmp_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
-				xmp_profile.size = (size_t)FreeImage_GetTagLength(tag);
-				error_status = WebPMuxSetChunk(mux, "XMP ", &xmp_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
+			// set XMP metadata
+			{
+				FITAG *tag = NULL;
+				if(FreeImage_GetMetadata(FIMD_XMP, dib, g_TagLib_XMPFieldName, &tag)) {
+					WebPData xmp_profile;
+					xmp_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
+					xmp_profile.size = (size_t)FreeImage_GetTagLength(tag);
+					error_status = WebPMuxSetChunk(mux, "XMP ", &xmp_profile, copy_data);
+					if(error_status != WEBP_MUX_OK) {
+						throw (1);
+					}
 				}
 			}
-		}
 
-		// set Exif metadata
-		{
-			FITAG *tag = NULL;
-			if(FreeImage_GetMetadata(FIMD_EXIF_RAW, dib, g_TagLib_ExifRawFieldName, &tag)) {
-				WebPData exif_profile;
-				exif_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
-				exif_profile.size = (size_t)FreeImage_GetTagLength(tag);
-				error_status = WebPMuxSetChunk(mux, "EXIF", &exif_profile, copy_data);
-				if(error_status != WEBP_MUX_OK) {
-					throw (1);
+			// set Exif metadata
+			{
+				FITAG *tag = NULL;
+				if(FreeImage_GetMetadata(FIMD_EXIF_RAW, dib, g_TagLib_ExifRawFieldName, &tag)) {
+					WebPData exif_profile;
+					exif_profile.bytes = (uint8_t*)FreeImage_GetTagValue(tag);
+					exif_profile.size = (size_t)FreeImage_GetTagLength(tag);
+					error_status = WebPMuxSetChunk(mux, "EXIF", &exif_profile, copy_data);
+					if(error_status != WEBP_MUX_OK) {
+						throw (1);
+					}
 				}
 			}
 		}
+
+		if(!single_image) {
+			// animation frames are written by Close
+			return TRUE;
+		}
 		
 		// get data from mux in WebP RIFF format
 		error_status = WebPMuxAssemble(mux, &output_data);
@@ -662,6 +936,9 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		if(hmem) {
 			FreeImage_CloseMemory(hmem);
 		}
+		if(padded) {
+			FreeImage_Unload(padded);
+		}
 		
 		WebPDataClear(&output_data);
 
@@ -683,7 +960,7 @@ InitWEBP(Plugin *plugin, int format_id) {
 	plugin->regexpr_proc = RegExpr;
 	plugin->open_proc = Open;
 	plugin->close_proc = Close;
-	plugin->pagecount_proc = NULL;
+	plugin->pagecount_proc = PageCount;
 	plugin->pagecapability_proc = NULL;
 	plugin->load_proc = Load;
 	plugin->save_proc = Save;
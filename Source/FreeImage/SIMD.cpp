@@ -0,0 +1,1927 @@
+// ==========================================================
+// SIMD kernels and CPU feature dispatch
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "SIMD.h"
+
+// SIMD kernels are only available for x86 and x64 targets.
+// Each kernel is compiled for its own instruction set and is only called when
+// the CPU supports it, the library itself is built for the baseline instruction set.
+
+#if !defined(FREEIMAGE_BIGENDIAN) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define FI_SIMD_X86
+#endif
+
+#ifdef FI_SIMD_X86
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FI_TARGET_SSE2
+#define FI_TARGET_SSSE3
+#define FI_TARGET_AVX2
+#else
+#define FI_TARGET_SSE2	__attribute__((target("sse2")))
+#define FI_TARGET_SSSE3	__attribute__((target("ssse3")))
+#define FI_TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+
+#endif // FI_SIMD_X86
+
+// ==========================================================
+//   CPU features
+// ==========================================================
+
+static unsigned
+DetectCPUFeatures() {
+	unsigned features = 0;
+
+#ifdef FI_SIMD_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_id = info[0];
+	if(max_id >= 1) {
+		__cpuid(info, 1);
+		if(info[3] & (1 << 26)) {
+			features |= FI_CPU_SSE2;
+		}
+		if(info[2] & (1 << 9)) {
+			features |= FI_CPU_SSSE3;
+		}
+		// AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0)
+		const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+		if(os_avx && (max_id >= 7)) {
+			__cpuidex(info, 7, 0);
+			if(info[1] & (1 << 5)) {
+				features |= FI_CPU_AVX2;
+			}
+		}
+	}
+#else
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2")) {
+		features |= FI_CPU_SSE2;
+	}
+	if(__builtin_cpu_supports("ssse3")) {
+		features |= FI_CPU_SSSE3;
+	}
+	if(__builtin_cpu_supports("avx2")) {
+		features |= FI_CPU_AVX2;
+	}
+#endif
+
+	// each level relies on the previous ones
+	if(!(features & FI_CPU_SSE2)) {
+		features = 0;
+	} else if(!(features & FI_CPU_SSSE3)) {
+		features = FI_CPU_SSE2;
+	}
+
+	// optional cap, used to test and benchmark the code paths
+	const char *cap = getenv("FREEIMAGE_SIMD");
+	if(cap) {
+		if(strcmp(cap, "none") == 0) {
+			features = 0;
+		} else if(strcmp(cap, "sse2") == 0) {
+			features &= FI_CPU_SSE2;
+		} else if(strcmp(cap, "ssse3") == 0) {
+			features &= (FI_CPU_SSE2 | FI_CPU_SSSE3);
+		}
+	}
+#endif // FI_SIMD_X86
+
+	return features;
+}
+
+unsigned
+GetCPUFeatures() {
+	static const unsigned s_features = DetectCPUFeatures();
+	return s_features;
+}
+
+// ==========================================================
+//   Helpers
+// ==========================================================
+
+#ifdef FI_SIMD_X86
+
+/**
+Scale 8 5-bit values to 8-bit, exactly as (v * 0xFF) / 0x1F
+*/
+static inline FI_TARGET_SSE2 __m128i
+Scale5To8(__m128i v) {
+	// x / 31 == (x * 33826) >> 20 for any x <= 0x1F * 0xFF
+	const __m128i x = _mm_mullo_epi16(v, _mm_set1_epi16(0xFF));
+	return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)33826)), 4);
+}
+
+/**
+Scale 8 6-bit values to 8-bit, exactly as (v * 0xFF) / 0x3F
+*/
+static inline FI_TARGET_SSE2 __m128i
+Scale6To8(__m128i v) {
+	// x / 63 == (x * 33289) >> 21 for any x <= 0x3F * 0xFF
+	const __m128i x = _mm_mullo_epi16(v, _mm_set1_epi16(0xFF));
+	return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)33289)), 5);
+}
+
+/**
+Split 8 16-bit 555 or 565 pixels into 8-bit red, green and blue 16-bit lanes
+*/
+template <bool IS_565>
+static inline FI_TARGET_SSE2 void
+Unpack16(__m128i w, __m128i& r, __m128i& g, __m128i& b) {
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	if(IS_565) {
+		r = Scale5To8(_mm_srli_epi16(w, FI16_565_RED_SHIFT));
+		g = Scale6To8(_mm_and_si128(_mm_srli_epi16(w, FI16_565_GREEN_SHIFT), _mm_set1_epi16(0x3F)));
+		b = Scale5To8(_mm_and_si128(w, mask5));
+	} else {
+		r = Scale5To8(_mm_and_si128(_mm_srli_epi16(w, FI16_555_RED_SHIFT), mask5));
+		g = Scale5To8(_mm_and_si128(_mm_srli_epi16(w, FI16_555_GREEN_SHIFT), mask5));
+		b = Scale5To8(_mm_and_si128(w, mask5));
+	}
+}
+
+/**
+Build 8 16-bit 555 or 565 pixels from 8-bit red, green and blue 16-bit lanes, as RGB555 and RGB565
+*/
+template <bool IS_565>
+static inline FI_TARGET_SSE2 __m128i
+Pack16(__m128i r, __m128i g, __m128i b) {
+	if(IS_565) {
+		return _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi16(_mm_srli_epi16(r, 3), FI16_565_RED_SHIFT),
+			_mm_slli_epi16(_mm_srli_epi16(g, 2), FI16_565_GREEN_SHIFT)),
+			_mm_srli_epi16(b, 3));
+	} else {
+		return _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi16(_mm_srli_epi16(r, 3), FI16_555_RED_SHIFT),
+			_mm_slli_epi16(_mm_srli_epi16(g, 3), FI16_555_GREEN_SHIFT)),
+			_mm_srli_epi16(b, 3));
+	}
+}
+
+/**
+Extract a channel of 4 32-bit pixels into 32-bit lanes
+*/
+static inline FI_TARGET_SSE2 __m128i
+Channel32(__m128i p, int channel) {
+	return _mm_and_si128(_mm_srli_epi32(p, 8 * channel), _mm_set1_epi32(0xFF));
+}
+
+/**
+Build 4 16-bit 555 or 565 pixels (in 32-bit lanes) from 4 32-bit pixels
+*/
+template <bool IS_565>
+static inline FI_TARGET_SSE2 __m128i
+Pack16From32(__m128i p) {
+	const __m128i r = _mm_srli_epi32(Channel32(p, FI_RGBA_RED), 3);
+	const __m128i g = _mm_srli_epi32(Channel32(p, FI_RGBA_GREEN), IS_565 ? 2 : 3);
+	const __m128i b = _mm_srli_epi32(Channel32(p, FI_RGBA_BLUE), 3);
+	return _mm_or_si128(_mm_or_si128(
+		_mm_slli_epi32(r, IS_565 ? FI16_565_RED_SHIFT : FI16_555_RED_SHIFT),
+		_mm_slli_epi32(g, IS_565 ? FI16_565_GREEN_SHIFT : FI16_555_GREEN_SHIFT)), b);
+}
+
+/**
+Compute the Wu quantizer histogram index of 4 32-bit pixels, in 32-bit lanes :
+((r >> 3) + 1) * 33 * 33 + ((g >> 3) + 1) * 33 + (b >> 3) + 1
+*/
+static inline FI_TARGET_SSE2 __m128i
+WuIndex32(__m128i p) {
+	// all products and sums fit in the low 16 bits of the lanes
+	const __m128i r = _mm_srli_epi32(Channel32(p, FI_RGBA_RED), 3);
+	const __m128i g = _mm_srli_epi32(Channel32(p, FI_RGBA_GREEN), 3);
+	const __m128i b = _mm_srli_epi32(Channel32(p, FI_RGBA_BLUE), 3);
+	const __m128i rg = _mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(1089)), _mm_mullo_epi16(g, _mm_set1_epi32(33)));
+	return _mm_add_epi32(_mm_add_epi32(rg, b), _mm_set1_epi32(1089 + 33 + 1));
+}
+
+/**
+Pack two vectors of 16-bit values stored in 32-bit lanes into one vector of 16-bit lanes
+*/
+static inline FI_TARGET_SSE2 __m128i
+PackWords(__m128i lo, __m128i hi) {
+	// sign extend the values so that the signed saturation keeps them unchanged
+	lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	return _mm_packs_epi32(lo, hi);
+}
+
+/**
+Build 8 32-bit pixels (with an opaque alpha) from 8-bit red, green and blue 16-bit lanes
+*/
+static inline FI_TARGET_SSE2 void
+PackRGBA(__m128i r, __m128i g, __m128i b, __m128i& lo, __m128i& hi) {
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	const __m128i c01 = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+	const __m128i c23 = _mm_or_si128(r, _mm_set1_epi16((short)0xFF00));
+#else
+	const __m128i c01 = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+	const __m128i c23 = _mm_or_si128(b, _mm_set1_epi16((short)0xFF00));
+#endif
+	lo = _mm_unpacklo_epi16(c01, c23);
+	hi = _mm_unpackhi_epi16(c01, c23);
+}
+
+/**
+Luminance of 4 pixels as GREY(r, g, b), from 32-bit lanes
+*/
+static inline FI_TARGET_SSE2 __m128i
+Grey(__m128i r, __m128i g, __m128i b) {
+	// same operations, in the same order, as LUMA_REC709(r, g, b) + 0.5F
+	__m128 y = _mm_mul_ps(_mm_set1_ps(0.2126F), _mm_cvtepi32_ps(r));
+	y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(0.7152F), _mm_cvtepi32_ps(g)));
+	y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(0.0722F), _mm_cvtepi32_ps(b)));
+	y = _mm_add_ps(y, _mm_set1_ps(0.5F));
+	return _mm_cvttps_epi32(y);
+}
+
+/**
+Luminance of 4 32-bit pixels
+*/
+static inline FI_TARGET_SSE2 __m128i
+Grey32(__m128i p) {
+	return Grey(Channel32(p, FI_RGBA_RED), Channel32(p, FI_RGBA_GREEN), Channel32(p, FI_RGBA_BLUE));
+}
+
+/**
+Luminance of 4 16-bit pixels, from the unscaled v * 0xFF values of each channel in 32-bit lanes.
+The FreeImage_ConvertLine16To8 functions divide in floating point, after the weighting.
+*/
+template <bool IS_565>
+static inline FI_TARGET_SSE2 __m128i
+Grey16(__m128i r, __m128i g, __m128i b) {
+	const __m128 d5 = _mm_set1_ps((float)0x1F);
+	const __m128 dg = _mm_set1_ps(IS_565 ? (float)0x3F : (float)0x1F);
+	__m128 y = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(0.2126F), _mm_cvtepi32_ps(r)), d5);
+	y = _mm_add_ps(y, _mm_div_ps(_mm_mul_ps(_mm_set1_ps(0.7152F), _mm_cvtepi32_ps(g)), dg));
+	y = _mm_add_ps(y, _mm_div_ps(_mm_mul_ps(_mm_set1_ps(0.0722F), _mm_cvtepi32_ps(b)), d5));
+	y = _mm_add_ps(y, _mm_set1_ps(0.5F));
+	return _mm_cvttps_epi32(y);
+}
+
+/**
+Store 16 luminance values computed in 32-bit lanes
+*/
+static inline FI_TARGET_SSE2 void
+StoreGrey(BYTE *target, __m128i y0, __m128i y1, __m128i y2, __m128i y3) {
+	_mm_storeu_si128((__m128i*)target, _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3)));
+}
+
+/**
+Load 16 24-bit pixels (48 bytes) as 4 vectors of 32-bit pixels, with a zero alpha
+*/
+static inline FI_TARGET_SSSE3 void
+Load24(const BYTE *source, __m128i p[4]) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i v0 = _mm_loadu_si128((const __m128i*)source);
+	const __m128i v1 = _mm_loadu_si128((const __m128i*)(source + 16));
+	const __m128i v2 = _mm_loadu_si128((const __m128i*)(source + 32));
+	p[0] = _mm_shuffle_epi8(v0, shuffle);
+	p[1] = _mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), shuffle);
+	p[2] = _mm_shuffle_epi8(_mm_alignr_epi8(v2, v1, 8), shuffle);
+	p[3] = _mm_shuffle_epi8(_mm_srli_si128(v2, 4), shuffle);
+}
+
+/**
+Store 4 vectors of 32-bit pixels as 16 24-bit pixels (48 bytes)
+*/
+static inline FI_TARGET_SSSE3 void
+Store24(BYTE *target, const __m128i p[4]) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m128i a = _mm_shuffle_epi8(p[0], shuffle);
+	const __m128i b = _mm_shuffle_epi8(p[1], shuffle);
+	const __m128i c = _mm_shuffle_epi8(p[2], shuffle);
+	const __m128i d = _mm_shuffle_epi8(p[3], shuffle);
+	_mm_storeu_si128((__m128i*)target, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+	_mm_storeu_si128((__m128i*)(target + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+	_mm_storeu_si128((__m128i*)(target + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+}
+
+// ==========================================================
+//   SSE2 kernels
+// ==========================================================
+
+template <bool IS_565>
+static FI_TARGET_SSE2 int
+ConvertLine16To8_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i maskG = _mm_set1_epi16(IS_565 ? 0x3F : 0x1F);
+	const __m128i scale = _mm_set1_epi16(0xFF);
+
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i y[4];
+		for(int k = 0; k < 2; k++) {
+			const __m128i w = _mm_loadu_si128((const __m128i*)(source + 2 * (cols + 8 * k)));
+			// unscaled v * 0xFF channel values
+			const __m128i r = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(w, IS_565 ? FI16_565_RED_SHIFT : FI16_555_RED_SHIFT), mask5), scale);
+			const __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(w, IS_565 ? FI16_565_GREEN_SHIFT : FI16_555_GREEN_SHIFT), maskG), scale);
+			const __m128i b = _mm_mullo_epi16(_mm_and_si128(w, mask5), scale);
+			y[2 * k] = Grey16<IS_565>(_mm_unpacklo_epi16(r, zero), _mm_unpacklo_epi16(g, zero), _mm_unpacklo_epi16(b, zero));
+			y[2 * k + 1] = Grey16<IS_565>(_mm_unpackhi_epi16(r, zero), _mm_unpackhi_epi16(g, zero), _mm_unpackhi_epi16(b, zero));
+		}
+		StoreGrey(target + cols, y[0], y[1], y[2], y[3]);
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ConvertLine32To8_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i *p = (const __m128i*)(source + 4 * cols);
+		StoreGrey(target + cols,
+			Grey32(_mm_loadu_si128(p)), Grey32(_mm_loadu_si128(p + 1)),
+			Grey32(_mm_loadu_si128(p + 2)), Grey32(_mm_loadu_si128(p + 3)));
+	}
+	return cols;
+}
+
+template <bool SRC_IS_565>
+static FI_TARGET_SSE2 int
+ConvertLine16To16_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		__m128i r, g, b;
+		Unpack16<SRC_IS_565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols)), r, g, b);
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), Pack16<!SRC_IS_565>(r, g, b));
+	}
+	return cols;
+}
+
+template <bool IS_565>
+static FI_TARGET_SSE2 int
+ConvertLine32To16_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i *p = (const __m128i*)(source + 4 * cols);
+		const __m128i lo = Pack16From32<IS_565>(_mm_loadu_si128(p));
+		const __m128i hi = Pack16From32<IS_565>(_mm_loadu_si128(p + 1));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), PackWords(lo, hi));
+	}
+	return cols;
+}
+
+template <bool IS_565>
+static FI_TARGET_SSE2 int
+ConvertLine16To32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		__m128i r, g, b, lo, hi;
+		Unpack16<IS_565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols)), r, g, b);
+		PackRGBA(r, g, b, lo, hi);
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), lo);
+		_mm_storeu_si128((__m128i*)(target + 4 * cols + 16), hi);
+	}
+	return cols;
+}
+
+/**
+Broadcast the alpha value of the two 32-bit pixels of 8 words to the 4 words of each pixel
+*/
+static inline FI_TARGET_SSE2 __m128i
+BroadcastAlpha16(__m128i c) {
+#if FI_RGBA_ALPHA == 3
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+#else
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(0, 0, 0, 0));
+#endif
+}
+
+static FI_TARGET_SSE2 int
+Premultiply32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(127);
+	const __m128i div255 = _mm_set1_epi16((short)0x8081);
+	// keep the alpha lanes unchanged
+	const __m128i alpha_mask = _mm_setr_epi16(
+		(FI_RGBA_ALPHA == 0) ? -1 : 0, (FI_RGBA_ALPHA == 1) ? -1 : 0, (FI_RGBA_ALPHA == 2) ? -1 : 0, (FI_RGBA_ALPHA == 3) ? -1 : 0,
+		(FI_RGBA_ALPHA == 0) ? -1 : 0, (FI_RGBA_ALPHA == 1) ? -1 : 0, (FI_RGBA_ALPHA == 2) ? -1 : 0, (FI_RGBA_ALPHA == 3) ? -1 : 0);
+
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const __m128i p = _mm_loadu_si128((const __m128i*)(source + 4 * cols));
+		__m128i c[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+		for(int k = 0; k < 2; k++) {
+			const __m128i a = BroadcastAlpha16(c[k]);
+			// (alpha * c + 127) / 255, with x / 255 == (x * 0x8081) >> 23 for any x <= 0xFFFF
+			const __m128i x = _mm_add_epi16(_mm_mullo_epi16(c[k], a), round);
+			const __m128i q = _mm_srli_epi16(_mm_mulhi_epu16(x, div255), 7);
+			c[k] = _mm_or_si128(_mm_andnot_si128(alpha_mask, q), _mm_and_si128(alpha_mask, c[k]));
+		}
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_packus_epi16(c[0], c[1]));
+	}
+	return cols;
+}
+
+/**
+Divide words by 255, rounded to nearest : (x + 127) / 255, saturated to 0xFFFF before the division. 
+Uses x / 255 == (x * 0x8081) >> 23 for any x <= 0xFFFF.
+*/
+static inline FI_TARGET_SSE2 __m128i
+Div255_16(__m128i x) {
+	const __m128i x_round = _mm_adds_epu16(x, _mm_set1_epi16(127));
+	return _mm_srli_epi16(_mm_mulhi_epu16(x_round, _mm_set1_epi16((short)0x8081)), 7);
+}
+
+/**
+Reciprocal of the alpha values used to unpremultiply 8-bit pixels : (255 * 256 + alpha / 2) / alpha, 0 for alpha = 0
+*/
+static const WORD*
+GetUnpremultiplyTable() {
+	static WORD s_table[256];
+	static const bool s_ready = [] {
+		s_table[0] = 0;
+		for(unsigned alpha = 1; alpha < 256; alpha++) {
+			s_table[alpha] = (WORD)((255 * 256 + alpha / 2) / alpha);
+		}
+		return true;
+	}();
+	(void)s_ready;
+	return s_table;
+}
+
+static FI_TARGET_SSE2 int
+Unpremultiply32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const WORD *reciprocal = GetUnpremultiplyTable();
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i max = _mm_set1_epi16(255);
+
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const BYTE *p = source + 4 * cols;
+		const __m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i c[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+		for(int k = 0; k < 2; k++) {
+			// factor of each channel, 256 keeps the alpha channel unchanged
+			const WORD f0 = reciprocal[p[8 * k + FI_RGBA_ALPHA]];
+			const WORD f1 = reciprocal[p[8 * k + 4 + FI_RGBA_ALPHA]];
+			WORD f[8] = { f0, f0, f0, f0, f1, f1, f1, f1 };
+			f[FI_RGBA_ALPHA] = 256;
+			f[4 + FI_RGBA_ALPHA] = 256;
+			const __m128i factor = _mm_loadu_si128((const __m128i*)f);
+			// (c * factor + 128) >> 8, from the low and high words of the 32-bit products
+			const __m128i lo = _mm_mullo_epi16(c[k], factor);
+			const __m128i hi = _mm_mulhi_epu16(c[k], factor);
+			const __m128i q = _mm_add_epi16(_mm_srli_epi16(lo, 8), _mm_and_si128(_mm_srli_epi16(lo, 7), one));
+			// saturate products above 0xFFFF to 255
+			c[k] = _mm_or_si128(q, _mm_and_si128(_mm_cmpgt_epi16(hi, zero), max));
+		}
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_packus_epi16(c[0], c[1]));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Mix32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(source + 4 * cols));
+		const __m128i t = _mm_loadu_si128((const __m128i*)(target + 4 * cols));
+		const __m128i s16[2] = { _mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero) };
+		const __m128i t16[2] = { _mm_unpacklo_epi8(t, zero), _mm_unpackhi_epi8(t, zero) };
+		__m128i c[2];
+		for(int k = 0; k < 2; k++) {
+			const __m128i alpha = BroadcastAlpha16(s16[k]);
+			// (alpha * s + (255 - alpha) * t) >> 8, alpha * s + (255 - alpha) * t <= 255 * 255
+			const __m128i mix = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s16[k], alpha), _mm_mullo_epi16(t16[k], _mm_sub_epi16(max, alpha))), 8);
+			// alpha = 0 gives t and alpha = 255 gives s
+			const __m128i transparent = _mm_cmpeq_epi16(alpha, zero);
+			const __m128i opaque = _mm_cmpeq_epi16(alpha, max);
+			c[k] = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(transparent, opaque), mix), 
+				_mm_or_si128(_mm_and_si128(transparent, t16[k]), _mm_and_si128(opaque, s16[k])));
+		}
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_packus_epi16(c[0], c[1]));
+	}
+	return cols;
+}
+
+/**
+Composition of premultiplied 32-bit pixels, see FI_CompositeLineKernel
+*/
+template <int MODE>
+static FI_TARGET_SSE2 int
+Composite32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels, unsigned opacity) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i scale = _mm_set1_epi16((short)opacity);
+
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(source + 4 * cols));
+		const __m128i t = _mm_loadu_si128((const __m128i*)(target + 4 * cols));
+		if((MODE == FIBM_ADD) && (opacity == 255)) {
+			_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_adds_epu8(s, t));
+			continue;
+		}
+		__m128i s16[2] = { _mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero) };
+		const __m128i t16[2] = { _mm_unpacklo_epi8(t, zero), _mm_unpackhi_epi8(t, zero) };
+		__m128i c[2];
+		for(int k = 0; k < 2; k++) {
+			if(opacity != 255) {
+				s16[k] = Div255_16(_mm_mullo_epi16(s16[k], scale));
+			}
+			switch(MODE) {
+				case FIBM_OVER:
+					// s + t * (255 - alpha_s) / 255
+					c[k] = _mm_add_epi16(s16[k], Div255_16(_mm_mullo_epi16(t16[k], _mm_sub_epi16(max, BroadcastAlpha16(s16[k])))));
+					break;
+				case FIBM_MULTIPLY: {
+					// (s * (255 - alpha_t + t) + t * (255 - alpha_s)) / 255
+					const __m128i m = _mm_min_epi16(_mm_add_epi16(_mm_sub_epi16(max, BroadcastAlpha16(t16[k])), t16[k]), max);
+					const __m128i x = _mm_adds_epu16(_mm_mullo_epi16(s16[k], m), _mm_mullo_epi16(t16[k], _mm_sub_epi16(max, BroadcastAlpha16(s16[k]))));
+					c[k] = Div255_16(x);
+					break;
+				}
+				case FIBM_SCREEN:
+					// s + t - s * t / 255
+					c[k] = _mm_sub_epi16(_mm_add_epi16(s16[k], t16[k]), Div255_16(_mm_mullo_epi16(s16[k], t16[k])));
+					break;
+				default:
+					c[k] = _mm_add_epi16(s16[k], t16[k]);
+					break;
+			}
+		}
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_packus_epi16(c[0], c[1]));
+	}
+	return cols;
+}
+
+/**
+Broadcast the alpha value of a FIT_RGBAF pixel
+*/
+static inline FI_TARGET_SSE2 __m128
+BroadcastAlphaF(__m128 p) {
+	return _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static FI_TARGET_SSE2 int
+PremultiplyRGBAF_SSE2(float *target, const float *source, int width_in_pixels) {
+	const __m128 color_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 alpha_one = _mm_setr_ps(0, 0, 0, 1);
+	for(int x = 0; x < width_in_pixels; x++) {
+		const __m128 p = _mm_loadu_ps(source + 4 * x);
+		// (alpha, alpha, alpha, 1)
+		const __m128 factor = _mm_or_ps(_mm_and_ps(BroadcastAlphaF(p), color_mask), alpha_one);
+		_mm_storeu_ps(target + 4 * x, _mm_mul_ps(p, factor));
+	}
+	return width_in_pixels;
+}
+
+static FI_TARGET_SSE2 int
+UnpremultiplyRGBAF_SSE2(float *target, const float *source, int width_in_pixels) {
+	const __m128 color_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 alpha_one = _mm_setr_ps(0, 0, 0, 1);
+	const __m128 zero = _mm_setzero_ps();
+	for(int x = 0; x < width_in_pixels; x++) {
+		const __m128 p = _mm_loadu_ps(source + 4 * x);
+		const __m128 alpha = BroadcastAlphaF(p);
+		const __m128 factor = _mm_or_ps(_mm_and_ps(alpha, color_mask), alpha_one);
+		// pixels with a zero alpha are set to 0
+		_mm_storeu_ps(target + 4 * x, _mm_and_ps(_mm_div_ps(p, factor), _mm_cmpneq_ps(alpha, zero)));
+	}
+	return width_in_pixels;
+}
+
+/**
+Composition of premultiplied FIT_RGBAF pixels, see FI_FloatCompositeLineKernel
+*/
+template <int MODE>
+static FI_TARGET_SSE2 int
+CompositeRGBAF_SSE2(float *target, const float *source, int width_in_pixels, float opacity) {
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 scale = _mm_set1_ps(opacity);
+	for(int x = 0; x < width_in_pixels; x++) {
+		__m128 s = _mm_loadu_ps(source + 4 * x);
+		const __m128 t = _mm_loadu_ps(target + 4 * x);
+		if(opacity != 1) {
+			s = _mm_mul_ps(s, scale);
+		}
+		__m128 c;
+		switch(MODE) {
+			case FIBM_OVER:
+				c = _mm_add_ps(s, _mm_mul_ps(t, _mm_sub_ps(one, BroadcastAlphaF(s))));
+				break;
+			case FIBM_MULTIPLY:
+				c = _mm_add_ps(_mm_mul_ps(s, _mm_add_ps(_mm_sub_ps(one, BroadcastAlphaF(t)), t)), _mm_mul_ps(t, _mm_sub_ps(one, BroadcastAlphaF(s))));
+				break;
+			case FIBM_SCREEN:
+				c = _mm_sub_ps(_mm_add_ps(s, t), _mm_mul_ps(s, t));
+				break;
+			default:
+				c = _mm_add_ps(s, t);
+				break;
+		}
+		_mm_storeu_ps(target + 4 * x, c);
+	}
+	return width_in_pixels;
+}
+
+static FI_TARGET_SSE2 int
+Blend8_SSE2(BYTE *target, const BYTE *source, int count, unsigned alpha) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i source_weight = _mm_set1_epi16((short)alpha);
+	const __m128i target_weight = _mm_set1_epi16((short)(256 - alpha));
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(source + i));
+		const __m128i t = _mm_loadu_si128((const __m128i*)(target + i));
+		// s * alpha + t * (256 - alpha) <= 255 * 256
+		const __m128i lo = _mm_srli_epi16(_mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), source_weight), _mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), target_weight)), 8);
+		const __m128i hi = _mm_srli_epi16(_mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), source_weight), _mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), target_weight)), 8);
+		_mm_storeu_si128((__m128i*)(target + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+static FI_TARGET_SSE2 int
+MinMaxFloat_SSE2(const float *source, int count, float *min_value, float *max_value) {
+	if(count < 8) {
+		return 0;
+	}
+	// min / max return their second operand when the first one is NaN
+	__m128 lo0 = _mm_set1_ps(*min_value), hi0 = _mm_set1_ps(*max_value);
+	__m128 lo1 = lo0, hi1 = hi0;
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		const __m128 a = _mm_loadu_ps(source + i);
+		const __m128 b = _mm_loadu_ps(source + i + 4);
+		lo0 = _mm_min_ps(a, lo0); hi0 = _mm_max_ps(a, hi0);
+		lo1 = _mm_min_ps(b, lo1); hi1 = _mm_max_ps(b, hi1);
+	}
+	lo0 = _mm_min_ps(lo0, lo1);
+	hi0 = _mm_max_ps(hi0, hi1);
+	lo0 = _mm_min_ps(lo0, _mm_movehl_ps(lo0, lo0));
+	hi0 = _mm_max_ps(hi0, _mm_movehl_ps(hi0, hi0));
+	lo0 = _mm_min_ss(lo0, _mm_shuffle_ps(lo0, lo0, 1));
+	hi0 = _mm_max_ss(hi0, _mm_shuffle_ps(hi0, hi0, 1));
+	*min_value = _mm_cvtss_f32(lo0);
+	*max_value = _mm_cvtss_f32(hi0);
+	return i;
+}
+
+static FI_TARGET_SSE2 int
+MinMaxDouble_SSE2(const double *source, int count, double *min_value, double *max_value) {
+	if(count < 4) {
+		return 0;
+	}
+	__m128d lo0 = _mm_set1_pd(*min_value), hi0 = _mm_set1_pd(*max_value);
+	__m128d lo1 = lo0, hi1 = hi0;
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		const __m128d a = _mm_loadu_pd(source + i);
+		const __m128d b = _mm_loadu_pd(source + i + 2);
+		lo0 = _mm_min_pd(a, lo0); hi0 = _mm_max_pd(a, hi0);
+		lo1 = _mm_min_pd(b, lo1); hi1 = _mm_max_pd(b, hi1);
+	}
+	lo0 = _mm_min_pd(lo0, lo1);
+	hi0 = _mm_max_pd(hi0, hi1);
+	lo0 = _mm_min_sd(lo0, _mm_unpackhi_pd(lo0, lo0));
+	hi0 = _mm_max_sd(hi0, _mm_unpackhi_pd(hi0, hi0));
+	*min_value = _mm_cvtsd_f64(lo0);
+	*max_value = _mm_cvtsd_f64(hi0);
+	return i;
+}
+
+static FI_TARGET_SSE2 int
+WuIndexLine32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i *s = (const __m128i*)(source + 4 * cols);
+		const __m128i i0 = WuIndex32(_mm_loadu_si128(s));
+		const __m128i i1 = WuIndex32(_mm_loadu_si128(s + 1));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), PackWords(i0, i1));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Threshold8To1_SSE2(BYTE *target, const BYTE *source, const BYTE *threshold, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(source + cols));
+		const __m128i t = _mm_loadu_si128((const __m128i*)(threshold + cols));
+		__m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+		// reverse the bytes of each 8 pixels, so that the first pixel gives the highest bit
+		ge = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ge, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+		ge = _mm_or_si128(_mm_slli_epi16(ge, 8), _mm_srli_epi16(ge, 8));
+		const int mask = _mm_movemask_epi8(ge);
+		target[cols >> 3] = (BYTE)mask;
+		target[(cols >> 3) + 1] = (BYTE)(mask >> 8);
+	}
+	return cols;
+}
+
+/**
+Split 4 RGBF pixels into red, green and blue vectors
+*/
+static inline FI_TARGET_SSE2 void
+LoadRGBF(const float *source, __m128& r, __m128& g, __m128& b) {
+	const __m128 p0 = _mm_loadu_ps(source);		// r0 g0 b0 r1
+	const __m128 p1 = _mm_loadu_ps(source + 4);	// g1 b1 r2 g2
+	const __m128 p2 = _mm_loadu_ps(source + 8);	// b2 r3 g3 b3
+	r = _mm_shuffle_ps(p0, _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	g = _mm_shuffle_ps(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	b = _mm_shuffle_ps(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(p2, p2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/**
+Store red, green and blue vectors as 4 RGBF pixels
+*/
+static inline FI_TARGET_SSE2 void
+StoreRGBF(float *target, __m128 r, __m128 g, __m128 b) {
+	const __m128 rg_lo = _mm_unpacklo_ps(r, g);	// r0 g0 r1 g1
+	const __m128 rg_hi = _mm_unpackhi_ps(r, g);	// r2 g2 r3 g3
+	_mm_storeu_ps(target, _mm_shuffle_ps(rg_lo, _mm_shuffle_ps(b, r, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0)));
+	_mm_storeu_ps(target + 4, _mm_shuffle_ps(_mm_shuffle_ps(g, b, _MM_SHUFFLE(1, 1, 1, 1)), rg_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+	_mm_storeu_ps(target + 8, _mm_shuffle_ps(_mm_shuffle_ps(b, r, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(g, b, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/**
+Row i of a color matrix applied to (a, b, c), with the rounding of the scalar sum 0 + m[i][0] * a + m[i][1] * b + m[i][2] * c
+*/
+static inline FI_TARGET_SSE2 __m128
+MatrixRow(const float matrix[3][3], int i, __m128 a, __m128 b, __m128 c) {
+	__m128 v = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_set1_ps(matrix[i][0]), a));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(matrix[i][1]), b));
+	return _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(matrix[i][2]), c));
+}
+
+static FI_TARGET_SSE2 int
+ConvertLineRGBFToYxy_SSE2(float *target, const float *source, int width_in_pixels, const float matrix[3][3]) {
+	const __m128 zero = _mm_setzero_ps();
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		__m128 r, g, b;
+		LoadRGBF(source + 3 * cols, r, g, b);
+		const __m128 X = MatrixRow(matrix, 0, r, g, b);
+		const __m128 Y = MatrixRow(matrix, 1, r, g, b);
+		const __m128 Z = MatrixRow(matrix, 2, r, g, b);
+		const __m128 W = _mm_add_ps(_mm_add_ps(X, Y), Z);
+		// black when W <= 0
+		const __m128 valid = _mm_cmpgt_ps(W, zero);
+		StoreRGBF(target + 3 * cols, _mm_and_ps(valid, Y), _mm_and_ps(valid, _mm_div_ps(X, W)), _mm_and_ps(valid, _mm_div_ps(Y, W)));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ConvertLineYxyToRGBF_SSE2(float *target, const float *source, int width_in_pixels, const float matrix[3][3]) {
+	const __m128 epsilon = _mm_set1_ps(1e-06F);
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		__m128 Y, x, y;
+		LoadRGBF(source + 3 * cols, Y, x, y);
+		const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(Y, epsilon), _mm_and_ps(_mm_cmpgt_ps(x, epsilon), _mm_cmpgt_ps(y, epsilon)));
+		__m128 X = _mm_div_ps(_mm_mul_ps(x, Y), y);
+		__m128 Z = _mm_sub_ps(_mm_sub_ps(_mm_div_ps(X, x), X), Y);
+		// X = Z = epsilon for dark pixels
+		X = _mm_or_ps(_mm_and_ps(valid, X), _mm_andnot_ps(valid, epsilon));
+		Z = _mm_or_ps(_mm_and_ps(valid, Z), _mm_andnot_ps(valid, epsilon));
+		StoreRGBF(target + 3 * cols, MatrixRow(matrix, 0, X, Y, Z), MatrixRow(matrix, 1, X, Y, Z), MatrixRow(matrix, 2, X, Y, Z));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ConvertLineRGBFToY_SSE2(float *target, const float *source, int width_in_pixels) {
+	const __m128 kr = _mm_set1_ps(0.2126F);
+	const __m128 kg = _mm_set1_ps(0.7152F);
+	const __m128 kb = _mm_set1_ps(0.0722F);
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		__m128 r, g, b;
+		LoadRGBF(source + 3 * cols, r, g, b);
+		const __m128 L = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kr, r), _mm_mul_ps(kg, g)), _mm_mul_ps(kb, b));
+		// negative and NaN values give 0
+		_mm_storeu_ps(target + cols, _mm_max_ps(L, _mm_setzero_ps()));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+RelaxationLine_SSE2(float *u, const float *rhs, int pitch, int first, int last, float h2) {
+	const __m128 quarter = _mm_set1_ps(0.25F);
+	const __m128 vh2 = _mm_set1_ps(h2);
+	int x = first;
+	// update x, x + 2, x + 4 and x + 6
+	for(; x + 7 <= last; x += 8) {
+		const float *center = u + x;
+		const __m128 c0 = _mm_loadu_ps(center);
+		const __m128 c1 = _mm_loadu_ps(center + 4);
+		const __m128 l0 = _mm_loadu_ps(center - 1);
+		const __m128 l1 = _mm_loadu_ps(center + 3);
+		const __m128 right = _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128 left = _mm_shuffle_ps(l0, l1, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 down = _mm_shuffle_ps(_mm_loadu_ps(center + pitch), _mm_loadu_ps(center + pitch + 4), _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 up = _mm_shuffle_ps(_mm_loadu_ps(center - pitch), _mm_loadu_ps(center - pitch + 4), _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 f = _mm_shuffle_ps(_mm_loadu_ps(rhs + x), _mm_loadu_ps(rhs + x + 4), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 v = _mm_add_ps(_mm_add_ps(_mm_add_ps(down, up), right), left);
+		v = _mm_mul_ps(_mm_sub_ps(v, _mm_mul_ps(vh2, f)), quarter);
+		// the values in between belong to the other color, and may be read by other threads
+		_mm_store_ss(u + x, v);
+		_mm_store_ss(u + x + 2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+		_mm_store_ss(u + x + 4, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+		_mm_store_ss(u + x + 6, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+	}
+	return x;
+}
+
+static FI_TARGET_SSE2 int
+ResidualLine_SSE2(float *res, const float *u, const float *rhs, int pitch, int first, int last, float h2i) {
+	const __m128 four = _mm_set1_ps(4);
+	const __m128 minus_h2i = _mm_set1_ps(-h2i);
+	int x = first;
+	for(; x + 4 <= last; x += 4) {
+		const float *center = u + x;
+		__m128 v = _mm_add_ps(_mm_loadu_ps(center + pitch), _mm_loadu_ps(center - pitch));
+		v = _mm_add_ps(_mm_add_ps(v, _mm_loadu_ps(center + 1)), _mm_loadu_ps(center - 1));
+		v = _mm_sub_ps(v, _mm_mul_ps(four, _mm_loadu_ps(center)));
+		v = _mm_add_ps(_mm_mul_ps(v, minus_h2i), _mm_loadu_ps(rhs + x));
+		_mm_storeu_ps(res + x, v);
+	}
+	return x;
+}
+
+// ----------------------------------------------------------
+
+/**
+Transposes the N x N blocks of pixels of a tile with a block function, see FI_TransposeKernel
+*/
+template <int N, int bytespp, void (*TransposeBlock)(BYTE*, int, const BYTE*, int)>
+static inline FI_TARGET_SSE2 int
+TransposeTile_SSE2(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	if((width < N) || (height < N)) {
+		return 0;
+	}
+	for(int y = 0; y + N <= height; y += N) {
+		const BYTE *src_bits = source + (ptrdiff_t)y * source_pitch;
+		for(int x = 0; x + N <= width; x += N) {
+			TransposeBlock(target + (ptrdiff_t)x * target_pitch + y * bytespp, target_pitch, src_bits + x * bytespp, source_pitch);
+		}
+	}
+	return N;
+}
+
+static inline FI_TARGET_SSE2 void
+TransposeBlock8x8_8(BYTE *target, int target_pitch, const BYTE *source, int source_pitch) {
+	__m128i r[8];
+	for(int i = 0; i < 8; i++) {
+		r[i] = _mm_loadl_epi64((const __m128i*)(source + (ptrdiff_t)i * source_pitch));
+	}
+	// interleave rows by pairs, then by 4, then by 8
+	const __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+	const __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+	const __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+	const __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+	const __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+	const __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+	const __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+	const __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+	// columns 0-1, 2-3, 4-5 and 6-7
+	const __m128i c[4] = { _mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2), _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3) };
+	for(int i = 0; i < 4; i++) {
+		_mm_storel_epi64((__m128i*)(target + (ptrdiff_t)(2 * i) * target_pitch), c[i]);
+		_mm_storel_epi64((__m128i*)(target + (ptrdiff_t)(2 * i + 1) * target_pitch), _mm_unpackhi_epi64(c[i], c[i]));
+	}
+}
+
+static inline FI_TARGET_SSE2 void
+TransposeBlock8x8_16(BYTE *target, int target_pitch, const BYTE *source, int source_pitch) {
+	__m128i r[8];
+	for(int i = 0; i < 8; i++) {
+		r[i] = _mm_loadu_si128((const __m128i*)(source + (ptrdiff_t)i * source_pitch));
+	}
+	const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+	const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+	const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+	const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+	const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+	const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+	const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+	const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+	// columns 0-1, 2-3, 4-5 and 6-7 of rows 0-3, then of rows 4-7
+	const __m128i b[8] = {
+		_mm_unpacklo_epi32(a0, a2), _mm_unpackhi_epi32(a0, a2), _mm_unpacklo_epi32(a1, a3), _mm_unpackhi_epi32(a1, a3),
+		_mm_unpacklo_epi32(a4, a6), _mm_unpackhi_epi32(a4, a6), _mm_unpacklo_epi32(a5, a7), _mm_unpackhi_epi32(a5, a7)
+	};
+	for(int i = 0; i < 4; i++) {
+		_mm_storeu_si128((__m128i*)(target + (ptrdiff_t)(2 * i) * target_pitch), _mm_unpacklo_epi64(b[i], b[i + 4]));
+		_mm_storeu_si128((__m128i*)(target + (ptrdiff_t)(2 * i + 1) * target_pitch), _mm_unpackhi_epi64(b[i], b[i + 4]));
+	}
+}
+
+/**
+Transpose a 4x4 matrix of 32-bit values
+*/
+static inline FI_TARGET_SSE2 void
+Transpose4x4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) {
+	const __m128i a0 = _mm_unpacklo_epi32(r0, r1);
+	const __m128i a1 = _mm_unpackhi_epi32(r0, r1);
+	const __m128i a2 = _mm_unpacklo_epi32(r2, r3);
+	const __m128i a3 = _mm_unpackhi_epi32(r2, r3);
+	r0 = _mm_unpacklo_epi64(a0, a2);
+	r1 = _mm_unpackhi_epi64(a0, a2);
+	r2 = _mm_unpacklo_epi64(a1, a3);
+	r3 = _mm_unpackhi_epi64(a1, a3);
+}
+
+static inline FI_TARGET_SSE2 void
+TransposeBlock4x4_32(BYTE *target, int target_pitch, const BYTE *source, int source_pitch) {
+	__m128i r0 = _mm_loadu_si128((const __m128i*)source);
+	__m128i r1 = _mm_loadu_si128((const __m128i*)(source + source_pitch));
+	__m128i r2 = _mm_loadu_si128((const __m128i*)(source + 2 * (ptrdiff_t)source_pitch));
+	__m128i r3 = _mm_loadu_si128((const __m128i*)(source + 3 * (ptrdiff_t)source_pitch));
+	Transpose4x4(r0, r1, r2, r3);
+	_mm_storeu_si128((__m128i*)target, r0);
+	_mm_storeu_si128((__m128i*)(target + target_pitch), r1);
+	_mm_storeu_si128((__m128i*)(target + 2 * (ptrdiff_t)target_pitch), r2);
+	_mm_storeu_si128((__m128i*)(target + 3 * (ptrdiff_t)target_pitch), r3);
+}
+
+static inline FI_TARGET_SSE2 void
+TransposeBlock2x2_64(BYTE *target, int target_pitch, const BYTE *source, int source_pitch) {
+	const __m128i r0 = _mm_loadu_si128((const __m128i*)source);
+	const __m128i r1 = _mm_loadu_si128((const __m128i*)(source + source_pitch));
+	_mm_storeu_si128((__m128i*)target, _mm_unpacklo_epi64(r0, r1));
+	_mm_storeu_si128((__m128i*)(target + target_pitch), _mm_unpackhi_epi64(r0, r1));
+}
+
+static FI_TARGET_SSE2 int
+Transpose8_SSE2(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	return TransposeTile_SSE2<8, 1, TransposeBlock8x8_8>(target, target_pitch, source, source_pitch, width, height);
+}
+
+static FI_TARGET_SSE2 int
+Transpose16_SSE2(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	return TransposeTile_SSE2<8, 2, TransposeBlock8x8_16>(target, target_pitch, source, source_pitch, width, height);
+}
+
+static FI_TARGET_SSE2 int
+Transpose32_SSE2(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	return TransposeTile_SSE2<4, 4, TransposeBlock4x4_32>(target, target_pitch, source, source_pitch, width, height);
+}
+
+static FI_TARGET_SSE2 int
+Transpose64_SSE2(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	return TransposeTile_SSE2<2, 8, TransposeBlock2x2_64>(target, target_pitch, source, source_pitch, width, height);
+}
+
+/**
+Reverse the order of the 16-bit words of a vector
+*/
+static inline FI_TARGET_SSE2 __m128i
+ReverseWords(__m128i v) {
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+static FI_TARGET_SSE2 int
+ReverseLine8_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i v = ReverseWords(_mm_loadu_si128((const __m128i*)(source + width_in_pixels - cols - 16)));
+		// swap the bytes of each word
+		_mm_storeu_si128((__m128i*)(target + cols), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ReverseLine16_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const WORD *src_bits = (const WORD*)source;
+	WORD *dst_bits = (WORD*)target;
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		_mm_storeu_si128((__m128i*)(dst_bits + cols), ReverseWords(_mm_loadu_si128((const __m128i*)(src_bits + width_in_pixels - cols - 8))));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ReverseLine32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const DWORD *src_bits = (const DWORD*)source;
+	DWORD *dst_bits = (DWORD*)target;
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src_bits + width_in_pixels - cols - 4));
+		_mm_storeu_si128((__m128i*)(dst_bits + cols), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+ReverseLine64_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 2 <= width_in_pixels; cols += 2) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(source + 8 * (width_in_pixels - cols - 2)));
+		_mm_storeu_si128((__m128i*)(target + 8 * cols), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	}
+	return cols;
+}
+
+// ----------------------------------------------------------
+
+/**
+Load 4 bytes from an unaligned address
+*/
+static inline FI_TARGET_SSE2 int
+LoadInt32(const BYTE *p) {
+	int v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+Load 2 adjacent 24- or 32-bit pixels as 2 x 4 bytes, without reading past the pixels
+*/
+template <int bytespp>
+static inline FI_TARGET_SSE2 __m128i
+LoadPixels2(const BYTE *p) {
+	if(bytespp == 4) {
+		return _mm_loadl_epi64((const __m128i*)p);
+	}
+	return _mm_unpacklo_epi32(_mm_cvtsi32_si128(LoadInt32(p)), _mm_srli_epi32(_mm_cvtsi32_si128(LoadInt32(p + 2)), 8));
+}
+
+/**
+Load 4 adjacent 24- or 32-bit pixels as 4 x 4 bytes, without reading past the pixels
+*/
+template <int bytespp>
+static inline FI_TARGET_SSE2 __m128i
+LoadPixels4(const BYTE *p) {
+	if(bytespp == 4) {
+		return _mm_loadu_si128((const __m128i*)p);
+	}
+	const __m128i p01 = _mm_unpacklo_epi32(_mm_cvtsi32_si128(LoadInt32(p)), _mm_cvtsi32_si128(LoadInt32(p + 3)));
+	const __m128i p23 = _mm_unpacklo_epi32(_mm_cvtsi32_si128(LoadInt32(p + 6)), _mm_srli_epi32(_mm_cvtsi32_si128(LoadInt32(p + 8)), 8));
+	return _mm_unpacklo_epi64(p01, p23);
+}
+
+/**
+Interleave the channels of the 2 pixels of the low 8 bytes of a vector, as 16-bit (pixel 0, pixel 1) pairs
+*/
+static inline FI_TARGET_SSE2 __m128i
+PairChannels(__m128i v) {
+	v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+	return _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+}
+
+/**
+Round, shift and clamp the 32-bit channel sums of a pixel, and store its first bytespp channels
+*/
+template <int bytespp>
+static inline FI_TARGET_SSE2 void
+StoreWarpPixel(BYTE *target, __m128i sum) {
+	sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (FI_WARP_WEIGHT_BITS - 1))), FI_WARP_WEIGHT_BITS);
+	sum = _mm_packs_epi32(sum, sum);
+	const int v = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+	memcpy(target, &v, bytespp);
+}
+
+/**
+Round, shift, clamp and store 4 8-bit pixels from their 32-bit sums
+*/
+static inline FI_TARGET_SSE2 void
+StoreWarpPixels8(BYTE *target, __m128i sum) {
+	sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (FI_WARP_WEIGHT_BITS - 1))), FI_WARP_WEIGHT_BITS);
+	sum = _mm_packs_epi32(sum, sum);
+	const int v = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+	memcpy(target, &v, sizeof(v));
+}
+
+template <int bytespp>
+static FI_TARGET_SSE2 int
+WarpBilinear_SSE2(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count) {
+	for(int i = 0; i < count; i++) {
+		const BYTE *p = source + offset[i];
+		const __m128i w = _mm_loadl_epi64((const __m128i*)(weights + 4 * phase[i]));
+		__m128i sum = _mm_madd_epi16(PairChannels(LoadPixels2<bytespp>(p)), _mm_shuffle_epi32(w, _MM_SHUFFLE(0, 0, 0, 0)));
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(PairChannels(LoadPixels2<bytespp>(p + pitch)), _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 1, 1))));
+		StoreWarpPixel<bytespp>(target + i * bytespp, sum);
+	}
+	return count;
+}
+
+/**
+Add the weighted taps of a row of the 4 x 4 taps of a 24- or 32-bit pixel. 
+The (tap 0, tap 1) and (tap 2, tap 3) weight pairs of the row are the 32-bit elements E0 and E1 of w.
+*/
+template <int bytespp, int E0, int E1>
+static inline FI_TARGET_SSE2 __m128i
+AddBicubicRow(__m128i sum, const BYTE *p, __m128i w) {
+	const __m128i v = LoadPixels4<bytespp>(p);
+	sum = _mm_add_epi32(sum, _mm_madd_epi16(PairChannels(v), _mm_shuffle_epi32(w, _MM_SHUFFLE(E0, E0, E0, E0))));
+	return _mm_add_epi32(sum, _mm_madd_epi16(PairChannels(_mm_srli_si128(v, 8)), _mm_shuffle_epi32(w, _MM_SHUFFLE(E1, E1, E1, E1))));
+}
+
+template <int bytespp>
+static FI_TARGET_SSE2 int
+WarpBicubic_SSE2(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count) {
+	for(int i = 0; i < count; i++) {
+		const BYTE *p = source + offset[i];
+		const short *w = weights + 16 * phase[i];
+		const __m128i w01 = _mm_loadu_si128((const __m128i*)w);
+		const __m128i w23 = _mm_loadu_si128((const __m128i*)(w + 8));
+		__m128i sum = _mm_setzero_si128();
+		sum = AddBicubicRow<bytespp, 0, 1>(sum, p, w01);
+		sum = AddBicubicRow<bytespp, 2, 3>(sum, p + pitch, w01);
+		sum = AddBicubicRow<bytespp, 0, 1>(sum, p + 2 * pitch, w23);
+		sum = AddBicubicRow<bytespp, 2, 3>(sum, p + 3 * pitch, w23);
+		StoreWarpPixel<bytespp>(target + i * bytespp, sum);
+	}
+	return count;
+}
+
+/**
+Add the 4 values of each of 4 vectors : returns (sum(m0), sum(m1), sum(m2), sum(m3))
+*/
+static inline FI_TARGET_SSE2 __m128i
+HorizontalSum4(__m128i m0, __m128i m1, __m128i m2, __m128i m3) {
+	const __m128i t0 = _mm_add_epi32(_mm_unpacklo_epi32(m0, m1), _mm_unpackhi_epi32(m0, m1));
+	const __m128i t1 = _mm_add_epi32(_mm_unpacklo_epi32(m2, m3), _mm_unpackhi_epi32(m2, m3));
+	return _mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+}
+
+static FI_TARGET_SSE2 int
+WarpBilinear8_SSE2(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		// 2 x 2 taps of 4 pixels
+		unsigned taps[4];
+		for(int k = 0; k < 4; k++) {
+			const BYTE *p = source + offset[i + k];
+			taps[k] = p[0] | (p[1] << 8) | (p[pitch] << 16) | ((unsigned)p[pitch + 1] << 24);
+		}
+		const __m128i v = _mm_setr_epi32((int)taps[0], (int)taps[1], (int)taps[2], (int)taps[3]);
+		const __m128i w01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(weights + 4 * phase[i])), _mm_loadl_epi64((const __m128i*)(weights + 4 * phase[i + 1])));
+		const __m128i w23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(weights + 4 * phase[i + 2])), _mm_loadl_epi64((const __m128i*)(weights + 4 * phase[i + 3])));
+		const __m128 m01 = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(v, zero), w01));
+		const __m128 m23 = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(v, zero), w23));
+		const __m128i sum = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(m01, m23, _MM_SHUFFLE(2, 0, 2, 0))), 
+			_mm_castps_si128(_mm_shuffle_ps(m01, m23, _MM_SHUFFLE(3, 1, 3, 1))));
+		StoreWarpPixels8(target + i, sum);
+	}
+	return i;
+}
+
+static FI_TARGET_SSE2 int
+WarpBicubic8_SSE2(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i m[4];
+		for(int k = 0; k < 4; k++) {
+			// 4 x 4 taps of a pixel, in row order
+			const BYTE *p = source + offset[i + k];
+			const __m128i v = _mm_setr_epi32(LoadInt32(p), LoadInt32(p + pitch), LoadInt32(p + 2 * pitch), LoadInt32(p + 3 * pitch));
+			const short *w = weights + 16 * phase[i + k];
+			m[k] = _mm_add_epi32(
+				_mm_madd_epi16(_mm_unpacklo_epi8(v, zero), _mm_loadu_si128((const __m128i*)w)), 
+				_mm_madd_epi16(_mm_unpackhi_epi8(v, zero), _mm_loadu_si128((const __m128i*)(w + 8))));
+		}
+		StoreWarpPixels8(target + i, HorizontalSum4(m[0], m[1], m[2], m[3]));
+	}
+	return i;
+}
+
+// ----------------------------------------------------------
+
+/**
+Deinterleave 16 32-bit pixels : vector k receives byte k of each pixel
+*/
+static inline FI_TARGET_SSE2 void
+Deinterleave32(__m128i v[4]) {
+	for(int round = 0; round < 3; round++) {
+		const __m128i t0 = _mm_unpacklo_epi8(v[0], v[1]);
+		const __m128i t1 = _mm_unpackhi_epi8(v[0], v[1]);
+		const __m128i t2 = _mm_unpacklo_epi8(v[2], v[3]);
+		const __m128i t3 = _mm_unpackhi_epi8(v[2], v[3]);
+		v[0] = t0; v[1] = t1; v[2] = t2; v[3] = t3;
+	}
+	// v[0] and v[2] hold bytes 0 and 1 of pixels 0-7 and 8-15, v[1] and v[3] bytes 2 and 3
+	const __m128i t0 = v[0], t1 = v[1], t2 = v[2], t3 = v[3];
+	v[0] = _mm_unpacklo_epi64(t0, t2);
+	v[1] = _mm_unpackhi_epi64(t0, t2);
+	v[2] = _mm_unpacklo_epi64(t1, t3);
+	v[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+/**
+Interleave 4 vectors of 16 bytes into 16 32-bit pixels : byte k of each pixel is taken from vector k
+*/
+static inline FI_TARGET_SSE2 void
+Interleave32(__m128i v[4]) {
+	const __m128i lo01 = _mm_unpacklo_epi8(v[0], v[1]);
+	const __m128i hi01 = _mm_unpackhi_epi8(v[0], v[1]);
+	const __m128i lo23 = _mm_unpacklo_epi8(v[2], v[3]);
+	const __m128i hi23 = _mm_unpackhi_epi8(v[2], v[3]);
+	v[0] = _mm_unpacklo_epi16(lo01, lo23);
+	v[1] = _mm_unpackhi_epi16(lo01, lo23);
+	v[2] = _mm_unpacklo_epi16(hi01, hi23);
+	v[3] = _mm_unpackhi_epi16(hi01, hi23);
+}
+
+static FI_TARGET_SSE2 int
+Split32_SSE2(BYTE *const planes[4], const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i *s = (const __m128i*)(source + 4 * cols);
+		__m128i v[4] = { _mm_loadu_si128(s), _mm_loadu_si128(s + 1), _mm_loadu_si128(s + 2), _mm_loadu_si128(s + 3) };
+		Deinterleave32(v);
+		for(int k = 0; k < 4; k++) {
+			_mm_storeu_si128((__m128i*)(planes[k] + cols), v[k]);
+		}
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Merge32_SSE2(BYTE *target, const BYTE *const planes[4], int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i v[4];
+		for(int k = 0; k < 4; k++) {
+			v[k] = _mm_loadu_si128((const __m128i*)(planes[k] + cols));
+		}
+		Interleave32(v);
+		__m128i *t = (__m128i*)(target + 4 * cols);
+		for(int k = 0; k < 4; k++) {
+			_mm_storeu_si128(t + k, v[k]);
+		}
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Split64_SSE2(BYTE *const planes[4], const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i *s = (const __m128i*)(source + 8 * cols);
+		__m128i v[4] = { _mm_loadu_si128(s), _mm_loadu_si128(s + 1), _mm_loadu_si128(s + 2), _mm_loadu_si128(s + 3) };
+		for(int round = 0; round < 2; round++) {
+			const __m128i t0 = _mm_unpacklo_epi16(v[0], v[1]);
+			const __m128i t1 = _mm_unpackhi_epi16(v[0], v[1]);
+			const __m128i t2 = _mm_unpacklo_epi16(v[2], v[3]);
+			const __m128i t3 = _mm_unpackhi_epi16(v[2], v[3]);
+			v[0] = t0; v[1] = t1; v[2] = t2; v[3] = t3;
+		}
+		// v[0] and v[2] hold words 0 and 1 of pixels 0-3 and 4-7, v[1] and v[3] words 2 and 3
+		_mm_storeu_si128((__m128i*)(planes[0] + 2 * cols), _mm_unpacklo_epi64(v[0], v[2]));
+		_mm_storeu_si128((__m128i*)(planes[1] + 2 * cols), _mm_unpackhi_epi64(v[0], v[2]));
+		_mm_storeu_si128((__m128i*)(planes[2] + 2 * cols), _mm_unpacklo_epi64(v[1], v[3]));
+		_mm_storeu_si128((__m128i*)(planes[3] + 2 * cols), _mm_unpackhi_epi64(v[1], v[3]));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Merge64_SSE2(BYTE *target, const BYTE *const planes[4], int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		__m128i v[4];
+		for(int k = 0; k < 4; k++) {
+			v[k] = _mm_loadu_si128((const __m128i*)(planes[k] + 2 * cols));
+		}
+		const __m128i lo01 = _mm_unpacklo_epi16(v[0], v[1]);
+		const __m128i hi01 = _mm_unpackhi_epi16(v[0], v[1]);
+		const __m128i lo23 = _mm_unpacklo_epi16(v[2], v[3]);
+		const __m128i hi23 = _mm_unpackhi_epi16(v[2], v[3]);
+		__m128i *t = (__m128i*)(target + 8 * cols);
+		_mm_storeu_si128(t, _mm_unpacklo_epi32(lo01, lo23));
+		_mm_storeu_si128(t + 1, _mm_unpackhi_epi32(lo01, lo23));
+		_mm_storeu_si128(t + 2, _mm_unpacklo_epi32(hi01, hi23));
+		_mm_storeu_si128(t + 3, _mm_unpackhi_epi32(hi01, hi23));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Split128_SSE2(BYTE *const planes[4], const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const float *s = (const float*)(source + 16 * cols);
+		__m128 v0 = _mm_loadu_ps(s), v1 = _mm_loadu_ps(s + 4), v2 = _mm_loadu_ps(s + 8), v3 = _mm_loadu_ps(s + 12);
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+		_mm_storeu_ps((float*)(planes[0] + 4 * cols), v0);
+		_mm_storeu_ps((float*)(planes[1] + 4 * cols), v1);
+		_mm_storeu_ps((float*)(planes[2] + 4 * cols), v2);
+		_mm_storeu_ps((float*)(planes[3] + 4 * cols), v3);
+	}
+	return cols;
+}
+
+static FI_TARGET_SSE2 int
+Merge128_SSE2(BYTE *target, const BYTE *const planes[4], int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		__m128 v0 = _mm_loadu_ps((const float*)(planes[0] + 4 * cols));
+		__m128 v1 = _mm_loadu_ps((const float*)(planes[1] + 4 * cols));
+		__m128 v2 = _mm_loadu_ps((const float*)(planes[2] + 4 * cols));
+		__m128 v3 = _mm_loadu_ps((const float*)(planes[3] + 4 * cols));
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+		float *t = (float*)(target + 16 * cols);
+		_mm_storeu_ps(t, v0);
+		_mm_storeu_ps(t + 4, v1);
+		_mm_storeu_ps(t + 8, v2);
+		_mm_storeu_ps(t + 12, v3);
+	}
+	return cols;
+}
+
+// ----------------------------------------------------------
+
+static FI_TARGET_SSE2 int
+Convolve_SSE2(float *target, const float *const *rows, int count, const float *weights, int taps) {
+	int i = 0;
+	for(; i + 16 <= count; i += 16) {
+		__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+		for(int k = 0; k < taps; k++) {
+			const float *s = rows[k] + i;
+			const __m128 w = _mm_set1_ps(weights[k]);
+			a0 = _mm_add_ps(a0, _mm_mul_ps(w, _mm_loadu_ps(s)));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(w, _mm_loadu_ps(s + 4)));
+			a2 = _mm_add_ps(a2, _mm_mul_ps(w, _mm_loadu_ps(s + 8)));
+			a3 = _mm_add_ps(a3, _mm_mul_ps(w, _mm_loadu_ps(s + 12)));
+		}
+		_mm_storeu_ps(target + i, a0);
+		_mm_storeu_ps(target + i + 4, a1);
+		_mm_storeu_ps(target + i + 8, a2);
+		_mm_storeu_ps(target + i + 12, a3);
+	}
+	for(; i + 4 <= count; i += 4) {
+		__m128 a = _mm_setzero_ps();
+		for(int k = 0; k < taps; k++) {
+			const float *s = rows[k] + i;
+			a = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(s)));
+		}
+		_mm_storeu_ps(target + i, a);
+	}
+	return i;
+}
+
+// ==========================================================
+//   SSSE3 kernels
+// ==========================================================
+
+static FI_TARGET_SSSE3 int
+ReverseLine24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	// target vector k gets its bytes from the source vectors m by pshufb(source[m], mask_km)
+	const __m128i m01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 14);
+	const __m128i m02 = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -128);
+	const __m128i m10 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 15, -128);
+	const __m128i m11 = _mm_setr_epi8(15, -128, 11, 12, 13, 8, 9, 10, 5, 6, 7, 2, 3, 4, -128, 0);
+	const __m128i m12 = _mm_setr_epi8(-128, 0, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	const __m128i m20 = _mm_setr_epi8(-128, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+	const __m128i m21 = _mm_setr_epi8(1, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		// 16 pixels in 3 vectors
+		const BYTE *src_bits = source + 3 * (width_in_pixels - cols - 16);
+		const __m128i s0 = _mm_loadu_si128((const __m128i*)src_bits);
+		const __m128i s1 = _mm_loadu_si128((const __m128i*)(src_bits + 16));
+		const __m128i s2 = _mm_loadu_si128((const __m128i*)(src_bits + 32));
+		BYTE *dst_bits = target + 3 * cols;
+		_mm_storeu_si128((__m128i*)dst_bits, _mm_or_si128(_mm_shuffle_epi8(s1, m01), _mm_shuffle_epi8(s2, m02)));
+		_mm_storeu_si128((__m128i*)(dst_bits + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(s0, m10), _mm_shuffle_epi8(s1, m11)), _mm_shuffle_epi8(s2, m12)));
+		_mm_storeu_si128((__m128i*)(dst_bits + 32), _mm_or_si128(_mm_shuffle_epi8(s0, m20), _mm_shuffle_epi8(s1, m21)));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+Transpose24_SSSE3(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	if((width < 16) || (height < 16)) {
+		return 0;
+	}
+	for(int y = 0; y + 16 <= height; y += 16) {
+		for(int x = 0; x + 16 <= width; x += 16) {
+			// 16x16 block as 32-bit pixels, p[row][k] holds the pixels 4k .. 4k + 3 of a row
+			__m128i p[16][4];
+			const BYTE *src_bits = source + (ptrdiff_t)y * source_pitch + 3 * x;
+			for(int row = 0; row < 16; row++) {
+				Load24(src_bits + (ptrdiff_t)row * source_pitch, p[row]);
+			}
+			// transpose the 4x4 sub-blocks in place, then swap them
+			for(int i = 0; i < 4; i++) {
+				for(int k = 0; k < 4; k++) {
+					Transpose4x4(p[4 * i][k], p[4 * i + 1][k], p[4 * i + 2][k], p[4 * i + 3][k]);
+				}
+			}
+			for(int i = 0; i < 4; i++) {
+				for(int k = i + 1; k < 4; k++) {
+					for(int r = 0; r < 4; r++) {
+						const __m128i t = p[4 * i + r][k];
+						p[4 * i + r][k] = p[4 * k + r][i];
+						p[4 * k + r][i] = t;
+					}
+				}
+			}
+			BYTE *dst_bits = target + (ptrdiff_t)x * target_pitch + 3 * y;
+			for(int row = 0; row < 16; row++) {
+				Store24(dst_bits + (ptrdiff_t)row * target_pitch, p[row]);
+			}
+		}
+	}
+	return 16;
+}
+
+static FI_TARGET_SSSE3 int
+Shuffle32_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels, const BYTE order[4]) {
+	const __m128i shuffle = _mm_setr_epi8(
+		order[0], order[1], order[2], order[3],
+		order[0] + 4, order[1] + 4, order[2] + 4, order[3] + 4,
+		order[0] + 8, order[1] + 8, order[2] + 8, order[3] + 8,
+		order[0] + 12, order[1] + 12, order[2] + 12, order[3] + 12);
+	int cols = 0;
+	for(; cols + 4 <= width_in_pixels; cols += 4) {
+		const __m128i p = _mm_loadu_si128((const __m128i*)(source + 4 * cols));
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), _mm_shuffle_epi8(p, shuffle));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+WuIndexLine24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p[4];
+		Load24(source + 3 * cols, p);
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), PackWords(WuIndex32(p[0]), WuIndex32(p[1])));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols + 16), PackWords(WuIndex32(p[2]), WuIndex32(p[3])));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+ConvertLine24To8_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p[4];
+		Load24(source + 3 * cols, p);
+		StoreGrey(target + cols, Grey32(p[0]), Grey32(p[1]), Grey32(p[2]), Grey32(p[3]));
+	}
+	return cols;
+}
+
+template <bool IS_565>
+static FI_TARGET_SSSE3 int
+ConvertLine24To16_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p[4];
+		Load24(source + 3 * cols, p);
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), PackWords(Pack16From32<IS_565>(p[0]), Pack16From32<IS_565>(p[1])));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols + 16), PackWords(Pack16From32<IS_565>(p[2]), Pack16From32<IS_565>(p[3])));
+	}
+	return cols;
+}
+
+template <bool IS_565>
+static FI_TARGET_SSSE3 int
+ConvertLine16To24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i r, g, b, p[4];
+		Unpack16<IS_565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols)), r, g, b);
+		PackRGBA(r, g, b, p[0], p[1]);
+		Unpack16<IS_565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols + 16)), r, g, b);
+		PackRGBA(r, g, b, p[2], p[3]);
+		Store24(target + 3 * cols, p);
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+ConvertLine32To24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i *s = (const __m128i*)(source + 4 * cols);
+		__m128i p[4];
+		p[0] = _mm_loadu_si128(s);
+		p[1] = _mm_loadu_si128(s + 1);
+		p[2] = _mm_loadu_si128(s + 2);
+		p[3] = _mm_loadu_si128(s + 3);
+		Store24(target + 3 * cols, p);
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+ConvertLine24To32_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i alpha = _mm_set1_epi32(FI_RGBA_ALPHA_MASK);
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p[4];
+		Load24(source + 3 * cols, p);
+		__m128i *t = (__m128i*)(target + 4 * cols);
+		_mm_storeu_si128(t, _mm_or_si128(p[0], alpha));
+		_mm_storeu_si128(t + 1, _mm_or_si128(p[1], alpha));
+		_mm_storeu_si128(t + 2, _mm_or_si128(p[2], alpha));
+		_mm_storeu_si128(t + 3, _mm_or_si128(p[3], alpha));
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+Split24_SSSE3(BYTE *const planes[4], const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i v[4];
+		Load24(source + 3 * cols, v);
+		Deinterleave32(v);
+		for(int k = 0; k < 3; k++) {
+			_mm_storeu_si128((__m128i*)(planes[k] + cols), v[k]);
+		}
+	}
+	return cols;
+}
+
+static FI_TARGET_SSSE3 int
+Merge24_SSSE3(BYTE *target, const BYTE *const planes[4], int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i v[4];
+		for(int k = 0; k < 3; k++) {
+			v[k] = _mm_loadu_si128((const __m128i*)(planes[k] + cols));
+		}
+		v[3] = _mm_setzero_si128();
+		Interleave32(v);
+		Store24(target + 3 * cols, v);
+	}
+	return cols;
+}
+
+// ==========================================================
+//   AVX2 kernels
+// ==========================================================
+
+// A palette entry has the same memory layout as a 32-bit pixel :
+// palette lookups are done with gathers of 8 entries.
+
+/**
+Gather the palette entries of 8 8-bit pixels
+*/
+static inline FI_TARGET_AVX2 __m256i
+GatherPalette(const BYTE *source, const RGBQUAD *palette) {
+	const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)source));
+	return _mm256_i32gather_epi32((const int*)palette, index, 4);
+}
+
+template <bool IS_565>
+static FI_TARGET_AVX2 int
+ConvertLine8To16_AVX2(BYTE *target, const BYTE *source, int width_in_pixels, const RGBQUAD *palette) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m256i p = GatherPalette(source + cols, palette);
+		const __m128i lo = Pack16From32<IS_565>(_mm256_castsi256_si128(p));
+		const __m128i hi = Pack16From32<IS_565>(_mm256_extracti128_si256(p, 1));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), PackWords(lo, hi));
+	}
+	return cols;
+}
+
+static FI_TARGET_AVX2 int
+ConvertLine8To24_AVX2(BYTE *target, const BYTE *source, int width_in_pixels, const RGBQUAD *palette) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m256i p0 = GatherPalette(source + cols, palette);
+		const __m256i p1 = GatherPalette(source + cols + 8, palette);
+		__m128i p[4];
+		p[0] = _mm256_castsi256_si128(p0);
+		p[1] = _mm256_extracti128_si256(p0, 1);
+		p[2] = _mm256_castsi256_si128(p1);
+		p[3] = _mm256_extracti128_si256(p1, 1);
+		Store24(target + 3 * cols, p);
+	}
+	return cols;
+}
+
+static FI_TARGET_AVX2 int
+ConvertLine8To32_AVX2(BYTE *target, const BYTE *source, int width_in_pixels, const RGBQUAD *palette) {
+	const __m256i alpha = _mm256_set1_epi32(FI_RGBA_ALPHA_MASK);
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m256i p = GatherPalette(source + cols, palette);
+		_mm256_storeu_si256((__m256i*)(target + 4 * cols), _mm256_or_si256(p, alpha));
+	}
+	return cols;
+}
+
+static FI_TARGET_AVX2 int
+Convolve_AVX2(float *target, const float *const *rows, int count, const float *weights, int taps) {
+	int i = 0;
+	for(; i + 32 <= count; i += 32) {
+		__m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+		for(int k = 0; k < taps; k++) {
+			const float *s = rows[k] + i;
+			const __m256 w = _mm256_set1_ps(weights[k]);
+			a0 = _mm256_add_ps(a0, _mm256_mul_ps(w, _mm256_loadu_ps(s)));
+			a1 = _mm256_add_ps(a1, _mm256_mul_ps(w, _mm256_loadu_ps(s + 8)));
+			a2 = _mm256_add_ps(a2, _mm256_mul_ps(w, _mm256_loadu_ps(s + 16)));
+			a3 = _mm256_add_ps(a3, _mm256_mul_ps(w, _mm256_loadu_ps(s + 24)));
+		}
+		_mm256_storeu_ps(target + i, a0);
+		_mm256_storeu_ps(target + i + 8, a1);
+		_mm256_storeu_ps(target + i + 16, a2);
+		_mm256_storeu_ps(target + i + 24, a3);
+	}
+	for(; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_setzero_ps();
+		for(int k = 0; k < taps; k++) {
+			const float *s = rows[k] + i;
+			a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(s)));
+		}
+		_mm256_storeu_ps(target + i, a);
+	}
+	return i;
+}
+
+#endif // FI_SIMD_X86
+
+// ==========================================================
+//   Line kernels dispatch
+// ==========================================================
+
+static int
+ConvertLineNone(BYTE *target, const BYTE *source, int width_in_pixels) {
+	return 0;
+}
+
+static int
+ConvertLinePaletteNone(BYTE *target, const BYTE *source, int width_in_pixels, const RGBQUAD *palette) {
+	return 0;
+}
+
+static int
+ShuffleLineNone(BYTE *target, const BYTE *source, int width_in_pixels, const BYTE order[4]) {
+	return 0;
+}
+
+static int
+ThresholdLineNone(BYTE *target, const BYTE *source, const BYTE *threshold, int width_in_pixels) {
+	return 0;
+}
+
+static int
+ColorMatrixLineNone(float *target, const float *source, int width_in_pixels, const float matrix[3][3]) {
+	return 0;
+}
+
+static int
+FloatLineNone(float *target, const float *source, int width_in_pixels) {
+	return 0;
+}
+
+static int
+RelaxationLineNone(float *u, const float *rhs, int pitch, int first, int last, float h2) {
+	return first;
+}
+
+static int
+ResidualLineNone(float *res, const float *u, const float *rhs, int pitch, int first, int last, float h2i) {
+	return first;
+}
+
+static int
+TransposeNone(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height) {
+	return 0;
+}
+
+static int
+WarpLineNone(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count) {
+	return 0;
+}
+
+static int
+CompositeLineNone(BYTE *target, const BYTE *source, int width_in_pixels, unsigned opacity) {
+	return 0;
+}
+
+static int
+FloatCompositeLineNone(float *target, const float *source, int width_in_pixels, float opacity) {
+	return 0;
+}
+
+static int
+BlendLineNone(BYTE *target, const BYTE *source, int count, unsigned alpha) {
+	return 0;
+}
+
+static int
+SplitLineNone(BYTE *const planes[4], const BYTE *source, int width_in_pixels) {
+	return 0;
+}
+
+static int
+MergeLineNone(BYTE *target, const BYTE *const planes[4], int width_in_pixels) {
+	return 0;
+}
+
+static int
+ConvolveLineNone(float *target, const float *const *rows, int count, const float *weights, int taps) {
+	return 0;
+}
+
+static int
+MinMaxFloatNone(const float *source, int count, float *min_value, float *max_value) {
+	return 0;
+}
+
+static int
+MinMaxDoubleNone(const double *source, int count, double *min_value, double *max_value) {
+	return 0;
+}
+
+static FILineKernels
+BuildLineKernels() {
+	FILineKernels k;
+
+	k.convert16To8_555 = ConvertLineNone;
+	k.convert16To8_565 = ConvertLineNone;
+	k.convert24To8 = ConvertLineNone;
+	k.convert32To8 = ConvertLineNone;
+	k.convert8To16_555 = ConvertLinePaletteNone;
+	k.convert16_565_To16_555 = ConvertLineNone;
+	k.convert24To16_555 = ConvertLineNone;
+	k.convert32To16_555 = ConvertLineNone;
+	k.convert8To16_565 = ConvertLinePaletteNone;
+	k.convert16_555_To16_565 = ConvertLineNone;
+	k.convert24To16_565 = ConvertLineNone;
+	k.convert32To16_565 = ConvertLineNone;
+	k.convert8To24 = ConvertLinePaletteNone;
+	k.convert16To24_555 = ConvertLineNone;
+	k.convert16To24_565 = ConvertLineNone;
+	k.convert32To24 = ConvertLineNone;
+	k.convert8To32 = ConvertLinePaletteNone;
+	k.convert16To32_555 = ConvertLineNone;
+	k.convert16To32_565 = ConvertLineNone;
+	k.convert24To32 = ConvertLineNone;
+	k.premultiply32 = ConvertLineNone;
+	k.unpremultiply32 = ConvertLineNone;
+	k.premultiplyRGBAF = FloatLineNone;
+	k.unpremultiplyRGBAF = FloatLineNone;
+	k.mix32 = ConvertLineNone;
+	for(int mode = FIBM_OVER; mode <= FIBM_ADD; mode++) {
+		k.composite32[mode] = CompositeLineNone;
+		k.compositeRGBAF[mode] = FloatCompositeLineNone;
+	}
+	k.blend8 = BlendLineNone;
+	k.split24 = SplitLineNone;
+	k.split32 = SplitLineNone;
+	k.split64 = SplitLineNone;
+	k.split128 = SplitLineNone;
+	k.merge24 = MergeLineNone;
+	k.merge32 = MergeLineNone;
+	k.merge64 = MergeLineNone;
+	k.merge128 = MergeLineNone;
+	k.convolve = ConvolveLineNone;
+	k.shuffle32 = ShuffleLineNone;
+	k.minmaxFloat = MinMaxFloatNone;
+	k.minmaxDouble = MinMaxDoubleNone;
+	k.wuIndex24 = ConvertLineNone;
+	k.wuIndex32 = ConvertLineNone;
+	k.threshold8To1 = ThresholdLineNone;
+	k.rgbfToYxy = ColorMatrixLineNone;
+	k.yxyToRGBF = ColorMatrixLineNone;
+	k.rgbfToY = FloatLineNone;
+	k.relaxation = RelaxationLineNone;
+	k.residual = ResidualLineNone;
+	k.transpose8 = TransposeNone;
+	k.transpose16 = TransposeNone;
+	k.transpose24 = TransposeNone;
+	k.transpose32 = TransposeNone;
+	k.transpose64 = TransposeNone;
+	k.reverse8 = ConvertLineNone;
+	k.reverse16 = ConvertLineNone;
+	k.reverse24 = ConvertLineNone;
+	k.reverse32 = ConvertLineNone;
+	k.reverse64 = ConvertLineNone;
+	k.warpBilinear8 = WarpLineNone;
+	k.warpBilinear24 = WarpLineNone;
+	k.warpBilinear32 = WarpLineNone;
+	k.warpBicubic8 = WarpLineNone;
+	k.warpBicubic24 = WarpLineNone;
+	k.warpBicubic32 = WarpLineNone;
+
+#ifdef FI_SIMD_X86
+	const unsigned features = GetCPUFeatures();
+
+	if(features & FI_CPU_SSE2) {
+		k.convert16To8_555 = ConvertLine16To8_SSE2<false>;
+		k.convert16To8_565 = ConvertLine16To8_SSE2<true>;
+		k.convert32To8 = ConvertLine32To8_SSE2;
+		k.convert16_565_To16_555 = ConvertLine16To16_SSE2<true>;
+		k.convert32To16_555 = ConvertLine32To16_SSE2<false>;
+		k.convert16_555_To16_565 = ConvertLine16To16_SSE2<false>;
+		k.convert32To16_565 = ConvertLine32To16_SSE2<true>;
+		k.convert16To32_555 = ConvertLine16To32_SSE2<false>;
+		k.convert16To32_565 = ConvertLine16To32_SSE2<true>;
+		k.premultiply32 = Premultiply32_SSE2;
+		k.unpremultiply32 = Unpremultiply32_SSE2;
+		k.premultiplyRGBAF = PremultiplyRGBAF_SSE2;
+		k.unpremultiplyRGBAF = UnpremultiplyRGBAF_SSE2;
+		k.mix32 = Mix32_SSE2;
+		k.composite32[FIBM_OVER] = Composite32_SSE2<FIBM_OVER>;
+		k.composite32[FIBM_MULTIPLY] = Composite32_SSE2<FIBM_MULTIPLY>;
+		k.composite32[FIBM_SCREEN] = Composite32_SSE2<FIBM_SCREEN>;
+		k.composite32[FIBM_ADD] = Composite32_SSE2<FIBM_ADD>;
+		k.compositeRGBAF[FIBM_OVER] = CompositeRGBAF_SSE2<FIBM_OVER>;
+		k.compositeRGBAF[FIBM_MULTIPLY] = CompositeRGBAF_SSE2<FIBM_MULTIPLY>;
+		k.compositeRGBAF[FIBM_SCREEN] = CompositeRGBAF_SSE2<FIBM_SCREEN>;
+		k.compositeRGBAF[FIBM_ADD] = CompositeRGBAF_SSE2<FIBM_ADD>;
+		k.blend8 = Blend8_SSE2;
+		k.split32 = Split32_SSE2;
+		k.split64 = Split64_SSE2;
+		k.split128 = Split128_SSE2;
+		k.merge32 = Merge32_SSE2;
+		k.merge64 = Merge64_SSE2;
+		k.merge128 = Merge128_SSE2;
+		k.convolve = Convolve_SSE2;
+		k.minmaxFloat = MinMaxFloat_SSE2;
+		k.minmaxDouble = MinMaxDouble_SSE2;
+		k.wuIndex32 = WuIndexLine32_SSE2;
+		k.threshold8To1 = Threshold8To1_SSE2;
+		k.rgbfToYxy = ConvertLineRGBFToYxy_SSE2;
+		k.yxyToRGBF = ConvertLineYxyToRGBF_SSE2;
+		k.rgbfToY = ConvertLineRGBFToY_SSE2;
+		k.relaxation = RelaxationLine_SSE2;
+		k.residual = ResidualLine_SSE2;
+		k.transpose8 = Transpose8_SSE2;
+		k.transpose16 = Transpose16_SSE2;
+		k.transpose32 = Transpose32_SSE2;
+		k.transpose64 = Transpose64_SSE2;
+		k.reverse8 = ReverseLine8_SSE2;
+		k.reverse16 = ReverseLine16_SSE2;
+		k.reverse32 = ReverseLine32_SSE2;
+		k.reverse64 = ReverseLine64_SSE2;
+		k.warpBilinear8 = WarpBilinear8_SSE2;
+		k.warpBilinear24 = WarpBilinear_SSE2<3>;
+		k.warpBilinear32 = WarpBilinear_SSE2<4>;
+		k.warpBicubic8 = WarpBicubic8_SSE2;
+		k.warpBicubic24 = WarpBicubic_SSE2<3>;
+		k.warpBicubic32 = WarpBicubic_SSE2<4>;
+	}
+	if(features & FI_CPU_SSSE3) {
+		k.convert24To8 = ConvertLine24To8_SSSE3;
+		k.convert24To16_555 = ConvertLine24To16_SSSE3<false>;
+		k.convert24To16_565 = ConvertLine24To16_SSSE3<true>;
+		k.convert16To24_555 = ConvertLine16To24_SSSE3<false>;
+		k.convert16To24_565 = ConvertLine16To24_SSSE3<true>;
+		k.convert32To24 = ConvertLine32To24_SSSE3;
+		k.convert24To32 = ConvertLine24To32_SSSE3;
+		k.shuffle32 = Shuffle32_SSSE3;
+		k.wuIndex24 = WuIndexLine24_SSSE3;
+		k.reverse24 = ReverseLine24_SSSE3;
+		k.transpose24 = Transpose24_SSSE3;
+		k.split24 = Split24_SSSE3;
+		k.merge24 = Merge24_SSSE3;
+	}
+	if(features & FI_CPU_AVX2) {
+		k.convert8To16_555 = ConvertLine8To16_AVX2<false>;
+		k.convert8To16_565 = ConvertLine8To16_AVX2<true>;
+		k.convert8To24 = ConvertLine8To24_AVX2;
+		k.convert8To32 = ConvertLine8To32_AVX2;
+		k.convolve = Convolve_AVX2;
+	}
+#endif // FI_SIMD_X86
+
+	return k;
+}
+
+const FILineKernels&
+GetLineKernels() {
+	static const FILineKernels s_kernels = BuildLineKernels();
+	return s_kernels;
+}
@@ -0,0 +1,287 @@
+// ==========================================================
+// Shared worker pool and parallel loops
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "../ThreadPool.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <deque>
+#include <vector>
+
+// ----------------------------------------------------------
+//   Worker pool
+// ----------------------------------------------------------
+
+/**
+A set of tasks submitted by ParallelRun.
+Lives on the stack of the submitting thread, until all its tasks are done.
+*/
+struct PoolBatch {
+	const std::function<void(unsigned)> *task;
+	unsigned task_count;
+	//! next task index to run
+	std::atomic<unsigned> next;
+	//! number of finished tasks, protected by mutex
+	unsigned done;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	PoolBatch(unsigned count, const std::function<void(unsigned)> *f) : task(f), task_count(count), next(0), done(0) {
+	}
+
+	/**
+	Run the task of a given index, then record its completion
+	*/
+	void Run(unsigned index) {
+		std::exception_ptr task_error;
+		try {
+			(*task)(index);
+		} catch(...) {
+			task_error = std::current_exception();
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if(task_error && !error) {
+			error = task_error;
+		}
+		if(++done == task_count) {
+			finished.notify_all();
+		}
+	}
+};
+
+/**
+Worker threads, shared by all parallel routines.
+Workers are started on first use and stopped by FreeImage_DeInitialise, 
+so that no thread is joined during the static destruction.
+*/
+class ThreadPool {
+private:
+	std::vector<std::thread> _workers;
+	std::deque<PoolBatch*> _queue;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	bool _stop;
+	//! requested number of threads, 0 for the number of hardware threads
+	std::atomic<unsigned> _thread_count;
+
+	//! true on pool worker threads
+	static thread_local bool s_is_worker;
+
+	void WorkerLoop() {
+		s_is_worker = true;
+		std::unique_lock<std::mutex> lock(_mutex);
+		for(;;) {
+			_wake.wait(lock, [this]() { return _stop || !_queue.empty(); });
+			if(_stop) {
+				return;
+			}
+			PoolBatch *batch = _queue.front();
+			const unsigned index = batch->next++;
+			if(index >= batch->task_count) {
+				// all tasks of the batch are started
+				_queue.pop_front();
+				continue;
+			}
+			lock.unlock();
+			batch->Run(index);
+			lock.lock();
+		}
+	}
+
+	void StopWorkers() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_wake.notify_all();
+		for(size_t i = 0; i < _workers.size(); i++) {
+			_workers[i].join();
+		}
+		_workers.clear();
+		_stop = false;
+	}
+
+	void StartWorkers() {
+		const unsigned worker_count = GetThreadCount() - 1;
+		try {
+			while(_workers.size() < worker_count) {
+				_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+			}
+		} catch(...) {
+			// thread creation failed, run with the workers already started
+		}
+	}
+
+public:
+	ThreadPool() : _stop(false), _thread_count(0) {
+	}
+
+	~ThreadPool() {
+		StopWorkers();
+	}
+
+	unsigned GetThreadCount() const {
+		const unsigned thread_count = _thread_count;
+		if(thread_count != 0) {
+			return thread_count;
+		}
+		return MAX(1U, std::thread::hardware_concurrency());
+	}
+
+	void Stop() {
+		std::lock_guard<std::mutex> config_lock(ConfigMutex());
+		StopWorkers();
+	}
+
+	void SetThreadCount(unsigned count) {
+		std::lock_guard<std::mutex> config_lock(ConfigMutex());
+		StopWorkers();
+		_thread_count = count;
+	}
+
+	void Run(unsigned task_count, const std::function<void(unsigned)>& task) {
+		if((task_count == 1) || s_is_worker || (GetThreadCount() == 1)) {
+			for(unsigned i = 0; i < task_count; i++) {
+				task(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> config_lock(ConfigMutex());
+			if(_workers.empty()) {
+				StartWorkers();
+			}
+		}
+
+		PoolBatch batch(task_count, &task);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_queue.push_back(&batch);
+		}
+		_wake.notify_all();
+
+		// take part in the work
+		unsigned index;
+		while((index = batch.next++) < task_count) {
+			batch.Run(index);
+		}
+
+		// wait for the tasks started by the workers
+		{
+			std::unique_lock<std::mutex> lock(batch.mutex);
+			batch.finished.wait(lock, [&batch]() { return batch.done == batch.task_count; });
+		}
+		{
+			// the batch may still be queued when no worker looked at it
+			std::lock_guard<std::mutex> lock(_mutex);
+			for(std::deque<PoolBatch*>::iterator i = _queue.begin(); i != _queue.end(); ++i) {
+				if(*i == &batch) {
+					_queue.erase(i);
+					break;
+				}
+			}
+		}
+
+		if(batch.error) {
+			std::rethrow_exception(batch.error);
+		}
+	}
+
+	//! serializes the pool start and stop
+	static std::mutex& ConfigMutex() {
+		static std::mutex s_mutex;
+		return s_mutex;
+	}
+};
+
+thread_local bool ThreadPool::s_is_worker = false;
+
+static ThreadPool&
+GetThreadPool() {
+	static ThreadPool s_pool;
+	return s_pool;
+}
+
+// ----------------------------------------------------------
+//   Parallel loops
+// ----------------------------------------------------------
+
+void
+StopParallelWorkers() {
+	GetThreadPool().Stop();
+}
+
+unsigned
+GetParallelism() {
+	return GetThreadPool().GetThreadCount();
+}
+
+void
+ParallelRun(unsigned task_count, const std::function<void(unsigned)>& task) {
+	if(task_count == 0) {
+		return;
+	}
+	GetThreadPool().Run(task_count, task);
+}
+
+void
+ParallelFor(unsigned count, unsigned min_count, const std::function<void(unsigned, unsigned)>& body) {
+	if(count == 0) {
+		return;
+	}
+	const unsigned range_count = MIN(GetParallelism(), count / MAX(1U, min_count));
+	if(range_count < 2) {
+		body(0, count);
+		return;
+	}
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((unsigned long long)count * range) / range_count);
+		const unsigned last = (unsigned)(((unsigned long long)count * (range + 1)) / range_count);
+		body(first, last);
+	});
+}
+
+// ----------------------------------------------------------
+//   Public API
+// ----------------------------------------------------------
+
+/**
+Set the number of threads used by the multithreaded routines, including the calling thread.
+Must not be called while images are processed.
+@param count Number of threads, 1 to disable multithreading, 0 for the number of hardware threads (default)
+*/
+void DLL_CALLCONV
+FreeImage_SetThreadCount(unsigned count) {
+	GetThreadPool().SetThreadCount(count);
+}
+
+/**
+Get the number of threads used by the multithreaded routines, including the calling thread.
+@return Returns the value set by FreeImage_SetThreadCount, or the number of hardware threads
+*/
+unsigned DLL_CALLCONV
+FreeImage_GetThreadCount() {
+	return GetParallelism();
+}
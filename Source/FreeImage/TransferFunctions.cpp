@@ -0,0 +1,211 @@
+// ==========================================================
+// sRGB and Rec.709 transfer functions
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "../TransferFunctions.h"
+
+// ----------------------------------------------------------
+
+/**
+Linear interpolation in a table of TABLE_SIZE intervals over [0..1]
+*/
+static inline float
+Interpolate(const float *table, float x) {
+	const int i = (int)x;
+	return table[i] + (x - i) * (table[i + 1] - table[i]);
+}
+
+/**
+Clamp a value to [0..1], NaN values give 0
+*/
+static inline float
+ClampUnit(float value) {
+	if(!(value > 0)) {
+		return 0;
+	}
+	return (value < 1) ? value : 1;
+}
+
+// ----------------------------------------------------------
+
+TransferFunction::TransferFunction(float slope, float threshold, float scale, float exponent, Tables tables) :
+_slope(slope), _threshold(threshold), _scale(scale), _offset(scale - 1), _exponent(exponent),
+_encode(TABLE_SIZE + 2) {
+
+	for(int i = 0; i <= TABLE_SIZE; i++) {
+		_encode[i] = Encode((float)i / TABLE_SIZE);
+	}
+	// only read with a zero weight
+	_encode[TABLE_SIZE + 1] = _encode[TABLE_SIZE];
+
+	if(tables == FLOAT_ENCODING) {
+		return;
+	}
+
+	_decode8.resize(256);
+	_decode16.resize(65536);
+	_decode.resize(TABLE_SIZE + 2);
+	_encode8.resize(TABLE_SIZE + 1);
+
+	for(int i = 0; i < 256; i++) {
+		_decode8[i] = Decode(i / 255.F);
+	}
+	for(int i = 0; i < 65536; i++) {
+		_decode16[i] = Decode(i / 65535.F);
+	}
+	for(int i = 0; i <= TABLE_SIZE; i++) {
+		_decode[i] = Decode((float)i / TABLE_SIZE);
+		_encode8[i] = EncodeByte((float)i / TABLE_SIZE);
+	}
+	// only read with a zero weight
+	_decode[TABLE_SIZE + 1] = _decode[TABLE_SIZE];
+
+	// find the code thresholds by bisection, 
+	// positive floats are ordered as their bit patterns
+	_threshold8[0] = 0;
+	for(int k = 1; k < 256; k++) {
+		unsigned lo = 0;			// 0.F, encoded to less than k
+		unsigned hi = 0x3F800000;	// 1.F, encoded to 255
+		while(hi - lo > 1) {
+			const unsigned mid = lo + (hi - lo) / 2;
+			float value;
+			memcpy(&value, &mid, sizeof(float));
+			if(EncodeByte(value) >= k) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+		memcpy(&_threshold8[k], &hi, sizeof(float));
+	}
+	// never reached, values are clamped to 1
+	_threshold8[256] = 2;
+}
+
+const TransferFunction& 
+TransferFunction::sRGB() {
+	static const TransferFunction s_srgb(12.92F, 0.0031308F, 1.055F, 1 / 2.4F);
+	return s_srgb;
+}
+
+const TransferFunction& 
+TransferFunction::Rec709() {
+	static const TransferFunction s_rec709(4.5F, 0.018F, 1.099F, 0.45F);
+	return s_rec709;
+}
+
+float 
+TransferFunction::Encode(float value) const {
+	return (value <= _threshold) ? value * _slope : _scale * powf(value, _exponent) - _offset;
+}
+
+float 
+TransferFunction::Decode(float value) const {
+	return (value <= _threshold * _slope) ? value / _slope : powf((value + _offset) / _scale, 1 / _exponent);
+}
+
+BYTE 
+TransferFunction::EncodeByte(float value) const {
+	return (BYTE)(255 * Encode(ClampUnit(value)) + 0.5F);
+}
+
+// ----------------------------------------------------------
+
+void 
+TransferFunction::DecodeLine(float *target, const BYTE *source, unsigned count) const {
+	if(_decode8.empty()) {
+		for(unsigned i = 0; i < count; i++) {
+			target[i] = Decode(source[i] / 255.F);
+		}
+		return;
+	}
+	const float *table = &_decode8[0];
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = table[source[i]];
+	}
+}
+
+void 
+TransferFunction::DecodeLine(float *target, const WORD *source, unsigned count) const {
+	if(_decode16.empty()) {
+		for(unsigned i = 0; i < count; i++) {
+			target[i] = Decode(source[i] / 65535.F);
+		}
+		return;
+	}
+	const float *table = &_decode16[0];
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = table[source[i]];
+	}
+}
+
+void 
+TransferFunction::DecodeLine(float *target, const float *source, unsigned count) const {
+	const float *table = _decode.empty() ? NULL : &_decode[0];
+	for(unsigned i = 0; i < count; i++) {
+		const float value = source[i];
+		if(table && (value >= 0) && (value <= 1)) {
+			target[i] = Interpolate(table, value * TABLE_SIZE);
+		} else {
+			target[i] = Decode(value);
+		}
+	}
+}
+
+void 
+TransferFunction::EncodeLine(BYTE *target, const float *source, unsigned count) const {
+	if(_encode8.empty()) {
+		for(unsigned i = 0; i < count; i++) {
+			target[i] = EncodeByte(source[i]);
+		}
+		return;
+	}
+	const BYTE *table = &_encode8[0];
+	for(unsigned i = 0; i < count; i++) {
+		const float value = ClampUnit(source[i]);
+		// the code of the interval lower bound, then the codes whose threshold is reached
+		unsigned code = table[(int)(value * TABLE_SIZE)];
+		while(value >= _threshold8[code + 1]) {
+			code++;
+		}
+		target[i] = (BYTE)code;
+	}
+}
+
+void 
+TransferFunction::EncodeLine(WORD *target, const float *source, unsigned count) const {
+	const float *table = &_encode[0];
+	for(unsigned i = 0; i < count; i++) {
+		const float value = Interpolate(table, ClampUnit(source[i]) * TABLE_SIZE);
+		target[i] = (WORD)(65535 * value + 0.5F);
+	}
+}
+
+void 
+TransferFunction::EncodeLine(float *target, const float *source, unsigned count) const {
+	const float *table = &_encode[0];
+	for(unsigned i = 0; i < count; i++) {
+		const float value = source[i];
+		if((value >= 0) && (value <= 1)) {
+			target[i] = Interpolate(table, value * TABLE_SIZE);
+		} else {
+			target[i] = Encode(value);
+		}
+	}
+}
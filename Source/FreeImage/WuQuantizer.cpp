@@ -33,6 +33,10 @@
 #include "Quantizers.h"
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -47,40 +51,34 @@
 // Constructor / Destructor
 
 WuQuantizer::WuQuantizer(FIBITMAP *dib) {
-	width = FreeImage_GetWidth(dib);
-	height = FreeImage_GetHeight(dib);
-	pitch = FreeImage_GetPitch(dib);
 	m_dib = dib;
 
 	gm2 = NULL;
 	wt = mr = mg = mb = NULL;
-	Qadd = NULL;
+	tag = NULL;
 
 	// Allocate 3D arrays
 	gm2 = (float*)malloc(SIZE_3D * sizeof(float));
-	wt = (LONG*)malloc(SIZE_3D * sizeof(LONG));
-	mr = (LONG*)malloc(SIZE_3D * sizeof(LONG));
-	mg = (LONG*)malloc(SIZE_3D * sizeof(LONG));
-	mb = (LONG*)malloc(SIZE_3D * sizeof(LONG));
-
-	// Allocate Qadd
-	Qadd = (WORD *)malloc(sizeof(WORD) * width * height);
+	wt = (INT64*)malloc(SIZE_3D * sizeof(INT64));
+	mr = (INT64*)malloc(SIZE_3D * sizeof(INT64));
+	mg = (INT64*)malloc(SIZE_3D * sizeof(INT64));
+	mb = (INT64*)malloc(SIZE_3D * sizeof(INT64));
 
-	if(!gm2 || !wt || !mr || !mg || !mb || !Qadd) {
+	if(!gm2 || !wt || !mr || !mg || !mb) {
 		if(gm2)	free(gm2);
 		if(wt)	free(wt);
 		if(mr)	free(mr);
 		if(mg)	free(mg);
 		if(mb)	free(mb);
-		if(Qadd)  free(Qadd);
 		throw FI_MSG_ERROR_MEMORY;
 	}
 	memset(gm2, 0, SIZE_3D * sizeof(float));
-	memset(wt, 0, SIZE_3D * sizeof(LONG));
-	memset(mr, 0, SIZE_3D * sizeof(LONG));
-	memset(mg, 0, SIZE_3D * sizeof(LONG));
-	memset(mb, 0, SIZE_3D * sizeof(LONG));
-	memset(Qadd, 0, sizeof(WORD) * width * height);
+	memset(wt, 0, SIZE_3D * sizeof(INT64));
+	memset(mr, 0, SIZE_3D * sizeof(INT64));
+	memset(mg, 0, SIZE_3D * sizeof(INT64));
+	memset(mb, 0, SIZE_3D * sizeof(INT64));
+	memset(m_palette, 0, sizeof(m_palette));
+	m_palette_size = 0;
 }
 
 WuQuantizer::~WuQuantizer() {
@@ -89,69 +87,113 @@ WuQuantizer::~WuQuantizer() {
 	if(mr)	free(mr);
 	if(mg)	free(mg);
 	if(mb)	free(mb);
-	if(Qadd)  free(Qadd);
+	if(tag)	free(tag);
 }
 
+// Histogram cell of a 24- or 32-bit pixel : [r][g][b]
+static inline WORD
+PixelIndex(const BYTE *pixel) {
+	const int inr = (pixel[FI_RGBA_RED] >> 3) + 1;
+	const int ing = (pixel[FI_RGBA_GREEN] >> 3) + 1;
+	const int inb = (pixel[FI_RGBA_BLUE] >> 3) + 1;
+	return (WORD)INDEX(inr, ing, inb);
+}
+
+// Compute the histogram cell of each pixel of a scanline
+static inline void
+LineIndex(WORD *index, const BYTE *bits, unsigned width, unsigned bytespp, FI_LineKernel kernel) {
+	unsigned x = (unsigned)kernel((BYTE*)index, bits, (int)width);
+	for(; x < width; x++) {
+		index[x] = PixelIndex(bits + x * bytespp);
+	}
+}
+
+// Histogram of a range of scanlines
+struct WuHistogram {
+	std::vector<INT64> vwt, vmr, vmg, vmb;
+	// c^2 sums are exact integers, converted to float once all ranges are summed.
+	// Summing floats per pixel, as the original code did, rounds once the sums grow: 
+	// palettes of large images can differ from the ones of the original code
+	std::vector<UINT64> m2;
+
+	WuHistogram() : vwt(SIZE_3D), vmr(SIZE_3D), vmg(SIZE_3D), vmb(SIZE_3D), m2(SIZE_3D) {
+	}
+};
+
 
 // Histogram is in elements 1..HISTSIZE along each axis,
 // element 0 is for base or marginal value
 // NB: these must start out 0!
 
 // Build 3-D color histogram of counts, r/g/b, c^2
+// The scanlines are split between threads, each thread builds its own histogram
 void 
-WuQuantizer::Hist3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2, int ReserveSize, RGBQUAD *ReservePalette) {
-	int ind = 0;
-	int inr, ing, inb, table[256];
-	int i;
-	unsigned y, x;
-
-	for(i = 0; i < 256; i++)
+WuQuantizer::AddImage(FIBITMAP *dib) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bytespp = FreeImage_GetLine(dib) / width;
+	const FI_LineKernel kernel = (bytespp == 3) ? GetLineKernels().wuIndex24 : GetLineKernels().wuIndex32;
+	int table[256];
+
+	for(int i = 0; i < 256; i++)
 		table[i] = i * i;
 
-	if (FreeImage_GetBPP(m_dib) == 24) {
-		for(y = 0; y < height; y++) {
-			BYTE *bits = FreeImage_GetScanLine(m_dib, y);
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	const unsigned range_count = MAX(1U, MIN(GetParallelism(), height / min_rows));
+	std::vector<WuHistogram> partial(range_count);
+
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((UINT64)height * range) / range_count);
+		const unsigned last = (unsigned)(((UINT64)height * (range + 1)) / range_count);
+		WuHistogram& h = partial[range];
+		std::vector<WORD> index(width);
 
-			for(x = 0; x < width; x++)	{
-				inr = (bits[FI_RGBA_RED] >> 3) + 1;
-				ing = (bits[FI_RGBA_GREEN] >> 3) + 1;
-				inb = (bits[FI_RGBA_BLUE] >> 3) + 1;
-				ind = INDEX(inr, ing, inb);
-				Qadd[y*width + x] = (WORD)ind;
+		for(unsigned y = first; y < last; y++) {
+			const BYTE *bits = FreeImage_GetScanLine(dib, y);
+
+			LineIndex(&index[0], bits, width, bytespp, kernel);
+
+			for(unsigned x = 0; x < width; x++) {
+				const WORD ind = index[x];
 				// [inr][ing][inb]
-				vwt[ind]++;
-				vmr[ind] += bits[FI_RGBA_RED];
-				vmg[ind] += bits[FI_RGBA_GREEN];
-				vmb[ind] += bits[FI_RGBA_BLUE];
-				m2[ind] += (float)(table[bits[FI_RGBA_RED]] + table[bits[FI_RGBA_GREEN]] + table[bits[FI_RGBA_BLUE]]);
-				bits += 3;
+				h.vwt[ind]++;
+				h.vmr[ind] += bits[FI_RGBA_RED];
+				h.vmg[ind] += bits[FI_RGBA_GREEN];
+				h.vmb[ind] += bits[FI_RGBA_BLUE];
+				h.m2[ind] += (UINT64)(table[bits[FI_RGBA_RED]] + table[bits[FI_RGBA_GREEN]] + table[bits[FI_RGBA_BLUE]]);
+				bits += bytespp;
 			}
 		}
-	} else {
-		for(y = 0; y < height; y++) {
-			BYTE *bits = FreeImage_GetScanLine(m_dib, y);
-
-			for(x = 0; x < width; x++)	{
-				inr = (bits[FI_RGBA_RED] >> 3) + 1;
-				ing = (bits[FI_RGBA_GREEN] >> 3) + 1;
-				inb = (bits[FI_RGBA_BLUE] >> 3) + 1;
-				ind = INDEX(inr, ing, inb);
-				Qadd[y*width + x] = (WORD)ind;
-				// [inr][ing][inb]
-				vwt[ind]++;
-				vmr[ind] += bits[FI_RGBA_RED];
-				vmg[ind] += bits[FI_RGBA_GREEN];
-				vmb[ind] += bits[FI_RGBA_BLUE];
-				m2[ind] += (float)(table[bits[FI_RGBA_RED]] + table[bits[FI_RGBA_GREEN]] + table[bits[FI_RGBA_BLUE]]);
-				bits += 4;
-			}
+	});
+
+	// sum the histograms of the ranges
+	for(int i = 0; i < SIZE_3D; i++) {
+		UINT64 m2 = 0;
+		for(unsigned range = 0; range < range_count; range++) {
+			const WuHistogram& h = partial[range];
+			wt[i] += h.vwt[i];
+			mr[i] += h.vmr[i];
+			mg[i] += h.vmg[i];
+			mb[i] += h.vmb[i];
+			m2 += h.m2[i];
 		}
+		gm2[i] += (float)m2;
 	}
+}
+
+// Give the reserved colors a weight higher than any image color
+void
+WuQuantizer::Reserve(int ReserveSize, RGBQUAD *ReservePalette) {
+	int inr, ing, inb, ind, table[256];
+	int i;
+
+	for(i = 0; i < 256; i++)
+		table[i] = i * i;
 
 	if( ReserveSize > 0 ) {
-		int max = 0;
+		INT64 max = 0;
 		for(i = 0; i < SIZE_3D; i++) {
-			if( vwt[i] > max ) max = vwt[i];
+			if( wt[i] > max ) max = wt[i];
 		}
 		max++;
 		for(i = 0; i < ReserveSize; i++) {
@@ -182,11 +224,11 @@ WuQuantizer::Hist3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2, int R
 
 // Compute cumulative moments
 void 
-WuQuantizer::M3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2) {
+WuQuantizer::M3D(INT64 *vwt, INT64 *vmr, INT64 *vmg, INT64 *vmb, float *m2) {
 	unsigned ind1, ind2;
 	BYTE i, r, g, b;
-	LONG line, line_r, line_g, line_b;
-	LONG area[33], area_r[33], area_g[33], area_b[33];
+	INT64 line, line_r, line_g, line_b;
+	INT64 area[33], area_r[33], area_g[33], area_b[33];
 	float line2, area2[33];
 
     for(r = 1; r <= 32; r++) {
@@ -221,8 +263,8 @@ WuQuantizer::M3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2) {
 }
 
 // Compute sum over a box of any given statistic
-LONG 
-WuQuantizer::Vol( Box *cube, LONG *mmt ) {
+INT64 
+WuQuantizer::Vol( Box *cube, INT64 *mmt ) {
     return( mmt[INDEX(cube->r1, cube->g1, cube->b1)] 
 		  - mmt[INDEX(cube->r1, cube->g1, cube->b0)]
 		  - mmt[INDEX(cube->r1, cube->g0, cube->b1)]
@@ -242,8 +284,8 @@ WuQuantizer::Vol( Box *cube, LONG *mmt ) {
 // Compute part of Vol(cube, mmt) that doesn't depend on r1, g1, or b1
 // (depending on dir)
 
-LONG 
-WuQuantizer::Bottom(Box *cube, BYTE dir, LONG *mmt) {
+INT64 
+WuQuantizer::Bottom(Box *cube, BYTE dir, INT64 *mmt) {
     switch(dir)
 	{
 		case FI_RGBA_RED:
@@ -273,8 +315,8 @@ WuQuantizer::Bottom(Box *cube, BYTE dir, LONG *mmt) {
 // Compute remainder of Vol(cube, mmt), substituting pos for
 // r1, g1, or b1 (depending on dir)
 
-LONG 
-WuQuantizer::Top(Box *cube, BYTE dir, int pos, LONG *mmt) {
+INT64 
+WuQuantizer::Top(Box *cube, BYTE dir, int pos, INT64 *mmt) {
     switch(dir)
 	{
 		case FI_RGBA_RED:
@@ -327,15 +369,15 @@ WuQuantizer::Var(Box *cube) {
 // so we drop the minus sign and MAXIMIZE the sum of the two terms.
 
 float
-WuQuantizer::Maximize(Box *cube, BYTE dir, int first, int last , int *cut, LONG whole_r, LONG whole_g, LONG whole_b, LONG whole_w) {
-	LONG half_r, half_g, half_b, half_w;
+WuQuantizer::Maximize(Box *cube, BYTE dir, int first, int last , int *cut, INT64 whole_r, INT64 whole_g, INT64 whole_b, INT64 whole_w) {
+	INT64 half_r, half_g, half_b, half_w;
 	int i;
 	float temp;
 
-    LONG base_r = Bottom(cube, dir, mr);
-    LONG base_g = Bottom(cube, dir, mg);
-    LONG base_b = Bottom(cube, dir, mb);
-    LONG base_w = Bottom(cube, dir, wt);
+    INT64 base_r = Bottom(cube, dir, mr);
+    INT64 base_g = Bottom(cube, dir, mg);
+    INT64 base_b = Bottom(cube, dir, mb);
+    INT64 base_w = Bottom(cube, dir, wt);
 
     float max = 0.0;
 
@@ -380,10 +422,10 @@ WuQuantizer::Cut(Box *set1, Box *set2) {
 	BYTE dir;
 	int cutr, cutg, cutb;
 
-    LONG whole_r = Vol(set1, mr);
-    LONG whole_g = Vol(set1, mg);
-    LONG whole_b = Vol(set1, mb);
-    LONG whole_w = Vol(set1, wt);
+    INT64 whole_r = Vol(set1, mr);
+    INT64 whole_g = Vol(set1, mg);
+    INT64 whole_b = Vol(set1, mb);
+    INT64 whole_w = Vol(set1, wt);
 
     float maxr = Maximize(set1, FI_RGBA_RED, set1->r0+1, set1->r1, &cutr, whole_r, whole_g, whole_b, whole_w);    
 	float maxg = Maximize(set1, FI_RGBA_GREEN, set1->g0+1, set1->g1, &cutg, whole_r, whole_g, whole_b, whole_w);    
@@ -443,116 +485,148 @@ WuQuantizer::Mark(Box *cube, int label, BYTE *tag) {
 	}
 }
 
-// Wu Quantization algorithm
-FIBITMAP *
-WuQuantizer::Quantize(int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette) {
-	BYTE *tag = NULL;
+// Build the palette and the cell to palette index table
+int
+WuQuantizer::BuildPalette(int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette) {
+	Box	cube[MAXCOLOR];
+	int	next;
+	int i;
+	INT64 weight;
+	int k;
+	float vv[MAXCOLOR], temp;
 
-	try {
-		Box	cube[MAXCOLOR];
-		int	next;
-		LONG i, weight;
-		int k;
-		float vv[MAXCOLOR], temp;
-		
-		// Compute 3D histogram
+	// Reserve colors
 
-		Hist3D(wt, mr, mg, mb, gm2, ReserveSize, ReservePalette);
+	Reserve(ReserveSize, ReservePalette);
 
-		// Compute moments
+	// Compute moments
 
-		M3D(wt, mr, mg, mb, gm2);
+	M3D(wt, mr, mg, mb, gm2);
 
-		cube[0].r0 = cube[0].g0 = cube[0].b0 = 0;
-		cube[0].r1 = cube[0].g1 = cube[0].b1 = 32;
-		next = 0;
+	cube[0].r0 = cube[0].g0 = cube[0].b0 = 0;
+	cube[0].r1 = cube[0].g1 = cube[0].b1 = 32;
+	next = 0;
 
-		for (i = 1; i < PaletteSize; i++) {
-			if(Cut(&cube[next], &cube[i])) {
-				// volume test ensures we won't try to cut one-cell box
-				vv[next] = (cube[next].vol > 1) ? Var(&cube[next]) : 0;
-				vv[i] = (cube[i].vol > 1) ? Var(&cube[i]) : 0;
-			} else {
-				  vv[next] = 0.0;   // don't try to split this box again
-				  i--;              // didn't create box i
-			}
+	for (i = 1; i < PaletteSize; i++) {
+		if(Cut(&cube[next], &cube[i])) {
+			// volume test ensures we won't try to cut one-cell box
+			vv[next] = (cube[next].vol > 1) ? Var(&cube[next]) : 0;
+			vv[i] = (cube[i].vol > 1) ? Var(&cube[i]) : 0;
+		} else {
+			  vv[next] = 0.0;   // don't try to split this box again
+			  i--;              // didn't create box i
+		}
 
-			next = 0; temp = vv[0];
+		next = 0; temp = vv[0];
 
-			for (k = 1; k <= i; k++) {
-				if (vv[k] > temp) {
-					temp = vv[k]; next = k;
-				}
+		for (k = 1; k <= i; k++) {
+			if (vv[k] > temp) {
+				temp = vv[k]; next = k;
 			}
+		}
 
-			if (temp <= 0.0) {
-				  PaletteSize = i + 1;
+		if (temp <= 0.0) {
+			  PaletteSize = i + 1;
 
-				  // Error: "Only got 'PaletteSize' boxes"
+			  // Error: "Only got 'PaletteSize' boxes"
 
-				  break;
-			}
+			  break;
 		}
+	}
 
-		// Partition done
+	// Partition done
 
-		// the space for array gm2 can be freed now
+	// the space for array gm2 can be freed now
 
-		free(gm2);
+	free(gm2);
 
-		gm2 = NULL;
+	gm2 = NULL;
+
+	// create an optimized palette
+
+	tag = (BYTE*) malloc(SIZE_3D * sizeof(BYTE));
+	if (tag == NULL) {
+		throw FI_MSG_ERROR_MEMORY;
+	}
+	memset(tag, 0, SIZE_3D * sizeof(BYTE));
 
-		// Allocate a new dib
+	for (k = 0; k < PaletteSize ; k++) {
+		Mark(&cube[k], k, tag);
+		weight = Vol(&cube[k], wt);
 
-		FIBITMAP *new_dib = FreeImage_Allocate(width, height, 8);
+		if (weight) {
+			m_palette[k].rgbRed	  = (BYTE)(((float)Vol(&cube[k], mr) / (float)weight) + 0.5f);
+			m_palette[k].rgbGreen = (BYTE)(((float)Vol(&cube[k], mg) / (float)weight) + 0.5f);
+			m_palette[k].rgbBlue  = (BYTE)(((float)Vol(&cube[k], mb) / (float)weight) + 0.5f);
+		} else {
+			// Error: bogus box 'k'
 
-		if (new_dib == NULL) {
-			throw FI_MSG_ERROR_MEMORY;
+			m_palette[k].rgbRed = m_palette[k].rgbGreen = m_palette[k].rgbBlue = 0;		
 		}
+	}
 
-		// create an optimized palette
+	m_palette_size = PaletteSize;
 
-		RGBQUAD *new_pal = FreeImage_GetPalette(new_dib);
+	return PaletteSize;
+}
 
-		tag = (BYTE*) malloc(SIZE_3D * sizeof(BYTE));
-		if (tag == NULL) {
-			throw FI_MSG_ERROR_MEMORY;
-		}
-		memset(tag, 0, SIZE_3D * sizeof(BYTE));
+// Map the pixels to the palette built by BuildPalette
+FIBITMAP *
+WuQuantizer::Map(FIBITMAP *dib) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bytespp = FreeImage_GetLine(dib) / width;
+	const FI_LineKernel kernel = (bytespp == 3) ? GetLineKernels().wuIndex24 : GetLineKernels().wuIndex32;
 
-		for (k = 0; k < PaletteSize ; k++) {
-			Mark(&cube[k], k, tag);
-			weight = Vol(&cube[k], wt);
+	// Allocate a new dib
 
-			if (weight) {
-				new_pal[k].rgbRed	= (BYTE)(((float)Vol(&cube[k], mr) / (float)weight) + 0.5f);
-				new_pal[k].rgbGreen = (BYTE)(((float)Vol(&cube[k], mg) / (float)weight) + 0.5f);
-				new_pal[k].rgbBlue	= (BYTE)(((float)Vol(&cube[k], mb) / (float)weight) + 0.5f);
-			} else {
-				// Error: bogus box 'k'
+	FIBITMAP *new_dib = FreeImage_Allocate(width, height, 8);
 
-				new_pal[k].rgbRed = new_pal[k].rgbGreen = new_pal[k].rgbBlue = 0;		
-			}
-		}
+	if (new_dib == NULL) {
+		throw FI_MSG_ERROR_MEMORY;
+	}
 
-		int npitch = FreeImage_GetPitch(new_dib);
+	memcpy(FreeImage_GetPalette(new_dib), m_palette, m_palette_size * sizeof(RGBQUAD));
 
-		for (unsigned y = 0; y < height; y++) {
-			BYTE *new_bits = FreeImage_GetBits(new_dib) + (y * npitch);
+	try {
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			std::vector<WORD> index(width);
+
+			for (unsigned y = first_row; y < last_row; y++) {
+				BYTE *new_bits = FreeImage_GetScanLine(new_dib, y);
+
+				LineIndex(&index[0], FreeImage_GetScanLine(dib, y), width, bytespp, kernel);
 
-			for (unsigned x = 0; x < width; x++) {
-				new_bits[x] = tag[Qadd[y*width + x]];
+				for (unsigned x = 0; x < width; x++) {
+					new_bits[x] = tag[index[x]];
+				}
 			}
-		}
+		});
+	} catch(...) {
+		FreeImage_Unload(new_dib);
+		throw;
+	}
+
+	return new_dib;
+}
+
+// Wu Quantization algorithm
+FIBITMAP *
+WuQuantizer::Quantize(int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette) {
+	try {
+		// Compute 3D histogram
+
+		AddImage(m_dib);
+
+		// Compute the palette
 
-		// output 'new_pal' as color look-up table contents,
-		// 'new_bits' as the quantized image (array of table addresses).
+		BuildPalette(PaletteSize, ReserveSize, ReservePalette);
 
-		free(tag);
+		// output the palette as color look-up table contents,
+		// and the pixels as the quantized image (array of table addresses).
 
-		return (FIBITMAP*) new_dib;
+		return Map(m_dib);
 	} catch(...) {
-		free(tag);
 	}
 
 	return NULL;
@@ -23,6 +23,8 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "ToneMapping.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 // Convert RGB to and from Yxy, same as in Reinhard et al. SIGGRAPH 2002
@@ -130,38 +132,38 @@ On output, pixel->red == Y, pixel->green == x, pixel->blue == y
 */
 BOOL 
 ConvertInPlaceRGBFToYxy(FIBITMAP *dib) {
-	float result[3];
-
 	if(FreeImage_GetImageType(dib) != FIT_RGBF)
 		return FALSE;
 
 	const unsigned width  = FreeImage_GetWidth(dib);
 	const unsigned height = FreeImage_GetHeight(dib);
 	const unsigned pitch  = FreeImage_GetPitch(dib);
-	
+	const FI_ColorMatrixLineKernel kernel = GetLineKernels().rgbfToYxy;
+
 	BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
-	for(unsigned y = 0; y < height; y++) {
-		FIRGBF *pixel = (FIRGBF*)bits;
-		for(unsigned x = 0; x < width; x++) {
-			result[0] = result[1] = result[2] = 0;
-			for (int i = 0; i < 3; i++) {
-				result[i] += RGB2XYZ[i][0] * pixel[x].red;
-				result[i] += RGB2XYZ[i][1] * pixel[x].green;
-				result[i] += RGB2XYZ[i][2] * pixel[x].blue;
-			}
-			const float W = result[0] + result[1] + result[2];
-			const float Y = result[1];
-			if(W > 0) { 
-				pixel[x].red   = Y;			    // Y 
-				pixel[x].green = result[0] / W;	// x 
-				pixel[x].blue  = result[1] / W;	// y 	
-			} else {
-				pixel[x].red = pixel[x].green = pixel[x].blue = 0;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		float result[3];
+		for(unsigned y = first_row; y < last_row; y++) {
+			FIRGBF *pixel = (FIRGBF*)(bits + y * pitch);
+			for(unsigned x = kernel((float*)pixel, (float*)pixel, width, RGB2XYZ); x < width; x++) {
+				result[0] = result[1] = result[2] = 0;
+				for (int i = 0; i < 3; i++) {
+					result[i] += RGB2XYZ[i][0] * pixel[x].red;
+					result[i] += RGB2XYZ[i][1] * pixel[x].green;
+					result[i] += RGB2XYZ[i][2] * pixel[x].blue;
+				}
+				const float W = result[0] + result[1] + result[2];
+				const float Y = result[1];
+				if(W > 0) { 
+					pixel[x].red   = Y;			    // Y 
+					pixel[x].green = result[0] / W;	// x 
+					pixel[x].blue  = result[1] / W;	// y 	
+				} else {
+					pixel[x].red = pixel[x].green = pixel[x].blue = 0;
+				}
 			}
 		}
-		// next line
-		bits += pitch;
-	}
+	});
 
 	return TRUE;
 }
@@ -174,45 +176,45 @@ On input, pixel->red == Y, pixel->green == x, pixel->blue == y
 */
 BOOL 
 ConvertInPlaceYxyToRGBF(FIBITMAP *dib) {
-	float result[3];
-	float X, Y, Z;
-
 	if(FreeImage_GetImageType(dib) != FIT_RGBF)
 		return FALSE;
 
 	const unsigned width  = FreeImage_GetWidth(dib);
 	const unsigned height = FreeImage_GetHeight(dib);
 	const unsigned pitch  = FreeImage_GetPitch(dib);
+	const FI_ColorMatrixLineKernel kernel = GetLineKernels().yxyToRGBF;
 
 	BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
-	for(unsigned y = 0; y < height; y++) {
-		FIRGBF *pixel = (FIRGBF*)bits;
-		for(unsigned x = 0; x < width; x++) {
-			Y = pixel[x].red;	        // Y 
-			result[1] = pixel[x].green;	// x 
-			result[2] = pixel[x].blue;	// y 
-			if ((Y > EPSILON) && (result[1] > EPSILON) && (result[2] > EPSILON)) {
-				X = (result[1] * Y) / result[2];
-				Z = (X / result[1]) - X - Y;
-			} else {
-				X = Z = EPSILON;
-			}
-			pixel[x].red   = X;
-			pixel[x].green = Y;
-			pixel[x].blue  = Z;
-			result[0] = result[1] = result[2] = 0;
-			for (int i = 0; i < 3; i++) {
-				result[i] += XYZ2RGB[i][0] * pixel[x].red;
-				result[i] += XYZ2RGB[i][1] * pixel[x].green;
-				result[i] += XYZ2RGB[i][2] * pixel[x].blue;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		float result[3];
+		float X, Y, Z;
+		for(unsigned y = first_row; y < last_row; y++) {
+			FIRGBF *pixel = (FIRGBF*)(bits + y * pitch);
+			for(unsigned x = kernel((float*)pixel, (float*)pixel, width, XYZ2RGB); x < width; x++) {
+				Y = pixel[x].red;	        // Y 
+				result[1] = pixel[x].green;	// x 
+				result[2] = pixel[x].blue;	// y 
+				if ((Y > EPSILON) && (result[1] > EPSILON) && (result[2] > EPSILON)) {
+					X = (result[1] * Y) / result[2];
+					Z = (X / result[1]) - X - Y;
+				} else {
+					X = Z = EPSILON;
+				}
+				pixel[x].red   = X;
+				pixel[x].green = Y;
+				pixel[x].blue  = Z;
+				result[0] = result[1] = result[2] = 0;
+				for (int i = 0; i < 3; i++) {
+					result[i] += XYZ2RGB[i][0] * pixel[x].red;
+					result[i] += XYZ2RGB[i][1] * pixel[x].green;
+					result[i] += XYZ2RGB[i][2] * pixel[x].blue;
+				}
+				pixel[x].red   = result[0];	// R
+				pixel[x].green = result[1];	// G
+				pixel[x].blue  = result[2];	// B
 			}
-			pixel[x].red   = result[0];	// R
-			pixel[x].green = result[1];	// G
-			pixel[x].blue  = result[2];	// B
 		}
-		// next line
-		bits += pitch;
-	}
+	});
 
 	return TRUE;
 }
@@ -238,17 +240,35 @@ LuminanceFromYxy(FIBITMAP *Yxy, float *maxLum, float *minLum, float *worldLum) {
 	float max_lum = 0, min_lum = 0;
 	double sum = 0;
 
-	BYTE *bits = (BYTE*)FreeImage_GetBits(Yxy);
-	for(unsigned y = 0; y < height; y++) {
-		const FIRGBF *pixel = (FIRGBF*)bits;
-		for(unsigned x = 0; x < width; x++) {
-			const float Y = MAX(0.0F, pixel[x].red);// avoid negative values
-			max_lum = (max_lum < Y) ? Y : max_lum;	// max Luminance in the scene
-			min_lum = (min_lum < Y) ? min_lum : Y;	// min Luminance in the scene
-			sum += log(2.3e-5F + Y);				// contrast constant in Tumblin paper
+	try {
+		// per row statistics, summed in row order so that the result does not depend on the number of threads
+		std::vector<float> row_max(height), row_min(height);
+		std::vector<double> row_sum(height);
+
+		const BYTE *bits = (BYTE*)FreeImage_GetBits(Yxy);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const FIRGBF *pixel = (FIRGBF*)(bits + y * pitch);
+				float max_lum = 0, min_lum = 0;
+				double sum = 0;
+				for(unsigned x = 0; x < width; x++) {
+					const float Y = MAX(0.0F, pixel[x].red);// avoid negative values
+					max_lum = (max_lum < Y) ? Y : max_lum;	// max Luminance in the scene
+					min_lum = (min_lum < Y) ? min_lum : Y;	// min Luminance in the scene
+					sum += log(2.3e-5F + Y);				// contrast constant in Tumblin paper
+				}
+				row_max[y] = max_lum;
+				row_min[y] = min_lum;
+				row_sum[y] = sum;
+			}
+		});
+		for(unsigned y = 0; y < height; y++) {
+			max_lum = MAX(max_lum, row_max[y]);
+			min_lum = MIN(min_lum, row_min[y]);
+			sum += row_sum[y];
 		}
-		// next line
-		bits += pitch;
+	} catch(const std::bad_alloc&) {
+		return FALSE;
 	}
 	// maximum luminance
 	*maxLum = max_lum;
@@ -280,25 +300,25 @@ ClampConvertRGBFTo24(FIBITMAP *src) {
 	const unsigned src_pitch  = FreeImage_GetPitch(src);
 	const unsigned dst_pitch  = FreeImage_GetPitch(dst);
 
-	BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
+	const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 	BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-	for(unsigned y = 0; y < height; y++) {
-		const FIRGBF *src_pixel = (FIRGBF*)src_bits;
-		BYTE *dst_pixel = (BYTE*)dst_bits;
-		for(unsigned x = 0; x < width; x++) {
-			const float red   = (src_pixel[x].red > 1)   ? 1 : src_pixel[x].red;
-			const float green = (src_pixel[x].green > 1) ? 1 : src_pixel[x].green;
-			const float blue  = (src_pixel[x].blue > 1)  ? 1 : src_pixel[x].blue;
-			
-			dst_pixel[FI_RGBA_RED]   = (BYTE)(255.0F * red   + 0.5F);
-			dst_pixel[FI_RGBA_GREEN] = (BYTE)(255.0F * green + 0.5F);
-			dst_pixel[FI_RGBA_BLUE]  = (BYTE)(255.0F * blue  + 0.5F);
-			dst_pixel += 3;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			const FIRGBF *src_pixel = (FIRGBF*)(src_bits + y * src_pitch);
+			BYTE *dst_pixel = dst_bits + y * dst_pitch;
+			for(unsigned x = 0; x < width; x++) {
+				const float red   = (src_pixel[x].red > 1)   ? 1 : src_pixel[x].red;
+				const float green = (src_pixel[x].green > 1) ? 1 : src_pixel[x].green;
+				const float blue  = (src_pixel[x].blue > 1)  ? 1 : src_pixel[x].blue;
+				
+				dst_pixel[FI_RGBA_RED]   = (BYTE)(255.0F * red   + 0.5F);
+				dst_pixel[FI_RGBA_GREEN] = (BYTE)(255.0F * green + 0.5F);
+				dst_pixel[FI_RGBA_BLUE]  = (BYTE)(255.0F * blue  + 0.5F);
+				dst_pixel += 3;
+			}
 		}
-		src_bits += src_pitch;
-		dst_bits += dst_pitch;
-	}
+	});
 
 	return dst;
 }
@@ -325,22 +345,21 @@ ConvertRGBFToY(FIBITMAP *src) {
 
 	const unsigned src_pitch  = FreeImage_GetPitch(src);
 	const unsigned dst_pitch  = FreeImage_GetPitch(dst);
+	const FI_FloatLineKernel kernel = GetLineKernels().rgbfToY;
 
-	
-	BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
+	const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
 	BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
 
-	for(unsigned y = 0; y < height; y++) {
-		const FIRGBF *src_pixel = (FIRGBF*)src_bits;
-		float  *dst_pixel = (float*)dst_bits;
-		for(unsigned x = 0; x < width; x++) {
-			const float L = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
-			dst_pixel[x] = (L > 0) ? L : 0;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			const FIRGBF *src_pixel = (FIRGBF*)(src_bits + y * src_pitch);
+			float *dst_pixel = (float*)(dst_bits + y * dst_pitch);
+			for(unsigned x = kernel(dst_pixel, (float*)src_pixel, width); x < width; x++) {
+				const float L = LUMA_REC709(src_pixel[x].red, src_pixel[x].green, src_pixel[x].blue);
+				dst_pixel[x] = (L > 0) ? L : 0;
+			}
 		}
-		// next line
-		src_bits += src_pitch;
-		dst_bits += dst_pitch;
-	}
+	});
 
 	return dst;
 }
@@ -367,18 +386,38 @@ LuminanceFromY(FIBITMAP *dib, float *maxLum, float *minLum, float *Lav, float *L
 	float max_lum = -1e20F, min_lum = 1e20F;
 	double sumLum = 0, sumLogLum = 0;
 
-	BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
-	for(unsigned y = 0; y < height; y++) {
-		const float *pixel = (float*)bits;
-		for(unsigned x = 0; x < width; x++) {
-			const float Y = pixel[x];
-			max_lum = (max_lum < Y) ? Y : max_lum;				// max Luminance in the scene
-			min_lum = ((Y > 0) && (min_lum < Y)) ? min_lum : Y;	// min Luminance in the scene
-			sumLum += Y;										// average luminance
-			sumLogLum += log(2.3e-5F + Y);						// contrast constant in Tumblin paper
+	try {
+		// per row statistics, summed in row order so that the result does not depend on the number of threads
+		std::vector<float> row_max(height), row_min(height);
+		std::vector<double> row_sum(height), row_log_sum(height);
+
+		const BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const float *pixel = (float*)(bits + y * pitch);
+				float max_lum = -1e20F, min_lum = 1e20F;
+				double sumLum = 0, sumLogLum = 0;
+				for(unsigned x = 0; x < width; x++) {
+					const float Y = pixel[x];
+					max_lum = (max_lum < Y) ? Y : max_lum;				// max Luminance in the scene
+					min_lum = ((Y > 0) && (min_lum < Y)) ? min_lum : Y;	// min Luminance in the scene
+					sumLum += Y;										// average luminance
+					sumLogLum += log(2.3e-5F + Y);						// contrast constant in Tumblin paper
+				}
+				row_max[y] = max_lum;
+				row_min[y] = min_lum;
+				row_sum[y] = sumLum;
+				row_log_sum[y] = sumLogLum;
+			}
+		});
+		for(unsigned y = 0; y < height; y++) {
+			max_lum = (max_lum < row_max[y]) ? row_max[y] : max_lum;
+			min_lum = ((row_min[y] > 0) && (min_lum < row_min[y])) ? min_lum : row_min[y];
+			sumLum += row_sum[y];
+			sumLogLum += row_log_sum[y];
 		}
-		// next line
-		bits += pitch;
+	} catch(const std::bad_alloc&) {
+		return FALSE;
 	}
 
 	// maximum luminance
@@ -394,31 +433,6 @@ LuminanceFromY(FIBITMAP *dib, float *maxLum, float *minLum, float *Lav, float *L
 }
 // --------------------------------------------------------------------------
 
-static void findMaxMinPercentile(FIBITMAP *Y, float minPrct, float *minLum, float maxPrct, float *maxLum) {
-	int x, y;
-	int width = FreeImage_GetWidth(Y);
-	int height = FreeImage_GetHeight(Y);
-	int pitch = FreeImage_GetPitch(Y);
-
-	std::vector<float> vY(width * height);
-
-	BYTE *bits = (BYTE*)FreeImage_GetBits(Y);
-	for(y = 0; y < height; y++) {
-		float *pixel = (float*)bits;
-		for(x = 0; x < width; x++) {
-			if(pixel[x] != 0) {
-				vY.push_back(pixel[x]);
-			}
-		}
-		bits += pitch;
-	}
-
-	std::sort(vY.begin(), vY.end());
-	
-	*minLum = vY.at( int(minPrct * vY.size()) );
-	*maxLum = vY.at( int(maxPrct * vY.size()) );
-}
-
 /**
 Clipping function<br>
 Remove any extremely bright and/or extremely dark pixels 
@@ -429,7 +443,6 @@ and normalize between 0 and 1.
 */
 void 
 NormalizeY(FIBITMAP *Y, float minPrct, float maxPrct) {
-	int x, y;
 	float maxLum, minLum;
 
 	if(minPrct > maxPrct) {
@@ -439,41 +452,57 @@ NormalizeY(FIBITMAP *Y, float minPrct, float maxPrct) {
 	if(minPrct < 0) minPrct = 0;
 	if(maxPrct > 1) maxPrct = 1;
 
-	int width = FreeImage_GetWidth(Y);
-	int height = FreeImage_GetHeight(Y);
-	int pitch = FreeImage_GetPitch(Y);
+	const unsigned width = FreeImage_GetWidth(Y);
+	const unsigned height = FreeImage_GetHeight(Y);
+	const unsigned pitch = FreeImage_GetPitch(Y);
+
+	BYTE *bits = (BYTE*)FreeImage_GetBits(Y);
 
 	// find max & min luminance values
 	if((minPrct > 0) || (maxPrct < 1)) {
-		maxLum = 0, minLum = 0;
-		findMaxMinPercentile(Y, minPrct, &minLum, maxPrct, &maxLum);
+		const double percentiles[2] = { minPrct, maxPrct };
+		double values[2];
+		if(!FreeImage_GetPercentiles(Y, percentiles, values, 2)) return;
+		minLum = (float)values[0];
+		maxLum = (float)values[1];
 	} else {
 		maxLum = -1e20F, minLum = 1e20F;
-		BYTE *bits = (BYTE*)FreeImage_GetBits(Y);
-		for(y = 0; y < height; y++) {
-			const float *pixel = (float*)bits;
-			for(x = 0; x < width; x++) {
-				const float value = pixel[x];
-				maxLum = (maxLum < value) ? value : maxLum;	// max Luminance in the scene
-				minLum = (minLum < value) ? minLum : value;	// min Luminance in the scene
+		try {
+			// per row extrema
+			std::vector<float> row_max(height), row_min(height);
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const float *pixel = (float*)(bits + y * pitch);
+					float maxLum = -1e20F, minLum = 1e20F;
+					for(unsigned x = 0; x < width; x++) {
+						const float value = pixel[x];
+						maxLum = (maxLum < value) ? value : maxLum;	// max Luminance in the scene
+						minLum = (minLum < value) ? minLum : value;	// min Luminance in the scene
+					}
+					row_max[y] = maxLum;
+					row_min[y] = minLum;
+				}
+			});
+			for(unsigned y = 0; y < height; y++) {
+				maxLum = (maxLum < row_max[y]) ? row_max[y] : maxLum;
+				minLum = (minLum < row_min[y]) ? minLum : row_min[y];
 			}
-			// next line
-			bits += pitch;
+		} catch(const std::bad_alloc&) {
+			return;
 		}
 	}
 	if(maxLum == minLum) return;
 
 	// normalize to range 0..1 
 	const float divider = maxLum - minLum;
-	BYTE *bits = (BYTE*)FreeImage_GetBits(Y);
-	for(y = 0; y < height; y++) {
-		float *pixel = (float*)bits;
-		for(x = 0; x < width; x++) {
-			pixel[x] = (pixel[x] - minLum) / divider;
-			if(pixel[x] <= 0) pixel[x] = EPSILON;
-			if(pixel[x] > 1) pixel[x] = 1;
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			float *pixel = (float*)(bits + y * pitch);
+			for(unsigned x = 0; x < width; x++) {
+				pixel[x] = (pixel[x] - minLum) / divider;
+				if(pixel[x] <= 0) pixel[x] = EPSILON;
+				if(pixel[x] > 1) pixel[x] = 1;
+			}
 		}
-		// next line
-		bits += pitch;
-	}
+	});
 }
@@ -22,6 +22,8 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "ToneMapping.h"
+#include "../TransferFunctions.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 // Logarithmic mapping operator
@@ -97,18 +99,18 @@ ToneMappingDrago03(FIBITMAP *dib, const float maxLum, const float avgLum, float
 	further acceleration is obtained by a Pad approximation of log(x + 1)
 	*/
 	BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
-	for(y = 0; y < height; y++) {
-		FIRGBF *pixel = (FIRGBF*)bits;
-		for(x = 0; x < width; x++) {
-			double Yw = pixel[x].red / avgLum;
-			Yw *= exposure;
-			interpol = log(2 + biasFunction(biasP, Yw / Lmax) * 8);
-			L = pade_log(Yw);// log(Yw + 1)
-			pixel[x].red = (float)((L / interpol) / divider);
+	ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+		for(unsigned y = first_row; y < last_row; y++) {
+			FIRGBF *pixel = (FIRGBF*)(bits + y * pitch);
+			for(unsigned x = 0; x < width; x++) {
+				double Yw = pixel[x].red / avgLum;
+				Yw *= exposure;
+				const double interpol = log(2 + biasFunction(biasP, Yw / Lmax) * 8);
+				const double L = pade_log(Yw);// log(Yw + 1)
+				pixel[x].red = (float)((L / interpol) / divider);
+			}
 		}
-		// next line
-		bits += pitch;
-	}
+	});
 
 #else
 	unsigned index;
@@ -228,16 +230,19 @@ REC709GammaCorrection(FIBITMAP *dib, const float gammaval) {
 	const unsigned height = FreeImage_GetHeight(dib);
 	const unsigned pitch  = FreeImage_GetPitch(dib);
 
-	BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
-	for(unsigned y = 0; y < height; y++) {
-		float *pixel = (float*)bits;
-		for(unsigned x = 0; x < width; x++) {
-			for(int i = 0; i < 3; i++) {
-				*pixel = (*pixel <= start) ? *pixel * slope : (1.099F * pow(*pixel, fgamma) - 0.099F);
-				pixel++;
+	try {
+		// (*pixel <= start) ? *pixel * slope : (1.099F * pow(*pixel, fgamma) - 0.099F)
+		const TransferFunction rec709(slope, start, 1.099F, fgamma, TransferFunction::FLOAT_ENCODING);
+
+		BYTE *bits = (BYTE*)FreeImage_GetBits(dib);
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				float *pixel = (float*)(bits + y * pitch);
+				rec709.EncodeLine(pixel, pixel, 3 * width);
 			}
-		}
-		bits += pitch;
+		});
+	} catch(const std::bad_alloc&) {
+		return FALSE;
 	}
 
 	return TRUE;
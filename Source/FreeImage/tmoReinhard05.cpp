@@ -23,6 +23,7 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "ToneMapping.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 // Global and/or local tone mapping operator
@@ -52,9 +53,6 @@ ToneMappingReinhard05(FIBITMAP *dib, FIBITMAP *Y, float f, float m, float a, flo
 	float minLum = 1;	// min luminance
 	float maxLum = 1;	// max luminance
 
-	float L;		// pixel luminance
-	float I_g, I_l; // global and local light adaptation
-	float I_a;		// interpolated pixel light adaptation
 	float k = 0;	// key (low-key means overall dark image, high-key means overall light image)
 
 	// check input parameters 
@@ -74,8 +72,6 @@ ToneMappingReinhard05(FIBITMAP *dib, FIBITMAP *Y, float f, float m, float a, flo
 	const unsigned dib_pitch  = FreeImage_GetPitch(dib);
 	const unsigned y_pitch    = FreeImage_GetPitch(Y);
 
-	int i;
-	unsigned x, y;
 	BYTE *bits = NULL, *Ybits = NULL;
 
 	// get statistics about the data (but only if its really needed)
@@ -103,97 +99,123 @@ ToneMappingReinhard05(FIBITMAP *dib, FIBITMAP *Y, float f, float m, float a, flo
 	bits  = (BYTE*)FreeImage_GetBits(dib);
 	Ybits = (BYTE*)FreeImage_GetBits(Y);
 
-	if((a == 1) && (c == 0)) {
-		// when using default values, use a fastest code
-
-		for(y = 0; y < height; y++) {
-			float *Y     = (float*)Ybits;
-			float *color = (float*)bits;
-
-			for(x = 0; x < width; x++) {
-				I_a = Y[x];	// luminance(x, y)
-				for (i = 0; i < 3; i++) {
-					*color /= ( *color + pow(f * I_a, m) );
-					
-					max_color = (*color > max_color) ? *color : max_color;
-					min_color = (*color < min_color) ? *color : min_color;
-
-					color++;
+	try {
+		// per row extrema of the tone mapped values
+		std::vector<float> row_max(height), row_min(height);
+
+		if((a == 1) && (c == 0)) {
+			// when using default values, use a fastest code
+
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const float *Y = (float*)(Ybits + y * y_pitch);
+					float *color = (float*)(bits + y * dib_pitch);
+					float max_color = -1e6F;
+					float min_color = +1e6F;
+
+					for(unsigned x = 0; x < width; x++) {
+						// the light adaptation is the same for the 3 channels
+						const float I_a = pow(f * Y[x], m);	// luminance(x, y)
+						for (int i = 0; i < 3; i++) {
+							*color /= ( *color + I_a );
+							
+							max_color = (*color > max_color) ? *color : max_color;
+							min_color = (*color < min_color) ? *color : min_color;
+
+							color++;
+						}
+					}
+					row_max[y] = max_color;
+					row_min[y] = min_color;
 				}
-			}
-			// next line
-			bits  += dib_pitch;
-			Ybits += y_pitch;
-		}
-	} else {
-		// complete algorithm
-
-		// channel averages
-
-		Cav[0] = Cav[1] = Cav[2] = 0;
-		if((a != 1) && (c != 0)) {
-			// channel averages are not needed when (a == 1) or (c == 0)
-			bits = (BYTE*)FreeImage_GetBits(dib);
-			for(y = 0; y < height; y++) {
-				float *color = (float*)bits;
-				for(x = 0; x < width; x++) {
-					for(i = 0; i < 3; i++) {
-						Cav[i] += *color;
-						color++;
+			});
+		} else {
+			// complete algorithm
+
+			// channel averages
+
+			Cav[0] = Cav[1] = Cav[2] = 0;
+			if((a != 1) && (c != 0)) {
+				// channel averages are not needed when (a == 1) or (c == 0)
+				// per row sums, summed in row order so that the result does not depend on the number of threads
+				std::vector<double> row_sum(3 * height);
+				ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+					for(unsigned y = first_row; y < last_row; y++) {
+						const float *color = (float*)(bits + y * dib_pitch);
+						double sum[3] = { 0, 0, 0 };
+						for(unsigned x = 0; x < width; x++) {
+							for(int i = 0; i < 3; i++) {
+								sum[i] += *color;
+								color++;
+							}
+						}
+						for(int i = 0; i < 3; i++) {
+							row_sum[3 * y + i] = sum[i];
+						}
+					}
+				});
+				double sum[3] = { 0, 0, 0 };
+				for(unsigned y = 0; y < height; y++) {
+					for(int i = 0; i < 3; i++) {
+						sum[i] += row_sum[3 * y + i];
 					}
 				}
-				// next line
-				bits += dib_pitch;
-			}
-			const float image_size = (float)width * height;
-			for(i = 0; i < 3; i++) {
-				Cav[i] /= image_size;
+				const double image_size = (double)width * height;
+				for(int i = 0; i < 3; i++) {
+					Cav[i] = (float)(sum[i] / image_size);
+				}
 			}
-		}
 
-		// perform tone mapping
-
-		bits = (BYTE*)FreeImage_GetBits(dib);
-		for(y = 0; y < height; y++) {
-			const float *Y     = (float*)Ybits;
-			float *color = (float*)bits;
-
-			for(x = 0; x < width; x++) {
-				L = Y[x];	// luminance(x, y)
-				for (i = 0; i < 3; i++) {
-					I_l = c * *color + (1-c) * L;
-					I_g = c * Cav[i] + (1-c) * Lav;
-					I_a = a * I_l + (1-a) * I_g;
-					*color /= ( *color + pow(f * I_a, m) );
-					
-					max_color = (*color > max_color) ? *color : max_color;
-					min_color = (*color < min_color) ? *color : min_color;
-
-					color++;
+			// perform tone mapping
+
+			ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+				for(unsigned y = first_row; y < last_row; y++) {
+					const float *Y = (float*)(Ybits + y * y_pitch);
+					float *color = (float*)(bits + y * dib_pitch);
+					float max_color = -1e6F;
+					float min_color = +1e6F;
+
+					for(unsigned x = 0; x < width; x++) {
+						const float L = Y[x];	// luminance(x, y)
+						for (int i = 0; i < 3; i++) {
+							const float I_l = c * *color + (1-c) * L;
+							const float I_g = c * Cav[i] + (1-c) * Lav;
+							const float I_a = a * I_l + (1-a) * I_g;
+							*color /= ( *color + pow(f * I_a, m) );
+							
+							max_color = (*color > max_color) ? *color : max_color;
+							min_color = (*color < min_color) ? *color : min_color;
+
+							color++;
+						}
+					}
+					row_max[y] = max_color;
+					row_min[y] = min_color;
 				}
-			}
-			// next line
-			bits  += dib_pitch;
-			Ybits += y_pitch;
+			});
+		}
+
+		for(unsigned y = 0; y < height; y++) {
+			max_color = (row_max[y] > max_color) ? row_max[y] : max_color;
+			min_color = (row_min[y] < min_color) ? row_min[y] : min_color;
 		}
+	} catch(const std::bad_alloc&) {
+		return FALSE;
 	}
 
 	// normalize intensities
 
 	if(max_color != min_color) {
-		bits = (BYTE*)FreeImage_GetBits(dib);
 		const float range = max_color - min_color;
-		for(y = 0; y < height; y++) {
-			float *color = (float*)bits;
-			for(x = 0; x < width; x++) {
-				for(i = 0; i < 3; i++) {
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				float *color = (float*)(bits + y * dib_pitch);
+				for(unsigned x = 0; x < 3 * width; x++) {
 					*color = (*color - min_color) / range;
 					color++;
 				}
 			}
-			// next line
-			bits += dib_pitch;
-		}
+		});
 	}
 
 	return TRUE;
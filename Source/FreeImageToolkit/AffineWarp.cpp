@@ -0,0 +1,622 @@
+// ==========================================================
+// Affine image warp
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+#include <vector>
+
+// sample positions are rounded to 1 / WARP_PHASES pixel
+#define WARP_PHASE_BITS		5
+#define WARP_PHASES			(1 << WARP_PHASE_BITS)
+// sample positions are fixed point values with WARP_FIXED_BITS fractional bits
+#define WARP_FIXED_BITS		32
+// largest scale factor of the inverse matrix
+#define WARP_MAX_SCALE		16777216.0
+
+// --------------------------------------------------------------------------
+//   Interpolation weights
+// --------------------------------------------------------------------------
+
+/**
+Mitchell & Netravali's two-parameter cubic filter
+*/
+static double
+CubicWeight(double x, double B, double C) {
+	x = fabs(x);
+	if(x < 1) {
+		return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6;
+	}
+	if(x < 2) {
+		return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+	}
+	return 0;
+}
+
+/**
+Interpolation weights of a filter, for each sampling phase.
+The taps of a sample at position s are the source pixels floor(s) - (taps - 1) / 2, ...,
+and its phase is the rounded fractional part of s, in 1 / WARP_PHASES units.
+*/
+class WarpWeights {
+public:
+	//! number of taps on each axis : 1 (nearest pixel), 2 (bilinear) or 4 (cubic), 0 for an unsupported filter
+	int taps;
+	//! taps weights of each phase
+	std::vector<float> weights1D;
+	//! taps x taps weights of each (vertical phase * WARP_PHASES + horizontal phase), rows first, with FI_WARP_WEIGHT_BITS fractional bits
+	std::vector<short> weights2D;
+
+	/**
+	Build the weights of a filter.
+	Throws std::bad_alloc when the tables cannot be allocated.
+	*/
+	WarpWeights(FREE_IMAGE_FILTER filter) : taps(0) {
+		double B = 0, C = 0;
+		switch(filter) {
+			case FILTER_BOX:
+				taps = 1;
+				return;
+			case FILTER_BILINEAR:
+				taps = 2;
+				break;
+			case FILTER_BICUBIC:
+				taps = 4;
+				B = 1.0 / 3;
+				C = 1.0 / 3;
+				break;
+			case FILTER_BSPLINE:
+				taps = 4;
+				B = 1;
+				C = 0;
+				break;
+			case FILTER_CATMULLROM:
+				taps = 4;
+				B = 0;
+				C = 0.5;
+				break;
+			default:
+				return;
+		}
+
+		std::vector<double> w(WARP_PHASES * taps);
+		for(int phase = 0; phase < WARP_PHASES; phase++) {
+			const double t = (double)phase / WARP_PHASES;
+			double *pw = &w[phase * taps];
+			if(taps == 2) {
+				pw[0] = 1 - t;
+				pw[1] = t;
+			} else {
+				pw[0] = CubicWeight(1 + t, B, C);
+				pw[1] = CubicWeight(t, B, C);
+				pw[2] = CubicWeight(1 - t, B, C);
+				pw[3] = CubicWeight(2 - t, B, C);
+				const double sum = pw[0] + pw[1] + pw[2] + pw[3];
+				for(int i = 0; i < 4; i++) {
+					pw[i] /= sum;
+				}
+			}
+		}
+		weights1D.assign(w.begin(), w.end());
+
+		// 2D weights, adjusted so that they add up to exactly 1
+		const int one = 1 << FI_WARP_WEIGHT_BITS;
+		weights2D.resize(WARP_PHASES * WARP_PHASES * taps * taps);
+		for(int py = 0; py < WARP_PHASES; py++) {
+			for(int px = 0; px < WARP_PHASES; px++) {
+				short *pw = &weights2D[(py * WARP_PHASES + px) * taps * taps];
+				int sum = 0;
+				int largest = 0;
+				for(int j = 0; j < taps; j++) {
+					for(int i = 0; i < taps; i++) {
+						const int k = j * taps + i;
+						pw[k] = (short)floor(w[py * taps + j] * w[px * taps + i] * one + 0.5);
+						sum += pw[k];
+						if(pw[k] > pw[largest]) {
+							largest = k;
+						}
+					}
+				}
+				pw[largest] = (short)(pw[largest] + one - sum);
+			}
+		}
+	}
+};
+
+// --------------------------------------------------------------------------
+//   Samplers
+// --------------------------------------------------------------------------
+
+/**
+Sampler of the nearest source pixel
+*/
+struct NearestSampler {
+	unsigned bytespp;
+
+	inline void Pixel(BYTE *target, const BYTE *const *rows, const int *cols, WORD phase) const {
+		memcpy(target, rows[0] + cols[0], bytespp);
+	}
+	inline int Line(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, int count) const {
+		return 0;
+	}
+};
+
+/**
+Sampler of 8-bit channels, with fixed point weights.
+The kernel and the scalar code give the same values.
+*/
+template <int TAPS>
+struct FixedSampler {
+	unsigned bytespp;
+	const short *weights;
+	FI_WarpLineKernel kernel;
+
+	inline void Pixel(BYTE *target, const BYTE *const *rows, const int *cols, WORD phase) const {
+		const short *w = weights + phase * TAPS * TAPS;
+		for(unsigned c = 0; c < bytespp; c++) {
+			int sum = 1 << (FI_WARP_WEIGHT_BITS - 1);
+			for(int j = 0; j < TAPS; j++) {
+				for(int i = 0; i < TAPS; i++) {
+					sum += w[j * TAPS + i] * rows[j][cols[i] + c];
+				}
+			}
+			target[c] = (BYTE)CLAMP(sum >> FI_WARP_WEIGHT_BITS, 0, 255);
+		}
+	}
+	inline int Line(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, int count) const {
+		return kernel(target, source, pitch, offset, phase, weights, count);
+	}
+};
+
+static inline void
+StoreSample(WORD *target, float value) {
+	*target = (WORD)CLAMP((int)(value + 0.5F), 0, 65535);
+}
+
+static inline void
+StoreSample(float *target, float value) {
+	*target = value;
+}
+
+/**
+Sampler of 16-bit and float channels, filtering rows then columns
+*/
+template <class T, int TAPS>
+struct FloatSampler {
+	unsigned channels;
+	const float *weights;
+
+	inline void Pixel(BYTE *target, const BYTE *const *rows, const int *cols, WORD phase) const {
+		const float *wx = weights + (phase % WARP_PHASES) * TAPS;
+		const float *wy = weights + (phase / WARP_PHASES) * TAPS;
+		for(unsigned c = 0; c < channels; c++) {
+			float value = 0;
+			for(int j = 0; j < TAPS; j++) {
+				float h = 0;
+				for(int i = 0; i < TAPS; i++) {
+					h += wx[i] * (float)((const T*)(rows[j] + cols[i]))[c];
+				}
+				value += wy[j] * h;
+			}
+			StoreSample((T*)target + c, value);
+		}
+	}
+	inline int Line(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, int count) const {
+		return 0;
+	}
+};
+
+// --------------------------------------------------------------------------
+//   Warp engine
+// --------------------------------------------------------------------------
+
+/**
+Parameters of a warp.
+The source position of destination pixel (x, y) is (ax * x + bx * y + cx, ay * x + by * y + cy).
+*/
+struct WarpContext {
+	double ax, bx, cx;
+	double ay, by, cy;
+	//! top source row, and byte offset from a row to the row below
+	const BYTE *top;
+	int pitch;
+	int src_width;
+	int src_height;
+	unsigned bytespp;
+	FIBITMAP *dst;
+	int dst_width;
+	int dst_height;
+	const void *bkcolor;
+};
+
+/**
+Invert the warp matrix.
+@return Returns FALSE if the matrix is singular, or too close to singular
+*/
+static BOOL
+InvertWarpMatrix(WarpContext& ctx, const double *m) {
+	const double det = m[0] * m[4] - m[1] * m[3];
+	if(!(fabs(det) > 0)) {
+		return FALSE;
+	}
+	ctx.ax = m[4] / det;
+	ctx.bx = -m[1] / det;
+	ctx.cx = (m[1] * m[5] - m[4] * m[2]) / det;
+	ctx.ay = -m[3] / det;
+	ctx.by = m[0] / det;
+	ctx.cy = (m[3] * m[2] - m[0] * m[5]) / det;
+
+	const double scale = MAX(MAX(fabs(ctx.ax), fabs(ctx.bx)), MAX(fabs(ctx.ay), fabs(ctx.by)));
+	const double offset = MAX(fabs(ctx.cx), fabs(ctx.cy));
+	// the comparisons are false for NaN values
+	return ((scale < WARP_MAX_SCALE) && (offset < 1e300)) ? TRUE : FALSE;
+}
+
+/**
+Restrict [lo, hi] to the x values where a * x + s0 is in [-1, size]
+*/
+static void
+RestrictToSource(double a, double s0, int size, double& lo, double& hi) {
+	if(a == 0) {
+		if((s0 < -1) || (s0 > size)) {
+			hi = lo - 1;
+		}
+		return;
+	}
+	double x0 = (-1 - s0) / a;
+	double x1 = (size - s0) / a;
+	if(x0 > x1) {
+		const double t = x0;
+		x0 = x1;
+		x1 = t;
+	}
+	lo = MAX(lo, x0);
+	hi = MIN(hi, x1);
+}
+
+/**
+Get the range [first, last) of the pixels of destination row y whose source position is within a pixel of the source.
+The other pixels of the row are outside the source.
+*/
+static void
+GetSampledRange(const WarpContext& ctx, int y, int& first, int& last) {
+	double lo = 0;
+	double hi = ctx.dst_width - 1;
+	RestrictToSource(ctx.ax, ctx.bx * y + ctx.cx, ctx.src_width, lo, hi);
+	RestrictToSource(ctx.ay, ctx.by * y + ctx.cy, ctx.src_height, lo, hi);
+	if(!(lo <= hi)) {
+		first = last = 0;
+		return;
+	}
+	first = (int)ceil(lo);
+	last = MAX(first, (int)floor(hi) + 1);
+}
+
+static inline INT64
+ToFixed(double value) {
+	return (INT64)floor(value * 4294967296.0 + 0.5);
+}
+
+/**
+Warp a range of destination rows.
+Pixels with all their taps in the source are computed by the sampler line function, the other ones by its pixel function.
+*/
+template <int TAPS, class Sampler>
+static void
+WarpRows(const WarpContext& ctx, const Sampler& sampler, unsigned first_row, unsigned last_row) {
+	const INT64 half = (INT64)1 << (WARP_FIXED_BITS - 1);
+	const INT64 half_phase = (INT64)1 << (WARP_FIXED_BITS - WARP_PHASE_BITS - 1);
+	const unsigned bytespp = ctx.bytespp;
+
+	// byte offset and phase of the pixels with all their taps in the source
+	std::vector<int> offset(ctx.dst_width);
+	std::vector<WORD> phase(ctx.dst_width);
+
+	for(unsigned y = first_row; y < last_row; y++) {
+		BYTE *dst_bits = FreeImage_GetScanLine(ctx.dst, ctx.dst_height - 1 - y);
+
+		int first, last;
+		GetSampledRange(ctx, y, first, last);
+
+		INT64 X = ToFixed(ctx.ax * first + ctx.bx * y + ctx.cx);
+		INT64 Y = ToFixed(ctx.ay * first + ctx.by * y + ctx.cy);
+		const INT64 dX = ToFixed(ctx.ax);
+		const INT64 dY = ToFixed(ctx.ay);
+
+		int fast_first = 0;
+		int fast_count = 0;
+
+		for(int x = first; x < last; x++, X += dX, Y += dY) {
+			BYTE *target = dst_bits + x * bytespp;
+
+			// the nearest source pixel must be in the source
+			const int nx = (int)((X + half) >> WARP_FIXED_BITS);
+			const int ny = (int)((Y + half) >> WARP_FIXED_BITS);
+			if((nx < 0) || (nx >= ctx.src_width) || (ny < 0) || (ny >= ctx.src_height)) {
+				if(ctx.bkcolor) {
+					memcpy(target, ctx.bkcolor, bytespp);
+				}
+				continue;
+			}
+
+			// first tap and phase
+			int ix = nx;
+			int iy = ny;
+			WORD ph = 0;
+			if(TAPS > 1) {
+				const INT64 tx = (X + half_phase) >> (WARP_FIXED_BITS - WARP_PHASE_BITS);
+				const INT64 ty = (Y + half_phase) >> (WARP_FIXED_BITS - WARP_PHASE_BITS);
+				ix = (int)(tx >> WARP_PHASE_BITS) - (TAPS - 1) / 2;
+				iy = (int)(ty >> WARP_PHASE_BITS) - (TAPS - 1) / 2;
+				ph = (WORD)((ty & (WARP_PHASES - 1)) * WARP_PHASES + (tx & (WARP_PHASES - 1)));
+			}
+
+			if((ix >= 0) && (ix + TAPS <= ctx.src_width) && (iy >= 0) && (iy + TAPS <= ctx.src_height)) {
+				// these pixels are contiguous
+				if(fast_count == 0) {
+					fast_first = x;
+				}
+				offset[fast_count] = iy * ctx.pitch + ix * (int)bytespp;
+				phase[fast_count] = ph;
+				fast_count++;
+			} else {
+				// taps clamped to the source edges
+				const BYTE *rows[TAPS];
+				int cols[TAPS];
+				for(int k = 0; k < TAPS; k++) {
+					rows[k] = ctx.top + CLAMP(iy + k, 0, ctx.src_height - 1) * ctx.pitch;
+					cols[k] = CLAMP(ix + k, 0, ctx.src_width - 1) * bytespp;
+				}
+				sampler.Pixel(target, rows, cols, ph);
+			}
+		}
+
+		if(ctx.bkcolor) {
+			for(int x = 0; x < first; x++) {
+				memcpy(dst_bits + x * bytespp, ctx.bkcolor, bytespp);
+			}
+			for(int x = last; x < ctx.dst_width; x++) {
+				memcpy(dst_bits + x * bytespp, ctx.bkcolor, bytespp);
+			}
+		}
+
+		if(fast_count) {
+			BYTE *target = dst_bits + fast_first * bytespp;
+			for(int i = sampler.Line(target, ctx.top, ctx.pitch, &offset[0], &phase[0], fast_count); i < fast_count; i++) {
+				const BYTE *rows[TAPS];
+				int cols[TAPS];
+				for(int k = 0; k < TAPS; k++) {
+					rows[k] = ctx.top + offset[i] + k * ctx.pitch;
+					cols[k] = k * bytespp;
+				}
+				sampler.Pixel(target + i * bytespp, rows, cols, phase[i]);
+			}
+		}
+	}
+}
+
+template <int TAPS, class Sampler>
+static void
+WarpImage(const WarpContext& ctx, const Sampler& sampler) {
+	ParallelForRows(ctx.dst_width, ctx.dst_height, [&](unsigned first, unsigned last) {
+		WarpRows<TAPS>(ctx, sampler, first, last);
+	});
+}
+
+/**
+Get the SIMD kernel of a 8-bit channels warp
+*/
+static FI_WarpLineKernel
+GetWarpKernel(unsigned bytespp, int taps) {
+	const FILineKernels& kernels = GetLineKernels();
+	switch(bytespp) {
+		case 1:
+			return (taps == 2) ? kernels.warpBilinear8 : kernels.warpBicubic8;
+		case 3:
+			return (taps == 2) ? kernels.warpBilinear24 : kernels.warpBicubic24;
+		default:
+			return (taps == 2) ? kernels.warpBilinear32 : kernels.warpBicubic32;
+	}
+}
+
+/**
+Warp src into dst.
+Throws std::bad_alloc when the working buffers cannot be allocated.
+@return Returns FALSE if the images, the matrix or the filter are not supported
+*/
+static BOOL
+AffineWarp(FIBITMAP *dst, FIBITMAP *src, const double *matrix, FREE_IMAGE_FILTER filter, const void *bkcolor) {
+	if(!matrix) {
+		return FALSE;
+	}
+
+	// channel type
+	enum { CHANNEL_BYTE, CHANNEL_WORD, CHANNEL_FLOAT } channel;
+	switch(FreeImage_GetImageType(src)) {
+		case FIT_BITMAP:
+			switch(FreeImage_GetBPP(src)) {
+				case 8:
+					// palette indexes cannot be interpolated
+					if(FreeImage_GetColorType(src) == FIC_PALETTE) {
+						filter = FILTER_BOX;
+					}
+					break;
+				case 24:
+				case 32:
+					break;
+				default:
+					return FALSE;
+			}
+			channel = CHANNEL_BYTE;
+			break;
+		case FIT_UINT16:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+			channel = CHANNEL_WORD;
+			break;
+		case FIT_FLOAT:
+		case FIT_RGBF:
+		case FIT_RGBAF:
+			channel = CHANNEL_FLOAT;
+			break;
+		default:
+			return FALSE;
+	}
+
+	WarpContext ctx;
+	if(!InvertWarpMatrix(ctx, matrix)) {
+		return FALSE;
+	}
+	const WarpWeights weights(filter);
+	if(weights.taps == 0) {
+		return FALSE;
+	}
+
+	ctx.src_width = (int)FreeImage_GetWidth(src);
+	ctx.src_height = (int)FreeImage_GetHeight(src);
+	ctx.top = FreeImage_GetScanLine(src, ctx.src_height - 1);
+	ctx.pitch = -(int)FreeImage_GetPitch(src);
+	ctx.bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+	ctx.dst = dst;
+	ctx.dst_width = (int)FreeImage_GetWidth(dst);
+	ctx.dst_height = (int)FreeImage_GetHeight(dst);
+	ctx.bkcolor = bkcolor;
+
+	if(weights.taps == 1) {
+		NearestSampler sampler = { ctx.bytespp };
+		WarpImage<1>(ctx, sampler);
+	}
+	else if(channel == CHANNEL_BYTE) {
+		if(weights.taps == 2) {
+			FixedSampler<2> sampler = { ctx.bytespp, &weights.weights2D[0], GetWarpKernel(ctx.bytespp, 2) };
+			WarpImage<2>(ctx, sampler);
+		} else {
+			FixedSampler<4> sampler = { ctx.bytespp, &weights.weights2D[0], GetWarpKernel(ctx.bytespp, 4) };
+			WarpImage<4>(ctx, sampler);
+		}
+	}
+	else if(channel == CHANNEL_WORD) {
+		const unsigned channels = ctx.bytespp / sizeof(WORD);
+		if(weights.taps == 2) {
+			FloatSampler<WORD, 2> sampler = { channels, &weights.weights1D[0] };
+			WarpImage<2>(ctx, sampler);
+		} else {
+			FloatSampler<WORD, 4> sampler = { channels, &weights.weights1D[0] };
+			WarpImage<4>(ctx, sampler);
+		}
+	}
+	else {
+		const unsigned channels = ctx.bytespp / sizeof(float);
+		if(weights.taps == 2) {
+			FloatSampler<float, 2> sampler = { channels, &weights.weights1D[0] };
+			WarpImage<2>(ctx, sampler);
+		} else {
+			FloatSampler<float, 4> sampler = { channels, &weights.weights1D[0] };
+			WarpImage<4>(ctx, sampler);
+		}
+	}
+
+	return TRUE;
+}
+
+// --------------------------------------------------------------------------
+//   Public API
+// --------------------------------------------------------------------------
+
+/**
+Apply an affine transformation (rotation, scaling, shear and translation) to an image, into an existing image.
+The matrix maps the source pixel (x, y) to the destination position
+(matrix[0] * x + matrix[1] * y + matrix[2], matrix[3] * x + matrix[4] * y + matrix[5]),
+with pixel centers at integer positions and row 0 at the top of the image.
+Each destination pixel is interpolated at its source position, rounded to 1/32 pixel,
+replicating the edge pixels of the source. Destination pixels whose source position is outside the source
+are set to the background color, or left unchanged when bkcolor is NULL.
+8-bit palettized images that are not greyscale are sampled with the nearest pixel.
+The palette, transparency settings and metadata of dst are not changed.
+@param dst Destination image, with the same type and bit depth as src
+@param src Source image : 8-, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16, FIT_RGBA16, FIT_FLOAT, FIT_RGBF or FIT_RGBAF
+@param matrix 2x3 matrix of the transformation, rows first
+@param filter FILTER_BOX (nearest pixel), FILTER_BILINEAR, FILTER_BICUBIC, FILTER_BSPLINE or FILTER_CATMULLROM
+@param bkcolor Background color, a pixel value of the image type, or NULL
+@return Returns TRUE if successful, returns FALSE if the images, the matrix or the filter are not supported
+@see FreeImage_AffineWarp
+*/
+BOOL DLL_CALLCONV
+FreeImage_AffineWarpInto(FIBITMAP *dst, FIBITMAP *src, const double matrix[6], FREE_IMAGE_FILTER filter, const void *bkcolor) {
+	if(!FreeImage_HasPixels(dst) || !FreeImage_HasPixels(src) || (dst == src)) {
+		return FALSE;
+	}
+	if((FreeImage_GetImageType(dst) != FreeImage_GetImageType(src)) || (FreeImage_GetBPP(dst) != FreeImage_GetBPP(src))) {
+		return FALSE;
+	}
+
+	try {
+		return AffineWarp(dst, src, matrix, filter, bkcolor);
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+	}
+	return FALSE;
+}
+
+/**
+Apply an affine transformation (rotation, scaling, shear and translation) to an image.
+For a deskew, the rotation of FreeImage_RotateEx(dib, angle, 0, 0, cx, cy, TRUE), with a = angle * PI / 180, is
+{ cos(a), sin(a), cx - cos(a) * cx - sin(a) * cy, -sin(a), cos(a), cy + sin(a) * cx - cos(a) * cy }.
+@param dib Source image : 8-, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16, FIT_RGBA16, FIT_FLOAT, FIT_RGBF or FIT_RGBAF
+@param matrix 2x3 matrix of the transformation, rows first, see FreeImage_AffineWarpInto
+@param dst_width Width of the returned image
+@param dst_height Height of the returned image
+@param filter FILTER_BOX (nearest pixel), FILTER_BILINEAR, FILTER_BICUBIC, FILTER_BSPLINE or FILTER_CATMULLROM
+@param bkcolor Background color, a pixel value of the image type, or NULL for a black background
+@return Returns the warped image if successful, returns NULL otherwise
+@see FreeImage_AffineWarpInto
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_AffineWarp(FIBITMAP *dib, const double matrix[6], int dst_width, int dst_height, FREE_IMAGE_FILTER filter, const void *bkcolor) {
+	if(!FreeImage_HasPixels(dib) || (dst_width <= 0) || (dst_height <= 0)) {
+		return NULL;
+	}
+
+	FIBITMAP *dst = FreeImage_AllocateT(FreeImage_GetImageType(dib), dst_width, dst_height, FreeImage_GetBPP(dib),
+		FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib));
+	if(!dst) {
+		return NULL;
+	}
+
+	// the allocated image is black
+	if(!FreeImage_AffineWarpInto(dst, dib, matrix, filter, bkcolor)) {
+		FreeImage_Unload(dst);
+		return NULL;
+	}
+
+	// copy the palette, the transparency settings and the metadata
+	const unsigned colors = FreeImage_GetColorsUsed(dib);
+	if(colors) {
+		memcpy(FreeImage_GetPalette(dst), FreeImage_GetPalette(dib), colors * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(dst, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+	}
+	RGBQUAD bkgnd;
+	if(FreeImage_GetBackgroundColor(dib, &bkgnd)) {
+		FreeImage_SetBackgroundColor(dst, &bkgnd);
+	}
+	FreeImage_CloneMetadata(dst, dib);
+
+	return dst;
+}
@@ -21,6 +21,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 
 /** @brief Retrieves the red, green, blue or alpha channel of a BGR[A] image. 
@@ -486,3 +488,254 @@ FreeImage_SetComplexChannel(FIBITMAP *dst, FIBITMAP *src, FREE_IMAGE_COLOR_CHANN
 
 	return TRUE;
 }
+
+// ----------------------------------------------------------
+//   Split and merge of all channels
+// ----------------------------------------------------------
+
+/**
+Copy the channels of pixels [first, width) of a row to planes : plane k receives channel k
+*/
+template <class T> static void
+SplitPixels(BYTE *const planes[4], const BYTE *source, unsigned first, unsigned width, unsigned channels) {
+	const T *src = (const T*)source + first * channels;
+	for(unsigned x = first; x < width; x++) {
+		for(unsigned k = 0; k < channels; k++) {
+			((T*)planes[k])[x] = *src++;
+		}
+	}
+}
+
+/**
+Copy pixels [first, width) of planes to the channels of a row : channel k is taken from plane k
+*/
+template <class T> static void
+MergePixels(BYTE *target, const BYTE *const planes[4], unsigned first, unsigned width, unsigned channels) {
+	T *dst = (T*)target + first * channels;
+	for(unsigned x = first; x < width; x++) {
+		for(unsigned k = 0; k < channels; k++) {
+			*dst++ = ((const T*)planes[k])[x];
+		}
+	}
+}
+
+/**
+Describe the channels of a RGB[A] image type.
+@param image_type FIT_BITMAP, FIT_RGB16, FIT_RGBA16, FIT_RGBF or FIT_RGBAF
+@param bpp Bit depth of the image
+@param channel_type Returns the type of a single channel image
+@param index Returns the memory index of the red, green, blue and alpha channels
+@return Returns the number of channels, 0 when the image type is not supported
+*/
+static unsigned
+GetChannelLayout(FREE_IMAGE_TYPE image_type, unsigned bpp, FREE_IMAGE_TYPE *channel_type, unsigned index[4]) {
+	switch(image_type) {
+		case FIT_BITMAP:
+			if((bpp != 24) && (bpp != 32)) {
+				return 0;
+			}
+			*channel_type = FIT_BITMAP;
+			index[0] = FI_RGBA_RED;
+			index[1] = FI_RGBA_GREEN;
+			index[2] = FI_RGBA_BLUE;
+			index[3] = FI_RGBA_ALPHA;
+			return bpp / 8;
+		case FIT_RGB16:
+		case FIT_RGBA16:
+			*channel_type = FIT_UINT16;
+			break;
+		case FIT_RGBF:
+		case FIT_RGBAF:
+			*channel_type = FIT_FLOAT;
+			break;
+		default:
+			return 0;
+	}
+	for(unsigned k = 0; k < 4; k++) {
+		index[k] = k;
+	}
+	return ((image_type == FIT_RGBA16) || (image_type == FIT_RGBAF)) ? 4 : 3;
+}
+
+/** @brief Extract all the channels of a RGB[A] image in a single pass. 
+24- and 32-bit images give 8-bit greyscale images, FIT_RGB16 and FIT_RGBA16 images give 
+FIT_UINT16 images, FIT_RGBF and FIT_RGBAF images give FIT_FLOAT images. 
+@param src Input image to be processed.
+@param channels Returns the red, green, blue and (if any) alpha channels. Must have room for 4 images.
+@return Returns the number of extracted channels (3 or 4) if successful, returns 0 otherwise.
+@see FreeImage_GetChannel
+*/
+int DLL_CALLCONV 
+FreeImage_SplitChannels(FIBITMAP *src, FIBITMAP **channels) {
+	if(!FreeImage_HasPixels(src) || !channels) return 0;
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	const unsigned bpp = FreeImage_GetBPP(src);
+	FREE_IMAGE_TYPE channel_type;
+	unsigned index[4];
+	const unsigned count = GetChannelLayout(image_type, bpp, &channel_type, index);
+	if(count == 0) return 0;
+
+	const unsigned width  = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+
+	for(unsigned c = 0; c < count; c++) {
+		channels[c] = (channel_type == FIT_BITMAP) ? FreeImage_Allocate(width, height, 8) : FreeImage_AllocateT(channel_type, width, height);
+		if(!channels[c]) {
+			for(unsigned k = 0; k < c; k++) {
+				FreeImage_Unload(channels[k]);
+				channels[k] = NULL;
+			}
+			return 0;
+		}
+		if(channel_type == FIT_BITMAP) {
+			// build a greyscale palette
+			RGBQUAD *pal = FreeImage_GetPalette(channels[c]);
+			for(int i = 0; i < 256; i++) {
+				pal[i].rgbBlue = pal[i].rgbGreen = pal[i].rgbRed = (BYTE)i;
+			}
+		}
+		// copy metadata from src to dst
+		FreeImage_CloneMetadata(channels[c], src);
+	}
+
+	const FILineKernels& kernels = GetLineKernels();
+	FI_SplitLineKernel split = NULL;
+	switch(bpp) {
+		case 24:
+			split = kernels.split24;
+			break;
+		case 32:
+			split = kernels.split32;
+			break;
+		case 64:
+			split = kernels.split64;
+			break;
+		case 128:
+			split = kernels.split128;
+			break;
+	}
+	const unsigned component_size = bpp / (8 * count);
+
+	ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+		for(unsigned y = first; y < last; y++) {
+			const BYTE *src_bits = FreeImage_GetScanLine(src, y);
+			BYTE *planes[4] = { NULL, NULL, NULL, NULL };
+			for(unsigned c = 0; c < count; c++) {
+				planes[index[c]] = FreeImage_GetScanLine(channels[c], y);
+			}
+			const unsigned done = split ? (unsigned)split(planes, src_bits, (int)width) : 0;
+			switch(component_size) {
+				case 1:
+					SplitPixels<BYTE>(planes, src_bits, done, width, count);
+					break;
+				case 2:
+					SplitPixels<WORD>(planes, src_bits, done, width, count);
+					break;
+				case 4:
+					SplitPixels<DWORD>(planes, src_bits, done, width, count);
+					break;
+			}
+		}
+	});
+
+	return (int)count;
+}
+
+/** @brief Build a RGB[A] image from its channels in a single pass. 
+All channels must have the same type and size. 8-bit images give a 24- or 32-bit image, 
+FIT_UINT16 images give a FIT_RGB16 or FIT_RGBA16 image, FIT_FLOAT images give a FIT_RGBF or 
+FIT_RGBAF image. The palette of 8-bit channels is ignored. 
+@param channels Red, green, blue and (if count is 4) alpha channels
+@param count Number of channels, 3 or 4
+@return Returns the merged image if successful, returns NULL otherwise.
+@see FreeImage_SetChannel
+*/
+FIBITMAP * DLL_CALLCONV 
+FreeImage_MergeChannels(FIBITMAP **channels, int count) {
+	if(!channels || ((count != 3) && (count != 4))) return NULL;
+
+	for(int c = 0; c < count; c++) {
+		if(!FreeImage_HasPixels(channels[c])) return NULL;
+	}
+
+	const FREE_IMAGE_TYPE channel_type = FreeImage_GetImageType(channels[0]);
+	const unsigned width  = FreeImage_GetWidth(channels[0]);
+	const unsigned height = FreeImage_GetHeight(channels[0]);
+	for(int c = 1; c < count; c++) {
+		if((FreeImage_GetImageType(channels[c]) != channel_type) || (FreeImage_GetBPP(channels[c]) != FreeImage_GetBPP(channels[0]))) return NULL;
+		if((FreeImage_GetWidth(channels[c]) != width) || (FreeImage_GetHeight(channels[c]) != height)) return NULL;
+	}
+
+	FREE_IMAGE_TYPE image_type;
+	unsigned bpp;
+	switch(channel_type) {
+		case FIT_BITMAP:
+			if(FreeImage_GetBPP(channels[0]) != 8) return NULL;
+			image_type = FIT_BITMAP;
+			bpp = 8 * count;
+			break;
+		case FIT_UINT16:
+			image_type = (count == 4) ? FIT_RGBA16 : FIT_RGB16;
+			bpp = 16 * count;
+			break;
+		case FIT_FLOAT:
+			image_type = (count == 4) ? FIT_RGBAF : FIT_RGBF;
+			bpp = 32 * count;
+			break;
+		default:
+			return NULL;
+	}
+
+	FIBITMAP *dst = FreeImage_AllocateT(image_type, width, height, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+	if(!dst) return NULL;
+
+	FREE_IMAGE_TYPE layout_type;
+	unsigned index[4];
+	GetChannelLayout(image_type, bpp, &layout_type, index);
+
+	const FILineKernels& kernels = GetLineKernels();
+	FI_MergeLineKernel merge = NULL;
+	switch(bpp) {
+		case 24:
+			merge = kernels.merge24;
+			break;
+		case 32:
+			merge = kernels.merge32;
+			break;
+		case 64:
+			merge = kernels.merge64;
+			break;
+		case 128:
+			merge = kernels.merge128;
+			break;
+	}
+	const unsigned component_size = bpp / (8 * count);
+
+	ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+		for(unsigned y = first; y < last; y++) {
+			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+			const BYTE *planes[4] = { NULL, NULL, NULL, NULL };
+			for(int c = 0; c < count; c++) {
+				planes[index[c]] = FreeImage_GetScanLine(channels[c], y);
+			}
+			const unsigned done = merge ? (unsigned)merge(dst_bits, planes, (int)width) : 0;
+			switch(component_size) {
+				case 1:
+					MergePixels<BYTE>(dst_bits, planes, done, width, count);
+					break;
+				case 2:
+					MergePixels<WORD>(dst_bits, planes, done, width, count);
+					break;
+				case 4:
+					MergePixels<DWORD>(dst_bits, planes, done, width, count);
+					break;
+			}
+		}
+	});
+
+	// copy metadata from the first channel to dst
+	FreeImage_CloneMetadata(dst, channels[0]);
+
+	return dst;
+}
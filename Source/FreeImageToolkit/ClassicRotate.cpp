@@ -35,6 +35,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 #define RBLOCK		64	// image blocks of RBLOCK*RBLOCK pixels
 
@@ -310,208 +312,219 @@ VerticalSkew(FIBITMAP *src, FIBITMAP *dst, int col, int iOffset, double dWeight,
 	}
 } 
 
+/**
+Transposes a tile of pixels : target row x, column y is set to the source pixel at row y, column x. 
+The SIMD kernel transposes the largest part of the tile made of whole blocks, the remaining pixels are copied one by one.
+*/
+template <unsigned bytespp> static void
+TransposeTile(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, unsigned width, unsigned height, FI_TransposeKernel kernel) {
+	const unsigned block = kernel ? (unsigned)kernel(target, target_pitch, source, source_pitch, (int)width, (int)height) : 0;
+	const unsigned done_width = block ? width - width % block : 0;
+	const unsigned done_height = block ? height - height % block : 0;
+
+	// fill the target rows sequentially : 
+	// rows below the kernel blocks, then whole rows right of them
+	for(unsigned x = 0; x < width; x++) {
+		const unsigned first_y = (x < done_width) ? done_height : 0;
+		const BYTE *src_bits = source + (ptrdiff_t)first_y * source_pitch + x * bytespp;
+		BYTE *dst_bits = target + (ptrdiff_t)x * target_pitch + first_y * bytespp;
+		for(unsigned y = first_y; y < height; y++) {
+			memcpy(dst_bits, src_bits, bytespp);
+			src_bits += source_pitch;
+			dst_bits += bytespp;
+		}
+	}
+}
+
+/**
+Transposes an image by tiles of RBLOCK*RBLOCK pixels. 
+This produces much less CPU cache misses than walking the source column by column. 
+The bands of tiles making a target row band are processed in parallel.
+*/
+template <unsigned bytespp> static void
+TransposeT(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, unsigned width, unsigned height, FI_TransposeKernel kernel) {
+	const unsigned band_count = (width + RBLOCK - 1) / RBLOCK;
+
+	ParallelForRows(height * RBLOCK, band_count, [&](unsigned first_band, unsigned last_band) {
+		for(unsigned band = first_band; band < last_band; band++) {
+			// source columns [xs, xs + RBLOCK) are target rows
+			const unsigned xs = band * RBLOCK;
+			const unsigned tile_width = MIN(width - xs, (unsigned)RBLOCK);
+			for(unsigned ys = 0; ys < height; ys += RBLOCK) {
+				const unsigned tile_height = MIN(height - ys, (unsigned)RBLOCK);
+				TransposeTile<bytespp>(target + (ptrdiff_t)xs * target_pitch + ys * bytespp, target_pitch, 
+					source + (ptrdiff_t)ys * source_pitch + xs * bytespp, source_pitch, tile_width, tile_height, kernel);
+			}
+		}
+	});
+}
+
+/**
+Transposes the pixels of a width x height source image into a height x width target image. 
+Rows are given by a first row and a pitch, so that a negative pitch flips an image vertically.
+@return Returns FALSE if the pixel size is not supported
+*/
+static BOOL
+Transpose(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, unsigned width, unsigned height, unsigned bytespp) {
+	const FILineKernels& kernels = GetLineKernels();
+
+	switch(bytespp) {
+		case 1:
+			TransposeT<1>(target, target_pitch, source, source_pitch, width, height, kernels.transpose8);
+			break;
+		case 2:
+			TransposeT<2>(target, target_pitch, source, source_pitch, width, height, kernels.transpose16);
+			break;
+		case 3:
+			TransposeT<3>(target, target_pitch, source, source_pitch, width, height, kernels.transpose24);
+			break;
+		case 4:
+			TransposeT<4>(target, target_pitch, source, source_pitch, width, height, kernels.transpose32);
+			break;
+		case 6:
+			TransposeT<6>(target, target_pitch, source, source_pitch, width, height, NULL);
+			break;
+		case 8:
+			TransposeT<8>(target, target_pitch, source, source_pitch, width, height, kernels.transpose64);
+			break;
+		case 12:
+			TransposeT<12>(target, target_pitch, source, source_pitch, width, height, NULL);
+			break;
+		case 16:
+			TransposeT<16>(target, target_pitch, source, source_pitch, width, height, NULL);
+			break;
+		default:
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+Get the number of bytes per pixel of an image rotated by right angles
+@return Returns 0 for 1-bit images, the number of bytes per pixel of 8-bit and larger images, or -1 if the image cannot be rotated
+*/
+static int
+GetRotationBytesPerPixel(FIBITMAP *src) {
+	const unsigned bpp = FreeImage_GetBPP(src);
+	if(bpp == 1) {
+		return (FreeImage_GetImageType(src) == FIT_BITMAP) ? 0 : -1;
+	}
+	switch(bpp / 8) {
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 6:
+		case 8:
+		case 12:
+		case 16:
+			return ((bpp % 8) == 0) ? (int)(bpp / 8) : -1;
+		default:
+			return -1;
+	}
+}
+
 /**
 Rotates an image by 90 degrees (counter clockwise). 
 Precise rotation, no filters required.<br>
-Code adapted from CxImage (http://www.xdp.it/cximage.htm)
+1-bit code adapted from CxImage (http://www.xdp.it/cximage.htm)
 @param src Pointer to source image to rotate
-@return Returns a pointer to a newly allocated rotated image if successful, returns NULL otherwise
+@param dst Pointer to the rotated image, with the size of the rotated image and the format of src, cleared if 1-bit
 */
-static FIBITMAP* 
-Rotate90(FIBITMAP *src) {
+static void 
+Rotate90(FIBITMAP *src, FIBITMAP *dst) {
 
 	const unsigned bpp = FreeImage_GetBPP(src);
 
 	const unsigned src_width  = FreeImage_GetWidth(src);
 	const unsigned src_height = FreeImage_GetHeight(src);	
-	const unsigned dst_width  = src_height;
 	const unsigned dst_height = src_width;
 
-	FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
-
-	// allocate and clear dst image
-	FIBITMAP *dst = FreeImage_AllocateT(image_type, dst_width, dst_height, bpp);
-	if(NULL == dst) return NULL;
-
 	// get src and dst scan width
 	const unsigned src_pitch  = FreeImage_GetPitch(src);
 	const unsigned dst_pitch  = FreeImage_GetPitch(dst);
 
-	switch(image_type) {
-		case FIT_BITMAP:
-			if(bpp == 1) {
-				// speedy rotate for BW images
-
-				BYTE *bsrc  = FreeImage_GetBits(src); 
-				BYTE *bdest = FreeImage_GetBits(dst);
-
-				BYTE *dbitsmax = bdest + dst_height * dst_pitch - 1;
-
-				for(unsigned y = 0; y < src_height; y++) {
-					// figure out the column we are going to be copying to
-					const div_t div_r = div(y, 8);
-					// set bit pos of src column byte
-					const BYTE bitpos = (BYTE)(128 >> div_r.rem);
-					BYTE *srcdisp = bsrc + y * src_pitch;
-					for(unsigned x = 0; x < src_pitch; x++) {
-						// get source bits
-						BYTE *sbits = srcdisp + x;
-						// get destination column
-						BYTE *nrow = bdest + (dst_height - 1 - (x * 8)) * dst_pitch + div_r.quot;
-						for (int z = 0; z < 8; z++) {
-						   // get destination byte
-							BYTE *dbits = nrow - z * dst_pitch;
-							if ((dbits < bdest) || (dbits > dbitsmax)) break;
-							if (*sbits & (128 >> z)) *dbits |= bitpos;
-						}
-					}
-				}
-			}
-			else if((bpp == 8) || (bpp == 24) || (bpp == 32)) {
-				// anything other than BW :
-				// This optimized version of rotation rotates image by smaller blocks. It is quite
-				// a bit faster than obvious algorithm, because it produces much less CPU cache misses.
-				// This optimization can be tuned by changing block size (RBLOCK). 96 is good value for current
-				// CPUs (tested on Athlon XP and Celeron D). Larger value (if CPU has enough cache) will increase
-				// speed somehow, but once you drop out of CPU's cache, things will slow down drastically.
-				// For older CPUs with less cache, lower value would yield better results.
-
-				BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-				BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-				// calculate the number of bytes per pixel (1 for 8-bit, 3 for 24-bit or 4 for 32-bit)
-				const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-				
-				// for all image blocks of RBLOCK*RBLOCK pixels
-				
-				// x-segment
-				for(unsigned xs = 0; xs < dst_width; xs += RBLOCK) {
-					// y-segment
-					for(unsigned ys = 0; ys < dst_height; ys += RBLOCK) {
-						for(unsigned y = ys; y < MIN(dst_height, ys + RBLOCK); y++) {    // do rotation
-							const unsigned y2 = dst_height - y - 1;
-							// point to src pixel at (y2, xs)
-							BYTE *src_bits = bsrc + (xs * src_pitch) + (y2 * bytespp);
-							// point to dst pixel at (xs, y)
-							BYTE *dst_bits = bdest + (y * dst_pitch) + (xs * bytespp);
-							for(unsigned x = xs; x < MIN(dst_width, xs + RBLOCK); x++) {
-								// dst.SetPixel(x, y, src.GetPixel(y2, x));
-								AssignPixel(dst_bits, src_bits, bytespp);
-								dst_bits += bytespp;
-								src_bits += src_pitch;
-							}
-						}
-					}
-				}
-			}
-			break;
-		case FIT_UINT16:
-		case FIT_RGB16:
-		case FIT_RGBA16:
-		case FIT_FLOAT:
-		case FIT_RGBF:
-		case FIT_RGBAF:
-		{
-			BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-			BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-			// calculate the number of bytes per pixel
-			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-
-			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *src_bits = bsrc + (src_width - 1 - y) * bytespp;
-				BYTE *dst_bits = bdest + (y * dst_pitch);
-				for(unsigned x = 0; x < dst_width; x++) {
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits += src_pitch;
-					dst_bits += bytespp;
+	BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
+	BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
+
+	if(bpp == 1) {
+		// speedy rotate for BW images
+
+		BYTE *dbitsmax = bdest + dst_height * dst_pitch - 1;
+
+		for(unsigned y = 0; y < src_height; y++) {
+			// figure out the column we are going to be copying to
+			const div_t div_r = div(y, 8);
+			// set bit pos of src column byte
+			const BYTE bitpos = (BYTE)(128 >> div_r.rem);
+			BYTE *srcdisp = bsrc + y * src_pitch;
+			for(unsigned x = 0; x < src_pitch; x++) {
+				// get source bits
+				BYTE *sbits = srcdisp + x;
+				// get destination column
+				BYTE *nrow = bdest + (dst_height - 1 - (x * 8)) * dst_pitch + div_r.quot;
+				for (int z = 0; z < 8; z++) {
+				   // get destination byte
+					BYTE *dbits = nrow - z * dst_pitch;
+					if ((dbits < bdest) || (dbits > dbitsmax)) break;
+					if (*sbits & (128 >> z)) *dbits |= bitpos;
 				}
 			}
 		}
-		break;
 	}
-
-	return dst;
+	else {
+		// dst(x, y) = src(dst_height - 1 - y, x) : transpose src into dst rows taken from top to bottom
+		Transpose(bdest + (dst_height - 1) * dst_pitch, -(int)dst_pitch, bsrc, src_pitch, src_width, src_height, bpp / 8);
+	}
 }
 
 /**
 Rotates an image by 180 degrees (counter clockwise). 
 Precise rotation, no filters required.
 @param src Pointer to source image to rotate
-@return Returns a pointer to a newly allocated rotated image if successful, returns NULL otherwise
+@param dst Pointer to the rotated image, with the size and the format of src
 */
-static FIBITMAP* 
-Rotate180(FIBITMAP *src) {
-	int x, y, k, pos;
-
-	const int bpp = FreeImage_GetBPP(src);
-
-	const int src_width  = FreeImage_GetWidth(src);
-	const int src_height = FreeImage_GetHeight(src);
-	const int dst_width  = src_width;
-	const int dst_height = src_height;
-
-	FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
-
-	FIBITMAP *dst = FreeImage_AllocateT(image_type, dst_width, dst_height, bpp);
-	if(NULL == dst) return NULL;
+static void 
+Rotate180(FIBITMAP *src, FIBITMAP *dst) {
+	const unsigned bpp = FreeImage_GetBPP(src);
 
-	switch(image_type) {
-		case FIT_BITMAP:
-			if(bpp == 1) {
-				for(int y = 0; y < src_height; y++) {
-					BYTE *src_bits = FreeImage_GetScanLine(src, y);
-					BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - y - 1);
-					for(int x = 0; x < src_width; x++) {
-						// get bit at (x, y)
-						k = (src_bits[x >> 3] & (0x80 >> (x & 0x07))) != 0;
-						// set bit at (dst_width - x - 1, dst_height - y - 1)
-						pos = dst_width - x - 1;
-						k ? dst_bits[pos >> 3] |= (0x80 >> (pos & 0x7)) : dst_bits[pos >> 3] &= (0xFF7F >> (pos & 0x7));
-					}			
-				}
-				break;
-			}
-			// else if((bpp == 8) || (bpp == 24) || (bpp == 32)) FALL TROUGH
-		case FIT_UINT16:
-		case FIT_RGB16:
-		case FIT_RGBA16:
-		case FIT_FLOAT:
-		case FIT_RGBF:
-		case FIT_RGBAF:
-		{
-			 // Calculate the number of bytes per pixel
-			const int bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-
-			for(y = 0; y < src_height; y++) {
-				BYTE *src_bits = FreeImage_GetScanLine(src, y);
-				BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - y - 1) + (dst_width - 1) * bytespp;
-				for(x = 0; x < src_width; x++) {
-					// get pixel at (x, y)
-					// set pixel at (dst_width - x - 1, dst_height - y - 1)
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits += bytespp;
-					dst_bits -= bytespp;					
-				}				
-			}
+	const unsigned src_width  = FreeImage_GetWidth(src);
+	const unsigned src_height = FreeImage_GetHeight(src);
+	const unsigned dst_width  = src_width;
+	const unsigned dst_height = src_height;
+
+	if(bpp == 1) {
+		for(unsigned y = 0; y < src_height; y++) {
+			BYTE *src_bits = FreeImage_GetScanLine(src, y);
+			BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - y - 1);
+			for(unsigned x = 0; x < src_width; x++) {
+				// get bit at (x, y)
+				const int k = (src_bits[x >> 3] & (0x80 >> (x & 0x07))) != 0;
+				// set bit at (dst_width - x - 1, dst_height - y - 1)
+				const unsigned pos = dst_width - x - 1;
+				k ? dst_bits[pos >> 3] |= (0x80 >> (pos & 0x7)) : dst_bits[pos >> 3] &= (0xFF7F >> (pos & 0x7));
+			}			
 		}
-		break;
 	}
-
-	return dst;
+	else {
+		// set pixel at (dst_width - x - 1, dst_height - y - 1) to pixel at (x, y)
+		ParallelForRows(src_width, src_height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				ReversePixels(FreeImage_GetScanLine(dst, dst_height - y - 1), FreeImage_GetScanLine(src, y), src_width, bpp / 8);
+			}
+		});
+	}
 }
 
 /**
 Rotates an image by 270 degrees (counter clockwise). 
 Precise rotation, no filters required.<br>
-Code adapted from CxImage (http://www.xdp.it/cximage.htm)
+1-bit code adapted from CxImage (http://www.xdp.it/cximage.htm)
 @param src Pointer to source image to rotate
-@return Returns a pointer to a newly allocated rotated image if successful, returns NULL otherwise
+@param dst Pointer to the rotated image, with the size of the rotated image and the format of src, cleared if 1-bit
 */
-static FIBITMAP* 
-Rotate270(FIBITMAP *src) {
-	int x2, dlineup;
-
+static void 
+Rotate270(FIBITMAP *src, FIBITMAP *dst) {
 	const unsigned bpp = FreeImage_GetBPP(src);
 
 	const unsigned src_width  = FreeImage_GetWidth(src);
@@ -519,108 +532,75 @@ Rotate270(FIBITMAP *src) {
 	const unsigned dst_width  = src_height;
 	const unsigned dst_height = src_width;
 
-	FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
-
-	// allocate and clear dst image
-	FIBITMAP *dst = FreeImage_AllocateT(image_type, dst_width, dst_height, bpp);
-	if(NULL == dst) return NULL;
-
 	// get src and dst scan width
 	const unsigned src_pitch  = FreeImage_GetPitch(src);
 	const unsigned dst_pitch  = FreeImage_GetPitch(dst);
+
+	BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
+	BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
 	
-	switch(image_type) {
-		case FIT_BITMAP:
-			if(bpp == 1) {
-				// speedy rotate for BW images
-				
-				BYTE *bsrc  = FreeImage_GetBits(src); 
-				BYTE *bdest = FreeImage_GetBits(dst);
-				BYTE *dbitsmax = bdest + dst_height * dst_pitch - 1;
-				dlineup = 8 * dst_pitch - dst_width;
-
-				for(unsigned y = 0; y < src_height; y++) {
-					// figure out the column we are going to be copying to
-					const div_t div_r = div(y + dlineup, 8);
-					// set bit pos of src column byte
-					const BYTE bitpos = (BYTE)(1 << div_r.rem);
-					const BYTE *srcdisp = bsrc + y * src_pitch;
-					for(unsigned x = 0; x < src_pitch; x++) {
-						// get source bits
-						const BYTE *sbits = srcdisp + x;
-						// get destination column
-						BYTE *nrow = bdest + (x * 8) * dst_pitch + dst_pitch - 1 - div_r.quot;
-						for(unsigned z = 0; z < 8; z++) {
-						   // get destination byte
-							BYTE *dbits = nrow + z * dst_pitch;
-							if ((dbits < bdest) || (dbits > dbitsmax)) break;
-							if (*sbits & (128 >> z)) *dbits |= bitpos;
-						}
-					}
-				}
-			} 
-			else if((bpp == 8) || (bpp == 24) || (bpp == 32)) {
-				// anything other than BW :
-				// This optimized version of rotation rotates image by smaller blocks. It is quite
-				// a bit faster than obvious algorithm, because it produces much less CPU cache misses.
-				// This optimization can be tuned by changing block size (RBLOCK). 96 is good value for current
-				// CPUs (tested on Athlon XP and Celeron D). Larger value (if CPU has enough cache) will increase
-				// speed somehow, but once you drop out of CPU's cache, things will slow down drastically.
-				// For older CPUs with less cache, lower value would yield better results.
-
-				BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-				BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-				// Calculate the number of bytes per pixel (1 for 8-bit, 3 for 24-bit or 4 for 32-bit)
-				const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-
-				// for all image blocks of RBLOCK*RBLOCK pixels
-
-				// x-segment
-				for(unsigned xs = 0; xs < dst_width; xs += RBLOCK) {
-					// y-segment
-					for(unsigned ys = 0; ys < dst_height; ys += RBLOCK) {
-						for(unsigned x = xs; x < MIN(dst_width, xs + RBLOCK); x++) {    // do rotation
-							x2 = dst_width - x - 1;
-							// point to src pixel at (ys, x2)
-							BYTE *src_bits = bsrc + (x2 * src_pitch) + (ys * bytespp);
-							// point to dst pixel at (x, ys)
-							BYTE *dst_bits = bdest + (ys * dst_pitch) + (x * bytespp);
-							for(unsigned y = ys; y < MIN(dst_height, ys + RBLOCK); y++) {
-								// dst.SetPixel(x, y, src.GetPixel(y, x2));
-								AssignPixel(dst_bits, src_bits, bytespp);
-								src_bits += bytespp;
-								dst_bits += dst_pitch;
-							}
-						}
-					}
-				}
-			}
-			break;
-		case FIT_UINT16:
-		case FIT_RGB16:
-		case FIT_RGBA16:
-		case FIT_FLOAT:
-		case FIT_RGBF:
-		case FIT_RGBAF:
-		{
-			BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-			BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-			// calculate the number of bytes per pixel
-			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-
-			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *src_bits = bsrc + (src_height - 1) * src_pitch + y * bytespp;
-				BYTE *dst_bits = bdest + (y * dst_pitch);
-				for(unsigned x = 0; x < dst_width; x++) {
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits -= src_pitch;
-					dst_bits += bytespp;
+	if(bpp == 1) {
+		// speedy rotate for BW images
+		
+		BYTE *dbitsmax = bdest + dst_height * dst_pitch - 1;
+		const int dlineup = 8 * dst_pitch - dst_width;
+
+		for(unsigned y = 0; y < src_height; y++) {
+			// figure out the column we are going to be copying to
+			const div_t div_r = div(y + dlineup, 8);
+			// set bit pos of src column byte
+			const BYTE bitpos = (BYTE)(1 << div_r.rem);
+			const BYTE *srcdisp = bsrc + y * src_pitch;
+			for(unsigned x = 0; x < src_pitch; x++) {
+				// get source bits
+				const BYTE *sbits = srcdisp + x;
+				// get destination column
+				BYTE *nrow = bdest + (x * 8) * dst_pitch + dst_pitch - 1 - div_r.quot;
+				for(unsigned z = 0; z < 8; z++) {
+				   // get destination byte
+					BYTE *dbits = nrow + z * dst_pitch;
+					if ((dbits < bdest) || (dbits > dbitsmax)) break;
+					if (*sbits & (128 >> z)) *dbits |= bitpos;
 				}
 			}
 		}
-		break;
+	} 
+	else {
+		// dst(x, y) = src(y, src_height - 1 - x) : transpose src rows taken from top to bottom into dst
+		Transpose(bdest, dst_pitch, bsrc + (src_height - 1) * src_pitch, -(int)src_pitch, src_width, src_height, bpp / 8);
+	}
+}
+
+/**
+Rotates an image by 90, 180 or 270 degrees (counter clockwise) into a new image. 
+@param src Pointer to source image to rotate
+@param angle Rotation angle, 90, 180 or 270
+@return Returns a pointer to a newly allocated rotated image if successful, returns NULL otherwise
+*/
+static FIBITMAP*
+RotateRightAngle(FIBITMAP *src, int angle) {
+	if(GetRotationBytesPerPixel(src) < 0) {
+		return NULL;
+	}
+
+	const unsigned width  = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+	const BOOL swap = (angle != 180);
+
+	// allocate and clear dst image
+	FIBITMAP *dst = FreeImage_AllocateT(FreeImage_GetImageType(src), swap ? height : width, swap ? width : height, FreeImage_GetBPP(src));
+	if(NULL == dst) return NULL;
+
+	switch(angle) {
+		case 90:
+			Rotate90(src, dst);
+			break;
+		case 180:
+			Rotate180(src, dst);
+			break;
+		case 270:
+			Rotate270(src, dst);
+			break;
 	}
 
 	return dst;
@@ -772,7 +752,7 @@ RotateAny(FIBITMAP *src, double dAngle, const void *bkcolor) {
 		// Rotate image by 90 degrees into temporary image,
 		// so it requires only an extra rotation angle 
 		// of -45 .. +45 to complete rotation.
-		image = Rotate90(src);
+		image = RotateRightAngle(src, 90);
 		dAngle -= 90;
 	}
 	else if((dAngle > 135) && (dAngle <= 225)) { 
@@ -780,7 +760,7 @@ RotateAny(FIBITMAP *src, double dAngle, const void *bkcolor) {
 		// Rotate image by 180 degrees into temporary image,
 		// so it requires only an extra rotation angle 
 		// of -45 .. +45 to complete rotation.
-		image = Rotate180(src);
+		image = RotateRightAngle(src, 180);
 		dAngle -= 180;
 	}
 	else if((dAngle > 225) && (dAngle <= 315)) { 
@@ -788,7 +768,7 @@ RotateAny(FIBITMAP *src, double dAngle, const void *bkcolor) {
 		// Rotate image by 270 degrees into temporary image,
 		// so it requires only an extra rotation angle 
 		// of -45 .. +45 to complete rotation.
-		image = Rotate270(src);
+		image = RotateRightAngle(src, 270);
 		dAngle -= 270;
 	}
 
@@ -915,3 +895,84 @@ FreeImage_Rotate(FIBITMAP *dib, double angle, const void *bkcolor) {
 	return NULL;
 }
 
+
+/**
+Rotates an image by a multiple of 90 degrees (counter clockwise) into a caller allocated image. 
+Precise rotation, no filters required. The palette and the transparency settings of src are copied to dst.
+@param dst Destination image, with the image type and the bit depth of src, and the size of the rotated image
+@param src Source image (1-bit or 8-bit and more, except 16-bit FIT_BITMAP with different color masks)
+@param angle Rotation angle in degrees, a multiple of 90
+@param flags FI_CONVERT_DEFAULT to rotate the pixels only, FI_CONVERT_METADATA to also copy the metadata of src
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+BOOL DLL_CALLCONV 
+FreeImage_RotateInto(FIBITMAP *dst, FIBITMAP *src, int angle, int flags) {
+	if(!FreeImage_HasPixels(dst) || !FreeImage_HasPixels(src) || (dst == src)) {
+		return FALSE;
+	}
+	if((angle % 90) != 0) {
+		return FALSE;
+	}
+	if((FreeImage_GetImageType(dst) != FreeImage_GetImageType(src)) || (FreeImage_GetBPP(dst) != FreeImage_GetBPP(src))) {
+		return FALSE;
+	}
+	if((FreeImage_GetBPP(src) == 16) && (FreeImage_GetImageType(src) == FIT_BITMAP) && (IS_FORMAT_RGB565(src) != IS_FORMAT_RGB565(dst))) {
+		return FALSE;
+	}
+	const int bytespp = GetRotationBytesPerPixel(src);
+	if(bytespp < 0) {
+		return FALSE;
+	}
+
+	// DIB are stored upside down ...
+	angle = (360 - angle % 360) % 360;
+
+	const unsigned width  = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+	const BOOL swap = (angle == 90) || (angle == 270);
+	if((FreeImage_GetWidth(dst) != (swap ? height : width)) || (FreeImage_GetHeight(dst) != (swap ? width : height))) {
+		return FALSE;
+	}
+
+	if(bytespp == 0) {
+		// the 1-bit rotations set the bits of a cleared image
+		memset(FreeImage_GetBits(dst), 0, FreeImage_GetPitch(dst) * FreeImage_GetHeight(dst));
+	}
+
+	switch(angle) {
+		case 0:
+		{
+			const unsigned line = FreeImage_GetLine(src);
+			for(unsigned y = 0; y < height; y++) {
+				memcpy(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(src, y), line);
+			}
+		}
+		break;
+		case 90:
+			Rotate90(src, dst);
+			break;
+		case 180:
+			Rotate180(src, dst);
+			break;
+		case 270:
+			Rotate270(src, dst);
+			break;
+	}
+
+	// copy the palette and the transparency settings
+	const unsigned colors = FreeImage_GetColorsUsed(src);
+	if(colors) {
+		memcpy(FreeImage_GetPalette(dst), FreeImage_GetPalette(src), colors * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(dst, FreeImage_GetTransparencyTable(src), FreeImage_GetTransparencyCount(src));
+	}
+	RGBQUAD bkcolor; 
+	if(FreeImage_GetBackgroundColor(src, &bkcolor)) {
+		FreeImage_SetBackgroundColor(dst, &bkcolor); 
+	}
+
+	if((flags & FI_CONVERT_METADATA) == FI_CONVERT_METADATA) {
+		FreeImage_CloneMetadata(dst, src);
+	}
+
+	return TRUE;
+}
@@ -23,6 +23,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../ThreadPool.h"
 
 // ----------------------------------------------------------
 //   Macros + structures
@@ -343,103 +344,700 @@ FreeImage_AdjustContrast(FIBITMAP *src, double percentage) {
 
 /** @brief Computes image histogram
 
-For 24-bit and 32-bit images, histogram can be computed from red, green, blue and 
+For 24-bit and 32-bit images, histogram can be computed from red, green, blue, alpha (32-bit only) and 
 black channels. For 8-bit images, histogram is computed from the black channel. Other 
 bit depth is not supported (nothing is done).
 @param src Input image to be processed.
 @param histo Histogram array to fill. <b>The size of 'histo' is assumed to be 256.</b>
 @param channel Color channel to use
 @return Returns TRUE if succesful, returns FALSE if the image bit depth isn't supported.
+@see FreeImage_GetHistograms
 */
 BOOL DLL_CALLCONV 
 FreeImage_GetHistogram(FIBITMAP *src, DWORD *histo, FREE_IMAGE_COLOR_CHANNEL channel) {
-	BYTE pixel;
-	BYTE *bits = NULL;
-	unsigned x, y;
-
 	if(!FreeImage_HasPixels(src) || !histo) return FALSE;
+	if(FreeImage_GetImageType(src) != FIT_BITMAP) return FALSE;
 
-	unsigned width  = FreeImage_GetWidth(src);
-	unsigned height = FreeImage_GetHeight(src);
-	unsigned bpp    = FreeImage_GetBPP(src);
+	switch(FreeImage_GetBPP(src)) {
+		case 8:
+			// histogram of the pixel values, whatever the channel
+			channel = FICC_BLACK;
+			break;
+		case 24:
+		case 32:
+			break;
+		default:
+			return FALSE;
+	}
 
-	if(bpp == 8) {
-		// clear histogram array
-		memset(histo, 0, 256 * sizeof(DWORD));
-		// compute histogram for black channel
-		for(y = 0; y < height; y++) {
-			bits = FreeImage_GetScanLine(src, y);
-			for(x = 0; x < width; x++) {
-				// get pixel value
-				pixel = bits[x];
-				histo[pixel]++;
+	return FreeImage_GetHistograms(src, &histo, &channel, 1);
+}
+
+// ----------------------------------------------------------
+
+// histograms computed by a pass over the pixels
+#define SLOT_RED	0
+#define SLOT_GREEN	1
+#define SLOT_BLUE	2
+#define SLOT_ALPHA	3
+#define SLOT_BLACK	4	// luminance, or value of single channel images
+#define SLOT_COUNT	5
+
+/**
+Index in the pixel of the red, green, blue and alpha samples, and number of samples of a pixel
+*/
+struct PixelLayout {
+	unsigned samples;
+	int offset[4];
+};
+
+/**
+Get the sample layout of the pixels of a 8-, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16, FIT_RGBA16, 
+FIT_FLOAT, FIT_RGBF or FIT_RGBAF image. Missing samples have a -1 offset.
+@return Returns FALSE if the image type is not supported
+*/
+static BOOL 
+GetPixelLayout(FIBITMAP *dib, PixelLayout& layout) {
+	layout.samples = 1;
+	layout.offset[0] = layout.offset[1] = layout.offset[2] = layout.offset[3] = -1;
+
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			switch(FreeImage_GetBPP(dib)) {
+				case 8:
+					return TRUE;
+				case 32:
+					layout.offset[3] = FI_RGBA_ALPHA;
+					// no break here
+				case 24:
+					layout.samples = FreeImage_GetBPP(dib) / 8;
+					layout.offset[0] = FI_RGBA_RED;
+					layout.offset[1] = FI_RGBA_GREEN;
+					layout.offset[2] = FI_RGBA_BLUE;
+					return TRUE;
+				default:
+					return FALSE;
+			}
+		case FIT_UINT16:
+		case FIT_FLOAT:
+			return TRUE;
+		case FIT_RGBA16:
+		case FIT_RGBAF:
+			layout.offset[3] = 3;
+			// no break here
+		case FIT_RGB16:
+		case FIT_RGBF:
+			layout.samples = FreeImage_GetBPP(dib) / ((FreeImage_GetImageType(dib) == FIT_RGB16) || (FreeImage_GetImageType(dib) == FIT_RGBA16) ? 16 : 32);
+			layout.offset[0] = 0;
+			layout.offset[1] = 1;
+			layout.offset[2] = 2;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+Add the luminance of a row of 24- or 32-bit pixels to a histogram, using the line conversion to 8-bit
+@param buffer Work buffer of width values
+*/
+static void 
+AddLumaToHistogram(const BYTE *bits, unsigned width, const PixelLayout& layout, DWORD *h, BYTE *buffer) {
+	if(layout.samples == 3) {
+		FreeImage_ConvertLine24To8(buffer, (BYTE*)bits, width);
+	} else {
+		FreeImage_ConvertLine32To8(buffer, (BYTE*)bits, width);
+	}
+	for(unsigned x = 0; x < width; x++) {
+		h[buffer[x]]++;
+	}
+}
+
+/**
+Add the luminance of a row of FIT_RGB16 or FIT_RGBA16 pixels to a histogram, as the conversion to FIT_UINT16
+*/
+static void 
+AddLumaToHistogram(const WORD *bits, unsigned width, const PixelLayout& layout, DWORD *h, BYTE *buffer) {
+	for(unsigned x = 0; x < width; x++) {
+		const WORD *pixel = bits + x * layout.samples;
+		h[(WORD)LUMA_REC709(pixel[0], pixel[1], pixel[2])]++;
+	}
+}
+
+/**
+Add the pixels of a row to the histograms of the needed slots
+@param buffer Work buffer of width values
+*/
+template <class T> static void 
+AddRowToHistograms(const T *bits, unsigned width, const PixelLayout& layout, const BOOL *needed, DWORD *const *histograms, BYTE *buffer) {
+	const unsigned samples = layout.samples;
+	for(int slot = SLOT_RED; slot <= SLOT_ALPHA; slot++) {
+		if(needed[slot]) {
+			const T *sample = bits + layout.offset[slot];
+			DWORD *h = histograms[slot];
+			for(unsigned x = 0; x < width; x++) {
+				h[sample[x * samples]]++;
 			}
 		}
-		return TRUE;
 	}
-	else if((bpp == 24) || (bpp == 32)) {
-		int bytespp = bpp / 8;	// bytes / pixel
+	if(needed[SLOT_BLACK]) {
+		DWORD *h = histograms[SLOT_BLACK];
+		if(samples == 1) {
+			for(unsigned x = 0; x < width; x++) {
+				h[bits[x]]++;
+			}
+		} else {
+			AddLumaToHistogram(bits, width, layout, h, buffer);
+		}
+	}
+}
+
+/**
+Compute the histograms of the needed slots in one pass over the pixels, on row ranges computed in parallel
+@param histograms Histograms to fill, of bin_count bins, SLOT_COUNT x bin_count values
+*/
+template <class T> static void 
+BuildSlotHistograms(FIBITMAP *dib, const PixelLayout& layout, const BOOL *needed, unsigned bin_count, std::vector<DWORD>& histograms) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	const unsigned range_count = MAX(1U, MIN(GetParallelism(), height / min_rows));
+	std::vector<std::vector<DWORD> > partial(range_count);
+
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((UINT64)height * range) / range_count);
+		const unsigned last = (unsigned)(((UINT64)height * (range + 1)) / range_count);
+		std::vector<DWORD>& h = partial[range];
+		h.assign(SLOT_COUNT * bin_count, 0);
+		std::vector<BYTE> buffer(width);
+		DWORD *slots[SLOT_COUNT];
+		for(int slot = 0; slot < SLOT_COUNT; slot++) {
+			slots[slot] = &h[slot * bin_count];
+		}
+		for(unsigned y = first; y < last; y++) {
+			AddRowToHistograms((const T*)FreeImage_GetScanLine(dib, y), width, layout, needed, slots, &buffer[0]);
+		}
+	});
+
+	// sum the histograms of the ranges
+	histograms.assign(SLOT_COUNT * bin_count, 0);
+	for(unsigned range = 0; range < range_count; range++) {
+		for(size_t i = 0; i < histograms.size(); i++) {
+			histograms[i] += partial[range][i];
+		}
+	}
+}
 
-		// clear histogram array
-		memset(histo, 0, 256 * sizeof(DWORD));
+/** @brief Computes the histograms of several channels in one pass
+
+Each histogram has 256 bins for FIT_BITMAP images, and 65536 bins for FIT_UINT16, FIT_RGB16 and FIT_RGBA16 images.<br>
+Channels : 
+FICC_RED, FICC_GREEN, FICC_BLUE and FICC_ALPHA give the histograms of the samples. 
+For 8-bit images, they give the histograms of the palette entries (the alpha values are 
+those of the transparency table).
+FICC_BLACK and FICC_RGB give the histogram of the luminance (as FreeImage_GetHistogram 
+for 24- and 32-bit images, as the conversion to FIT_UINT16 for FIT_RGB16 and FIT_RGBA16 images), 
+or of the pixel values for 8-bit and FIT_UINT16 images.<br>
+The pixels are read once, whatever the number of channels, and the rows are split between threads.
+@param dib Input 8-, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16 or FIT_RGBA16 image
+@param histograms Array of count histograms to fill
+@param channels Array of the count channels of the histograms, a channel may be used several times
+@param count Number of histograms
+@return Returns TRUE if successful, returns FALSE if the image type or a channel isn't supported
+*/
+BOOL DLL_CALLCONV 
+FreeImage_GetHistograms(FIBITMAP *dib, DWORD **histograms, const FREE_IMAGE_COLOR_CHANNEL *channels, int count) {
+	if(!FreeImage_HasPixels(dib) || !histograms || !channels || (count <= 0)) return FALSE;
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	if((image_type != FIT_BITMAP) && (image_type != FIT_UINT16) && (image_type != FIT_RGB16) && (image_type != FIT_RGBA16)) return FALSE;
+	PixelLayout layout;
+	if(!GetPixelLayout(dib, layout)) return FALSE;
+	const BOOL is_palette = (image_type == FIT_BITMAP) && (layout.samples == 1);
+
+	try {
+		// slot of each channel
+		std::vector<int> slot_of(count);
+		BOOL needed[SLOT_COUNT] = { FALSE, FALSE, FALSE, FALSE, FALSE };
+		for(int k = 0; k < count; k++) {
+			if(!histograms[k]) return FALSE;
+			switch(channels[k]) {
+				case FICC_RED:
+					slot_of[k] = SLOT_RED;
+					break;
+				case FICC_GREEN:
+					slot_of[k] = SLOT_GREEN;
+					break;
+				case FICC_BLUE:
+					slot_of[k] = SLOT_BLUE;
+					break;
+				case FICC_ALPHA:
+					slot_of[k] = SLOT_ALPHA;
+					break;
+				case FICC_RGB:
+				case FICC_BLACK:
+					slot_of[k] = SLOT_BLACK;
+					break;
+				default:
+					return FALSE;
+			}
+			if(is_palette) {
+				// histograms of the palette entries, from the histogram of the pixel values
+				needed[SLOT_BLACK] = TRUE;
+			} else {
+				if((slot_of[k] != SLOT_BLACK) && (layout.offset[slot_of[k]] < 0)) return FALSE;
+				needed[slot_of[k]] = TRUE;
+			}
+		}
 
-		switch(channel) {
-			case FICC_RED:
-				// compute histogram for red channel
-				for(y = 0; y < height; y++) {
-					bits =  FreeImage_GetScanLine(src, y);
-					for(x = 0; x < width; x++) {
-						pixel = bits[FI_RGBA_RED];	// R
-						histo[pixel]++;
-						bits += bytespp;
-					}
-				}
-				return TRUE;
+		const unsigned bin_count = (image_type == FIT_BITMAP) ? 256 : 0x10000;
+		std::vector<DWORD> slot_histograms;
+		if(image_type == FIT_BITMAP) {
+			BuildSlotHistograms<BYTE>(dib, layout, needed, bin_count, slot_histograms);
+		} else {
+			BuildSlotHistograms<WORD>(dib, layout, needed, bin_count, slot_histograms);
+		}
 
-			case FICC_GREEN:
-				// compute histogram for green channel
-				for(y = 0; y < height; y++) {
-					bits =  FreeImage_GetScanLine(src, y);
-					for(x = 0; x < width; x++) {
-						pixel = bits[FI_RGBA_GREEN];	// G
-						histo[pixel]++;
-						bits += bytespp;
+		if(is_palette) {
+			const DWORD *values = &slot_histograms[SLOT_BLACK * bin_count];
+			const RGBQUAD *palette = FreeImage_GetPalette(dib);
+			const BYTE *table = FreeImage_GetTransparencyTable(dib);
+			const unsigned table_count = FreeImage_GetTransparencyCount(dib);
+			for(int slot = SLOT_RED; slot <= SLOT_ALPHA; slot++) {
+				DWORD *h = &slot_histograms[slot * bin_count];
+				for(unsigned i = 0; i < 256; i++) {
+					BYTE entry = 0xFF;
+					switch(slot) {
+						case SLOT_RED:
+							entry = palette[i].rgbRed;
+							break;
+						case SLOT_GREEN:
+							entry = palette[i].rgbGreen;
+							break;
+						case SLOT_BLUE:
+							entry = palette[i].rgbBlue;
+							break;
+						default:
+							entry = (i < table_count) ? table[i] : 0xFF;
+							break;
 					}
+					h[entry] += values[i];
 				}
-				return TRUE;
+			}
+		}
 
-			case FICC_BLUE:
-				// compute histogram for blue channel
-				for(y = 0; y < height; y++) {
-					bits =  FreeImage_GetScanLine(src, y);
-					for(x = 0; x < width; x++) {
-						pixel = bits[FI_RGBA_BLUE];	// B
-						histo[pixel]++;
-						bits += bytespp;
-					}
+		for(int k = 0; k < count; k++) {
+			memcpy(histograms[k], &slot_histograms[slot_of[k] * bin_count], bin_count * sizeof(DWORD));
+		}
+
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// ----------------------------------------------------------
+
+/**
+Count, mean and sum of the squared deviations from the mean of a set of values
+*/
+struct MomentSums {
+	double count;
+	double mean;
+	double m2;
+
+	/**
+	Add a set of values : Chan et al. pairwise update
+	*/
+	void Add(const MomentSums& other) {
+		if(other.count == 0) {
+			return;
+		}
+		const double total = count + other.count;
+		const double delta = other.mean - mean;
+		mean += delta * (other.count / total);
+		m2 += other.m2 + delta * delta * (count * other.count / total);
+		count = total;
+	}
+};
+
+/**
+Get the moments of the channels of a row of 8-bit or 16-bit samples, and update the channel ranges. 
+The sums are exact.
+*/
+template <class T, unsigned CHANNELS> static void 
+GetRowMoments(const T *bits, unsigned width, const PixelLayout& layout, MomentSums *moments, double *min_value, double *max_value) {
+	const unsigned samples = layout.samples;
+	int offset[4] = { 0, 0, 0, 0 };
+	if(samples > 1) {
+		memcpy(offset, layout.offset, sizeof(offset));
+	}
+	UINT64 sum[CHANNELS];
+	UINT64 squares[CHANNELS];
+	unsigned lo[CHANNELS];
+	unsigned hi[CHANNELS];
+	for(unsigned c = 0; c < CHANNELS; c++) {
+		sum[c] = squares[c] = 0;
+		lo[c] = 0xFFFF;
+		hi[c] = 0;
+	}
+	for(unsigned x = 0; x < width; x++) {
+		const T *pixel = bits + x * samples;
+		for(unsigned c = 0; c < CHANNELS; c++) {
+			const unsigned v = pixel[offset[c]];
+			sum[c] += v;
+			squares[c] += (UINT64)(v * v);
+			lo[c] = MIN(lo[c], v);
+			hi[c] = MAX(hi[c], v);
+		}
+	}
+	for(unsigned c = 0; c < CHANNELS; c++) {
+		moments[c].count = width;
+		moments[c].mean = (double)sum[c] / width;
+		moments[c].m2 = MAX(0.0, (double)squares[c] - (double)sum[c] * moments[c].mean);
+		min_value[c] = MIN(min_value[c], (double)lo[c]);
+		max_value[c] = MAX(max_value[c], (double)hi[c]);
+	}
+}
+
+/**
+Get the moments of the channels of a row of float samples, ignoring NaN values, and update the channel ranges
+*/
+template <class T, unsigned CHANNELS> static void 
+GetFloatRowMoments(const T *bits, unsigned width, const PixelLayout& layout, MomentSums *moments, double *min_value, double *max_value) {
+	const unsigned samples = layout.samples;
+	for(unsigned c = 0; c < CHANNELS; c++) {
+		const T *sample = bits + ((samples == 1) ? 0 : layout.offset[c]);
+		MomentSums& m = moments[c];
+		m.count = m.mean = m.m2 = 0;
+		double sum = 0;
+		for(unsigned x = 0; x < width; x++) {
+			const double v = (double)sample[x * samples];
+			if(v == v) {
+				sum += v;
+				m.count++;
+				min_value[c] = MIN(min_value[c], v);
+				max_value[c] = MAX(max_value[c], v);
+			}
+		}
+		if(m.count > 0) {
+			// deviations from the mean of the row
+			m.mean = sum / m.count;
+			for(unsigned x = 0; x < width; x++) {
+				const double v = (double)sample[x * samples];
+				if(v == v) {
+					m.m2 += (v - m.mean) * (v - m.mean);
 				}
-				return TRUE;
+			}
+		}
+	}
+}
 
-			case FICC_BLACK:
-			case FICC_RGB:
-				// compute histogram for black channel
-				for(y = 0; y < height; y++) {
-					bits =  FreeImage_GetScanLine(src, y);
-					for(x = 0; x < width; x++) {
-						// RGB to GREY conversion
-						pixel = GREY(bits[FI_RGBA_RED], bits[FI_RGBA_GREEN], bits[FI_RGBA_BLUE]);
-						histo[pixel]++;
-						bits += bytespp;
-					}
+/**
+Compute the statistics of the channels of an image.
+The moments of the rows are computed in parallel, and added in row order, so that the result does not depend on the number of threads.
+*/
+template <class T, unsigned CHANNELS, void (*RowMoments)(const T*, unsigned, const PixelLayout&, MomentSums*, double*, double*)> static void 
+GetChannelStatistics(FIBITMAP *dib, const PixelLayout& layout, double *min_value, double *max_value, MomentSums *moments) {
+	const unsigned channel_count = CHANNELS;
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+
+	std::vector<MomentSums> row_moments(height * channel_count);
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	const unsigned range_count = MAX(1U, MIN(GetParallelism(), height / min_rows));
+	std::vector<double> range_min(range_count * channel_count, DBL_MAX);
+	std::vector<double> range_max(range_count * channel_count, -DBL_MAX);
+
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((UINT64)height * range) / range_count);
+		const unsigned last = (unsigned)(((UINT64)height * (range + 1)) / range_count);
+		for(unsigned y = first; y < last; y++) {
+			RowMoments((const T*)FreeImage_GetScanLine(dib, y), width, layout, &row_moments[y * channel_count], &range_min[range * channel_count], &range_max[range * channel_count]);
+		}
+	});
+
+	for(unsigned c = 0; c < channel_count; c++) {
+		min_value[c] = DBL_MAX;
+		max_value[c] = -DBL_MAX;
+		for(unsigned range = 0; range < range_count; range++) {
+			min_value[c] = MIN(min_value[c], range_min[range * channel_count + c]);
+			max_value[c] = MAX(max_value[c], range_max[range * channel_count + c]);
+		}
+		MomentSums m = { 0, 0, 0 };
+		for(unsigned y = 0; y < height; y++) {
+			m.Add(row_moments[y * channel_count + c]);
+		}
+		moments[c] = m;
+	}
+}
+
+/** @brief Computes the minimum, maximum, mean and standard deviation of each channel of an image
+
+Channels are the red, green, blue and alpha samples of colour images (in this order), or the 
+pixel values of 8-bit, FIT_UINT16 and FIT_FLOAT images. NaN values are ignored. 
+The standard deviation is the population standard deviation.<br>
+The pixels are read once, and the rows are split between threads.
+@param dib Input 8-, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16, FIT_RGBA16, FIT_FLOAT, FIT_RGBF or FIT_RGBAF image
+@param min_value Array of the minimum value of each channel, may be NULL
+@param max_value Array of the maximum value of each channel, may be NULL
+@param mean Array of the mean value of each channel, may be NULL
+@param stddev Array of the standard deviation of each channel, may be NULL
+@return Returns the number of channels (1, 3 or 4, the size of the arrays), 
+returns 0 if the image type isn't supported or if a channel has no value
+*/
+int DLL_CALLCONV 
+FreeImage_GetStatistics(FIBITMAP *dib, double *min_value, double *max_value, double *mean, double *stddev) {
+	if(!FreeImage_HasPixels(dib)) return 0;
+
+	PixelLayout layout;
+	if(!GetPixelLayout(dib, layout)) return 0;
+	const unsigned channel_count = layout.samples;
+
+	try {
+		double channel_min[4], channel_max[4];
+		MomentSums moments[4];
+
+		switch(FreeImage_GetImageType(dib)) {
+			case FIT_BITMAP:
+				switch(channel_count) {
+					case 1:
+						GetChannelStatistics<BYTE, 1, GetRowMoments<BYTE, 1> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					case 3:
+						GetChannelStatistics<BYTE, 3, GetRowMoments<BYTE, 3> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					default:
+						GetChannelStatistics<BYTE, 4, GetRowMoments<BYTE, 4> >(dib, layout, channel_min, channel_max, moments);
+						break;
+				}
+				break;
+			case FIT_UINT16:
+			case FIT_RGB16:
+			case FIT_RGBA16:
+				switch(channel_count) {
+					case 1:
+						GetChannelStatistics<WORD, 1, GetRowMoments<WORD, 1> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					case 3:
+						GetChannelStatistics<WORD, 3, GetRowMoments<WORD, 3> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					default:
+						GetChannelStatistics<WORD, 4, GetRowMoments<WORD, 4> >(dib, layout, channel_min, channel_max, moments);
+						break;
 				}
-				return TRUE;
-				
+				break;
 			default:
-				return FALSE;
+				switch(channel_count) {
+					case 1:
+						GetChannelStatistics<float, 1, GetFloatRowMoments<float, 1> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					case 3:
+						GetChannelStatistics<float, 3, GetFloatRowMoments<float, 3> >(dib, layout, channel_min, channel_max, moments);
+						break;
+					default:
+						GetChannelStatistics<float, 4, GetFloatRowMoments<float, 4> >(dib, layout, channel_min, channel_max, moments);
+						break;
+				}
+				break;
+		}
+
+		for(unsigned c = 0; c < channel_count; c++) {
+			if(moments[c].count == 0) return 0;
 		}
+		for(unsigned c = 0; c < channel_count; c++) {
+			if(min_value) min_value[c] = channel_min[c];
+			if(max_value) max_value[c] = channel_max[c];
+			if(mean) mean[c] = moments[c].mean;
+			if(stddev) stddev[c] = sqrt(moments[c].m2 / moments[c].count);
+		}
+
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return 0;
 	}
 
-	return FALSE;
+	return (int)channel_count;
+}
+
+// ----------------------------------------------------------
+
+/**
+Histogram of the bins of the values of a FIT_FLOAT or FIT_UINT16 image, computed in parallel
+@param dib Input image
+@param histogram Histogram to fill, its size is the number of bins
+@param bin Bin function, giving the bin of a value, or -1 to ignore the value
+*/
+template<class T, class BinFunction> static void 
+BuildBinHistogram(FIBITMAP *dib, std::vector<DWORD>& histogram, const BinFunction& bin) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const size_t bin_count = histogram.size();
+
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	const unsigned range_count = MAX(1U, MIN(GetParallelism(), height / min_rows));
+	std::vector<std::vector<DWORD> > partial(range_count, std::vector<DWORD>(bin_count, 0));
+
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((UINT64)height * range) / range_count);
+		const unsigned last = (unsigned)(((UINT64)height * (range + 1)) / range_count);
+		std::vector<DWORD>& h = partial[range];
+		for(unsigned y = first; y < last; y++) {
+			const T *bits = (T*)FreeImage_GetScanLine(dib, y);
+			for(unsigned x = 0; x < width; x++) {
+				const int index = bin(bits[x]);
+				if(index >= 0) {
+					h[index]++;
+				}
+			}
+		}
+	});
+
+	// sum the histograms of the ranges
+	for(size_t i = 0; i < bin_count; i++) {
+		DWORD count = 0;
+		for(unsigned range = 0; range < range_count; range++) {
+			count += partial[range][i];
+		}
+		histogram[i] = count;
+	}
+}
+
+/**
+Find the bin holding the value of a given rank
+@param histogram Histogram to search, of the bin_count bins starting at first_bin
+@param rank Rank of the value, updated to the rank inside of the bin
+@return Returns the bin index, relative to first_bin
+*/
+static unsigned 
+FindRankBin(const DWORD *histogram, unsigned bin_count, DWORD& rank) {
+	unsigned i = 0;
+	for(; i < bin_count - 1; i++) {
+		if(rank < histogram[i]) {
+			break;
+		}
+		rank -= histogram[i];
+	}
+	return i;
+}
+
+/**
+Sortable key of a float value : the keys of two values are ordered as the values
+*/
+static inline DWORD 
+FloatToKey(float value) {
+	DWORD u;
+	memcpy(&u, &value, sizeof(DWORD));
+	return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
+
+/**
+Float value of a key
+@see FloatToKey
+*/
+static inline float 
+KeyToFloat(DWORD key) {
+	const DWORD u = (key & 0x80000000) ? (key & 0x7FFFFFFF) : ~key;
+	float value;
+	memcpy(&value, &u, sizeof(DWORD));
+	return value;
+}
+
+/** @brief Computes percentiles of the pixel values of an image
+
+The percentile p is the value of rank floor(p * N) of the N sorted pixel values, 
+the last value for p = 1. NaN values are ignored.<br>
+Percentiles are exact and computed without sorting : with a 65536 bins histogram 
+for FIT_UINT16 images, with a 65536 bins histogram of the high bits of the values, 
+followed by a histogram of the low bits of the values in the bins of the percentiles, 
+for FIT_FLOAT images.
+@param src Input FIT_UINT16 or FIT_FLOAT image
+@param percentiles Array of percentiles to compute, in [0..1]
+@param values Array of count output values
+@param count Number of percentiles
+@return Returns TRUE if successful, returns FALSE if the image type isn't supported 
+or if the image has no value
+*/
+BOOL DLL_CALLCONV 
+FreeImage_GetPercentiles(FIBITMAP *src, const double *percentiles, double *values, int count) {
+	if(!FreeImage_HasPixels(src) || !percentiles || !values || (count <= 0)) return FALSE;
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	if((image_type != FIT_UINT16) && (image_type != FIT_FLOAT)) return FALSE;
+
+	try {
+		std::vector<DWORD> histogram(0x10000, 0);
+
+		if(image_type == FIT_UINT16) {
+			BuildBinHistogram<WORD>(src, histogram, [](WORD value) { return (int)value; });
+		} else {
+			// high 16 bits of the keys
+			BuildBinHistogram<float>(src, histogram, [](float value) { return (value != value) ? -1 : (int)(FloatToKey(value) >> 16); });
+		}
+
+		UINT64 total = 0;
+		for(size_t i = 0; i < histogram.size(); i++) {
+			total += histogram[i];
+		}
+		if(total == 0) return FALSE;
+
+		// bin and rank inside of the bin of each percentile
+		std::vector<unsigned> bins(count);
+		std::vector<DWORD> ranks(count);
+		for(int k = 0; k < count; k++) {
+			const double p = MAX(0.0, MIN(percentiles[k], 1.0));
+			ranks[k] = (DWORD)MIN((double)(total - 1), floor(p * (double)total));
+			bins[k] = FindRankBin(&histogram[0], 0x10000, ranks[k]);
+		}
+
+		if(image_type == FIT_UINT16) {
+			for(int k = 0; k < count; k++) {
+				values[k] = bins[k];
+			}
+			return TRUE;
+		}
+
+		// histogram of the low 16 bits of the keys, in the bins of the percentiles
+		std::vector<int> slots(0x10000, -1);
+		int slot_count = 0;
+		for(int k = 0; k < count; k++) {
+			if(slots[bins[k]] < 0) {
+				slots[bins[k]] = slot_count++;
+			}
+		}
+
+		// the bins are processed by groups of SLOTS_PER_PASS, 
+		// which bounds the size of the per-thread histograms
+		const int SLOTS_PER_PASS = 4;
+		std::vector<DWORD> low_histogram;
+		for(int first_slot = 0; first_slot < slot_count; first_slot += SLOTS_PER_PASS) {
+			const int group_size = MIN(SLOTS_PER_PASS, slot_count - first_slot);
+			low_histogram.assign((size_t)group_size << 16, 0);
+			BuildBinHistogram<float>(src, low_histogram, [&slots, first_slot, group_size](float value) { 
+				if(value != value) return -1;
+				const DWORD key = FloatToKey(value);
+				const int slot = slots[key >> 16] - first_slot;
+				return ((slot < 0) || (slot >= group_size)) ? -1 : (int)((slot << 16) | (key & 0xFFFF));
+			});
+
+			for(int k = 0; k < count; k++) {
+				const int slot = slots[bins[k]] - first_slot;
+				if((slot >= 0) && (slot < group_size)) {
+					const unsigned low = FindRankBin(&low_histogram[(size_t)slot << 16], 0x10000, ranks[k]);
+					values[k] = KeyToFloat((bins[k] << 16) | low);
+				}
+			}
+		}
+
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 // ----------------------------------------------------------
@@ -629,6 +1227,224 @@ FreeImage_AdjustColors(FIBITMAP *dib, double brightness, double contrast, double
 	return FALSE;
 }
 
+// ----------------------------------------------------------
+//   Color mapping
+// ----------------------------------------------------------
+
+/**
+Number of mapped colors up to which pixels are compared with each color. 
+Above, pixels are looked up in a table.
+*/
+#define COLOR_MAPPING_MAX_LINEAR	4
+
+/**
+Get the key of a 24- or 32-bit pixel, bytes in memory order
+*/
+static inline DWORD 
+PixelKey(const BYTE *pixel, unsigned bytespp) {
+	DWORD key = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+	if(bytespp == 4) {
+		key |= ((DWORD)pixel[3] << 24);
+	}
+	return key;
+}
+
+/**
+Get the key of a color, as the key of a 32-bit pixel of this color
+*/
+static inline DWORD 
+QuadKey(const RGBQUAD& color) {
+	BYTE pixel[4];
+	pixel[FI_RGBA_RED] = color.rgbRed;
+	pixel[FI_RGBA_GREEN] = color.rgbGreen;
+	pixel[FI_RGBA_BLUE] = color.rgbBlue;
+	pixel[FI_RGBA_ALPHA] = color.rgbReserved;
+	return PixelKey(pixel, 4);
+}
+
+/**
+Color mapping searched in order of insertion, for a few colors
+*/
+class LinearColorMap {
+private:
+	std::vector<DWORD> _keys;
+	std::vector<DWORD> _values;
+
+public:
+	void Add(DWORD key, DWORD value) {
+		_keys.push_back(key);
+		_values.push_back(value);
+	}
+
+	bool Find(DWORD key, DWORD& value) const {
+		for(size_t i = 0; i < _keys.size(); i++) {
+			if(_keys[i] == key) {
+				value = _values[i];
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+Color mapping of 16-bit keys, as a table of all keys
+*/
+class DirectColorMap {
+private:
+	//! mapped value, with FLAG set for the mapped keys
+	std::vector<DWORD> _table;
+	static const DWORD FLAG = 0x10000;
+
+public:
+	DirectColorMap() : _table(0x10000, 0) {
+	}
+
+	void Add(DWORD key, DWORD value) {
+		// the first mapping of a key is kept
+		if(!(_table[key & 0xFFFF] & FLAG)) {
+			_table[key & 0xFFFF] = (value & 0xFFFF) | FLAG;
+		}
+	}
+
+	bool Find(DWORD key, DWORD& value) const {
+		const DWORD entry = _table[key];
+		value = entry & 0xFFFF;
+		return (entry & FLAG) != 0;
+	}
+};
+
+/**
+Color mapping of 32-bit keys, as an open addressing hash table
+*/
+class HashedColorMap {
+private:
+	struct Entry {
+		DWORD key;
+		DWORD value;
+		BOOL used;
+	};
+	std::vector<Entry> _table;
+	unsigned _mask;
+	unsigned _shift;
+
+	unsigned Slot(DWORD key) const {
+		// Fibonacci hashing
+		return (unsigned)((key * 0x9E3779B1U) >> _shift);
+	}
+
+public:
+	/**
+	@param count Maximum number of keys
+	*/
+	HashedColorMap(unsigned count) {
+		// at most a quarter full, most pixels are not mapped and probe until an empty slot
+		unsigned bits = 6;
+		while(((size_t)1 << bits) < 4 * (size_t)count) {
+			bits++;
+		}
+		const Entry empty = { 0, 0, FALSE };
+		_table.assign((size_t)1 << bits, empty);
+		_mask = (1U << bits) - 1;
+		_shift = 32 - bits;
+	}
+
+	void Add(DWORD key, DWORD value) {
+		unsigned slot = Slot(key);
+		while(_table[slot].used) {
+			if(_table[slot].key == key) {
+				// the first mapping of a key is kept
+				return;
+			}
+			slot = (slot + 1) & _mask;
+		}
+		_table[slot].key = key;
+		_table[slot].value = value;
+		_table[slot].used = TRUE;
+	}
+
+	bool Find(DWORD key, DWORD& value) const {
+		for(unsigned slot = Slot(key); _table[slot].used; slot = (slot + 1) & _mask) {
+			if(_table[slot].key == key) {
+				value = _table[slot].value;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+Map the pixels of a 16-, 24- or 32-bit image. 
+The keys of 24- and 32-bit pixels are masked with key_mask, and the other bits of a pixel
+are kept when it is mapped.
+@return Returns the number of pixels mapped
+*/
+template <class ColorMap> static unsigned 
+MapImageColors(FIBITMAP *dib, const ColorMap& map, DWORD key_mask) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bytespp = FreeImage_GetBPP(dib) / 8;
+
+	const unsigned min_rows = (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	const unsigned range_count = MAX(1U, MIN(GetParallelism(), height / min_rows));
+	std::vector<unsigned> changed(range_count, 0);
+
+	ParallelRun(range_count, [&](unsigned range) {
+		const unsigned first = (unsigned)(((UINT64)height * range) / range_count);
+		const unsigned last = (unsigned)(((UINT64)height * (range + 1)) / range_count);
+		unsigned result = 0;
+		DWORD value;
+		for(unsigned y = first; y < last; y++) {
+			if(bytespp == 2) {
+				WORD *bits = (WORD*)FreeImage_GetScanLine(dib, y);
+				for(unsigned x = 0; x < width; x++) {
+					if(map.Find(bits[x], value)) {
+						bits[x] = (WORD)value;
+						result++;
+					}
+				}
+			} else {
+				BYTE *bits = FreeImage_GetScanLine(dib, y);
+				for(unsigned x = 0; x < width; x++, bits += bytespp) {
+					const DWORD pixel = PixelKey(bits, bytespp);
+					if(map.Find(pixel & key_mask, value)) {
+						value = (value & key_mask) | (pixel & ~key_mask);
+						bits[0] = (BYTE)value;
+						bits[1] = (BYTE)(value >> 8);
+						bits[2] = (BYTE)(value >> 16);
+						if(bytespp == 4) {
+							bits[3] = (BYTE)(value >> 24);
+						}
+						result++;
+					}
+				}
+			}
+		}
+		changed[range] = result;
+	});
+
+	unsigned result = 0;
+	for(unsigned range = 0; range < range_count; range++) {
+		result += changed[range];
+	}
+	return result;
+}
+
+/**
+Add the mappings of srckeys to dstkeys to a color map, and of dstkeys to srckeys when swap is TRUE. 
+Keys are added in the order they are compared by FreeImage_ApplyColorMapping.
+*/
+template <class ColorMap> static void 
+AddColorMappings(ColorMap& map, const std::vector<DWORD>& srckeys, const std::vector<DWORD>& dstkeys, BOOL swap) {
+	for(size_t j = 0; j < srckeys.size(); j++) {
+		map.Add(srckeys[j], dstkeys[j]);
+		if(swap) {
+			map.Add(dstkeys[j], srckeys[j]);
+		}
+	}
+}
+
 /** @brief Applies color mapping for one or several colors on a 1-, 4- or 8-bit
  palletized or a 16-, 24- or 32-bit high color image.
 
@@ -704,106 +1520,44 @@ FreeImage_ApplyColorMapping(FIBITMAP *dib, RGBQUAD *srccolors, RGBQUAD *dstcolor
 			}
 			return result;
 		}
-		case 16: {
-			WORD *src16 = (WORD *)malloc(sizeof(WORD) * count);
-			if (NULL == src16) {
-				return 0;
-			}
-
-			WORD *dst16 = (WORD *)malloc(sizeof(WORD) * count);
-			if (NULL == dst16) {
-				free(src16);
-				return 0;
-			}
-
-			for (unsigned j = 0; j < count; j++) {
-				src16[j] = RGBQUAD_TO_WORD(dib, (srccolors + j));
-				dst16[j] = RGBQUAD_TO_WORD(dib, (dstcolors + j));
-			}
-
-			unsigned height = FreeImage_GetHeight(dib);
-			unsigned width = FreeImage_GetWidth(dib);
-			WORD *a, *b;
-			for (unsigned y = 0; y < height; y++) {
-				WORD *bits = (WORD *)FreeImage_GetScanLine(dib, y);
-				for (unsigned x = 0; x < width; x++, bits++) {
-					for (unsigned j = 0; j < count; j++) {
-						a = src16;
-						b = dst16;
-						for (int i = (swap ? 0 : 1); i < 2; i++) {
-							if (*bits == a[j]) {
-								*bits = b[j];
-								result++;
-								j = count;
-								break;
-							}
-							a = dst16;
-							b = src16;
-						}
+		case 16:
+		case 24:
+		case 32: {
+			try {
+				// keys of the colors, alpha is compared on 32-bit images only
+				const DWORD alpha_mask = (DWORD)0xFF << (8 * FI_RGBA_ALPHA);
+				const DWORD key_mask = ((bpp == 32) && !ignore_alpha) ? 0xFFFFFFFF : ~alpha_mask;
+				std::vector<DWORD> srckeys(count);
+				std::vector<DWORD> dstkeys(count);
+				for (unsigned j = 0; j < count; j++) {
+					if (bpp == 16) {
+						srckeys[j] = RGBQUAD_TO_WORD(dib, (srccolors + j));
+						dstkeys[j] = RGBQUAD_TO_WORD(dib, (dstcolors + j));
+					} else {
+						srckeys[j] = QuadKey(srccolors[j]) & key_mask;
+						dstkeys[j] = QuadKey(dstcolors[j]) & key_mask;
 					}
 				}
-			}
-			free(src16);
-			free(dst16);
-			return result;
-		}
-		case 24: {
-			unsigned height = FreeImage_GetHeight(dib);
-			unsigned width = FreeImage_GetWidth(dib);
-			RGBQUAD *a, *b;
-			for (unsigned y = 0; y < height; y++) {
-				BYTE *bits = FreeImage_GetScanLine(dib, y);
-				for (unsigned x = 0; x < width; x++, bits += 3) {
-					for (unsigned j = 0; j < count; j++) {
-						a = srccolors;
-						b = dstcolors;
-						for (int i = (swap ? 0 : 1); i < 2; i++) {
-							if ((bits[FI_RGBA_BLUE] == a[j].rgbBlue) && (bits[FI_RGBA_GREEN] == a[j].rgbGreen) &&(bits[FI_RGBA_RED] == a[j].rgbRed)) {
-								bits[FI_RGBA_BLUE] = b[j].rgbBlue;
-								bits[FI_RGBA_GREEN] = b[j].rgbGreen;
-								bits[FI_RGBA_RED] = b[j].rgbRed;
-								result++;
-								j = count;
-								break;
-							}
-							a = dstcolors;
-							b = srccolors;
-						}
-					}
+
+				// compare with each color, or look up in a table
+				const unsigned entries = swap ? 2 * count : count;
+				if (entries <= COLOR_MAPPING_MAX_LINEAR) {
+					LinearColorMap map;
+					AddColorMappings(map, srckeys, dstkeys, swap);
+					return MapImageColors(dib, map, key_mask);
 				}
-			}
-			return result;
-		}
-		case 32: {
-			unsigned height = FreeImage_GetHeight(dib);
-			unsigned width = FreeImage_GetWidth(dib);
-			RGBQUAD *a, *b;
-			for (unsigned y = 0; y < height; y++) {
-				BYTE *bits = FreeImage_GetScanLine(dib, y);
-				for (unsigned x = 0; x < width; x++, bits += 4) {
-					for (unsigned j = 0; j < count; j++) {
-						a = srccolors;
-						b = dstcolors;
-						for (int i = (swap ? 0 : 1); i < 2; i++) {
-							if ((bits[FI_RGBA_BLUE] == a[j].rgbBlue) &&(bits[FI_RGBA_GREEN] == a[j].rgbGreen) &&(bits[FI_RGBA_RED] == a[j].rgbRed)
-								&&((ignore_alpha) || (bits[FI_RGBA_ALPHA] == a[j].rgbReserved))) {
-								bits[FI_RGBA_BLUE] = b[j].rgbBlue;
-								bits[FI_RGBA_GREEN] = b[j].rgbGreen;
-								bits[FI_RGBA_RED] = b[j].rgbRed;
-								if (!ignore_alpha) {
-									bits[FI_RGBA_ALPHA] = b[j].rgbReserved;
-								}
-								result++;
-								j = count;
-								break;
-							}
-							a = dstcolors;
-							b = srccolors;
-						}
-					}
+				if (bpp == 16) {
+					DirectColorMap map;
+					AddColorMappings(map, srckeys, dstkeys, swap);
+					return MapImageColors(dib, map, key_mask);
 				}
+				HashedColorMap map(entries);
+				AddColorMappings(map, srckeys, dstkeys, swap);
+				return MapImageColors(dib, map, key_mask);
+			} catch(std::bad_alloc&) {
+				FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+				return 0;
 			}
-			return result;
 		}
 		default: {
 			return 0;
@@ -0,0 +1,635 @@
+// ==========================================================
+// Separable convolution, Gaussian and box blur, unsharp mask
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+// size of the rows of a column strip read to filter a row of the strip
+#define CONVOLVE_STRIP_BYTES	(128 * 1024)
+// Gaussian blurs with a larger standard deviation use the recursive filter
+#define GAUSSIAN_MAX_FIR_SIGMA	4.0
+// largest standard deviation of the Gaussian blurs, beyond which the recursive filter coefficients lose their accuracy
+#define GAUSSIAN_MAX_SIGMA	100.0
+// length of the replicated edge filtered after the last sample by the recursive filter, in standard deviations
+#define RECURSIVE_TAIL_SIGMAS	6
+
+// --------------------------------------------------------------------------
+//   1D filters
+// --------------------------------------------------------------------------
+
+/**
+A 1D filter, applied to count samples of stride interleaved sequences 
+(the channels of a row, or the columns of a strip). 
+Filters read radius samples before and after the filtered samples.
+*/
+struct LineFilter {
+	enum { IDENTITY, FIR, BOX, RECURSIVE } type;
+	//! FIR weights, 2 * radius + 1 values
+	std::vector<float> weights;
+	//! number of samples read before and after the filtered samples, which may exceed the line length for the box filter
+	int radius;
+	//! recursive filter : w[n] = b * x[n] + a1 * w[n - 1] + a2 * w[n - 2] + a3 * w[n - 3], run forward then backward
+	float b, a1, a2, a3;
+
+	LineFilter() : type(IDENTITY), radius(0), b(1), a1(0), a2(0), a3(0) {
+	}
+};
+
+/**
+Set a FIR filter computing the convolution with a kernel of odd size
+*/
+static void
+SetKernelFilter(LineFilter& filter, const float *kernel, int size) {
+	filter.type = LineFilter::FIR;
+	filter.radius = size / 2;
+	// the convolution is a correlation with the reversed kernel
+	filter.weights.assign(kernel, kernel + size);
+	std::reverse(filter.weights.begin(), filter.weights.end());
+}
+
+/**
+Number of samples replicated before and after a row filtered by FilterRow. 
+The box filter reads the edge samples of the row instead, as its radius is not bounded by the row length
+*/
+static inline int
+RowPadding(const LineFilter& filter) {
+	return (filter.type == LineFilter::BOX) ? 0 : filter.radius;
+}
+
+/**
+Set a box filter, averaging 2 * radius + 1 samples
+*/
+static void
+SetBoxFilter(LineFilter& filter, int radius) {
+	if(radius > 0) {
+		filter.type = LineFilter::BOX;
+		filter.radius = radius;
+	}
+}
+
+/**
+Set a Gaussian filter. Small standard deviations use a FIR filter of radius 3 * sigma, 
+larger ones the recursive filter of Young and van Vliet, whose cost does not depend on sigma. 
+sigma is at most GAUSSIAN_MAX_SIGMA. 
+See I.T. Young, L.J. van Vliet, Recursive implementation of the Gaussian filter, Signal Processing 44 (1995)
+*/
+static void
+SetGaussianFilter(LineFilter& filter, double sigma) {
+	if(sigma <= GAUSSIAN_MAX_FIR_SIGMA) {
+		filter.type = LineFilter::FIR;
+		filter.radius = MAX(1, (int)ceil(3 * sigma));
+		std::vector<double> weights(2 * filter.radius + 1);
+		double sum = 0;
+		for(int k = -filter.radius; k <= filter.radius; k++) {
+			weights[k + filter.radius] = exp(-k * k / (2 * sigma * sigma));
+			sum += weights[k + filter.radius];
+		}
+		filter.weights.resize(weights.size());
+		for(size_t k = 0; k < weights.size(); k++) {
+			filter.weights[k] = (float)(weights[k] / sum);
+		}
+	} else {
+		const double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+		const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+		const double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+		const double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+		const double b3 = 0.422205 * q * q * q;
+		filter.type = LineFilter::RECURSIVE;
+		// the backward pass starts far enough after the last sample for the forward pass to have converged
+		filter.radius = (int)ceil(RECURSIVE_TAIL_SIGMAS * sigma);
+		filter.a1 = (float)(b1 / b0);
+		filter.a2 = (float)(b2 / b0);
+		filter.a3 = (float)(b3 / b0);
+		// unit gain
+		filter.b = 1 - (filter.a1 + filter.a2 + filter.a3);
+	}
+}
+
+/**
+Replicate the first and last samples of count samples of stride interleaved sequences, 
+over the radius samples before and after them
+*/
+static void
+ExtendLine(float *line, unsigned count, unsigned stride, int radius) {
+	const float *first = line + radius * stride;
+	const float *last = line + (radius + count - 1) * stride;
+	for(int k = 0; k < radius; k++) {
+		memcpy(line + k * stride, first, stride * sizeof(float));
+		memcpy(line + (radius + count + k) * stride, last, stride * sizeof(float));
+	}
+}
+
+/**
+FIR filter of count values : target[i] = sum of weights[k] * rows[k][i]
+*/
+static void
+ConvolveLine(float *target, const float *const *rows, unsigned count, const std::vector<float>& weights, FI_ConvolveLineKernel kernel) {
+	const int taps = (int)weights.size();
+	const unsigned done = (unsigned)kernel(target, rows, (int)count, &weights[0], taps);
+	for(unsigned i = done; i < count; i++) {
+		float sum = 0;
+		for(int k = 0; k < taps; k++) {
+			sum += weights[k] * rows[k][i];
+		}
+		target[i] = sum;
+	}
+}
+
+/**
+Filter a row of width pixels of interleaved channels.
+@param target Output, width * channels values
+@param source Input, with RowPadding(filter) pixels before and after the filtered pixels. Overwritten by the recursive filter
+@param rows Buffer of filter.weights.size() pointers
+*/
+static void
+FilterRow(const LineFilter& filter, float *target, float *source, unsigned width, unsigned channels, FI_ConvolveLineKernel kernel, const float **rows) {
+	const unsigned count = width * channels;
+
+	switch(filter.type) {
+		case LineFilter::IDENTITY:
+			memcpy(target, source, count * sizeof(float));
+			break;
+
+		case LineFilter::FIR:
+			for(size_t k = 0; k < filter.weights.size(); k++) {
+				rows[k] = source + k * channels;
+			}
+			ConvolveLine(target, rows, count, filter.weights, kernel);
+			break;
+
+		case LineFilter::BOX:
+		{
+			// running sums, in double as a float sum loses the small samples added after a large one. 
+			// The samples outside of the row replicate its edge samples, counted once for all
+			const unsigned radius = (unsigned)filter.radius;
+			const unsigned last = width - 1;
+			const unsigned inside = MIN(radius, last);
+			const double scale = 1.0 / (2.0 * radius + 1);
+			for(unsigned c = 0; c < channels; c++) {
+				const float *values = source + c;
+				double sum = (radius + 1.0) * values[0] + (double)(radius - inside) * values[last * channels];
+				for(unsigned k = 1; k <= inside; k++) {
+					sum += values[k * channels];
+				}
+				for(unsigned x = 0; x < width; x++) {
+					target[x * channels + c] = (float)(sum * scale);
+					const unsigned added = (radius < last - x) ? x + radius + 1 : last;
+					const unsigned removed = (x >= radius) ? x - radius : 0;
+					sum += (double)values[added * channels] - values[removed * channels];
+				}
+			}
+			break;
+		}
+
+		case LineFilter::RECURSIVE:
+		{
+			// filter in place the pixels and the pixels after them, which replicate the last pixel, 
+			// the forward pass starts with the first pixel, as the pixels before it are equal to it
+			const float b = filter.b, a1 = filter.a1, a2 = filter.a2, a3 = filter.a3;
+			float *const first = source + filter.radius * channels;
+			const unsigned length = (width + filter.radius) * channels;
+			for(unsigned i = 0; i < length; i++) {
+				const float w1 = (i >= channels) ? first[i - channels] : first[i];
+				const float w2 = (i >= 2 * channels) ? first[i - 2 * channels] : first[i % channels];
+				const float w3 = (i >= 3 * channels) ? first[i - 3 * channels] : first[i % channels];
+				first[i] = b * first[i] + a1 * w1 + a2 * w2 + a3 * w3;
+			}
+			// the backward pass starts with the last pixel of the forward pass
+			float last[4];
+			memcpy(last, first + length - channels, channels * sizeof(float));
+			for(unsigned i = length; i-- > 0; ) {
+				const unsigned c = i % channels;
+				const float y1 = (i + channels < length) ? first[i + channels] : last[c];
+				const float y2 = (i + 2 * channels < length) ? first[i + 2 * channels] : last[c];
+				const float y3 = (i + 3 * channels < length) ? first[i + 3 * channels] : last[c];
+				first[i] = b * first[i] + a1 * y1 + a2 * y2 + a3 * y3;
+			}
+			memcpy(target, first, count * sizeof(float));
+			break;
+		}
+	}
+}
+
+/**
+Filter the columns [x, x + n) of a float image of height rows of line values, 
+calling store(y, values) with the n filtered values of each row. 
+The filters read whole rows of the strip, the recursive filter working in place.
+*/
+template <class Store> static void
+FilterColumns(const LineFilter& filter, float *bits, unsigned line, unsigned height, unsigned x, unsigned n, FI_ConvolveLineKernel kernel, const Store& store) {
+	// row y of the strip, the rows outside of the image replicating the edge rows
+	auto row = [&](INT64 y) -> float* {
+		return bits + (size_t)CLAMP(y, (INT64)0, (INT64)height - 1) * line + x;
+	};
+
+	switch(filter.type) {
+		case LineFilter::IDENTITY:
+			for(unsigned y = 0; y < height; y++) {
+				store(y, row(y));
+			}
+			break;
+
+		case LineFilter::FIR:
+		{
+			std::vector<const float*> rows(filter.weights.size());
+			std::vector<float> filtered(n);
+			for(unsigned y = 0; y < height; y++) {
+				for(size_t k = 0; k < rows.size(); k++) {
+					rows[k] = row((int)(y + k) - filter.radius);
+				}
+				ConvolveLine(&filtered[0], &rows[0], n, filter.weights, kernel);
+				store(y, &filtered[0]);
+			}
+			break;
+		}
+
+		case LineFilter::BOX:
+		{
+			// running sums in double, the rows outside of the image being counted once for all, see FilterRow
+			const INT64 radius = filter.radius;
+			const unsigned inside = MIN((unsigned)radius, height - 1);
+			std::vector<double> sum(n);
+			std::vector<float> filtered(n);
+			const float *first = row(0);
+			const float *last = row(height - 1);
+			for(unsigned i = 0; i < n; i++) {
+				sum[i] = (radius + 1.0) * first[i] + (double)(radius - inside) * last[i];
+			}
+			for(unsigned k = 1; k <= inside; k++) {
+				const float *added = row(k);
+				for(unsigned i = 0; i < n; i++) {
+					sum[i] += added[i];
+				}
+			}
+			const double scale = 1.0 / (2.0 * radius + 1);
+			for(unsigned y = 0; y < height; y++) {
+				for(unsigned i = 0; i < n; i++) {
+					filtered[i] = (float)(sum[i] * scale);
+				}
+				store(y, &filtered[0]);
+				const float *added = row(y + radius + 1);
+				const float *removed = row(y - radius);
+				for(unsigned i = 0; i < n; i++) {
+					sum[i] += (double)added[i] - removed[i];
+				}
+			}
+			break;
+		}
+
+		case LineFilter::RECURSIVE:
+		{
+			// the rows after the last one replicate it
+			const unsigned length = height + filter.radius;
+			std::vector<float> tail((size_t)filter.radius * n);
+			for(int k = 0; k < filter.radius; k++) {
+				memcpy(&tail[(size_t)k * n], row(height - 1), n * sizeof(float));
+			}
+			auto value = [&](unsigned y) -> float* {
+				return (y < height) ? row(y) : &tail[(size_t)(y - height) * n];
+			};
+			const float b = filter.b, a1 = filter.a1, a2 = filter.a2, a3 = filter.a3;
+			// forward pass, the rows before the first one are equal to it
+			for(unsigned y = 0; y < length; y++) {
+				float *w = value(y);
+				const float *w1 = value((y >= 1) ? y - 1 : 0);
+				const float *w2 = value((y >= 2) ? y - 2 : 0);
+				const float *w3 = value((y >= 3) ? y - 3 : 0);
+				for(unsigned i = 0; i < n; i++) {
+					w[i] = b * w[i] + a1 * w1[i] + a2 * w2[i] + a3 * w3[i];
+				}
+			}
+			// backward pass, starting with the last row of the forward pass
+			std::vector<float> last(value(length - 1), value(length - 1) + n);
+			for(unsigned y = length; y-- > 0; ) {
+				float *v = value(y);
+				const float *y1 = (y + 1 < length) ? value(y + 1) : &last[0];
+				const float *y2 = (y + 2 < length) ? value(y + 2) : &last[0];
+				const float *y3 = (y + 3 < length) ? value(y + 3) : &last[0];
+				for(unsigned i = 0; i < n; i++) {
+					v[i] = b * v[i] + a1 * y1[i] + a2 * y2[i] + a3 * y3[i];
+				}
+				if(y < height) {
+					store(y, v);
+				}
+			}
+			break;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+//   Convolution engine
+// --------------------------------------------------------------------------
+
+/**
+Parameters of an unsharp mask : a channel value v whose blurred value is b becomes 
+v + amount * (v - b) when |v - b| >= threshold, and is unchanged otherwise
+*/
+struct SharpenParameters {
+	float amount;
+	float threshold;
+};
+
+template <class T> static void
+LoadRow(float *target, const BYTE *source, unsigned count) {
+	const T *src = (const T*)source;
+	for(unsigned i = 0; i < count; i++) {
+		target[i] = (float)src[i];
+	}
+}
+
+static inline void
+StoreValue(BYTE *target, float value) {
+	*target = (BYTE)(CLAMP(value, 0.0F, 255.0F) + 0.5F);
+}
+
+static inline void
+StoreValue(WORD *target, float value) {
+	*target = (WORD)(CLAMP(value, 0.0F, 65535.0F) + 0.5F);
+}
+
+static inline void
+StoreValue(float *target, float value) {
+	*target = value;
+}
+
+template <class T> static void
+StoreRow(BYTE *target, const float *source, unsigned count) {
+	T *dst = (T*)target;
+	for(unsigned i = 0; i < count; i++) {
+		StoreValue(dst + i, source[i]);
+	}
+}
+
+template <class T> static void
+StoreSharpenedRow(BYTE *target, const float *blurred, const BYTE *source, unsigned count, const SharpenParameters& sharpen) {
+	T *dst = (T*)target;
+	const T *src = (const T*)source;
+	for(unsigned i = 0; i < count; i++) {
+		const float value = (float)src[i];
+		const float detail = value - blurred[i];
+		StoreValue(dst + i, (fabsf(detail) >= sharpen.threshold) ? value + sharpen.amount * detail : value);
+	}
+}
+
+/**
+Filter the rows of src, then its columns, into dst. dst may be src. 
+The rows are filtered in parallel into a float image, whose columns are then filtered 
+in parallel, by strips whose rows read by a filtered row fit in CONVOLVE_STRIP_BYTES. 
+Throws std::bad_alloc when the working buffers cannot be allocated.
+*/
+template <class T> static void
+ConvolveImage(FIBITMAP *dst, FIBITMAP *src, const LineFilter& horizontal, const LineFilter& vertical, const SharpenParameters *sharpen) {
+	const unsigned width = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+	const unsigned channels = FreeImage_GetLine(src) / (width * sizeof(T));
+	const unsigned line = width * channels;
+	const FI_ConvolveLineKernel kernel = GetLineKernels().convolve;
+
+	std::unique_ptr<float[]> buffer(new float[(size_t)line * height]);
+	float *const bits = buffer.get();
+
+	// rows
+	const int hr = RowPadding(horizontal);
+	ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+		std::vector<float> row(((size_t)width + 2 * hr) * channels);
+		std::vector<const float*> rows(horizontal.weights.size());
+		for(unsigned y = first; y < last; y++) {
+			LoadRow<T>(&row[(size_t)hr * channels], FreeImage_GetScanLine(src, y), line);
+			ExtendLine(&row[0], width, channels, hr);
+			FilterRow(horizontal, bits + (size_t)y * line, &row[0], width, channels, kernel, rows.empty() ? NULL : &rows[0]);
+		}
+	});
+
+	// columns
+	unsigned strip_rows = 1;
+	switch(vertical.type) {
+		case LineFilter::FIR:
+			strip_rows = (unsigned)vertical.weights.size() + 1;
+			break;
+		case LineFilter::BOX:
+			strip_rows = 4;
+			break;
+		case LineFilter::RECURSIVE:
+			strip_rows = vertical.radius + 5;
+			break;
+		default:
+			break;
+	}
+	// strips of a multiple of 16 values, at least one strip per thread
+	unsigned strip = CONVOLVE_STRIP_BYTES / (strip_rows * sizeof(float));
+	strip = MIN(strip, (line + GetParallelism() - 1) / GetParallelism());
+	strip = MAX(16U, strip & ~15U);
+	const unsigned strip_count = (line + strip - 1) / strip;
+	const unsigned min_strips = (FI_PARALLEL_MIN_PIXELS + strip * height - 1) / (strip * height);
+	ParallelFor(strip_count, min_strips, [&](unsigned first, unsigned last) {
+		for(unsigned s = first; s < last; s++) {
+			const unsigned x = s * strip;
+			const unsigned n = MIN(strip, line - x);
+			FilterColumns(vertical, bits, line, height, x, n, kernel, [&](unsigned y, const float *values) {
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, y) + x * sizeof(T);
+				if(sharpen) {
+					StoreSharpenedRow<T>(dst_bits, values, FreeImage_GetScanLine(src, y) + x * sizeof(T), n, *sharpen);
+				} else {
+					StoreRow<T>(dst_bits, values, n);
+				}
+			});
+		}
+	});
+}
+
+/**
+Filter an image into a new image.
+@return Returns the filtered image, or NULL if the image type is not supported or if memory is missing
+*/
+static FIBITMAP*
+FilterImage(FIBITMAP *dib, const LineFilter& horizontal, const LineFilter& vertical, const SharpenParameters *sharpen) {
+	if(!FreeImage_HasPixels(dib)) {
+		return NULL;
+	}
+
+	// channel type
+	enum { CHANNEL_BYTE, CHANNEL_WORD, CHANNEL_FLOAT } channel;
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			switch(FreeImage_GetBPP(dib)) {
+				case 8:
+					// palette indexes cannot be filtered
+					if(FreeImage_GetColorType(dib) == FIC_PALETTE) {
+						return NULL;
+					}
+					break;
+				case 24:
+				case 32:
+					break;
+				default:
+					return NULL;
+			}
+			channel = CHANNEL_BYTE;
+			break;
+		case FIT_UINT16:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+			channel = CHANNEL_WORD;
+			break;
+		case FIT_FLOAT:
+		case FIT_RGBF:
+		case FIT_RGBAF:
+			channel = CHANNEL_FLOAT;
+			break;
+		default:
+			return NULL;
+	}
+
+	FIBITMAP *dst = FreeImage_AllocateT(FreeImage_GetImageType(dib), FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), FreeImage_GetBPP(dib),
+		FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib));
+	if(!dst) {
+		return NULL;
+	}
+
+	try {
+		switch(channel) {
+			case CHANNEL_BYTE:
+				ConvolveImage<BYTE>(dst, dib, horizontal, vertical, sharpen);
+				break;
+			case CHANNEL_WORD:
+				ConvolveImage<WORD>(dst, dib, horizontal, vertical, sharpen);
+				break;
+			case CHANNEL_FLOAT:
+				ConvolveImage<float>(dst, dib, horizontal, vertical, sharpen);
+				break;
+		}
+	} catch(std::bad_alloc &) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		FreeImage_Unload(dst);
+		return NULL;
+	}
+
+	// copy the palette, the transparency settings and the metadata
+	const unsigned colors = FreeImage_GetColorsUsed(dib);
+	if(colors) {
+		memcpy(FreeImage_GetPalette(dst), FreeImage_GetPalette(dib), colors * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(dst, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+	}
+	RGBQUAD bkgnd;
+	if(FreeImage_GetBackgroundColor(dib, &bkgnd)) {
+		FreeImage_SetBackgroundColor(dst, &bkgnd);
+	}
+	FreeImage_CloneMetadata(dst, dib);
+
+	return dst;
+}
+
+// --------------------------------------------------------------------------
+//   Public API
+// --------------------------------------------------------------------------
+
+/**
+Convolve an image with a separable kernel : the rows are convolved with kernel_x, then the columns with kernel_y, 
+dst(x) = sum of kernel_x[k] * src(x + size_x / 2 - k) for k = 0 to size_x - 1, the edge pixels being replicated. 
+All channels are filtered, including alpha. Results are rounded and clamped to the range of integer channels. 
+@param dib Source image : 8-bit greyscale, 24- or 32-bit FIT_BITMAP, FIT_UINT16, FIT_RGB16, FIT_RGBA16, FIT_FLOAT, FIT_RGBF or FIT_RGBAF
+@param kernel_x Horizontal kernel, or NULL to leave the rows unfiltered
+@param size_x Size of the horizontal kernel, an odd number
+@param kernel_y Vertical kernel, or NULL to leave the columns unfiltered
+@param size_y Size of the vertical kernel, an odd number
+@return Returns the convolved image if successful, returns NULL otherwise
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_Convolve(FIBITMAP *dib, const float *kernel_x, int size_x, const float *kernel_y, int size_y) {
+	LineFilter horizontal, vertical;
+	if(kernel_x) {
+		if((size_x <= 0) || !(size_x & 1)) {
+			return NULL;
+		}
+		SetKernelFilter(horizontal, kernel_x, size_x);
+	}
+	if(kernel_y) {
+		if((size_y <= 0) || !(size_y & 1)) {
+			return NULL;
+		}
+		SetKernelFilter(vertical, kernel_y, size_y);
+	}
+	return FilterImage(dib, horizontal, vertical, NULL);
+}
+
+/**
+Blur an image with a Gaussian kernel. 
+Standard deviations up to 4 pixels use a kernel of radius 3 * sigma, larger ones a recursive filter 
+whose cost does not depend on sigma.
+@param dib Source image, see FreeImage_Convolve
+@param sigma Standard deviation of the Gaussian, in pixels, at most 100
+@return Returns the blurred image if successful, returns NULL otherwise
+@see FreeImage_Convolve
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_GaussianBlur(FIBITMAP *dib, double sigma) {
+	if(!((sigma > 0) && (sigma <= GAUSSIAN_MAX_SIGMA))) {
+		return NULL;
+	}
+	LineFilter filter;
+	SetGaussianFilter(filter, sigma);
+	return FilterImage(dib, filter, filter, NULL);
+}
+
+/**
+Blur an image with a box filter, averaging (2 * radius_x + 1) x (2 * radius_y + 1) pixels. 
+The cost does not depend on the radius, which may exceed the image size.
+@param dib Source image, see FreeImage_Convolve
+@param radius_x Horizontal radius, 0 to leave the rows unfiltered
+@param radius_y Vertical radius, 0 to leave the columns unfiltered
+@return Returns the blurred image if successful, returns NULL otherwise
+@see FreeImage_Convolve
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_BoxBlur(FIBITMAP *dib, int radius_x, int radius_y) {
+	if((radius_x < 0) || (radius_y < 0)) {
+		return NULL;
+	}
+	LineFilter horizontal, vertical;
+	SetBoxFilter(horizontal, radius_x);
+	SetBoxFilter(vertical, radius_y);
+	return FilterImage(dib, horizontal, vertical, NULL);
+}
+
+/**
+Sharpen an image with an unsharp mask : a channel value v whose Gaussian blurred value is b becomes 
+v + amount * (v - b) when |v - b| >= threshold, and is unchanged otherwise.
+@param dib Source image, see FreeImage_Convolve
+@param sigma Standard deviation of the Gaussian blur, in pixels, at most 100
+@param amount Strength of the sharpening, 1 doubles the local contrast
+@param threshold Smallest difference with the blurred value that is sharpened, in channel units (e.g. 0 to 255 for 8-bit channels)
+@return Returns the sharpened image if successful, returns NULL otherwise
+@see FreeImage_GaussianBlur
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_UnsharpMask(FIBITMAP *dib, double sigma, double amount, double threshold) {
+	if(!((sigma > 0) && (sigma <= GAUSSIAN_MAX_SIGMA)) || (threshold < 0)) {
+		return NULL;
+	}
+	LineFilter filter;
+	SetGaussianFilter(filter, sigma);
+	const SharpenParameters sharpen = { (float)amount, (float)threshold };
+	return FilterImage(dib, filter, filter, &sharpen);
+}
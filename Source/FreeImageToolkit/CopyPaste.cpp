@@ -25,6 +25,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
 
 // ----------------------------------------------------------
 //   Helpers
@@ -189,6 +190,21 @@ Combine4(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 
 }
 
+// ----------------------------------------------------------
+//   Alpha blending
+// ----------------------------------------------------------
+
+/**
+Alpha blend count bytes of a source line into a destination line, with alpha in [0..255]
+*/
+static void 
+BlendLine(BYTE *dst_bits, const BYTE *src_bits, unsigned count, unsigned alpha) {
+	const unsigned done = GetLineKernels().blend8(dst_bits, src_bits, count, alpha);
+	for (unsigned cols = done; cols < count; cols++) {
+		dst_bits[cols] = (BYTE)(((src_bits[cols] - dst_bits[cols]) * alpha + (dst_bits[cols] << 8)) >> 8);
+	}
+}
+
 // ----------------------------------------------------------
 //   8-bit
 // ----------------------------------------------------------
@@ -219,9 +235,7 @@ Combine8(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	} else {
 		// alpha blend images
 		for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
-			for (unsigned cols = 0; cols < FreeImage_GetLine(src_dib); cols++) {							
-				dst_bits[cols] = (BYTE)(((src_bits[cols] - dst_bits[cols]) * alpha + (dst_bits[cols] << 8)) >> 8);
-			}
+			BlendLine(dst_bits, src_bits, FreeImage_GetLine(src_dib), alpha);
 
 			dst_bits += FreeImage_GetPitch(dst_dib);
 			src_bits += FreeImage_GetPitch(src_dib);
@@ -385,9 +399,7 @@ Combine24(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	} else {
 		// alpha blend images
 		for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
-			for (unsigned cols = 0; cols < FreeImage_GetLine(src_dib); cols++) {							
-				dst_bits[cols] = (BYTE)(((src_bits[cols] - dst_bits[cols]) * alpha + (dst_bits[cols] << 8)) >> 8);
-			}
+			BlendLine(dst_bits, src_bits, FreeImage_GetLine(src_dib), alpha);
 
 			dst_bits += FreeImage_GetPitch(dst_dib);
 			src_bits += FreeImage_GetPitch(src_dib);
@@ -427,9 +439,7 @@ Combine32(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y, unsigned
 	} else {
 		// alpha blend images
 		for(unsigned rows = 0; rows < FreeImage_GetHeight(src_dib); rows++) {
-			for(unsigned cols = 0; cols < FreeImage_GetLine(src_dib); cols++) {
-				dst_bits[cols] = (BYTE)(((src_bits[cols] - dst_bits[cols]) * alpha + (dst_bits[cols] << 8)) >> 8);
-			}
+			BlendLine(dst_bits, src_bits, FreeImage_GetLine(src_dib), alpha);
 
 			dst_bits += FreeImage_GetPitch(dst_dib);
 			src_bits += FreeImage_GetPitch(src_dib);
@@ -19,9 +19,294 @@
 // Use at your own risk!
 // ==========================================================
 
+
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+#include <vector>
+
+// ----------------------------------------------------------
+//   Pixel operations
+// ----------------------------------------------------------
 
+// The alpha value is the last channel of 32-bit (FI_RGBA_ALPHA), FIT_RGBA16 and FIT_RGBAF pixels.
+// The scalar functions give the same results as the SIMD kernels, 
+// they process the images without SIMD kernels and the pixels left by the kernels.
+
+/**
+Divide by MAX, rounded to nearest
+*/
+template <class W, unsigned MAX> static inline W 
+DivMax(W x) {
+	return (x + MAX / 2) / MAX;
+}
+
+/**
+Composite premultiplied pixels of 8-bit or 16-bit channels, see FreeImage_CompositeInto
+@param opacity Opacity in [0..MAX]
+*/
+template <class T, class W, unsigned MAX, int MODE> static void 
+CompositePixels(T *target, const T *source, unsigned width, W opacity) {
+	for(unsigned x = 0; x < width; x++, target += 4, source += 4) {
+		W s[4];
+		for(int c = 0; c < 4; c++) {
+			s[c] = (opacity != MAX) ? DivMax<W, MAX>(source[c] * opacity) : source[c];
+		}
+		const W source_alpha = s[3];
+		const W target_alpha = target[3];
+		for(int c = 0; c < 4; c++) {
+			const W t = target[c];
+			W value;
+			switch(MODE) {
+				case FIBM_OVER:
+					value = s[c] + DivMax<W, MAX>(t * (MAX - source_alpha));
+					break;
+				case FIBM_MULTIPLY:
+					value = DivMax<W, MAX>(s[c] * MIN(MAX - target_alpha + t, (W)MAX) + t * (MAX - source_alpha));
+					break;
+				case FIBM_SCREEN:
+					value = s[c] + t - DivMax<W, MAX>(s[c] * t);
+					break;
+				default:
+					value = s[c] + t;
+					break;
+			}
+			target[c] = (T)MIN(value, (W)MAX);
+		}
+	}
+}
+
+/**
+Composite premultiplied FIT_RGBAF pixels, see FreeImage_CompositeInto
+*/
+template <int MODE> static void 
+CompositePixels(float *target, const float *source, unsigned width, float opacity) {
+	for(unsigned x = 0; x < width; x++, target += 4, source += 4) {
+		float s[4];
+		for(int c = 0; c < 4; c++) {
+			s[c] = (opacity != 1) ? source[c] * opacity : source[c];
+		}
+		const float source_alpha = s[3];
+		const float target_alpha = target[3];
+		for(int c = 0; c < 4; c++) {
+			const float t = target[c];
+			switch(MODE) {
+				case FIBM_OVER:
+					target[c] = s[c] + t * (1 - source_alpha);
+					break;
+				case FIBM_MULTIPLY:
+					target[c] = s[c] * ((1 - target_alpha) + t) + t * (1 - source_alpha);
+					break;
+				case FIBM_SCREEN:
+					target[c] = (s[c] + t) - s[c] * t;
+					break;
+				default:
+					target[c] = s[c] + t;
+					break;
+			}
+		}
+	}
+}
+
+/**
+Composite a line of premultiplied 32-bit pixels
+*/
+static void 
+CompositeLine(BYTE *target, const BYTE *source, unsigned width, FREE_IMAGE_BLEND_MODE mode, int opacity) {
+	const unsigned done = GetLineKernels().composite32[mode](target, source, width, opacity);
+	target += 4 * done;
+	source += 4 * done;
+	width -= done;
+	switch(mode) {
+		case FIBM_OVER:
+			CompositePixels<BYTE, unsigned, 255, FIBM_OVER>(target, source, width, opacity);
+			break;
+		case FIBM_MULTIPLY:
+			CompositePixels<BYTE, unsigned, 255, FIBM_MULTIPLY>(target, source, width, opacity);
+			break;
+		case FIBM_SCREEN:
+			CompositePixels<BYTE, unsigned, 255, FIBM_SCREEN>(target, source, width, opacity);
+			break;
+		default:
+			CompositePixels<BYTE, unsigned, 255, FIBM_ADD>(target, source, width, opacity);
+			break;
+	}
+}
+
+/**
+Composite a line of premultiplied FIT_RGBA16 pixels
+*/
+static void 
+CompositeLine(WORD *target, const WORD *source, unsigned width, FREE_IMAGE_BLEND_MODE mode, int opacity) {
+	const UINT64 scaled_opacity = (UINT64)opacity * 257;
+	switch(mode) {
+		case FIBM_OVER:
+			CompositePixels<WORD, UINT64, 65535, FIBM_OVER>(target, source, width, scaled_opacity);
+			break;
+		case FIBM_MULTIPLY:
+			CompositePixels<WORD, UINT64, 65535, FIBM_MULTIPLY>(target, source, width, scaled_opacity);
+			break;
+		case FIBM_SCREEN:
+			CompositePixels<WORD, UINT64, 65535, FIBM_SCREEN>(target, source, width, scaled_opacity);
+			break;
+		default:
+			CompositePixels<WORD, UINT64, 65535, FIBM_ADD>(target, source, width, scaled_opacity);
+			break;
+	}
+}
+
+/**
+Composite a line of premultiplied FIT_RGBAF pixels
+*/
+static void 
+CompositeLine(float *target, const float *source, unsigned width, FREE_IMAGE_BLEND_MODE mode, int opacity) {
+	const float scaled_opacity = opacity / 255.0F;
+	const unsigned done = GetLineKernels().compositeRGBAF[mode](target, source, width, scaled_opacity);
+	target += 4 * done;
+	source += 4 * done;
+	width -= done;
+	switch(mode) {
+		case FIBM_OVER:
+			CompositePixels<FIBM_OVER>(target, source, width, scaled_opacity);
+			break;
+		case FIBM_MULTIPLY:
+			CompositePixels<FIBM_MULTIPLY>(target, source, width, scaled_opacity);
+			break;
+		case FIBM_SCREEN:
+			CompositePixels<FIBM_SCREEN>(target, source, width, scaled_opacity);
+			break;
+		default:
+			CompositePixels<FIBM_ADD>(target, source, width, scaled_opacity);
+			break;
+	}
+}
+
+/**
+Premultiply a line of 32-bit pixels
+*/
+static void 
+PreMultiplyLine(BYTE *bits, unsigned width) {
+	const unsigned done = GetLineKernels().premultiply32(bits, bits, width);
+	bits += 4 * done;
+	for(unsigned x = done; x < width; x++, bits += 4) {
+		const BYTE alpha = bits[FI_RGBA_ALPHA];
+		// slightly faster: care for two special cases
+		if(alpha == 0x00) {
+			// special case for alpha == 0x00
+			// color * 0x00 / 0xFF = 0x00
+			bits[FI_RGBA_BLUE] = 0x00;
+			bits[FI_RGBA_GREEN] = 0x00;
+			bits[FI_RGBA_RED] = 0x00;
+		} else if(alpha == 0xFF) {
+			// nothing to do for alpha == 0xFF
+			// color * 0xFF / 0xFF = color
+			continue;
+		} else {
+			bits[FI_RGBA_BLUE] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_BLUE] + 127) / 255 );
+			bits[FI_RGBA_GREEN] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_GREEN] + 127) / 255 );
+			bits[FI_RGBA_RED] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_RED] + 127) / 255 );
+		}
+	}
+}
+
+/**
+Premultiply a line of FIT_RGBA16 pixels
+*/
+static void 
+PreMultiplyLine(WORD *bits, unsigned width) {
+	for(unsigned x = 0; x < width; x++, bits += 4) {
+		const DWORD alpha = bits[3];
+		if(alpha != 0xFFFF) {
+			for(int c = 0; c < 3; c++) {
+				bits[c] = (WORD)DivMax<DWORD, 65535>(alpha * bits[c]);
+			}
+		}
+	}
+}
+
+/**
+Premultiply a line of FIT_RGBAF pixels
+*/
+static void 
+PreMultiplyLine(float *bits, unsigned width) {
+	const unsigned done = GetLineKernels().premultiplyRGBAF(bits, bits, width);
+	bits += 4 * done;
+	for(unsigned x = done; x < width; x++, bits += 4) {
+		for(int c = 0; c < 3; c++) {
+			bits[c] *= bits[3];
+		}
+	}
+}
+
+/**
+Unpremultiply a line of 32-bit pixels, with the 8.8 fixed point reciprocal of alpha
+*/
+static void 
+UnPreMultiplyLine(BYTE *bits, unsigned width) {
+	const unsigned done = GetLineKernels().unpremultiply32(bits, bits, width);
+	bits += 4 * done;
+	for(unsigned x = done; x < width; x++, bits += 4) {
+		const unsigned alpha = bits[FI_RGBA_ALPHA];
+		if(alpha != 0xFF) {
+			const unsigned factor = (alpha == 0) ? 0 : (255 * 256 + alpha / 2) / alpha;
+			bits[FI_RGBA_BLUE] = (BYTE)MIN((bits[FI_RGBA_BLUE] * factor + 128) >> 8, 255U);
+			bits[FI_RGBA_GREEN] = (BYTE)MIN((bits[FI_RGBA_GREEN] * factor + 128) >> 8, 255U);
+			bits[FI_RGBA_RED] = (BYTE)MIN((bits[FI_RGBA_RED] * factor + 128) >> 8, 255U);
+		}
+	}
+}
+
+/**
+Unpremultiply a line of FIT_RGBA16 pixels
+*/
+static void 
+UnPreMultiplyLine(WORD *bits, unsigned width) {
+	for(unsigned x = 0; x < width; x++, bits += 4) {
+		const DWORD alpha = bits[3];
+		if(alpha != 0xFFFF) {
+			for(int c = 0; c < 3; c++) {
+				bits[c] = (alpha == 0) ? 0 : (WORD)MIN((bits[c] * 65535U + alpha / 2) / alpha, 65535U);
+			}
+		}
+	}
+}
+
+/**
+Unpremultiply a line of FIT_RGBAF pixels
+*/
+static void 
+UnPreMultiplyLine(float *bits, unsigned width) {
+	const unsigned done = GetLineKernels().unpremultiplyRGBAF(bits, bits, width);
+	bits += 4 * done;
+	for(unsigned x = done; x < width; x++, bits += 4) {
+		const float alpha = bits[3];
+		for(int c = 0; c < 3; c++) {
+			bits[c] = (alpha != 0) ? bits[c] / alpha : 0;
+		}
+	}
+}
+
+/**
+Check that an image has an alpha channel that can be premultiplied
+*/
+static BOOL 
+HasAlphaChannel(FIBITMAP *dib) {
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			return (FreeImage_GetBPP(dib) == 32);
+		case FIT_RGBA16:
+		case FIT_RGBAF:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+// ----------------------------------------------------------
+//   Composition
+// ----------------------------------------------------------
 
 /**
 @brief Composite a foreground image against a background color or a background image.
@@ -57,16 +342,8 @@ FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg, RGBQUAD *appBkColor, FIBITMAP
 			return NULL;
 	}
 
-	int bytespp = (bpp == 8) ? 1 : 4;
-
-	
-	int x, y, c;
-	BYTE alpha = 0, not_alpha;
-	BYTE index;
-	RGBQUAD fgc;	// foreground color
 	RGBQUAD bkc;	// background color
 
-	memset(&fgc, 0, sizeof(RGBQUAD));
 	memset(&bkc, 0, sizeof(RGBQUAD));
 
 	// allocate the composite image
@@ -79,6 +356,7 @@ FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg, RGBQUAD *appBkColor, FIBITMAP
 	// retrieve the alpha table from the foreground image
 	BOOL bIsTransparent = FreeImage_IsTransparent(fg);
 	BYTE *trns = FreeImage_GetTransparencyTable(fg);
+	int trns_count = bIsTransparent ? FreeImage_GetTransparencyCount(fg) : 0;
 
 	// retrieve the background color from the foreground image
 	BOOL bHasBkColor = FALSE;
@@ -99,83 +377,70 @@ FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg, RGBQUAD *appBkColor, FIBITMAP
 		}
 	}
 
-	for(y = 0; y < height; y++) {
-		// foreground
-		BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
-		// background
-		BYTE *bg_bits = FreeImage_GetScanLine(bg, y);
-		// composite image
-		BYTE *cp_bits = FreeImage_GetScanLine(composite, y);
+	const FILineKernels& kernels = GetLineKernels();
 
-		for(x = 0; x < width; x++) {
+	try {
+		ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+			// foreground and background rows, as 32-bit pixels
+			std::vector<BYTE> fg_row(4 * width);
+			std::vector<BYTE> bg_row(4 * width);
 
-			// foreground color + alpha
+			for(unsigned y = first; y < last; y++) {
+				// foreground color + alpha
 
-			if(bpp == 8) {
-				// get the foreground color
-				index = fg_bits[0];
-				memcpy(&fgc, &pal[index], sizeof(RGBQUAD));
-				// get the alpha
-				if(bIsTransparent) {
-					alpha = trns[index];
-				} else {
-					alpha = 255;
+				BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
+				if(bpp == 8) {
+					FreeImage_ConvertLine8To32MapTransparency(&fg_row[0], fg_bits, width, pal, trns, trns_count);
+					fg_bits = &fg_row[0];
 				}
-			}
-			else if(bpp == 32) {
-				// get the foreground color
-				fgc.rgbBlue  = fg_bits[FI_RGBA_BLUE];
-				fgc.rgbGreen = fg_bits[FI_RGBA_GREEN];
-				fgc.rgbRed   = fg_bits[FI_RGBA_RED];
-				// get the alpha
-				alpha = fg_bits[FI_RGBA_ALPHA];
-			}
 
-			// background color
+				// background color
 
-			if(!bHasBkColor) {
-				if(bg) {
+				BYTE *bg_bits = &bg_row[0];
+				if(bHasBkColor) {
+					for(int x = 0; x < width; x++, bg_bits += 4) {
+						bg_bits[FI_RGBA_BLUE]  = bkc.rgbBlue;
+						bg_bits[FI_RGBA_GREEN] = bkc.rgbGreen;
+						bg_bits[FI_RGBA_RED]   = bkc.rgbRed;
+					}
+				} else if(bg) {
 					// get the background color from the background image
-					bkc.rgbBlue  = bg_bits[FI_RGBA_BLUE];
-					bkc.rgbGreen = bg_bits[FI_RGBA_GREEN];
-					bkc.rgbRed   = bg_bits[FI_RGBA_RED];
-				}
-				else {
+					FreeImage_ConvertLine24To32(bg_bits, FreeImage_GetScanLine(bg, y), width);
+				} else {
 					// use a checkerboard pattern
-					c = (((y & 0x8) == 0) ^ ((x & 0x8) == 0)) * 192;
-					c = c ? c : 255;
-					bkc.rgbBlue  = (BYTE)c;
-					bkc.rgbGreen = (BYTE)c;
-					bkc.rgbRed   = (BYTE)c;
+					for(int x = 0; x < width; x++, bg_bits += 4) {
+						int c = (((y & 0x8) == 0) ^ ((x & 0x8) == 0)) * 192;
+						c = c ? c : 255;
+						bg_bits[FI_RGBA_BLUE]  = (BYTE)c;
+						bg_bits[FI_RGBA_GREEN] = (BYTE)c;
+						bg_bits[FI_RGBA_RED]   = (BYTE)c;
+					}
 				}
-			}
-
-			// composition
 
-			if(alpha == 0) {
-				// output = background
-				cp_bits[FI_RGBA_BLUE] = bkc.rgbBlue;
-				cp_bits[FI_RGBA_GREEN] = bkc.rgbGreen;
-				cp_bits[FI_RGBA_RED] = bkc.rgbRed;
-			}
-			else if(alpha == 255) {
-				// output = foreground
-				cp_bits[FI_RGBA_BLUE] = fgc.rgbBlue;
-				cp_bits[FI_RGBA_GREEN] = fgc.rgbGreen;
-				cp_bits[FI_RGBA_RED] = fgc.rgbRed;
-			}
-			else {
+				// composition
 				// output = alpha * foreground + (1-alpha) * background
-				not_alpha = (BYTE)~alpha;
-				cp_bits[FI_RGBA_BLUE] = (BYTE)((alpha * (WORD)fgc.rgbBlue  + not_alpha * (WORD)bkc.rgbBlue) >> 8);
-				cp_bits[FI_RGBA_GREEN] = (BYTE)((alpha * (WORD)fgc.rgbGreen + not_alpha * (WORD)bkc.rgbGreen) >> 8);
-				cp_bits[FI_RGBA_RED] = (BYTE)((alpha * (WORD)fgc.rgbRed   + not_alpha * (WORD)bkc.rgbRed) >> 8);
-			}
 
-			fg_bits += bytespp;
-			bg_bits += 3;
-			cp_bits += 3;
-		}
+				const int done = kernels.mix32(&bg_row[0], fg_bits, width);
+				for(int x = done; x < width; x++) {
+					const BYTE *f = fg_bits + 4 * x;
+					BYTE *b = &bg_row[4 * x];
+					const unsigned alpha = f[FI_RGBA_ALPHA];
+					if(alpha == 255) {
+						// output = foreground
+						memcpy(b, f, 4);
+					} else if(alpha != 0) {
+						for(int c = 0; c < 4; c++) {
+							b[c] = (BYTE)((alpha * f[c] + (255 - alpha) * b[c]) >> 8);
+						}
+					}
+				}
+				FreeImage_ConvertLine32To24(FreeImage_GetScanLine(composite, y), &bg_row[0], width);
+			}
+		});
+	} catch(std::bad_alloc&) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		FreeImage_Unload(composite);
+		return NULL;
 	}
 
 	// copy metadata from src to dst
@@ -189,42 +454,173 @@ Pre-multiplies a 32-bit image's red-, green- and blue channels with it's alpha c
 for to be used with e.g. the Windows GDI function AlphaBlend(). 
 The transformation changes the red-, green- and blue channels according to the following equation:  
 channel(x, y) = channel(x, y) * alpha_channel(x, y) / 255  
+FIT_RGBA16 images are processed the same way, with 65535 instead of 255, and FIT_RGBAF images 
+with 1 instead of 255. Integer channels are rounded to nearest.
 @param dib Input/Output dib to be premultiplied
 @return Returns TRUE on success, FALSE otherwise (e.g. when the bitdepth of the source dib cannot be handled). 
+@see FreeImage_UnPreMultiplyWithAlpha
 */
 BOOL DLL_CALLCONV 
 FreeImage_PreMultiplyWithAlpha(FIBITMAP *dib) {
 	if (!FreeImage_HasPixels(dib)) return FALSE;
 	
-	if ((FreeImage_GetBPP(dib) != 32) || (FreeImage_GetImageType(dib) != FIT_BITMAP)) {
+	if (!HasAlphaChannel(dib)) {
 		return FALSE;
 	}
 
-	int width = FreeImage_GetWidth(dib);
-	int height = FreeImage_GetHeight(dib);
-
-	for(int y = 0; y < height; y++) {
-		BYTE *bits = FreeImage_GetScanLine(dib, y);
-		for (int x = 0; x < width; x++, bits += 4) {
-			const BYTE alpha = bits[FI_RGBA_ALPHA];
-			// slightly faster: care for two special cases
-			if(alpha == 0x00) {
-				// special case for alpha == 0x00
-				// color * 0x00 / 0xFF = 0x00
-				bits[FI_RGBA_BLUE] = 0x00;
-				bits[FI_RGBA_GREEN] = 0x00;
-				bits[FI_RGBA_RED] = 0x00;
-			} else if(alpha == 0xFF) {
-				// nothing to do for alpha == 0xFF
-				// color * 0xFF / 0xFF = color
-				continue;
-			} else {
-				bits[FI_RGBA_BLUE] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_BLUE] + 127) / 255 );
-				bits[FI_RGBA_GREEN] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_GREEN] + 127) / 255 );
-				bits[FI_RGBA_RED] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_RED] + 127) / 255 );
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+
+	ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+		for(unsigned y = first; y < last; y++) {
+			BYTE *bits = FreeImage_GetScanLine(dib, y);
+			switch(image_type) {
+				case FIT_BITMAP:
+					PreMultiplyLine(bits, width);
+					break;
+				case FIT_RGBA16:
+					PreMultiplyLine((WORD*)bits, width);
+					break;
+				default:
+					PreMultiplyLine((float*)bits, width);
+					break;
 			}
 		}
+	});
+	return TRUE;
+}
+
+/**
+Reverses FreeImage_PreMultiplyWithAlpha on a 32-bit, FIT_RGBA16 or FIT_RGBAF image. 
+The transformation changes the red-, green- and blue channels according to the following equation:  
+channel(x, y) = channel(x, y) * 255 / alpha_channel(x, y)  
+with 65535 instead of 255 for FIT_RGBA16 images and 1 for FIT_RGBAF images. 
+Integer channels are clamped to their maximum value, and are rounded to nearest on FIT_RGBA16 images 
+and to nearest +/- 1 on 32-bit images. Pixels with a zero alpha are set to black.
+@param dib Input/Output dib to be unpremultiplied
+@return Returns TRUE on success, FALSE otherwise (e.g. when the bitdepth of the source dib cannot be handled). 
+@see FreeImage_PreMultiplyWithAlpha
+*/
+BOOL DLL_CALLCONV 
+FreeImage_UnPreMultiplyWithAlpha(FIBITMAP *dib) {
+	if (!FreeImage_HasPixels(dib)) return FALSE;
+	
+	if (!HasAlphaChannel(dib)) {
+		return FALSE;
 	}
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+
+	ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+		for(unsigned y = first; y < last; y++) {
+			BYTE *bits = FreeImage_GetScanLine(dib, y);
+			switch(image_type) {
+				case FIT_BITMAP:
+					UnPreMultiplyLine(bits, width);
+					break;
+				case FIT_RGBA16:
+					UnPreMultiplyLine((WORD*)bits, width);
+					break;
+				default:
+					UnPreMultiplyLine((float*)bits, width);
+					break;
+			}
+		}
+	});
 	return TRUE;
 }
 
+/**
+Composite a premultiplied image onto a rectangle of a destination image. 
+The colors of both images are premultiplied with alpha (see FreeImage_PreMultiplyWithAlpha), 
+expressed below as fractions in the range 0 to 1, with As and Ad the source and destination alpha :<br>
+FIBM_OVER : output = source + destination * (1 - As)<br>
+FIBM_MULTIPLY : output = source * destination + source * (1 - Ad) + destination * (1 - As)<br>
+FIBM_SCREEN : output = source + destination - source * destination<br>
+FIBM_ADD : output = source + destination<br>
+The equations apply to the color and alpha channels. 
+Integer channels are rounded to nearest and clamped, float channels are not clamped. 
+A 24-bit destination is an opaque 32-bit destination : its pixels are premultiplied.
+@param dst Destination image, a 24- or 32-bit image for a 32-bit source, or an image of the source type
+@param src Premultiplied 32-bit, FIT_RGBA16 or FIT_RGBAF source image
+@param left Left position of the source image in the destination image, may be negative
+@param top Top position of the source image in the destination image, may be negative
+@param mode Blend mode
+@param opacity Opacity of the source image in [0..255], the source pixels are scaled by opacity / 255
+@return Returns TRUE on success, FALSE otherwise. Returns TRUE when the images do not overlap.
+@see FreeImage_Paste
+*/
+BOOL DLL_CALLCONV 
+FreeImage_CompositeInto(FIBITMAP *dst, FIBITMAP *src, int left, int top, FREE_IMAGE_BLEND_MODE mode, int opacity) {
+	if(!FreeImage_HasPixels(dst) || !FreeImage_HasPixels(src)) {
+		return FALSE;
+	}
+	if((mode < FIBM_OVER) || (mode > FIBM_ADD) || (opacity < 0) || (opacity > 255)) {
+		return FALSE;
+	}
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	if(!HasAlphaChannel(src) || (FreeImage_GetImageType(dst) != image_type)) {
+		return FALSE;
+	}
+	const unsigned dst_bpp = FreeImage_GetBPP(dst);
+	if((image_type == FIT_BITMAP) && (dst_bpp != 24) && (dst_bpp != 32)) {
+		return FALSE;
+	}
+
+	// clip the source rectangle to the destination image
+	const int src_width = (int)FreeImage_GetWidth(src);
+	const int src_height = (int)FreeImage_GetHeight(src);
+	const int dst_width = (int)FreeImage_GetWidth(dst);
+	const int dst_height = (int)FreeImage_GetHeight(dst);
+	const int x0 = MAX(left, 0);
+	const int y0 = MAX(top, 0);
+	const int x1 = (int)MIN((INT64)left + src_width, (INT64)dst_width);
+	const int y1 = (int)MIN((INT64)top + src_height, (INT64)dst_height);
+	if((x0 >= x1) || (y0 >= y1)) {
+		// nothing to composite
+		return TRUE;
+	}
+	const unsigned width = x1 - x0;
+	const unsigned height = y1 - y0;
+	const unsigned src_bytespp = FreeImage_GetBPP(src) / 8;
+	const unsigned dst_bytespp = dst_bpp / 8;
+
+	try {
+		ParallelForRows(width, height, [&](unsigned first, unsigned last) {
+			// 24-bit destination pixels, as 32-bit pixels
+			std::vector<BYTE> buffer((dst_bpp == 24) ? 4 * width : 0);
+
+			for(unsigned y = first; y < last; y++) {
+				// rows are stored bottom up
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - 1 - (y0 + y)) + x0 * dst_bytespp;
+				const BYTE *src_bits = FreeImage_GetScanLine(src, src_height - 1 - (y0 - top + y)) + (x0 - left) * src_bytespp;
+				switch(image_type) {
+					case FIT_BITMAP:
+						if(dst_bpp == 24) {
+							FreeImage_ConvertLine24To32(&buffer[0], dst_bits, width);
+							CompositeLine(&buffer[0], src_bits, width, mode, opacity);
+							FreeImage_ConvertLine32To24(dst_bits, &buffer[0], width);
+						} else {
+							CompositeLine(dst_bits, src_bits, width, mode, opacity);
+						}
+						break;
+					case FIT_RGBA16:
+						CompositeLine((WORD*)dst_bits, (const WORD*)src_bits, width, mode, opacity);
+						break;
+					default:
+						CompositeLine((float*)dst_bits, (const float*)src_bits, width, mode, opacity);
+						break;
+				}
+			}
+		});
+	} catch(std::bad_alloc&) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -23,6 +23,61 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
+
+// ----------------------------------------------------------
+
+/**
+Reverse the order of the pixels of a line, with the SIMD kernel of the pixel size if any
+*/
+template <unsigned bytespp> static inline void
+ReversePixelsT(BYTE *target, const BYTE *source, unsigned width, FI_LineKernel kernel) {
+	unsigned x = kernel ? (unsigned)kernel(target, source, (int)width) : 0;
+	const BYTE *src_bits = source + (width - 1 - x) * bytespp;
+	BYTE *dst_bits = target + x * bytespp;
+	for(; x < width; x++) {
+		memcpy(dst_bits, src_bits, bytespp);
+		src_bits -= bytespp;
+		dst_bits += bytespp;
+	}
+}
+
+void
+ReversePixels(BYTE *target, const BYTE *source, unsigned width, unsigned bytespp) {
+	const FILineKernels& kernels = GetLineKernels();
+
+	switch(bytespp) {
+		case 1:
+			ReversePixelsT<1>(target, source, width, kernels.reverse8);
+			break;
+		case 2:
+			ReversePixelsT<2>(target, source, width, kernels.reverse16);
+			break;
+		case 3:
+			ReversePixelsT<3>(target, source, width, kernels.reverse24);
+			break;
+		case 4:
+			ReversePixelsT<4>(target, source, width, kernels.reverse32);
+			break;
+		case 6:
+			ReversePixelsT<6>(target, source, width, NULL);
+			break;
+		case 8:
+			ReversePixelsT<8>(target, source, width, kernels.reverse64);
+			break;
+		case 12:
+			ReversePixelsT<12>(target, source, width, NULL);
+			break;
+		case 16:
+			ReversePixelsT<16>(target, source, width, NULL);
+			break;
+		default:
+			assert(FALSE);
+	}
+}
+
+// ----------------------------------------------------------
 
 /**
 Flip the image horizontally along the vertical axis.
@@ -33,91 +88,71 @@ BOOL DLL_CALLCONV
 FreeImage_FlipHorizontal(FIBITMAP *src) {
 	if (!FreeImage_HasPixels(src)) return FALSE;
 
-	unsigned line   = FreeImage_GetLine(src);
-	unsigned width	= FreeImage_GetWidth(src);
-	unsigned height = FreeImage_GetHeight(src);
-
-	unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-
-	// copy between aligned memories
-	BYTE *new_bits = (BYTE*)FreeImage_Aligned_Malloc(line * sizeof(BYTE), FIBITMAP_ALIGNMENT);
-	if (!new_bits) return FALSE;
-
-	// mirror the buffer
-
-	for (unsigned y = 0; y < height; y++) {
-		BYTE *bits = FreeImage_GetScanLine(src, y);
-		memcpy(new_bits, bits, line);
-
-		switch (FreeImage_GetBPP(src)) {
-			case 1 :
-			{				
-				for(unsigned x = 0; x < width; x++) {
-					// get pixel at (x, y)
-					BOOL value = (new_bits[x >> 3] & (0x80 >> (x & 0x07))) != 0;
-					// set pixel at (new_x, y)
-					unsigned new_x = width - 1 - x;
-					value ? bits[new_x >> 3] |= (0x80 >> (new_x & 0x7)) : bits[new_x >> 3] &= (0xff7f >> (new_x & 0x7));
-				}
-			}
-			break;
+	const unsigned line   = FreeImage_GetLine(src);
+	const unsigned width  = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+	const unsigned bpp    = FreeImage_GetBPP(src);
+
+	const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+
+	try {
+		// mirror the buffer, rows are independent
+
+		ParallelForRows(width, height, [&](unsigned first_row, unsigned last_row) {
+			// copy between aligned memories
+			BYTE *new_bits = (BYTE*)FreeImage_Aligned_Malloc(line * sizeof(BYTE), FIBITMAP_ALIGNMENT);
+			if (!new_bits) throw std::bad_alloc();
+
+			for (unsigned y = first_row; y < last_row; y++) {
+				BYTE *bits = FreeImage_GetScanLine(src, y);
+				memcpy(new_bits, bits, line);
+
+				switch (bpp) {
+					case 1 :
+					{				
+						for(unsigned x = 0; x < width; x++) {
+							// get pixel at (x, y)
+							BOOL value = (new_bits[x >> 3] & (0x80 >> (x & 0x07))) != 0;
+							// set pixel at (new_x, y)
+							unsigned new_x = width - 1 - x;
+							value ? bits[new_x >> 3] |= (0x80 >> (new_x & 0x7)) : bits[new_x >> 3] &= (0xff7f >> (new_x & 0x7));
+						}
+					}
+					break;
 
-			case 4 :
-			{
-				for(unsigned c = 0; c < line; c++) {
-					bits[c] = new_bits[line - c - 1];
+					case 4 :
+					{
+						for(unsigned c = 0; c < line; c++) {
+							bits[c] = new_bits[line - c - 1];
 
-					BYTE nibble = (bits[c] & 0xF0) >> 4;
+							BYTE nibble = (bits[c] & 0xF0) >> 4;
 
-					bits[c] = bits[c] << 4;
-					bits[c] |= nibble;
+							bits[c] = bits[c] << 4;
+							bits[c] |= nibble;
+						}
+					}
+					break;
+
+					case 8:
+					case 16:
+					case 24 :
+					case 32 :
+					case 48:
+					case 64:
+					case 96:
+					case 128:
+						ReversePixels(bits, new_bits, width, bytespp);
+						break;
 				}
 			}
-			break;
 
-			case 8:
-			{				
-				BYTE *dst_data = (BYTE*) bits; 				
-				BYTE *src_data = (BYTE*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 			
-					*dst_data++ = *src_data--;  
-				} 
-			}
-			break;
+			FreeImage_Aligned_Free(new_bits);
+		});
 
-			case 16:
-			{				
-				WORD *dst_data = (WORD*) bits; 				
-				WORD *src_data = (WORD*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 			
-					*dst_data++ = *src_data--;  
-				} 
-			}
-			break;
-
-			case 24 :
-			case 32 :
-			case 48:
-			case 64:
-			case 96:
-			case 128:
-			{				
-				BYTE *dst_data = (BYTE*) bits; 				
-				BYTE *src_data = (BYTE*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 		
-					for(unsigned k = 0; k < bytespp; k++) {
-						*dst_data++ = src_data[k];  
-					}
-					src_data -= bytespp;
-				} 
-			}
-			break;
-
-		}
+	} catch(std::bad_alloc&) {
+		return FALSE;
 	}
 
-	FreeImage_Aligned_Free(new_bits);
-
 	return TRUE;
 }
 
@@ -25,10 +25,20 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 #include "ToneMapping.h"
+#include "../SIMD.h"
+#include "../ThreadPool.h"
 
 static const int NPRE	= 1;		// Number of relaxation sweeps before ...
 static const int NPOST	= 1;		// ... and after the coarse-grid correction is computed
 static const int NGMAX	= 15;		// Maximum number of grids
+static const int NCOARSE = 64;		// Number of relaxation sweeps solving the coarsest grid
+
+// ----------------------------------------------------------
+// Grids are (cx * 2^j + 1) x (cy * 2^j + 1) arrays, j being the grid level, 
+// with the same spacing h in both directions. The coarsest grid (j = 0) is small 
+// in at least one direction, and is solved by relaxation. 
+// All routines process the rows of a grid in parallel.
+// ----------------------------------------------------------
 
 /**
 Copy src into dst
@@ -45,180 +55,143 @@ static inline void fmg_fillArrayWithZeros(FIBITMAP *src) {
 }
 
 /**
-Half-weighting restriction. nc is the coarse-grid dimension. The fine-grid solution is input in
-uf[0..2*nc-2][0..2*nc-2], the coarse-grid solution is returned in uc[0..nc-1][0..nc-1].
+Half-weighting restriction. ncx x ncy is the coarse-grid dimension. The fine-grid solution is input in
+uf[0..2*ncy-2][0..2*ncx-2], the coarse-grid solution is returned in uc[0..ncy-1][0..ncx-1].
 */
-static void fmg_restrict(FIBITMAP *UC, FIBITMAP *UF, int nc) {
-	int row_uc, row_uf, col_uc, col_uf;
-
+static void fmg_restrict(FIBITMAP *UC, FIBITMAP *UF, int ncx, int ncy) {
 	const int uc_pitch  = FreeImage_GetPitch(UC) / sizeof(float);
 	const int uf_pitch  = FreeImage_GetPitch(UF) / sizeof(float);
 	
 	float *uc_bits = (float*)FreeImage_GetBits(UC);
 	const float *uf_bits = (float*)FreeImage_GetBits(UF);
 
-	// interior points
-	{
-		float *uc_scan = uc_bits + uc_pitch;
-		for (row_uc = 1, row_uf = 2; row_uc < nc-1; row_uc++, row_uf += 2) {
-			const float *uf_scan = uf_bits + row_uf * uf_pitch;
-			for (col_uc = 1, col_uf = 2; col_uc < nc-1; col_uc++, col_uf += 2) { 
+	ParallelForRows(ncx, ncy, [&](unsigned first_row, unsigned last_row) {
+		for(int row_uc = first_row; row_uc < (int)last_row; row_uc++) {
+			float *uc_scan = uc_bits + row_uc * uc_pitch;
+			const float *uf_scan = uf_bits + 2 * row_uc * uf_pitch;
+			if((row_uc == 0) || (row_uc == ncy-1)) {
+				// boundary points
+				for (int col_uc = 0; col_uc < ncx; col_uc++) {
+					uc_scan[col_uc] = uf_scan[2 * col_uc];
+				}
+				continue;
+			}
+			// interior points
+			for (int col_uc = 1, col_uf = 2; col_uc < ncx-1; col_uc++, col_uf += 2) { 
 				// calculate 
 				// UC(row_uc, col_uc) = 
 				// 0.5 * UF(row_uf, col_uf) + 0.125 * [ UF(row_uf+1, col_uf) + UF(row_uf-1, col_uf) + UF(row_uf, col_uf+1) + UF(row_uf, col_uf-1) ]
-				float *uc_pixel = uc_scan + col_uc;
 				const float *uf_center = uf_scan + col_uf;
-				*uc_pixel = 0.5F * *uf_center + 0.125F * ( *(uf_center + uf_pitch) + *(uf_center - uf_pitch) + *(uf_center + 1) + *(uf_center - 1) );
+				uc_scan[col_uc] = 0.5F * *uf_center + 0.125F * ( *(uf_center + uf_pitch) + *(uf_center - uf_pitch) + *(uf_center + 1) + *(uf_center - 1) );
 			}
-			uc_scan += uc_pitch;
-		}
-	}
-	// boundary points
-	const int ncc = 2*nc-1;
-	{
-		/*
-		calculate the following: 
-		for (row_uc = 0, row_uf = 0; row_uc < nc; row_uc++, row_uf += 2) { 
-			UC(row_uc, 0) = UF(row_uf, 0);		
-			UC(row_uc, nc-1) = UF(row_uf, ncc-1);
-		}
-		*/
-		float *uc_scan = uc_bits;
-		for (row_uc = 0, row_uf = 0; row_uc < nc; row_uc++, row_uf += 2) { 
-			const float *uf_scan = uf_bits + row_uf * uf_pitch;
+			// boundary points
 			uc_scan[0] = uf_scan[0];
-			uc_scan[nc-1] = uf_scan[ncc-1];
-			uc_scan += uc_pitch;
-		}
-	}
-	{
-		/*
-		calculate the following: 
-		for (col_uc = 0, col_uf = 0; col_uc < nc; col_uc++, col_uf += 2) {
-			UC(0, col_uc) = UF(0, col_uf);
-			UC(nc-1, col_uc) = UF(ncc-1, col_uf);
-		}
-		*/
-		float *uc_scan_top = uc_bits;
-		float *uc_scan_bottom = uc_bits + (nc-1)*uc_pitch;
-		const float *uf_scan_top = uf_bits + (ncc-1)*uf_pitch;
-		const float *uf_scan_bottom = uf_bits;
-		for (col_uc = 0, col_uf = 0; col_uc < nc; col_uc++, col_uf += 2) {
-			uc_scan_top[col_uc] = uf_scan_top[col_uf];
-			uc_scan_bottom[col_uc] = uf_scan_bottom[col_uf];
+			uc_scan[ncx-1] = uf_scan[2*ncx-2];
 		}
+	});
+}
+
+/**
+Red-black Gauss-Seidel relaxation for model problem. Updates the current value of the solution
+u[0..ny-1][0..nx-1], using the right-hand side function rhs[0..ny-1][0..nx-1] and the grid spacing h.
+*/
+static void fmg_relaxation(FIBITMAP *U, FIBITMAP *RHS, int nx, int ny, float h) {
+	const float h2 = h*h;
+
+	const int u_pitch  = FreeImage_GetPitch(U) / sizeof(float);
+	const int rhs_pitch  = FreeImage_GetPitch(RHS) / sizeof(float);
+	
+	float *u_bits = (float*)FreeImage_GetBits(U);
+	const float *rhs_bits = (float*)FreeImage_GetBits(RHS);
+
+	const FI_RelaxationLineKernel kernel = GetLineKernels().relaxation;
+
+	for (int ipass = 0, jsw = 1; ipass < 2; ipass++, jsw = 3-jsw) { // Red and black sweeps
+		// the points of a color only depend on the points of the other color : rows are independent
+		ParallelForRows(nx, ny - 2, [&](unsigned first_row, unsigned last_row) {
+			for (int row = first_row + 1; row < (int)last_row + 1; row++) {
+				const int isw = ((row & 1) ? jsw : 3 - jsw);
+				float *u_scan = u_bits + row * u_pitch;
+				const float *rhs_scan = rhs_bits + row * rhs_pitch;
+				for (int col = kernel(u_scan, rhs_scan, u_pitch, isw, nx-1, h2); col < nx-1; col += 2) { 
+					// Gauss-Seidel formula
+					// calculate U(row, col) = 
+					// 0.25 * [ U(row+1, col) + U(row-1, col) + U(row, col+1) + U(row, col-1) - h2 * RHS(row, col) ]		 
+					float *u_center = u_scan + col;
+					const float *rhs_center = rhs_scan + col;
+					*u_center = *(u_center + u_pitch) + *(u_center - u_pitch) + *(u_center + 1) + *(u_center - 1);
+					*u_center -= h2 * *rhs_center;
+					*u_center *= 0.25F;
+				}
+			}
+		});
 	}
 }
 
 /**
-Solution of the model problem on the coarsest grid, where h = 1/2 . 
-The right-hand side is input
-in rhs[0..2][0..2] and the solution is returned in u[0..2][0..2].
+Solution of the model problem on the coarsest grid. The right-hand side is input
+in rhs[0..ny-1][0..nx-1] and the solution is returned in u[0..ny-1][0..nx-1]. 
+The coarsest grid has at most 3 interior points in one direction, so that relaxation converges quickly 
+whatever its other dimension.
 */
-static void fmg_solve(FIBITMAP *U, FIBITMAP *RHS) {
+static void fmg_solve(FIBITMAP *U, FIBITMAP *RHS, int nx, int ny, float h) {
 	// fill U with zeros
 	fmg_fillArrayWithZeros(U);
-	// calculate U(1, 1) = -h*h*RHS(1, 1)/4.0 where h = 1/2
-	float *u_scan = (float*)FreeImage_GetScanLine(U, 1);
-	const float *rhs_scan = (float*)FreeImage_GetScanLine(RHS, 1);
-	u_scan[1] = -rhs_scan[1] / 16;
+	for(int k = 0; k < NCOARSE; k++) {
+		fmg_relaxation(U, RHS, nx, ny, h);
+	}
 }
 
 /**
-Coarse-to-fine prolongation by bilinear interpolation. nf is the fine-grid dimension. The coarsegrid
-solution is input as uc[0..nc-1][0..nc-1], where nc = nf/2 + 1. The fine-grid solution is
-returned in uf[0..nf-1][0..nf-1].
+Coarse-to-fine prolongation by bilinear interpolation. nfx x nfy is the fine-grid dimension. The coarse-grid
+solution is input as uc[0..ncy-1][0..ncx-1], where ncx = nfx/2 + 1 and ncy = nfy/2 + 1. The fine-grid solution is
+returned in uf[0..nfy-1][0..nfx-1].
 */
-static void fmg_prolongate(FIBITMAP *UF, FIBITMAP *UC, int nf) {
-	int row_uc, row_uf, col_uc, col_uf;
-
+static void fmg_prolongate(FIBITMAP *UF, FIBITMAP *UC, int nfx, int nfy) {
 	const int uf_pitch  = FreeImage_GetPitch(UF) / sizeof(float);
 	const int uc_pitch  = FreeImage_GetPitch(UC) / sizeof(float);
 	
 	float *uf_bits = (float*)FreeImage_GetBits(UF);
 	const float *uc_bits = (float*)FreeImage_GetBits(UC);
+
+	const int ncy = nfy/2 + 1;
 	
-	// do elements that are copies
-	{
-		const int nc = nf/2 + 1;
-
-		float *uf_scan = uf_bits;
-		const float *uc_scan = uc_bits;		
-		for (row_uc = 0; row_uc < nc; row_uc++) {
-			for (col_uc = 0, col_uf = 0; col_uc < nc; col_uc++, col_uf += 2) {
-				// calculate UF(2*row_uc, col_uf) = UC(row_uc, col_uc);
-				uf_scan[col_uf] = uc_scan[col_uc];
+	// do elements that are copies, then interpolate horizontally the even-numbered rows
+	ParallelForRows(nfx, ncy, [&](unsigned first_row, unsigned last_row) {
+		for (int row_uc = first_row; row_uc < (int)last_row; row_uc++) {
+			float *uf_scan = uf_bits + 2 * row_uc * uf_pitch;
+			const float *uc_scan = uc_bits + row_uc * uc_pitch;
+			for (int col_uf = 0; col_uf < nfx; col_uf += 2) {
+				// calculate UF(2*row_uc, col_uf) = UC(row_uc, col_uf/2);
+				uf_scan[col_uf] = uc_scan[col_uf / 2];
+			}
+			for (int col_uf = 1; col_uf < nfx-1; col_uf += 2) {
+				// calculate UF(row_uf, col_uf) = 0.5 * ( UF(row_uf, col_uf+1) + UF(row_uf, col_uf-1) )
+				uf_scan[col_uf] = 0.5F * ( uf_scan[col_uf + 1] + uf_scan[col_uf - 1] );
 			}
-			uc_scan += uc_pitch;
-			uf_scan += 2 * uf_pitch;
 		}
-	}
-	// do odd-numbered columns, interpolating vertically
-	{		
-		for(row_uf = 1; row_uf < nf-1; row_uf += 2) {
+	});
+	// do odd-numbered rows, interpolating vertically the even-numbered columns, then horizontally
+	ParallelForRows(nfx, ncy - 1, [&](unsigned first_row, unsigned last_row) {
+		for (int row_uf = 2 * first_row + 1; row_uf < 2 * (int)last_row + 1; row_uf += 2) {
 			float *uf_scan = uf_bits + row_uf * uf_pitch;
-			for (col_uf = 0; col_uf < nf; col_uf += 2) {
+			for (int col_uf = 0; col_uf < nfx; col_uf += 2) {
 				// calculate UF(row_uf, col_uf) = 0.5 * ( UF(row_uf+1, col_uf) + UF(row_uf-1, col_uf) )
 				uf_scan[col_uf] = 0.5F * ( *(uf_scan + uf_pitch + col_uf) + *(uf_scan - uf_pitch + col_uf) );
 			}
-		}
-	}
-	// do even-numbered columns, interpolating horizontally
-	{
-		float *uf_scan = uf_bits;
-		for(row_uf = 0; row_uf < nf; row_uf++) {
-			for (col_uf = 1; col_uf < nf-1; col_uf += 2) {
+			for (int col_uf = 1; col_uf < nfx-1; col_uf += 2) {
 				// calculate UF(row_uf, col_uf) = 0.5 * ( UF(row_uf, col_uf+1) + UF(row_uf, col_uf-1) )
 				uf_scan[col_uf] = 0.5F * ( uf_scan[col_uf + 1] + uf_scan[col_uf - 1] );
 			}
-			uf_scan += uf_pitch;
 		}
-	}
+	});
 }
 
 /**
-Red-black Gauss-Seidel relaxation for model problem. Updates the current value of the solution
-u[0..n-1][0..n-1], using the right-hand side function rhs[0..n-1][0..n-1].
+Returns minus the residual for the model problem. Input quantities are u[0..ny-1][0..nx-1] and
+rhs[0..ny-1][0..nx-1], while res[0..ny-1][0..nx-1] is returned.
 */
-static void fmg_relaxation(FIBITMAP *U, FIBITMAP *RHS, int n) {
-	int row, col, ipass, isw, jsw;
-	const float h = 1.0F / (n - 1);
-	const float h2 = h*h;
-
-	const int u_pitch  = FreeImage_GetPitch(U) / sizeof(float);
-	const int rhs_pitch  = FreeImage_GetPitch(RHS) / sizeof(float);
-	
-	float *u_bits = (float*)FreeImage_GetBits(U);
-	const float *rhs_bits = (float*)FreeImage_GetBits(RHS);
-
-	for (ipass = 0, jsw = 1; ipass < 2; ipass++, jsw = 3-jsw) { // Red and black sweeps
-		float *u_scan = u_bits + u_pitch;
-		const float *rhs_scan = rhs_bits + rhs_pitch;
-		for (row = 1, isw = jsw; row < n-1; row++, isw = 3-isw) {
-			for (col = isw; col < n-1; col += 2) { 
-				// Gauss-Seidel formula
-				// calculate U(row, col) = 
-				// 0.25 * [ U(row+1, col) + U(row-1, col) + U(row, col+1) + U(row, col-1) - h2 * RHS(row, col) ]		 
-				float *u_center = u_scan + col;
-				const float *rhs_center = rhs_scan + col;
-				*u_center = *(u_center + u_pitch) + *(u_center - u_pitch) + *(u_center + 1) + *(u_center - 1);
-				*u_center -= h2 * *rhs_center;
-				*u_center *= 0.25F;
-			}
-			u_scan += u_pitch;
-			rhs_scan += rhs_pitch;
-		}
-	}
-}
-
-/**
-Returns minus the residual for the model problem. Input quantities are u[0..n-1][0..n-1] and
-rhs[0..n-1][0..n-1], while res[0..n-1][0..n-1] is returned.
-*/
-static void fmg_residual(FIBITMAP *RES, FIBITMAP *U, FIBITMAP *RHS, int n) {
-	int row, col;
-
-	const float h = 1.0F / (n-1);	
+static void fmg_residual(FIBITMAP *RES, FIBITMAP *U, FIBITMAP *RHS, int nx, int ny, float h) {
 	const float h2i = 1.0F / (h*h);
 
 	const int res_pitch  = FreeImage_GetPitch(RES) / sizeof(float);
@@ -229,13 +202,20 @@ static void fmg_residual(FIBITMAP *RES, FIBITMAP *U, FIBITMAP *RHS, int n) {
 	const float *u_bits = (float*)FreeImage_GetBits(U);
 	const float *rhs_bits = (float*)FreeImage_GetBits(RHS);
 
-	// interior points
-	{
-		float *res_scan = res_bits + res_pitch;
-		const float *u_scan = u_bits + u_pitch;
-		const float *rhs_scan = rhs_bits + rhs_pitch;
-		for (row = 1; row < n-1; row++) {
-			for (col = 1; col < n-1; col++) {
+	const FI_ResidualLineKernel kernel = GetLineKernels().residual;
+
+	ParallelForRows(nx, ny, [&](unsigned first_row, unsigned last_row) {
+		for (int row = first_row; row < (int)last_row; row++) {
+			float *res_scan = res_bits + row * res_pitch;
+			if((row == 0) || (row == ny-1)) {
+				// boundary points
+				memset(res_scan, 0, nx * sizeof(float));
+				continue;
+			}
+			// interior points
+			const float *u_scan = u_bits + row * u_pitch;
+			const float *rhs_scan = rhs_bits + row * rhs_pitch;
+			for (int col = kernel(res_scan, u_scan, rhs_scan, u_pitch, 1, nx-1, h2i); col < nx-1; col++) {
 				// calculate RES(row, col) = 
 				// -h2i * [ U(row+1, col) + U(row-1, col) + U(row, col+1) + U(row, col-1) - 4 * U(row, col) ] + RHS(row, col);
 				float *res_center = res_scan + col;
@@ -245,34 +225,20 @@ static void fmg_residual(FIBITMAP *RES, FIBITMAP *U, FIBITMAP *RHS, int n) {
 				*res_center *= -h2i;
 				*res_center += *rhs_center;
 			}
-			res_scan += res_pitch;
-			u_scan += u_pitch;
-			rhs_scan += rhs_pitch;
+			// boundary points
+			res_scan[0] = 0;
+			res_scan[nx-1] = 0;
 		}
-	}
-
-	// boundary points
-	{
-		memset(FreeImage_GetScanLine(RES, 0), 0, FreeImage_GetPitch(RES));
-		memset(FreeImage_GetScanLine(RES, n-1), 0, FreeImage_GetPitch(RES));
-		float *left = res_bits;
-		float *right = res_bits + (n-1);
-		for(int k = 0; k < n; k++) {
-			*left = 0;
-			*right = 0;
-			left += res_pitch;
-			right += res_pitch;
-		}
-	}
+	});
 }
 
 /**
-Does coarse-to-fine interpolation and adds result to uf. nf is the fine-grid dimension. The
-coarse-grid solution is input as uc[0..nc-1][0..nc-1], where nc = nf/2+1. The fine-grid solution
-is returned in uf[0..nf-1][0..nf-1]. res[0..nf-1][0..nf-1] is used for temporary storage.
+Does coarse-to-fine interpolation and adds result to uf. nfx x nfy is the fine-grid dimension. The
+coarse-grid solution is input as uc[0..ncy-1][0..ncx-1], where ncx = nfx/2+1 and ncy = nfy/2+1. The fine-grid solution
+is returned in uf[0..nfy-1][0..nfx-1]. res[0..nfy-1][0..nfx-1] is used for temporary storage.
 */
-static void fmg_addint(FIBITMAP *UF, FIBITMAP *UC, FIBITMAP *RES, int nf) {
-	fmg_prolongate(RES, UC, nf);
+static void fmg_addint(FIBITMAP *UF, FIBITMAP *UC, FIBITMAP *RES, int nfx, int nfy) {
+	fmg_prolongate(RES, UC, nfx, nfy);
 
 	const int uf_pitch  = FreeImage_GetPitch(UF) / sizeof(float);
 	const int res_pitch  = FreeImage_GetPitch(RES) / sizeof(float);	
@@ -280,32 +246,37 @@ static void fmg_addint(FIBITMAP *UF, FIBITMAP *UC, FIBITMAP *RES, int nf) {
 	float *uf_bits = (float*)FreeImage_GetBits(UF);
 	const float *res_bits = (float*)FreeImage_GetBits(RES);
 
-	for(int row = 0; row < nf; row++) {
-		for(int col = 0; col < nf; col++) {
-			// calculate UF(row, col) = UF(row, col) + RES(row, col);
-			uf_bits[col] += res_bits[col];
+	ParallelForRows(nfx, nfy, [&](unsigned first_row, unsigned last_row) {
+		for(int row = first_row; row < (int)last_row; row++) {
+			float *uf_scan = uf_bits + row * uf_pitch;
+			const float *res_scan = res_bits + row * res_pitch;
+			for(int col = 0; col < nfx; col++) {
+				// calculate UF(row, col) = UF(row, col) + RES(row, col);
+				uf_scan[col] += res_scan[col];
+			}
 		}
-		uf_bits += uf_pitch;
-		res_bits += res_pitch;
-	}
+	});
 }
 
 /**
 Full Multigrid Algorithm for solution of linear elliptic equation, here the model problem (19.0.6).
-On input u[0..n-1][0..n-1] contains the right-hand side , while on output it returns the solution.
-The dimension n must be of the form 2^j + 1 for some integer j. (j is actually the number of
-grid levels used in the solution, called ng below.) ncycle is the number of V-cycles to be
-used at each level.
+On input u[0..ny-1][0..nx-1] contains the right-hand side, while on output it returns the solution.
+The dimensions must be of the form nx = cx * 2^j + 1 and ny = cy * 2^j + 1 for some integers cx, cy and j 
+(j + 1 is actually the number of grid levels used in the solution, called ng below). The grid spacing 
+is 1 / (MAX(nx, ny) - 1). ncycle is the number of V-cycles to be used at each level.
 */
-static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
-	int j, jcycle, jj, jpost, jpre, nf, ngrid;
+static BOOL fmg_mglin(FIBITMAP *U, int cx, int cy, int ng, int ncycle) {
+	int j, jcycle, jj, jpost, jpre, nfx, nfy;
 
 	FIBITMAP **IRHO = NULL;
 	FIBITMAP **IU   = NULL;
 	FIBITMAP **IRHS = NULL;
 	FIBITMAP **IRES = NULL;
-	
-	int ng = 0;		// number of allocated grids
+
+	// dimensions and grid spacing of grid j
+#define GRID_NX(j)	(cx * (1 << (j)) + 1)
+#define GRID_NY(j)	(cy * (1 << (j)) + 1)
+#define GRID_H(j)	(h * (float)(1 << (ng - 1 - (j))))
 
 // --------------------------------------------------------------------------
 
@@ -327,17 +298,14 @@ static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
 // --------------------------------------------------------------------------
 
 	try {
-		int nn = n;
-		// check grid size and grid levels
-		while (nn >>= 1) ng++;
-		if (n != 1 + (1L << ng)) {
-			FreeImage_OutputMessageProc(FIF_UNKNOWN, "Multigrid algorithm: n = %d, while n-1 must be a power of 2.", n);
-			throw(1);
-		}
+		// check grid levels
 		if (ng > NGMAX) {
 			FreeImage_OutputMessageProc(FIF_UNKNOWN, "Multigrid algorithm: ng = %d while NGMAX = %d, increase NGMAX.", ng, NGMAX);
 			throw(1);
 		}
+		// grid spacing of the finest grid
+		const float h = 1.0F / (MAX(GRID_NX(ng - 1), GRID_NY(ng - 1)) - 1);
+
 		// allocate grid arrays
 		{
 			_CREATE_ARRAY_GRID_(IRHO, ng);
@@ -346,34 +314,38 @@ static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
 			_CREATE_ARRAY_GRID_(IRES, ng);
 		}
 
-		nn = n/2 + 1;
-		ngrid = ng - 2;
+		if(ng == 1) {
+			// the fine grid is the coarsest grid
+			IU[0] = FreeImage_AllocateT(FIT_FLOAT, GRID_NX(0), GRID_NY(0));
+			if(!IU[0]) throw(1);
+			fmg_solve(IU[0], U, GRID_NX(0), GRID_NY(0), GRID_H(0));
+			fmg_copyArray(U, IU[0]);
+			throw(0);
+		}
 
 		// allocate storage for r.h.s. on grid (ng - 2) ...
-		IRHO[ngrid] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+		int ngrid = ng - 2;
+		IRHO[ngrid] = FreeImage_AllocateT(FIT_FLOAT, GRID_NX(ngrid), GRID_NY(ngrid));
 		if(!IRHO[ngrid]) throw(1);
 
 		// ... and fill it by restricting from the fine grid
-		fmg_restrict(IRHO[ngrid], U, nn);	
+		fmg_restrict(IRHO[ngrid], U, GRID_NX(ngrid), GRID_NY(ngrid));	
 
 		// similarly allocate storage and fill r.h.s. on all coarse grids.
-		while (nn > 3) {
-			nn = nn/2 + 1; 
+		while (ngrid > 0) {
 			ngrid--;
-			IRHO[ngrid] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+			IRHO[ngrid] = FreeImage_AllocateT(FIT_FLOAT, GRID_NX(ngrid), GRID_NY(ngrid));
 			if(!IRHO[ngrid]) throw(1);
-			fmg_restrict(IRHO[ngrid], IRHO[ngrid+1], nn);
+			fmg_restrict(IRHO[ngrid], IRHO[ngrid+1], GRID_NX(ngrid), GRID_NY(ngrid));
 		}
 
-		nn = 3;
-
-		IU[0] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+		IU[0] = FreeImage_AllocateT(FIT_FLOAT, GRID_NX(0), GRID_NY(0));
 		if(!IU[0]) throw(1);
-		IRHS[0] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+		IRHS[0] = FreeImage_AllocateT(FIT_FLOAT, GRID_NX(0), GRID_NY(0));
 		if(!IRHS[0]) throw(1);
 
 		// initial solution on coarsest grid
-		fmg_solve(IU[0], IRHO[0]);
+		fmg_solve(IU[0], IRHO[0], GRID_NX(0), GRID_NY(0), GRID_H(0));
 		// irho[0] no longer needed ...
 		FreeImage_Unload(IRHO[0]); IRHO[0] = NULL;
 
@@ -381,49 +353,55 @@ static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
 
 		// nested iteration loop
 		for (j = 1; j < ngrid; j++) {
-			nn = 2*nn - 1;
+			const int nx = GRID_NX(j);
+			const int ny = GRID_NY(j);
 
-			IU[j] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+			IU[j] = FreeImage_AllocateT(FIT_FLOAT, nx, ny);
 			if(!IU[j]) throw(1);
-			IRHS[j] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+			IRHS[j] = FreeImage_AllocateT(FIT_FLOAT, nx, ny);
 			if(!IRHS[j]) throw(1);
-			IRES[j] = FreeImage_AllocateT(FIT_FLOAT, nn, nn);
+			IRES[j] = FreeImage_AllocateT(FIT_FLOAT, nx, ny);
 			if(!IRES[j]) throw(1);
 
-			fmg_prolongate(IU[j], IU[j-1], nn);
-			
 			// interpolate from coarse grid to next finer grid
+			fmg_prolongate(IU[j], IU[j-1], nx, ny);
 
 			// set up r.h.s.
-			fmg_copyArray(IRHS[j], j != (ngrid - 1) ? IRHO[j] : U);
+			if(j != (ngrid - 1)) {
+				fmg_copyArray(IRHS[j], IRHO[j]);
+				// irho[j] no longer needed ...
+				FreeImage_Unload(IRHO[j]); IRHO[j] = NULL;
+			} else {
+				fmg_copyArray(IRHS[j], U);
+			}
 			
 			// V-cycle loop
 			for (jcycle = 0; jcycle < ncycle; jcycle++) {
-				nf = nn;
 				// downward stoke of the V
 				for (jj = j; jj >= 1; jj--) {
+					nfx = GRID_NX(jj);
+					nfy = GRID_NY(jj);
 					// pre-smoothing
 					for (jpre = 0; jpre < NPRE; jpre++) {
-						fmg_relaxation(IU[jj], IRHS[jj], nf);
+						fmg_relaxation(IU[jj], IRHS[jj], nfx, nfy, GRID_H(jj));
 					}
-					fmg_residual(IRES[jj], IU[jj], IRHS[jj], nf);
-					nf = nf/2 + 1;
+					fmg_residual(IRES[jj], IU[jj], IRHS[jj], nfx, nfy, GRID_H(jj));
 					// restriction of the residual is the next r.h.s.
-					fmg_restrict(IRHS[jj-1], IRES[jj], nf);				
+					fmg_restrict(IRHS[jj-1], IRES[jj], GRID_NX(jj-1), GRID_NY(jj-1));				
 					// zero for initial guess in next relaxation
 					fmg_fillArrayWithZeros(IU[jj-1]);
 				}
 				// bottom of V: solve on coarsest grid
-				fmg_solve(IU[0], IRHS[0]); 
-				nf = 3; 
+				fmg_solve(IU[0], IRHS[0], GRID_NX(0), GRID_NY(0), GRID_H(0)); 
 				// upward stroke of V.
 				for (jj = 1; jj <= j; jj++) { 
-					nf = 2*nf - 1;
+					nfx = GRID_NX(jj);
+					nfy = GRID_NY(jj);
 					// use res for temporary storage inside addint
-					fmg_addint(IU[jj], IU[jj-1], IRES[jj], nf);				
+					fmg_addint(IU[jj], IU[jj-1], IRES[jj], nfx, nfy);				
 					// post-smoothing
 					for (jpost = 0; jpost < NPOST; jpost++) {
-						fmg_relaxation(IU[jj], IRHS[jj], nf);
+						fmg_relaxation(IU[jj], IRHS[jj], nfx, nfy, GRID_H(jj));
 					}
 				}
 			}
@@ -440,15 +418,19 @@ static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
 
 		return TRUE;
 
-	} catch(int) {
+	} catch(int error) {
 		// delete allocated arrays
 		_FREE_ARRAY_GRID_(IRES, ng);
 		_FREE_ARRAY_GRID_(IRHS, ng);
 		_FREE_ARRAY_GRID_(IU, ng);
 		_FREE_ARRAY_GRID_(IRHO, ng);
 
-		return FALSE;
+		return (error == 0) ? TRUE : FALSE;
 	}
+
+#undef GRID_NX
+#undef GRID_NY
+#undef GRID_H
 }
 
 // --------------------------------------------------------------------------
@@ -456,8 +438,8 @@ static BOOL fmg_mglin(FIBITMAP *U, int n, int ncycle) {
 /**
 Poisson solver based on a multigrid algorithm. 
 This routine solves a Poisson equation, remap result pixels to [0..1] and returns the solution. 
-NB: The input image is first stored inside a square image whose size is (2^j + 1)x(2^j + 1) for some integer j, 
-where j is such that 2^j is the nearest larger dimension corresponding to MAX(image width, image height). 
+NB: The input image is first stored inside an image whose size is (cx*2^j + 1)x(cy*2^j + 1), with a one pixel 
+boundary, for some integers cx, cy and j, where j is such that cx or cy is at most 4. 
 @param Laplacian Laplacian image
 @param ncycle Number of cycles in the multigrid algorithm (usually 2 or 3)
 @return Returns the solved PDE equations if successful, returns NULL otherwise
@@ -469,29 +451,32 @@ FreeImage_MultigridPoissonSolver(FIBITMAP *Laplacian, int ncycle) {
 	int width = FreeImage_GetWidth(Laplacian);
 	int height = FreeImage_GetHeight(Laplacian);
 
-	// get nearest larger dimension length that is acceptable by the algorithm
-	int n = MAX(width, height);
-	int size = 0;
-	while((n >>= 1) > 0) size++;
-	if((1 << size) < MAX(width, height)) {
-		size++;
+	// the grid needs (width + 1) x (height + 1) intervals, for the pixels and the boundary
+	// get the number of levels j such that the smallest dimension has 2 to 4 intervals on the coarsest grid
+	int j = 0;
+	while((j + 1 < NGMAX) && ((2 << (j + 1)) <= MIN(width, height) + 1)) {
+		j++;
 	}
-	// size must be of the form 2^j + 1 for some integer j
-	size = 1 + (1 << size);
+	const int cx = (width + 1 + (1 << j) - 1) >> j;
+	const int cy = (height + 1 + (1 << j) - 1) >> j;
 
-	// allocate a temporary square image I
-	FIBITMAP *I = FreeImage_AllocateT(FIT_FLOAT, size, size);
+	// allocate a temporary image I
+	FIBITMAP *I = FreeImage_AllocateT(FIT_FLOAT, cx * (1 << j) + 1, cy * (1 << j) + 1);
 	if(!I) return NULL;
 
 	// copy Laplacian into I and shift pixels to create a boundary
 	FreeImage_Paste(I, Laplacian, 1, 1, 255);
 
 	// solve the PDE equation
-	fmg_mglin(I, size, ncycle);
+	if(!fmg_mglin(I, cx, cy, j + 1, ncycle)) {
+		FreeImage_Unload(I);
+		return NULL;
+	}
 
 	// shift pixels back
 	FIBITMAP *U = FreeImage_Copy(I, 1, 1, width + 1, height + 1);
 	FreeImage_Unload(I);
+	if(!U) return NULL;
 
 	// remap pixels to [0..1]
 	NormalizeY(U, 0, 1);
@@ -502,4 +487,3 @@ FreeImage_MultigridPoissonSolver(FIBITMAP *Laplacian, int ncycle) {
 	// return the integrated image
 	return U;
 }
-
@@ -21,6 +21,142 @@
 // ==========================================================
 
 #include "Resize.h"
+#include "../ThreadPool.h"
+#include "../TransferFunctions.h"
+
+/**
+Rescale a sRGB image in linear light (flag FI_RESCALE_LINEAR_LIGHT). 
+The source rectangle is decoded to a float image, rescaled, then encoded back to the source format. 
+Alpha values are rescaled as they are. Images of other formats are rescaled without decoding.
+*/
+static FIBITMAP*
+ScaleLinearLight(CResizeEngine& engine, FIBITMAP *src, unsigned dst_width, unsigned dst_height, unsigned src_left, unsigned src_top, unsigned src_width, unsigned src_height, unsigned flags) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	const unsigned bpp = FreeImage_GetBPP(src);
+
+	FREE_IMAGE_TYPE linear_type = FIT_UNKNOWN;
+	unsigned samples = 0;
+	int alpha = -1;
+	float max_value = 255;
+	switch(image_type) {
+		case FIT_BITMAP:
+			if(bpp == 8) {
+				if((FreeImage_GetColorType(src) == FIC_MINISBLACK) && !FreeImage_IsTransparent(src) && !(flags & FI_RESCALE_TRUE_COLOR)) {
+					linear_type = FIT_FLOAT;
+					samples = 1;
+				}
+			} else if(bpp == 24) {
+				linear_type = FIT_RGBF;
+				samples = 3;
+			} else if(bpp == 32) {
+				linear_type = FIT_RGBAF;
+				samples = 4;
+				alpha = FI_RGBA_ALPHA;
+			}
+			break;
+		case FIT_RGB16:
+			linear_type = FIT_RGBF;
+			samples = 3;
+			max_value = 65535;
+			break;
+		case FIT_RGBA16:
+			linear_type = FIT_RGBAF;
+			samples = 4;
+			alpha = 3;
+			max_value = 65535;
+			break;
+		default:
+			break;
+	}
+
+	if((linear_type == FIT_UNKNOWN) || ((src_width == dst_width) && (src_height == dst_height))) {
+		return engine.scale(src, dst_width, dst_height, src_left, src_top, src_width, src_height, flags);
+	}
+
+	FIBITMAP *linear = NULL;
+	FIBITMAP *scaled = NULL;
+	FIBITMAP *dst = NULL;
+
+	try {
+		const TransferFunction& srgb = TransferFunction::sRGB();
+		const BOOL is_word = (max_value > 255);
+		const unsigned src_image_height = FreeImage_GetHeight(src);
+		const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+
+		// decode the source rectangle
+		linear = FreeImage_AllocateT(linear_type, src_width, src_height);
+		if(!linear) throw FI_MSG_ERROR_MEMORY;
+
+		ParallelForRows(src_width, src_height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				// (FIBITMAP are stored upside down)
+				const BYTE *src_bits = FreeImage_GetScanLine(src, src_image_height - src_top - src_height + y) + src_left * bytespp;
+				float *dst_bits = (float*)FreeImage_GetScanLine(linear, y);
+				if(is_word) {
+					srgb.DecodeLine(dst_bits, (const WORD*)src_bits, src_width * samples);
+				} else {
+					srgb.DecodeLine(dst_bits, src_bits, src_width * samples);
+				}
+				if(alpha >= 0) {
+					for(unsigned x = 0; x < src_width; x++) {
+						const unsigned i = x * samples + alpha;
+						dst_bits[i] = (is_word ? ((const WORD*)src_bits)[i] : src_bits[i]) / max_value;
+					}
+				}
+			}
+		});
+
+		scaled = engine.scale(linear, dst_width, dst_height, 0, 0, src_width, src_height, flags);
+		FreeImage_Unload(linear);
+		linear = NULL;
+		if(!scaled) throw FI_MSG_ERROR_MEMORY;
+
+		// encode to the source format
+		dst = FreeImage_AllocateT(image_type, dst_width, dst_height, bpp, FreeImage_GetRedMask(src), FreeImage_GetGreenMask(src), FreeImage_GetBlueMask(src));
+		if(!dst) throw FI_MSG_ERROR_MEMORY;
+		if(bpp == 8) {
+			RGBQUAD *pal = FreeImage_GetPalette(dst);
+			CREATE_GREYSCALE_PALETTE(pal, 256);
+		}
+
+		ParallelForRows(dst_width, dst_height, [&](unsigned first_row, unsigned last_row) {
+			for(unsigned y = first_row; y < last_row; y++) {
+				const float *src_bits = (float*)FreeImage_GetScanLine(scaled, y);
+				BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+				if(is_word) {
+					srgb.EncodeLine((WORD*)dst_bits, src_bits, dst_width * samples);
+				} else {
+					srgb.EncodeLine(dst_bits, src_bits, dst_width * samples);
+				}
+				if(alpha >= 0) {
+					for(unsigned x = 0; x < dst_width; x++) {
+						const unsigned i = x * samples + alpha;
+						const float value = CLAMP(src_bits[i], 0.F, 1.F) * max_value + 0.5F;
+						if(is_word) {
+							((WORD*)dst_bits)[i] = (WORD)value;
+						} else {
+							dst_bits[i] = (BYTE)value;
+						}
+					}
+				}
+			}
+		});
+
+		FreeImage_Unload(scaled);
+
+		return dst;
+
+	} catch(const std::bad_alloc&) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, FI_MSG_ERROR_MEMORY);
+	} catch(const char *message) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, message);
+	}
+	FreeImage_Unload(linear);
+	FreeImage_Unload(scaled);
+	FreeImage_Unload(dst);
+
+	return NULL;
+}
 
 FIBITMAP * DLL_CALLCONV
 FreeImage_RescaleRect(FIBITMAP *src, int dst_width, int dst_height, int src_left, int src_top, int src_right, int src_bottom, FREE_IMAGE_FILTER filter, unsigned flags) {
@@ -75,8 +211,13 @@ FreeImage_RescaleRect(FIBITMAP *src, int dst_width, int dst_height, int src_left
 
 	CResizeEngine Engine(pFilter);
 
-	dst = Engine.scale(src, dst_width, dst_height, src_left, src_top,
-			src_right - src_left, src_bottom - src_top, flags);
+	if ((flags & FI_RESCALE_LINEAR_LIGHT) == FI_RESCALE_LINEAR_LIGHT) {
+		dst = ScaleLinearLight(Engine, src, dst_width, dst_height, src_left, src_top,
+				src_right - src_left, src_bottom - src_top, flags);
+	} else {
+		dst = Engine.scale(src, dst_width, dst_height, src_left, src_top,
+				src_right - src_left, src_bottom - src_top, flags);
+	}
 
 	delete pFilter;
 
@@ -1460,6 +1460,7 @@ static TagInfo
     { 0x1004, (char *) "Interlaced", (char *) "Interlaced"},
     { 0x1005, (char *) "FrameTime", (char *) "Frame display time"},
     { 0x1006, (char *) "DisposalMethod", (char *) "Frame disposal method"},
+    { 0x1007, (char *) "BlendMethod", (char *) "Frame blend method"},
     { 0x0000, (char *) NULL, (char *) NULL}
   };
 
@@ -141,4 +141,10 @@ void DLL_CALLCONV InitJNG(Plugin *plugin, int format_id);
 void DLL_CALLCONV InitWEBP(Plugin *plugin, int format_id);
 void DLL_CALLCONV InitJXR(Plugin *plugin, int format_id);
 
+// ==========================================================
+//   Internal plugin resources, released by FreeImage_DeInitialise
+// ==========================================================
+
+void ReleaseRAWProcessors();
+
 #endif //!PLUGIN_H
@@ -28,6 +28,8 @@
 
 #include "FreeImage.h"
 
+#include <vector>
+
 ////////////////////////////////////////////////////////////////
 
 /**
@@ -49,33 +51,42 @@ typedef struct tagBox {
 
 protected:
     float *gm2;
-	LONG *wt, *mr, *mg, *mb;
-	WORD *Qadd;
+	// 64-bit moments : the sums of large images or of several frames overflow 32 bits
+	INT64 *wt, *mr, *mg, *mb;
+	// palette index of each histogram cell, built by BuildPalette
+	BYTE *tag;
+	RGBQUAD m_palette[256];
+	int m_palette_size;
 
 	// DIB data
-	unsigned width, height;
-	unsigned pitch;
 	FIBITMAP *m_dib;
 
 protected:
-    void Hist3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2, int ReserveSize, RGBQUAD *ReservePalette);
-	void M3D(LONG *vwt, LONG *vmr, LONG *vmg, LONG *vmb, float *m2);
-	LONG Vol(Box *cube, LONG *mmt);
-	LONG Bottom(Box *cube, BYTE dir, LONG *mmt);
-	LONG Top(Box *cube, BYTE dir, int pos, LONG *mmt);
+	void Reserve(int ReserveSize, RGBQUAD *ReservePalette);
+	void M3D(INT64 *vwt, INT64 *vmr, INT64 *vmg, INT64 *vmb, float *m2);
+	INT64 Vol(Box *cube, INT64 *mmt);
+	INT64 Bottom(Box *cube, BYTE dir, INT64 *mmt);
+	INT64 Top(Box *cube, BYTE dir, int pos, INT64 *mmt);
 	float Var(Box *cube);
 	float Maximize(Box *cube, BYTE dir, int first, int last , int *cut,
-				   LONG whole_r, LONG whole_g, LONG whole_b, LONG whole_w);
+				   INT64 whole_r, INT64 whole_g, INT64 whole_b, INT64 whole_w);
 	bool Cut(Box *set1, Box *set2);
 	void Mark(Box *cube, int label, BYTE *tag);
 
 public:
-	// Constructor - Input parameter: DIB 24-bit to be quantized
-    WuQuantizer(FIBITMAP *dib);
+	// Constructor - Input parameter: DIB 24-bit to be quantized, or NULL to add images with AddImage
+    WuQuantizer(FIBITMAP *dib = NULL);
 	// Destructor
 	~WuQuantizer();
 	// Quantizer - Return value: quantized 8-bit (color palette) DIB
 	FIBITMAP* Quantize(int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette);
+
+	// Add the colors of a 24-bit or 32-bit DIB to the histogram
+	void AddImage(FIBITMAP *dib);
+	// Build the palette of the images added so far, once - Return value: number of palette entries
+	int BuildPalette(int PaletteSize, int ReserveSize, RGBQUAD *ReservePalette);
+	// Map a 24-bit or 32-bit DIB to the palette - Return value: quantized 8-bit (color palette) DIB
+	FIBITMAP* Map(FIBITMAP *dib);
 };
 
 
@@ -356,4 +367,50 @@ protected:
 
 };
 
+/**
+ * Nearest color lookup in a palette
+ *
+ * The RGB cube is split into a grid of 16x16x16 cells. Each cell keeps
+ * the list of the palette entries that can be the nearest entry of a
+ * color of the cell: an entry is dropped when its distance to the cell
+ * is greater than the farthest distance of another entry to the cell.
+ * A lookup then only tests the few candidates of a cell, and gives the
+ * same result as a linear search of the palette (smallest Euclidean
+ * distance, lowest index on ties).
+ */
+class NearestColorMap {
+public:
+	/**
+	 * Constructor, throws std::bad_alloc
+	 * @param palette the palette to search
+	 * @param size the number of entries of the palette, in [1..256]
+	 */
+	NearestColorMap(const RGBQUAD *palette, int size);
+
+	/**
+	 * Returns the index of the palette entry nearest to a color
+	 */
+	BYTE GetIndex(BYTE red, BYTE green, BYTE blue) const;
+
+	/**
+	 * Maps a scanline of 24-bit or 32-bit pixels to palette indexes
+	 * @param target the 8-bit scanline receiving the indexes
+	 * @param source the 24-bit or 32-bit scanline
+	 * @param width the number of pixels
+	 * @param bytespp the number of bytes per pixel of source, 3 or 4
+	 */
+	void MapLine(BYTE *target, const BYTE *source, unsigned width, unsigned bytespp) const;
+
+protected:
+	/** Number of grid cells along each axis, as a shift of the 8-bit components. */
+	static const int CELL_SHIFT = 4;
+	static const int GRID_SIZE = 256 >> CELL_SHIFT;
+
+	/** The palette, as int components. */
+	int m_red[256], m_green[256], m_blue[256];
+	/** Candidates of cell i are m_candidates[m_first[i]] to m_candidates[m_first[i + 1] - 1]. */
+	std::vector<unsigned> m_first;
+	std::vector<BYTE> m_candidates;
+};
+
 #endif // FREEIMAGE_QUANTIZER_H
@@ -0,0 +1,253 @@
+// ==========================================================
+// SIMD kernels and CPU feature dispatch
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#ifndef FREEIMAGE_SIMD_H
+#define FREEIMAGE_SIMD_H
+
+#include "FreeImage.h"
+
+// ==========================================================
+//   CPU features
+// ==========================================================
+
+#define FI_CPU_SSE2		0x0001	//! SSE2 instructions
+#define FI_CPU_SSSE3	0x0002	//! SSSE3 instructions (pshufb, palignr)
+#define FI_CPU_AVX2		0x0004	//! AVX2 instructions (256-bit integer ops, gathers), with OS support
+
+/**
+Get the SIMD instruction sets usable on this CPU.
+The result is computed once. It can be capped for testing purpose with the FREEIMAGE_SIMD
+environment variable, set to 'none', 'sse2', 'ssse3' or 'avx2'.
+@return Returns a combination of FI_CPU_xxx flags, or 0 if SIMD code is not available
+*/
+unsigned GetCPUFeatures();
+
+// ==========================================================
+//   Line conversion kernels
+// ==========================================================
+
+/**
+SIMD kernel of a FreeImage_ConvertLineXXX function.
+A kernel converts the first pixels of a line, by blocks, and returns the number of
+converted pixels. The caller converts the remaining pixels.
+*/
+typedef int (*FI_LineKernel)(BYTE *target, const BYTE *source, int width_in_pixels);
+/**
+SIMD kernel of a FreeImage_ConvertLineXXX function using a palette
+@see FI_LineKernel
+*/
+typedef int (*FI_PaletteLineKernel)(BYTE *target, const BYTE *source, int width_in_pixels, const RGBQUAD *palette);
+/**
+SIMD kernel reordering the bytes of 32-bit pixels : target byte i of a pixel is source byte order[i].
+@see FI_LineKernel
+*/
+typedef int (*FI_ShuffleLineKernel)(BYTE *target, const BYTE *source, int width_in_pixels, const BYTE order[4]);
+/**
+SIMD kernel updating min_value and max_value with the first values of an array of float.
+NaN values are ignored. Returns the number of scanned values, the caller scans the remaining values.
+*/
+typedef int (*FI_FloatMinMaxKernel)(const float *source, int count, float *min_value, float *max_value);
+/**
+SIMD kernel updating min_value and max_value with the first values of an array of double
+@see FI_FloatMinMaxKernel
+*/
+typedef int (*FI_DoubleMinMaxKernel)(const double *source, int count, double *min_value, double *max_value);
+/**
+SIMD kernel converting the first pixels of a 8-bit line to a 1-bit line : the bit of pixel x is set
+when source[x] >= threshold[x]. Returns a multiple of 8 number of converted pixels.
+@see FI_LineKernel
+*/
+typedef int (*FI_ThresholdLineKernel)(BYTE *target, const BYTE *source, const BYTE *threshold, int width_in_pixels);
+/**
+SIMD kernel converting the first pixels of a RGBF line with a 3x3 color matrix. Target may be source.
+@see FI_LineKernel
+*/
+typedef int (*FI_ColorMatrixLineKernel)(float *target, const float *source, int width_in_pixels, const float matrix[3][3]);
+/**
+SIMD kernel converting the first pixels of a RGBF line to a float line
+@see FI_LineKernel
+*/
+typedef int (*FI_FloatLineKernel)(float *target, const float *source, int width_in_pixels);
+/**
+SIMD kernel of a red-black Gauss-Seidel sweep on a line of a Poisson grid. For x = first, first + 2, ... below last, 
+u[x] = 0.25 * (u[x + pitch] + u[x - pitch] + u[x + 1] + u[x - 1] - h2 * rhs[x]). 
+Returns the first x not updated, the caller updates the remaining values.
+*/
+typedef int (*FI_RelaxationLineKernel)(float *u, const float *rhs, int pitch, int first, int last, float h2);
+/**
+SIMD kernel of the residual on a line of a Poisson grid. For x in [first, last), 
+res[x] = -h2i * (u[x + pitch] + u[x - pitch] + u[x + 1] + u[x - 1] - 4 * u[x]) + rhs[x]. 
+Returns the first x not computed, the caller computes the remaining values.
+*/
+typedef int (*FI_ResidualLineKernel)(float *res, const float *u, const float *rhs, int pitch, int first, int last, float h2i);
+/**
+SIMD kernel transposing pixels : target row x, column y is set to the source pixel at row y, column x. 
+Pitches are in bytes and may be negative. The kernel transposes the top left (width - width % N) x (height - height % N) 
+source pixels by blocks of N x N pixels, and returns N, or 0 if it transposes no pixel. 
+The caller transposes the remaining pixels.
+*/
+typedef int (*FI_TransposeKernel)(BYTE *target, int target_pitch, const BYTE *source, int source_pitch, int width, int height);
+
+/**
+SIMD kernel compositing premultiplied 32-bit source pixels onto premultiplied 32-bit target pixels, 
+the source pixels being scaled by opacity / 255 (see FreeImage_CompositeInto).
+@see FI_LineKernel
+*/
+typedef int (*FI_CompositeLineKernel)(BYTE *target, const BYTE *source, int width_in_pixels, unsigned opacity);
+/**
+SIMD kernel compositing premultiplied FIT_RGBAF source pixels onto FIT_RGBAF target pixels, 
+the source pixels being scaled by opacity (see FreeImage_CompositeInto).
+@see FI_LineKernel
+*/
+typedef int (*FI_FloatCompositeLineKernel)(float *target, const float *source, int width_in_pixels, float opacity);
+/**
+SIMD kernel blending bytes with a constant alpha in [0..255], as FreeImage_Paste : 
+target[i] = (source[i] * alpha + target[i] * (256 - alpha)) >> 8. 
+Returns the number of blended bytes, the caller blends the remaining bytes.
+*/
+typedef int (*FI_BlendLineKernel)(BYTE *target, const BYTE *source, int count, unsigned alpha);
+
+/**
+SIMD kernel splitting pixels of 3 or 4 channels into planes : plane k receives channel k of the pixels, 
+channels being in memory order. 
+@see FI_LineKernel
+*/
+typedef int (*FI_SplitLineKernel)(BYTE *const planes[4], const BYTE *source, int width_in_pixels);
+/**
+SIMD kernel merging planes into pixels of 3 or 4 channels : channel k of the pixels is taken from plane k, 
+channels being in memory order. 
+@see FI_LineKernel
+*/
+typedef int (*FI_MergeLineKernel)(BYTE *target, const BYTE *const planes[4], int width_in_pixels);
+
+/**
+SIMD kernel of a FIR filter : target[i] = sum of weights[k] * rows[k][i] for k = 0 to taps - 1, 
+summed in increasing k order. Returns the number of computed values, the caller computes the remaining values.
+*/
+typedef int (*FI_ConvolveLineKernel)(float *target, const float *const *rows, int count, const float *weights, int taps);
+
+/**
+Number of fractional bits of the fixed point weights of the affine warp kernels
+*/
+#define FI_WARP_WEIGHT_BITS	14
+
+/**
+SIMD kernel of an affine warp with N x N taps (N = 2 or 4), on 8-bit channels. 
+Target pixel i is the sum of the N x N source pixels at source + offset[i] + row * pitch + column * bytespp, 
+times the N x N weights at weights + phase[i] * N * N (in row order, FI_WARP_WEIGHT_BITS fractional bits), 
+rounded and clamped to [0..255]. Returns the number of computed pixels, the caller computes the remaining pixels.
+*/
+typedef int (*FI_WarpLineKernel)(BYTE *target, const BYTE *source, int pitch, const int *offset, const WORD *phase, const short *weights, int count);
+
+/**
+Line conversion kernels, selected for the CPU features.
+Conversions without a SIMD implementation use a kernel converting no pixel.
+*/
+typedef struct tagFILineKernels {
+	FI_LineKernel convert16To8_555;
+	FI_LineKernel convert16To8_565;
+	FI_LineKernel convert24To8;
+	FI_LineKernel convert32To8;
+	FI_PaletteLineKernel convert8To16_555;
+	FI_LineKernel convert16_565_To16_555;
+	FI_LineKernel convert24To16_555;
+	FI_LineKernel convert32To16_555;
+	FI_PaletteLineKernel convert8To16_565;
+	FI_LineKernel convert16_555_To16_565;
+	FI_LineKernel convert24To16_565;
+	FI_LineKernel convert32To16_565;
+	FI_PaletteLineKernel convert8To24;
+	FI_LineKernel convert16To24_555;
+	FI_LineKernel convert16To24_565;
+	FI_LineKernel convert32To24;
+	FI_PaletteLineKernel convert8To32;
+	FI_LineKernel convert16To32_555;
+	FI_LineKernel convert16To32_565;
+	FI_LineKernel convert24To32;
+	//! premultiply 32-bit pixels with alpha as FreeImage_PreMultiplyWithAlpha, target may be source
+	FI_LineKernel premultiply32;
+	//! unpremultiply 32-bit pixels as FreeImage_UnPreMultiplyWithAlpha, target may be source
+	FI_LineKernel unpremultiply32;
+	//! premultiply and unpremultiply FIT_RGBAF pixels, target may be source
+	FI_FloatLineKernel premultiplyRGBAF;
+	FI_FloatLineKernel unpremultiplyRGBAF;
+	//! straight alpha 32-bit source pixels over opaque target pixels as FreeImage_Composite :
+	//! target = (alpha * source + (255 - alpha) * target) >> 8 for each channel, 
+	//! target is unchanged for alpha = 0 and replaced by source for alpha = 255
+	FI_LineKernel mix32;
+	//! composition of premultiplied pixels, indexed by FREE_IMAGE_BLEND_MODE
+	FI_CompositeLineKernel composite32[4];
+	FI_FloatCompositeLineKernel compositeRGBAF[4];
+	//! constant alpha blending of FreeImage_Paste
+	FI_BlendLineKernel blend8;
+	//! split and merge of 24-, 32-bit, FIT_RGBA16 (64-bit) and FIT_RGBAF (128-bit) pixels
+	FI_SplitLineKernel split24;
+	FI_SplitLineKernel split32;
+	FI_SplitLineKernel split64;
+	FI_SplitLineKernel split128;
+	FI_MergeLineKernel merge24;
+	FI_MergeLineKernel merge32;
+	FI_MergeLineKernel merge64;
+	FI_MergeLineKernel merge128;
+	//! FIR filter of the separable convolutions
+	FI_ConvolveLineKernel convolve;
+	FI_ShuffleLineKernel shuffle32;
+	FI_FloatMinMaxKernel minmaxFloat;
+	FI_DoubleMinMaxKernel minmaxDouble;
+	//! index of 24-bit pixels in the 33x33x33 histogram of the Wu quantizer, stored as WORD
+	FI_LineKernel wuIndex24;
+	//! index of 32-bit pixels in the 33x33x33 histogram of the Wu quantizer, stored as WORD
+	FI_LineKernel wuIndex32;
+	FI_ThresholdLineKernel threshold8To1;
+	//! RGBF to Yxy as ConvertInPlaceRGBFToYxy, with the RGB to XYZ matrix
+	FI_ColorMatrixLineKernel rgbfToYxy;
+	//! Yxy to RGBF as ConvertInPlaceYxyToRGBF, with the XYZ to RGB matrix
+	FI_ColorMatrixLineKernel yxyToRGBF;
+	//! RGBF to positive Rec. 709 luminance as ConvertRGBFToY
+	FI_FloatLineKernel rgbfToY;
+	//! red-black Gauss-Seidel sweep of the multigrid Poisson solver
+	FI_RelaxationLineKernel relaxation;
+	//! residual of the multigrid Poisson solver
+	FI_ResidualLineKernel residual;
+	//! transposition of 8-, 16-, 24-, 32- and 64-bit pixels
+	FI_TransposeKernel transpose8;
+	FI_TransposeKernel transpose16;
+	FI_TransposeKernel transpose24;
+	FI_TransposeKernel transpose32;
+	FI_TransposeKernel transpose64;
+	//! pixel order reversal of a line, target pixel x is source pixel width_in_pixels - 1 - x, target is not source
+	FI_LineKernel reverse8;
+	FI_LineKernel reverse16;
+	FI_LineKernel reverse24;
+	FI_LineKernel reverse32;
+	FI_LineKernel reverse64;
+	//! affine warp of 8-, 24- and 32-bit pixels with 2 x 2 (bilinear) and 4 x 4 (bicubic) taps
+	FI_WarpLineKernel warpBilinear8;
+	FI_WarpLineKernel warpBilinear24;
+	FI_WarpLineKernel warpBilinear32;
+	FI_WarpLineKernel warpBicubic8;
+	FI_WarpLineKernel warpBicubic24;
+	FI_WarpLineKernel warpBicubic32;
+} FILineKernels;
+
+/**
+Get the line conversion kernels. The table is built once, from GetCPUFeatures().
+*/
+const FILineKernels& GetLineKernels();
+
+#endif // FREEIMAGE_SIMD_H
@@ -0,0 +1,76 @@
+// ==========================================================
+// Shared worker pool and parallel loops
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#ifndef FREEIMAGE_THREADPOOL_H
+#define FREEIMAGE_THREADPOOL_H
+
+#include <functional>
+
+/**
+Minimum number of pixels of an image processed row by row for the rows to be split between threads.
+Below this size, the cost of waking the workers is higher than the gain.
+*/
+#define FI_PARALLEL_MIN_PIXELS	(256 * 256)
+
+/**
+Get the number of threads running parallel tasks, including the calling thread.
+@return Returns the value set by FreeImage_SetThreadCount, or the number of hardware threads
+@see FreeImage_SetThreadCount
+*/
+unsigned GetParallelism();
+
+/**
+Stop the workers of the shared pool, they are started again on the next parallel task.
+Called by FreeImage_DeInitialise.
+*/
+void StopParallelWorkers();
+
+/**
+Run task(0), ..., task(task_count - 1) on the shared worker pool.
+The calling thread runs tasks too, and the function returns when all tasks are done.
+Tasks started from a task run on the calling thread.
+If a task throws, the first exception is rethrown once all tasks are done.
+@param task_count Number of tasks
+@param task Task function, called with the task index
+*/
+void ParallelRun(unsigned task_count, const std::function<void(unsigned)>& task);
+
+/**
+Split [0, count) in contiguous ranges of at least min_count items, and run body(first, last)
+for each range on the shared worker pool.
+Runs body(0, count) on the calling thread when there is not enough work for two ranges.
+@param count Number of items
+@param min_count Minimum number of items of a range
+@param body Loop body, called with a [first, last) range
+*/
+void ParallelFor(unsigned count, unsigned min_count, const std::function<void(unsigned, unsigned)>& body);
+
+/**
+Run body(first, last) over [0, height) row ranges of an image, in parallel when the image
+has at least FI_PARALLEL_MIN_PIXELS pixels. Rows must be independent.
+@param width Image width in pixels
+@param height Image height in pixels
+@param body Loop body, called with a [first, last) row range
+*/
+inline void
+ParallelForRows(unsigned width, unsigned height, const std::function<void(unsigned, unsigned)>& body) {
+	const unsigned min_rows = (width == 0) ? height : (FI_PARALLEL_MIN_PIXELS + width - 1) / width;
+	ParallelFor(height, min_rows, body);
+}
+
+#endif // FREEIMAGE_THREADPOOL_H
@@ -0,0 +1,112 @@
+// ==========================================================
+// sRGB and Rec.709 transfer functions
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#ifndef FREEIMAGE_TRANSFERFUNCTIONS_H
+#define FREEIMAGE_TRANSFERFUNCTIONS_H
+
+#include "FreeImage.h"
+
+#include <vector>
+
+/**
+Transfer function of gamma encoded images, with a linear segment near black :
+encode(v) = slope * v for v <= threshold, scale * pow(v, exponent) - offset otherwise,
+with v the linear light value in [0..1].
+
+The line functions use lookup tables built by the constructor :
+- 8-bit and 16-bit values are decoded with a table of all values,
+- float values are encoded and decoded with interpolated tables,
+- floats are encoded to 8-bit values with a table of the code thresholds, which gives
+the same result as rounding the exact function.
+Values outside of [0..1] are clamped by the integer functions and use the exact
+function in the float functions.
+A line function whose table was not built uses the exact function.
+*/
+class TransferFunction {
+public:
+	/** Lookup tables built by the constructor */
+	enum Tables {
+		ALL_TABLES,		// all the tables
+		FLOAT_ENCODING	// only the float encoding table, used by EncodeLine(float*, ...)
+	};
+
+	/**
+	Build the tables of a transfer function. 
+	Throws std::bad_alloc when the tables cannot be allocated.
+	@param slope Slope of the linear segment
+	@param threshold End of the linear segment, in linear light
+	@param scale Scale of the power segment
+	@param exponent Exponent of the power segment, in the encoding direction
+	@param tables Tables to build, a single table is much cheaper to build for a one-off conversion
+	*/
+	TransferFunction(float slope, float threshold, float scale, float exponent, Tables tables = ALL_TABLES);
+
+	/**
+	Get the IEC 61966-2-1 sRGB transfer function. The tables are built on first use.
+	*/
+	static const TransferFunction& sRGB();
+	/**
+	Get the ITU-R BT.709 transfer function. The tables are built on first use.
+	*/
+	static const TransferFunction& Rec709();
+
+	/** Exact encoding of a linear light value */
+	float Encode(float value) const;
+	/** Exact decoding to a linear light value */
+	float Decode(float value) const;
+
+	/** Decode count 8-bit values to linear light */
+	void DecodeLine(float *target, const BYTE *source, unsigned count) const;
+	/** Decode count 16-bit values to linear light */
+	void DecodeLine(float *target, const WORD *source, unsigned count) const;
+	/** Decode count float values to linear light, target may be source */
+	void DecodeLine(float *target, const float *source, unsigned count) const;
+
+	/** Encode count linear light values to 8-bit values, rounded to nearest */
+	void EncodeLine(BYTE *target, const float *source, unsigned count) const;
+	/** Encode count linear light values to 16-bit values, rounded to nearest (+/- 1) */
+	void EncodeLine(WORD *target, const float *source, unsigned count) const;
+	/** Encode count linear light values, target may be source */
+	void EncodeLine(float *target, const float *source, unsigned count) const;
+
+private:
+	//! number of intervals of the float tables
+	static const int TABLE_SIZE = 4096;
+
+	float _slope;
+	float _threshold;
+	float _scale;
+	float _offset;
+	float _exponent;
+
+	//! decoded 8-bit and 16-bit values
+	std::vector<float> _decode8;
+	std::vector<float> _decode16;
+	//! interpolated float tables, TABLE_SIZE + 2 values
+	std::vector<float> _decode;
+	std::vector<float> _encode;
+	//! 8-bit code of the lower bound of each interval of the encoding table
+	std::vector<BYTE> _encode8;
+	//! _threshold8[k] is the smallest linear value encoded to k or more
+	float _threshold8[257];
+
+	//! exact encoding to a 8-bit value
+	BYTE EncodeByte(float value) const;
+};
+
+#endif // FREEIMAGE_TRANSFERFUNCTIONS_H
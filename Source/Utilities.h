@@ -374,10 +374,11 @@ BOOL ConvertCMYKtoRGBA(FIBITMAP* dib);
 
 /**
 Inplace convert CIELab to RGBA (8- and 16-bit).
+@param exact When FALSE, use tabulated transfer functions (faster, within one level of the exact conversion)
 @return Returns TRUE if successful, returns FALSE otherwise
 @see See definition in Conversion.cpp
 */
-BOOL ConvertLABtoRGB(FIBITMAP* dib);
+BOOL ConvertLABtoRGB(FIBITMAP* dib, BOOL exact = FALSE);
 
 /**
 RGBA to RGB conversion
@@ -385,6 +386,78 @@ RGBA to RGB conversion
 */
 FIBITMAP* RemoveAlphaChannel(FIBITMAP* dib);
 
+/**
+Get the destination image of a conversion. 
+@param target Caller allocated destination image, or NULL
+@param src Source image
+@return Returns target if not NULL, otherwise a new image of the given format with the size and the metadata of src
+@see See definition in Conversion.cpp
+*/
+FIBITMAP* AllocateConversionTarget(FIBITMAP *target, FIBITMAP *src, FREE_IMAGE_TYPE type, int bpp = 8, unsigned red_mask = 0, unsigned green_mask = 0, unsigned blue_mask = 0);
+
+/**
+Conversion of an image to its own format. 
+@return Returns target after copying the pixels and the palette of src into it, or a clone of src if target is NULL
+@see See definition in Conversion.cpp
+*/
+FIBITMAP* CopyConversionSource(FIBITMAP *target, FIBITMAP *src);
+
+/**
+Smart conversion routines, writing into a caller allocated image. 
+When target is NULL, these work as the FreeImage_ConvertToXXX functions. 
+Otherwise, target must have the size of dib and the format of the conversion, and it is returned on success. 
+@see FreeImage_ConvertInto
+*/
+FIBITMAP* ConvertTo4Bits(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertTo8Bits(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToGreyscale(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertTo16Bits555(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertTo16Bits565(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertTo24Bits(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertTo32Bits(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToFloat(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToUINT16(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToRGB16(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToRGBA16(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToRGBF(FIBITMAP *dib, FIBITMAP *target);
+FIBITMAP* ConvertToRGBAF(FIBITMAP *dib, FIBITMAP *target);
+
+/**
+Get the location of the pixels of an image if it had another pixel format, keeping its memory block. 
+@param dib Image with pixels
+@param bpp New bit depth
+@param need_masks TRUE if the new format stores RGB masks (16-bit FIT_BITMAP)
+@param pitch Returned pitch of the new format
+@return Returns NULL if the new format does not fit in the memory block of dib
+@see See definition in BitmapAccess.cpp
+*/
+BYTE* GetPixelFormatBits(FIBITMAP *dib, unsigned bpp, BOOL need_masks, unsigned *pitch);
+
+/**
+Change the pixel format of an image, keeping its memory block, size, resolution and metadata. 
+The pixels must already be stored in the new format, at the location returned by GetPixelFormatBits. 
+The palette, if any, is reset to a greyscale ramp and the transparency settings are cleared. 
+@see See definition in BitmapAccess.cpp
+*/
+void SetPixelFormat(FIBITMAP *dib, FREE_IMAGE_TYPE type, unsigned bpp, unsigned red_mask, unsigned green_mask, unsigned blue_mask);
+
+/**
+Point a header allocated by FreeImage_AllocateHeaderForBits to other user provided pixels, 
+with the same pitch and another height. 
+@see See definition in BitmapAccess.cpp
+*/
+void SetExternalBits(FIBITMAP *dib, BYTE *bits, unsigned height);
+
+/**
+Reverse the order of the pixels of a line : target pixel x is set to source pixel width - 1 - x. 
+@param target Target line, not overlapping source
+@param source Source line
+@param width Number of pixels
+@param bytespp Number of bytes per pixel (1, 2, 3, 4, 6, 8, 12 or 16)
+@see See definition in Flip.cpp
+*/
+void ReversePixels(BYTE *target, const BYTE *source, unsigned width, unsigned bytespp);
+
 /**
 Rotate a dib according to Exif info
 @param dib Input / Output dib to rotate
@@ -0,0 +1,160 @@
+// ==========================================================
+// FreeImage 3 Test Script
+// Microbenchmark of the FreeImage_ConvertLineXXX functions
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+// Usage : benchConvertLine [width] [iterations]
+// Run it with FREEIMAGE_SIMD set to 'none', 'sse2', 'ssse3' or 'avx2' to compare the code paths.
+
+#include "FreeImage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// ----------------------------------------------------------
+
+typedef void (DLL_CALLCONV *LineProc)(BYTE *target, BYTE *source, int width_in_pixels);
+typedef void (DLL_CALLCONV *PaletteLineProc)(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette);
+typedef void (DLL_CALLCONV *TransparencyLineProc)(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette, BYTE *table, int transparent_pixels);
+
+typedef struct tagLineConverter {
+	const char *name;
+	LineProc line;
+	PaletteLineProc palette_line;
+	TransparencyLineProc transparency_line;
+	int src_bpp;
+	int dst_bpp;
+} LineConverter;
+
+#define LINE(name, src_bpp, dst_bpp)			{ #name, FreeImage_ConvertLine##name, NULL, NULL, src_bpp, dst_bpp }
+#define PALETTE_LINE(name, src_bpp, dst_bpp)	{ #name, NULL, FreeImage_ConvertLine##name, NULL, src_bpp, dst_bpp }
+#define TRNS_LINE(name, src_bpp, dst_bpp)		{ #name, NULL, NULL, FreeImage_ConvertLine##name, src_bpp, dst_bpp }
+
+static const LineConverter s_converters[] = {
+	LINE(1To4, 1, 4),
+	PALETTE_LINE(8To4, 8, 4),
+	LINE(16To4_555, 16, 4),
+	LINE(16To4_565, 16, 4),
+	LINE(24To4, 24, 4),
+	LINE(32To4, 32, 4),
+	LINE(1To8, 1, 8),
+	LINE(4To8, 4, 8),
+	LINE(16To8_555, 16, 8),
+	LINE(16To8_565, 16, 8),
+	LINE(24To8, 24, 8),
+	LINE(32To8, 32, 8),
+	PALETTE_LINE(1To16_555, 1, 16),
+	PALETTE_LINE(4To16_555, 4, 16),
+	PALETTE_LINE(8To16_555, 8, 16),
+	LINE(16_565_To16_555, 16, 16),
+	LINE(24To16_555, 24, 16),
+	LINE(32To16_555, 32, 16),
+	PALETTE_LINE(1To16_565, 1, 16),
+	PALETTE_LINE(4To16_565, 4, 16),
+	PALETTE_LINE(8To16_565, 8, 16),
+	LINE(16_555_To16_565, 16, 16),
+	LINE(24To16_565, 24, 16),
+	LINE(32To16_565, 32, 16),
+	PALETTE_LINE(1To24, 1, 24),
+	PALETTE_LINE(4To24, 4, 24),
+	PALETTE_LINE(8To24, 8, 24),
+	LINE(16To24_555, 16, 24),
+	LINE(16To24_565, 16, 24),
+	LINE(32To24, 32, 24),
+	PALETTE_LINE(1To32, 1, 32),
+	TRNS_LINE(1To32MapTransparency, 1, 32),
+	PALETTE_LINE(4To32, 4, 32),
+	TRNS_LINE(4To32MapTransparency, 4, 32),
+	PALETTE_LINE(8To32, 8, 32),
+	TRNS_LINE(8To32MapTransparency, 8, 32),
+	LINE(16To32_555, 16, 32),
+	LINE(16To32_565, 16, 32),
+	LINE(24To32, 24, 32)
+};
+
+// ----------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+	const int width = (argc > 1) ? atoi(argv[1]) : 4096;
+	const int iterations = (argc > 2) ? atoi(argv[2]) : 2000;
+
+	if((width <= 0) || (iterations <= 0)) {
+		printf("Usage : benchConvertLine [width] [iterations]\n");
+		return 1;
+	}
+
+	const char *simd = getenv("FREEIMAGE_SIMD");
+	printf("FreeImage %s, width %d, %d iterations, FREEIMAGE_SIMD=%s\n\n", FreeImage_GetVersion(), width, iterations, simd ? simd : "(default)");
+
+	// pseudo random source line, palette and transparency table
+	const size_t line_size = (size_t)width * 4;
+	BYTE *source = (BYTE*)malloc(line_size);
+	BYTE *target = (BYTE*)malloc(line_size);
+	if(!source || !target) {
+		free(source);
+		free(target);
+		return 1;
+	}
+	unsigned seed = 12345;
+	for(size_t i = 0; i < line_size; i++) {
+		seed = seed * 1103515245 + 12345;
+		source[i] = (BYTE)(seed >> 16);
+	}
+	RGBQUAD palette[256];
+	BYTE table[256];
+	for(int i = 0; i < 256; i++) {
+		palette[i].rgbRed = (BYTE)i;
+		palette[i].rgbGreen = (BYTE)(255 - i);
+		palette[i].rgbBlue = (BYTE)(i * 7);
+		palette[i].rgbReserved = 0;
+		table[i] = (BYTE)(i * 3);
+	}
+
+	printf("%-24s %12s %12s\n", "converter", "ns/line", "Mpixels/s");
+
+	unsigned checksum = 0;
+	for(size_t k = 0; k < sizeof(s_converters) / sizeof(s_converters[0]); k++) {
+		const LineConverter& converter = s_converters[k];
+
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for(int i = 0; i < iterations; i++) {
+			if(converter.line) {
+				converter.line(target, source, width);
+			} else if(converter.palette_line) {
+				converter.palette_line(target, source, width, palette);
+			} else {
+				converter.transparency_line(target, source, width, palette, table, 256);
+			}
+			// keep the conversions from being optimized away
+			checksum += target[i % ((width * converter.dst_bpp + 7) / 8)];
+		}
+		const std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+		const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+		const double ns_per_line = ns / iterations;
+		printf("%-24s %12.0f %12.1f\n", converter.name, ns_per_line, (width * 1000.0) / ns_per_line);
+	}
+
+	printf("\nchecksum %u\n", checksum);
+
+	free(source);
+	free(target);
+
+	return 0;
+}
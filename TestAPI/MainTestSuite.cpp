@@ -74,6 +74,63 @@ int main(int argc, char *argv[]) {
 	// test loading / saving / converting image types using the TIFF plugin
 	testImageTypeTIFF(width, height);
 
+	// test loading / saving the RGBF image type using the HDR plugin
+	testImageTypeHDR(width, height);
+
+	// test the SIMD line conversions
+	testConvertLine();
+
+	// test the fused pixel export
+	testExportPixels(width, height);
+
+	// test the multithreaded conversions
+	testThreadCount(width, height);
+
+	// test the conversions into existing images
+	testConvertInto(width, height);
+
+	// test the conversion of a range to 8-bit
+	testConvertToStandardTypeRange(width, height);
+
+	// test the tabulated CIELab conversion
+	testLabToRGB();
+
+	// test the rescaling in linear light
+	testRescaleLinearLight(width, height);
+
+	// test the quantization of images to a shared palette
+	testColorQuantizeBatch(width, height);
+
+	// test the error diffusion to a palette
+	testDitherToPalette(width, height);
+
+	// test the percentiles of float and uint16 images
+	testGetPercentiles(width, height);
+
+	// test the Poisson solver on a non square image
+	testMultigridPoissonSolver(width, height);
+
+	// test the rotations into an existing image
+	testRotateInto(width, height);
+
+	// test the affine warps
+	testAffineWarp(width, height);
+
+	// test the histograms and statistics
+	testGetHistograms(width, height);
+
+	// test the color mappings
+	testApplyColorMapping(width, height);
+
+	// test the alpha compositing
+	testCompositeInto(width, height);
+
+	// test the channel split and merge
+	testSplitChannels(width, height);
+
+	// test the convolution and blur
+	testConvolve(width, height);
+
 	// test memory IO
 	testMemIO("sample.png");
 	testMemIO("exif.jxr");
@@ -102,6 +159,17 @@ int main(int argc, char *argv[]) {
 	// test thumbnail functions
 	testThumbnail("exif.jpg", 0);
 
+	// test reduced size loading
+	testReducedSize("exif.jpg", 0);
+	testReducedSize("exif.jxr", 0);
+	testReducedSize("tiles.jxr", 0);
+
+	// test the parallel decoding of tiles
+	testTiledJXR("tiles.jxr");
+
+	// test the RAW preview loading
+	testRAWPreview("preview.dng");
+
 	// test wrapped user buffer
 	testWrappedBuffer("exif.jpg", 0);
 
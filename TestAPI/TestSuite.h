@@ -40,6 +40,7 @@
 // Some useful tools
 // ==========================================================
 FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale);
+FIBITMAP* createTestImage(unsigned width, unsigned height, unsigned bpp);
 
 // Test plugins capabilities
 // ==========================================================
@@ -51,6 +52,25 @@ void testAllocateCloneUnload(const char *lpszPathName);
 BOOL testAllocateCloneUnloadType(FREE_IMAGE_TYPE image_type, unsigned width, unsigned height);
 void testImageType(unsigned width, unsigned height);
 void testImageTypeTIFF(unsigned width, unsigned height);
+void testImageTypeHDR(unsigned width, unsigned height);
+void testConvertLine();
+void testExportPixels(unsigned width, unsigned height);
+void testThreadCount(unsigned width, unsigned height);
+void testConvertInto(unsigned width, unsigned height);
+void testConvertToStandardTypeRange(unsigned width, unsigned height);
+void testLabToRGB();
+void testRescaleLinearLight(unsigned width, unsigned height);
+void testColorQuantizeBatch(unsigned width, unsigned height);
+void testDitherToPalette(unsigned width, unsigned height);
+void testGetPercentiles(unsigned width, unsigned height);
+void testMultigridPoissonSolver(unsigned width, unsigned height);
+void testRotateInto(unsigned width, unsigned height);
+void testAffineWarp(unsigned width, unsigned height);
+void testGetHistograms(unsigned width, unsigned height);
+void testApplyColorMapping(unsigned width, unsigned height);
+void testCompositeInto(unsigned width, unsigned height);
+void testSplitChannels(unsigned width, unsigned height);
+void testConvolve(unsigned width, unsigned height);
 
 // Header loading test suite
 // ==========================================================
@@ -86,6 +106,9 @@ void testImageChannels(unsigned width, unsigned height);
 // Thumbnails test suite
 // ==========================================================
 void testThumbnail(const char *lpszPathName, int flags);
+void testReducedSize(const char *lpszPathName, int flags);
+void testTiledJXR(const char *lpszPathName);
+void testRAWPreview(const char *lpszPathName);
 
 // Wrapped buffer test suite
 // ==========================================================
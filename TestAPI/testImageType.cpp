@@ -21,6 +21,7 @@
 
 
 #include "TestSuite.h"
+#include <string.h>
 
 // Local test functions
 // ----------------------------------------------------------
@@ -496,3 +497,1571 @@ void testImageTypeTIFF(unsigned width, unsigned height) {
 	FreeImage_Unload(src);
 
 }
+
+void testImageTypeHDR(unsigned width, unsigned height) {
+	FIBITMAP *src = NULL;
+	FIBITMAP *dst = NULL;
+	BOOL bResult = FALSE;
+
+	printf("testImageTypeHDR ...\n");
+
+	// create a test RGBF image
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	assert(zoneplate != NULL);
+	src = FreeImage_ConvertToType(zoneplate, FIT_RGBF);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+
+	// save as a RLE encoded RGBE image, then reload
+	bResult = FreeImage_Save(FIF_HDR, src, "TestImageType.hdr", HDR_DEFAULT);
+	assert(bResult);
+	dst = FreeImage_Load(FIF_HDR, "TestImageType.hdr", HDR_DEFAULT);
+	assert(dst != NULL);
+	assert(FreeImage_GetImageType(dst) == FIT_RGBF);
+	assert((FreeImage_GetWidth(dst) == width) && (FreeImage_GetHeight(dst) == height));
+
+	// the RGBE mantissa is stored with 8-bit precision
+	for(unsigned y = 0; y < height; y++) {
+		const FIRGBF *src_bits = (FIRGBF*)FreeImage_GetScanLine(src, y);
+		const FIRGBF *dst_bits = (FIRGBF*)FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(fabs(src_bits[x].red - dst_bits[x].red) <= src_bits[x].red / 128);
+			assert(fabs(src_bits[x].green - dst_bits[x].green) <= src_bits[x].green / 128);
+			assert(fabs(src_bits[x].blue - dst_bits[x].blue) <= src_bits[x].blue / 128);
+		}
+	}
+
+	FreeImage_Unload(dst);
+	FreeImage_Unload(src);
+}
+
+typedef void (DLL_CALLCONV *LineConverter)(BYTE *target, BYTE *source, int width_in_pixels);
+typedef void (DLL_CALLCONV *PaletteLineConverter)(BYTE *target, BYTE *source, int width_in_pixels, RGBQUAD *palette);
+
+/**
+Line converter and its source and target sizes in bytes per pixel
+*/
+typedef struct tagLineConversion {
+	LineConverter convert;
+	PaletteLineConverter convert_palette;
+	unsigned source_bytes;
+	unsigned target_bytes;
+} LineConversion;
+
+/**
+Compare the line converters with the scalar code they use for the last pixels of a line : 
+the SIMD kernels convert the blocks of a line, a one pixel line is converted by the scalar code
+*/
+void testConvertLine() {
+	printf("testConvertLine ...\n");
+
+	const LineConversion conversions[] = {
+		{ NULL, FreeImage_ConvertLine8To16_555, 1, 2 },
+		{ NULL, FreeImage_ConvertLine8To16_565, 1, 2 },
+		{ NULL, FreeImage_ConvertLine8To24, 1, 3 },
+		{ NULL, FreeImage_ConvertLine8To32, 1, 4 },
+		{ FreeImage_ConvertLine16To8_555, NULL, 2, 1 },
+		{ FreeImage_ConvertLine16To8_565, NULL, 2, 1 },
+		{ FreeImage_ConvertLine16_565_To16_555, NULL, 2, 2 },
+		{ FreeImage_ConvertLine16_555_To16_565, NULL, 2, 2 },
+		{ FreeImage_ConvertLine16To24_555, NULL, 2, 3 },
+		{ FreeImage_ConvertLine16To24_565, NULL, 2, 3 },
+		{ FreeImage_ConvertLine16To32_555, NULL, 2, 4 },
+		{ FreeImage_ConvertLine16To32_565, NULL, 2, 4 },
+		{ FreeImage_ConvertLine24To8, NULL, 3, 1 },
+		{ FreeImage_ConvertLine24To16_555, NULL, 3, 2 },
+		{ FreeImage_ConvertLine24To16_565, NULL, 3, 2 },
+		{ FreeImage_ConvertLine24To32, NULL, 3, 4 },
+		{ FreeImage_ConvertLine32To8, NULL, 4, 1 },
+		{ FreeImage_ConvertLine32To16_555, NULL, 4, 2 },
+		{ FreeImage_ConvertLine32To16_565, NULL, 4, 2 },
+		{ FreeImage_ConvertLine32To24, NULL, 4, 3 }
+	};
+
+	const int max_width = 259;
+	BYTE source[max_width * 4];
+	BYTE line[max_width * 4];
+	BYTE pixels[max_width * 4];
+	RGBQUAD palette[256];
+
+	srand(31);
+	for(int i = 0; i < max_width * 4; i++) {
+		source[i] = (BYTE)(rand() >> 4);
+	}
+	for(int i = 0; i < 256; i++) {
+		palette[i].rgbRed = (BYTE)(rand() >> 4);
+		palette[i].rgbGreen = (BYTE)(rand() >> 4);
+		palette[i].rgbBlue = (BYTE)(rand() >> 4);
+		palette[i].rgbReserved = (BYTE)(rand() >> 4);
+	}
+
+	for(size_t i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++) {
+		const LineConversion& conversion = conversions[i];
+		for(int width = 1; width <= max_width; width += (width < 70) ? 1 : 63) {
+			const size_t size = width * conversion.target_bytes;
+			memset(line, 0, size);
+			memset(pixels, 0, size);
+			if(conversion.convert) {
+				conversion.convert(line, source, width);
+				for(int x = 0; x < width; x++) {
+					conversion.convert(pixels + x * conversion.target_bytes, source + x * conversion.source_bytes, 1);
+				}
+			} else {
+				conversion.convert_palette(line, source, width, palette);
+				for(int x = 0; x < width; x++) {
+					conversion.convert_palette(pixels + x * conversion.target_bytes, source + x * conversion.source_bytes, 1, palette);
+				}
+			}
+			assert(memcmp(line, pixels, size) == 0);
+		}
+	}
+}
+
+void testExportPixels(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testExportPixels ...\n");
+
+	// create a test 32-bit image with a varying alpha
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = FreeImage_ConvertTo32Bits(zoneplate);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(src, y);
+		for(unsigned x = 0; x < width; x++, bits += 4) {
+			bits[FI_RGBA_ALPHA] = (BYTE)(x + y);
+		}
+	}
+
+	// reference : convert, premultiply and flip, then swizzle
+	FIBITMAP *ref = FreeImage_Clone(src);
+	assert(ref != NULL);
+	bResult = FreeImage_PreMultiplyWithAlpha(ref);
+	assert(bResult);
+	bResult = FreeImage_FlipVertical(ref);
+	assert(bResult);
+
+	// RGBA 8-bit, top-down, premultiplied
+	const unsigned pitch = width * 4;
+	BYTE *pixels = (BYTE*)malloc(pitch * height);
+	assert(pixels != NULL);
+	bResult = FreeImage_ExportPixels(src, pixels, pitch, FIPL_RGBA, FICT_UINT8, FI_EXPORT_TOPDOWN | FI_EXPORT_PREMULTIPLY);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *ref_bits = FreeImage_GetScanLine(ref, y);
+		const BYTE *dst_bits = pixels + y * pitch;
+		for(unsigned x = 0; x < width; x++, ref_bits += 4, dst_bits += 4) {
+			assert(dst_bits[0] == ref_bits[FI_RGBA_RED]);
+			assert(dst_bits[1] == ref_bits[FI_RGBA_GREEN]);
+			assert(dst_bits[2] == ref_bits[FI_RGBA_BLUE]);
+			assert(dst_bits[3] == ref_bits[FI_RGBA_ALPHA]);
+		}
+	}
+	free(pixels);
+
+	// linear float RGBA, the alpha channel is not decoded
+	float *linear = (float*)malloc(width * height * 4 * sizeof(float));
+	assert(linear != NULL);
+	bResult = FreeImage_ExportPixels(src, (BYTE*)linear, width * 4 * sizeof(float), FIPL_RGBA, FICT_FLOAT, FI_EXPORT_LINEAR);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *src_bits = FreeImage_GetScanLine(src, y);
+		const float *dst_bits = linear + y * width * 4;
+		for(unsigned x = 0; x < width; x++, src_bits += 4, dst_bits += 4) {
+			const double value = src_bits[FI_RGBA_RED] / 255.0;
+			const double expected = (value <= 0.04045) ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+			assert(fabs(dst_bits[0] - expected) < 1e-6);
+			assert(fabs(dst_bits[3] - src_bits[FI_RGBA_ALPHA] / 255.0) < 1e-6);
+		}
+	}
+	free(linear);
+
+	// float red channel of a RGBF image
+	FIBITMAP *rgbf = FreeImage_ConvertToRGBF(src);
+	assert(rgbf != NULL);
+	float *red = (float*)malloc(width * height * sizeof(float));
+	assert(red != NULL);
+	bResult = FreeImage_ExportPixels(rgbf, (BYTE*)red, width * sizeof(float), FIPL_R, FICT_FLOAT);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const FIRGBF *src_bits = (FIRGBF*)FreeImage_GetScanLine(rgbf, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(red[y * width + x] == src_bits[x].red);
+		}
+	}
+
+	// a too small pitch is rejected
+	bResult = FreeImage_ExportPixels(rgbf, (BYTE*)red, 1, FIPL_R, FICT_FLOAT);
+	assert(!bResult);
+	// so is a NULL buffer
+	bResult = FreeImage_ExportPixels(rgbf, NULL, width * sizeof(float), FIPL_R, FICT_FLOAT);
+	assert(!bResult);
+	free(red);
+
+	FreeImage_Unload(rgbf);
+	FreeImage_Unload(ref);
+	FreeImage_Unload(src);
+}
+
+/**
+Compare two images of the same size and type, pixel by pixel
+*/
+static BOOL isSameImage(FIBITMAP *dib1, FIBITMAP *dib2) {
+	if((FreeImage_GetImageType(dib1) != FreeImage_GetImageType(dib2)) || (FreeImage_GetBPP(dib1) != FreeImage_GetBPP(dib2))) {
+		return FALSE;
+	}
+	const unsigned height = FreeImage_GetHeight(dib1);
+	const unsigned line = FreeImage_GetLine(dib1);
+	for(unsigned y = 0; y < height; y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), line) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Check that a processing gives the same image with one thread and with several threads
+@param process Function returning a new image, called once for each thread count
+*/
+template<class Process> static void 
+assertThreadIndependent(const Process& process) {
+	FreeImage_SetThreadCount(1);
+	FIBITMAP *serial = process();
+	FreeImage_SetThreadCount(4);
+	FIBITMAP *parallel = process();
+	FreeImage_SetThreadCount(0);
+	assert(serial && parallel);
+	assert(isSameImage(serial, parallel));
+	FreeImage_Unload(serial);
+	FreeImage_Unload(parallel);
+}
+
+void testThreadCount(unsigned width, unsigned height) {
+	printf("testThreadCount ...\n");
+
+	const unsigned thread_count = FreeImage_GetThreadCount();
+	assert(thread_count >= 1);
+
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = FreeImage_ConvertTo32Bits(zoneplate);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+	FIBITMAP *rgbf = FreeImage_ConvertToRGBF(src);
+	assert(rgbf != NULL);
+
+	// conversions must give the same result whatever the number of threads
+	FIBITMAP *serial[10], *parallel[10];
+	for(int pass = 0; pass < 2; pass++) {
+		FreeImage_SetThreadCount(pass == 0 ? 1 : 4);
+		FIBITMAP **dst = (pass == 0) ? serial : parallel;
+		dst[0] = FreeImage_ConvertTo24Bits(src);
+		dst[1] = FreeImage_ConvertToGreyscale(src);
+		dst[2] = FreeImage_ConvertTo16Bits565(src);
+		dst[3] = FreeImage_ConvertToRGBA16(src);
+		dst[4] = FreeImage_ConvertToType(rgbf, FIT_RGBAF);
+		dst[5] = FreeImage_ColorQuantizeEx(src, FIQ_WUQUANT);
+		dst[6] = FreeImage_Dither(src, FID_FS);
+		dst[7] = FreeImage_TmoDrago03(rgbf, 2.2, 0);
+		dst[8] = FreeImage_TmoReinhard05Ex(rgbf, 0, 0, 0.5, 0.5);
+		dst[9] = FreeImage_TmoFattal02(rgbf, 0.5, 0.85);
+	}
+	for(int i = 0; i < 10; i++) {
+		assert(serial[i] && parallel[i]);
+		assert(isSameImage(serial[i], parallel[i]));
+		FreeImage_Unload(serial[i]);
+		FreeImage_Unload(parallel[i]);
+	}
+
+	// restore the default
+	FreeImage_SetThreadCount(0);
+	assert(FreeImage_GetThreadCount() == thread_count);
+
+	FreeImage_Unload(rgbf);
+	FreeImage_Unload(src);
+}
+
+void testConvertInto(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testConvertInto ...\n");
+
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = FreeImage_ConvertTo32Bits(zoneplate);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+
+	// conversion into an existing image
+	FIBITMAP *ref = FreeImage_ConvertTo24Bits(src);
+	assert(ref != NULL);
+	FIBITMAP *dst = FreeImage_Allocate(width, height, 24);
+	assert(dst != NULL);
+	bResult = FreeImage_ConvertInto(dst, src);
+	assert(bResult);
+	assert(isSameImage(ref, dst));
+	FIBITMAP *small = FreeImage_Allocate(width / 2, height, 24);
+	assert(small != NULL);
+	bResult = FreeImage_ConvertInto(small, src);
+	assert(!bResult);
+	FreeImage_Unload(small);
+	FreeImage_Unload(dst);
+
+	// in place conversion
+	FIBITMAP *dib = FreeImage_Clone(src);
+	assert(dib != NULL);
+	bResult = FreeImage_ConvertInPlace(dib, FIT_BITMAP, 24);
+	assert(bResult);
+	assert(isSameImage(ref, dib));
+	bResult = FreeImage_ConvertInPlace(dib, FIT_BITMAP, 32);
+	assert(!bResult);
+	FreeImage_Unload(dib);
+	FreeImage_Unload(ref);
+
+	FIBITMAP *rgbaf = FreeImage_ConvertToRGBAF(src);
+	assert(rgbaf != NULL);
+	ref = FreeImage_ConvertToRGBF(rgbaf);
+	assert(ref != NULL);
+	bResult = FreeImage_ConvertInPlace(rgbaf, FIT_RGBF);
+	assert(bResult);
+	assert(isSameImage(ref, rgbaf));
+	FreeImage_Unload(ref);
+	FreeImage_Unload(rgbaf);
+
+	FreeImage_Unload(src);
+
+	// in place conversions adding a palette, on an image large enough to be converted by several bands
+	zoneplate = createZonePlateImage(2001, 1100, 128);
+	assert(zoneplate != NULL);
+	src = FreeImage_ConvertTo32Bits(zoneplate);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+	FIBITMAP *uint16 = FreeImage_ConvertToType(src, FIT_UINT16);
+	assert(uint16 != NULL);
+	FIBITMAP *sources[2] = { src, uint16 };
+	for(int i = 0; i < 2; i++) {
+		ref = FreeImage_ConvertTo8Bits(sources[i]);
+		assert(ref != NULL);
+		dib = FreeImage_Clone(sources[i]);
+		assert(dib != NULL);
+		bResult = FreeImage_ConvertInPlace(dib, FIT_BITMAP, 8);
+		assert(bResult);
+		assert(isSameImage(ref, dib));
+		assert(FreeImage_GetColorType(dib) == FreeImage_GetColorType(ref));
+		assert(memcmp(FreeImage_GetPalette(dib), FreeImage_GetPalette(ref), 256 * sizeof(RGBQUAD)) == 0);
+		FreeImage_Unload(dib);
+		FreeImage_Unload(ref);
+	}
+	FreeImage_Unload(uint16);
+
+	// in place conversion to a smaller image type
+	FIBITMAP *rgbf = FreeImage_ConvertToRGBF(src);
+	assert(rgbf != NULL);
+	ref = FreeImage_ConvertToType(rgbf, FIT_FLOAT);
+	assert(ref != NULL);
+	bResult = FreeImage_ConvertInPlace(rgbf, FIT_FLOAT);
+	assert(bResult);
+	assert(isSameImage(ref, rgbf));
+	FreeImage_Unload(ref);
+	FreeImage_Unload(rgbf);
+
+	FreeImage_Unload(src);
+}
+
+void testConvertToStandardTypeRange(unsigned width, unsigned height) {
+	printf("testConvertToStandardTypeRange ...\n");
+
+	// horizontal ramp from 0 to 1
+	FIBITMAP *src = FreeImage_AllocateT(FIT_FLOAT, width, height);
+	assert(src != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(src, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = (float)x / (width - 1);
+		}
+	}
+
+	// the image range gives the same result as the min / max scan
+	FIBITMAP *ref = FreeImage_ConvertToStandardType(src, TRUE);
+	assert(ref != NULL);
+	FIBITMAP *dst = FreeImage_ConvertToStandardTypeRange(src, 0, 1);
+	assert(dst != NULL);
+	assert(isSameImage(ref, dst));
+	FreeImage_Unload(dst);
+	FreeImage_Unload(ref);
+
+	// values outside of the range are clipped
+	dst = FreeImage_ConvertToStandardTypeRange(src, 0.25, 0.5);
+	assert(dst != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		const float *src_bits = (float*)FreeImage_GetScanLine(src, y);
+		const BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++) {
+			if(src_bits[x] <= 0.25F) {
+				assert(dst_bits[x] == 0);
+			} else if(src_bits[x] >= 0.5F) {
+				assert(dst_bits[x] == 255);
+			}
+		}
+	}
+	FreeImage_Unload(dst);
+
+	// empty range
+	dst = FreeImage_ConvertToStandardTypeRange(src, 1, 1);
+	assert(dst == NULL);
+
+	FreeImage_Unload(src);
+}
+
+/**
+Build an uncompressed CIELab PSD file holding a grid of Lab values : L takes all values, a and b are sampled every step values
+*/
+static FIMEMORY* createLabPSD(unsigned bpc, unsigned step) {
+	const unsigned levels = (bpc == 8) ? 256 : 65536;
+	const unsigned ab_count = (255 + step) / step;
+	const unsigned width = ab_count * ab_count;
+	const unsigned height = 256;
+	const unsigned bytes = bpc / 8;
+
+	const size_t header_size = 26 + 3 * 4 + 2;
+	const size_t data_size = header_size + (size_t)3 * width * height * bytes;
+	BYTE *data = (BYTE*)calloc(data_size, 1);
+	assert(data != NULL);
+	BYTE *p = data;
+	memcpy(p, "8BPS", 4);
+	p[5] = 1;											// version
+	p[13] = 3;											// channels
+	p[16] = (BYTE)(height >> 8); p[17] = (BYTE)height;	// height
+	p[20] = (BYTE)(width >> 8); p[21] = (BYTE)width;	// width
+	p[23] = (BYTE)bpc;									// depth
+	p[25] = 9;											// Lab color mode
+	// empty color mode data, image resources and layer sections, then uncompressed planes
+	p += header_size;
+	for(unsigned c = 0; c < 3; c++) {
+		for(unsigned y = 0; y < height; y++) {
+			for(unsigned x = 0; x < width; x++) {
+				const unsigned v8 = (c == 0) ? y : (c == 1) ? (x / ab_count) * step : (x % ab_count) * step;
+				const unsigned v = ((v8 > 255) ? 255 : v8) * (levels - 1) / 255;
+				if(bytes == 1) {
+					*p++ = (BYTE)v;
+				} else {
+					*p++ = (BYTE)(v >> 8);
+					*p++ = (BYTE)v;
+				}
+			}
+		}
+	}
+
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(hmem != NULL);
+	FreeImage_WriteMemory(data, 1, (unsigned)data_size, hmem);
+	free(data);
+	FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+	return hmem;
+}
+
+/**
+Compare the tabulated CIELab to RGB conversion of the PSD loader with the exact formulas
+*/
+void testLabToRGB() {
+	printf("testLabToRGB ...\n");
+
+	const unsigned depths[2] = { 8, 16 };
+	for(int i = 0; i < 2; i++) {
+		FIMEMORY *hmem = createLabPSD(depths[i], 3);
+		FIBITMAP *tabulated = FreeImage_LoadFromMemory(FIF_PSD, hmem, 0);
+		FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+		FIBITMAP *exact = FreeImage_LoadFromMemory(FIF_PSD, hmem, PSD_LAB_EXACT);
+		FreeImage_CloseMemory(hmem);
+		assert(tabulated && exact);
+		assert(FreeImage_GetImageType(tabulated) == ((depths[i] == 8) ? FIT_BITMAP : FIT_RGB16));
+		assert(FreeImage_GetBPP(tabulated) == FreeImage_GetBPP(exact));
+
+		// the tabulated conversion is within one level of the exact one
+		const unsigned count = FreeImage_GetWidth(exact) * 3;
+		int max_difference = 0;
+		for(unsigned y = 0; y < FreeImage_GetHeight(exact); y++) {
+			const BYTE *t_bits = FreeImage_GetScanLine(tabulated, y);
+			const BYTE *e_bits = FreeImage_GetScanLine(exact, y);
+			for(unsigned x = 0; x < count; x++) {
+				const int difference = (depths[i] == 8) ? abs(t_bits[x] - e_bits[x]) : abs(((WORD*)t_bits)[x] - ((WORD*)e_bits)[x]);
+				if(difference > max_difference) {
+					max_difference = difference;
+				}
+			}
+		}
+		assert(max_difference <= 1);
+
+		FreeImage_Unload(exact);
+		FreeImage_Unload(tabulated);
+	}
+}
+
+void testRescaleLinearLight(unsigned width, unsigned height) {
+	printf("testRescaleLinearLight ...\n");
+
+	// black and white checkerboard
+	width &= ~1U;
+	height &= ~1U;
+	FIBITMAP *src = FreeImage_Allocate(width, height, 24);
+	assert(src != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(src, y);
+		for(unsigned x = 0; x < width; x++) {
+			const BYTE value = ((x + y) & 1) ? 255 : 0;
+			bits[FI_RGBA_RED] = bits[FI_RGBA_GREEN] = bits[FI_RGBA_BLUE] = value;
+			bits += 3;
+		}
+	}
+
+	// the average of the gamma encoded values is mid grey,
+	// the average of the linear light values is encoded to 188
+	FIBITMAP *dst = FreeImage_RescaleRect(src, width / 2, height / 2, 0, 0, width, height, FILTER_BOX, 0);
+	assert(dst != NULL);
+	BYTE *bits = FreeImage_GetScanLine(dst, height / 4) + 3 * (width / 4);
+	assert((bits[FI_RGBA_GREEN] >= 127) && (bits[FI_RGBA_GREEN] <= 128));
+	FreeImage_Unload(dst);
+
+	dst = FreeImage_RescaleRect(src, width / 2, height / 2, 0, 0, width, height, FILTER_BOX, FI_RESCALE_LINEAR_LIGHT);
+	assert(dst != NULL);
+	assert(FreeImage_GetBPP(dst) == 24);
+	bits = FreeImage_GetScanLine(dst, height / 4) + 3 * (width / 4);
+	assert(bits[FI_RGBA_RED] == 188 && bits[FI_RGBA_GREEN] == 188 && bits[FI_RGBA_BLUE] == 188);
+	FreeImage_Unload(dst);
+
+	FreeImage_Unload(src);
+}
+
+void testColorQuantizeBatch(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testColorQuantizeBatch ...\n");
+
+	FIBITMAP *src[3], *dst[3];
+	for(int i = 0; i < 3; i++) {
+		FIBITMAP *zoneplate = createZonePlateImage(width, height, 64 * (i + 1));
+		assert(zoneplate != NULL);
+		src[i] = (i == 1) ? FreeImage_ConvertTo32Bits(zoneplate) : FreeImage_ConvertTo24Bits(zoneplate);
+		assert(src[i] != NULL);
+		FreeImage_Unload(zoneplate);
+	}
+
+	// all images share the same palette
+	const FREE_IMAGE_QUANTIZE quantizers[2] = { FIQ_WUQUANT, FIQ_NNQUANT };
+	for(int q = 0; q < 2; q++) {
+		bResult = FreeImage_ColorQuantizeBatch(src, dst, 3, quantizers[q], 64);
+		assert(bResult);
+		for(int i = 0; i < 3; i++) {
+			assert(dst[i] != NULL);
+			assert(FreeImage_GetBPP(dst[i]) == 8);
+			assert(memcmp(FreeImage_GetPalette(dst[i]), FreeImage_GetPalette(dst[0]), 64 * sizeof(RGBQUAD)) == 0);
+		}
+		for(int i = 0; i < 3; i++) {
+			FreeImage_Unload(dst[i]);
+		}
+	}
+
+	// a single image gives the same result as FreeImage_ColorQuantizeEx
+	FIBITMAP *ref = FreeImage_ColorQuantizeEx(src[0], FIQ_WUQUANT);
+	assert(ref != NULL);
+	bResult = FreeImage_ColorQuantizeBatch(src, dst, 1, FIQ_WUQUANT);
+	assert(bResult);
+	assert(isSameImage(ref, dst[0]));
+	FreeImage_Unload(dst[0]);
+	FreeImage_Unload(ref);
+
+	// the zone plates have more than 2 colors
+	bResult = FreeImage_ColorQuantizeBatch(src, dst, 3, FIQ_LFPQUANT, 2);
+	assert(!bResult);
+	assert(dst[0] == NULL && dst[1] == NULL && dst[2] == NULL);
+
+	for(int i = 0; i < 3; i++) {
+		FreeImage_Unload(src[i]);
+	}
+
+	// the moments of many frames exceed 32 bits : 200 frames of 320x240 pixels, 
+	// the top 3/4 in a bright color and the rest in a dark color
+	const int frame_count = 200;
+	const RGBQUAD colors[2] = { { 30, 20, 10, 0 }, { 150, 200, 250, 0 } };
+	FIBITMAP *frame = FreeImage_Allocate(320, 240, 24);
+	assert(frame != NULL);
+	for(unsigned y = 0; y < 240; y++) {
+		BYTE *bits = FreeImage_GetScanLine(frame, y);
+		const RGBQUAD& color = colors[(y < 60) ? 0 : 1];
+		for(unsigned x = 0; x < 320; x++, bits += 3) {
+			bits[FI_RGBA_BLUE] = color.rgbBlue;
+			bits[FI_RGBA_GREEN] = color.rgbGreen;
+			bits[FI_RGBA_RED] = color.rgbRed;
+		}
+	}
+	FIBITMAP *frames[frame_count], *quantized[frame_count];
+	for(int i = 0; i < frame_count; i++) {
+		frames[i] = frame;
+	}
+	bResult = FreeImage_ColorQuantizeBatch(frames, quantized, frame_count, FIQ_WUQUANT, 16);
+	assert(bResult);
+	for(int i = 0; i < frame_count; i++) {
+		// both colors are in the palette
+		const RGBQUAD *palette = FreeImage_GetPalette(quantized[i]);
+		for(unsigned y = 0; y < 240; y += 59) {
+			const RGBQUAD& expected = colors[(y < 60) ? 0 : 1];
+			const RGBQUAD& color = palette[FreeImage_GetScanLine(quantized[i], y)[0]];
+			assert(color.rgbRed == expected.rgbRed && color.rgbGreen == expected.rgbGreen && color.rgbBlue == expected.rgbBlue);
+		}
+		FreeImage_Unload(quantized[i]);
+	}
+	FreeImage_Unload(frame);
+}
+
+void testDitherToPalette(unsigned width, unsigned height) {
+	printf("testDitherToPalette ...\n");
+
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = FreeImage_ConvertTo24Bits(zoneplate);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+
+	// 8 colors palette
+	RGBQUAD palette[8];
+	for(int i = 0; i < 8; i++) {
+		palette[i].rgbRed = (i & 1) ? 255 : 0;
+		palette[i].rgbGreen = (i & 2) ? 255 : 0;
+		palette[i].rgbBlue = (i & 4) ? 255 : 0;
+		palette[i].rgbReserved = 0;
+	}
+
+	// the result must be the same whatever the number of threads
+	FreeImage_SetThreadCount(1);
+	FIBITMAP *serial = FreeImage_DitherToPalette(src, palette, 8);
+	FreeImage_SetThreadCount(4);
+	FIBITMAP *parallel = FreeImage_DitherToPalette(src, palette, 8);
+	FreeImage_SetThreadCount(0);
+	assert(serial && parallel);
+	assert(isSameImage(serial, parallel));
+
+	// only the palette entries are used
+	assert(FreeImage_GetBPP(serial) == 8);
+	assert(memcmp(FreeImage_GetPalette(serial), palette, sizeof(palette)) == 0);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *bits = FreeImage_GetScanLine(serial, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(bits[x] < 8);
+		}
+	}
+
+	FreeImage_Unload(serial);
+	FreeImage_Unload(parallel);
+
+	// only 24-bit and 32-bit images are supported
+	FIBITMAP *grey = FreeImage_ConvertToGreyscale(src);
+	assert(grey != NULL);
+	assert(FreeImage_DitherToPalette(grey, palette, 8) == NULL);
+	FreeImage_Unload(grey);
+
+	FreeImage_Unload(src);
+}
+
+void testGetPercentiles(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testGetPercentiles ...\n");
+
+	// float image holding the values 0 .. n - 1, in scrambled order
+	const unsigned n = width * height;
+	FIBITMAP *dib = FreeImage_AllocateT(FIT_FLOAT, width, height);
+	assert(dib != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = (float)(((y * width + x) * 7919ULL) % n);
+		}
+	}
+
+	const double percentiles[4] = { 0, 0.25, 0.5, 1 };
+	double values[4];
+	bResult = FreeImage_GetPercentiles(dib, percentiles, values, 4);
+	assert(bResult);
+	assert(values[0] == 0);
+	assert(values[1] == floor(0.25 * n));
+	assert(values[2] == floor(0.5 * n));
+	assert(values[3] == n - 1);
+
+	// negative and positive values (n / 2 - i) / 4, with more percentiles 
+	// than the bins processed in a single pass
+	for(unsigned y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = (float)((double)(n / 2) - (double)(((y * width + x) * 7919ULL) % n)) / 4;
+		}
+	}
+	const double signed_percentiles[7] = { 0, 0.1, 0.25, 0.5, 0.75, 0.9, 1 };
+	double signed_values[7];
+	bResult = FreeImage_GetPercentiles(dib, signed_percentiles, signed_values, 7);
+	assert(bResult);
+	for(int k = 0; k < 7; k++) {
+		const double rank = (signed_percentiles[k] < 1) ? floor(signed_percentiles[k] * n) : n - 1;
+		assert(signed_values[k] == ((double)(n / 2) - (n - 1 - rank)) / 4);
+	}
+	assert(signed_values[0] < 0 && signed_values[6] > 0);
+	FreeImage_Unload(dib);
+
+	// uint16 image, with one pixel out of four set to 1000
+	dib = FreeImage_AllocateT(FIT_UINT16, width, height);
+	assert(dib != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		WORD *bits = (WORD*)FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = ((x & 1) && (y & 1)) ? 1000 : 10;
+		}
+	}
+	bResult = FreeImage_GetPercentiles(dib, percentiles, values, 4);
+	assert(bResult);
+	assert((values[0] == 10) && (values[2] == 10) && (values[3] == 1000));
+	FreeImage_Unload(dib);
+
+	// unsupported image type
+	dib = FreeImage_Allocate(width, height, 8);
+	assert(dib != NULL);
+	bResult = FreeImage_GetPercentiles(dib, percentiles, values, 4);
+	assert(!bResult);
+	FreeImage_Unload(dib);
+}
+
+void testMultigridPoissonSolver(unsigned width, unsigned height) {
+	printf("testMultigridPoissonSolver ...\n");
+
+	// non square Laplacian image
+	height = height / 3;
+	FIBITMAP *laplacian = FreeImage_AllocateT(FIT_FLOAT, width, height);
+	assert(laplacian != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(laplacian, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = (float)(sin(x * 0.05) * cos(y * 0.07));
+		}
+	}
+
+	// the solution must not depend on the number of threads
+	FIBITMAP *solution[2];
+	for(int pass = 0; pass < 2; pass++) {
+		FreeImage_SetThreadCount(pass == 0 ? 1 : 4);
+		solution[pass] = FreeImage_MultigridPoissonSolver(laplacian, 3);
+		assert(solution[pass] != NULL);
+	}
+	FreeImage_SetThreadCount(0);
+	assert(isSameImage(solution[0], solution[1]));
+
+	// the solution has the size of the Laplacian and is remapped to [0..1]
+	assert(FreeImage_GetWidth(solution[0]) == width);
+	assert(FreeImage_GetHeight(solution[0]) == height);
+	float min_value = 1, max_value = 0;
+	for(unsigned y = 0; y < height; y++) {
+		const float *bits = (float*)FreeImage_GetScanLine(solution[0], y);
+		for(unsigned x = 0; x < width; x++) {
+			min_value = (bits[x] < min_value) ? bits[x] : min_value;
+			max_value = (bits[x] > max_value) ? bits[x] : max_value;
+		}
+	}
+	assert((min_value >= 0) && (min_value < 0.001F));
+	assert((max_value <= 1) && (max_value > 0.999F));
+
+	// the discrete Laplacian of the solution matches the input, up to the scale of the remapping : 
+	// fit the scale over the inner pixels, then check the residual
+	double lf = 0, ff = 0, ll = 0;
+	for(unsigned y = 1; y < height - 1; y++) {
+		const float *up = (float*)FreeImage_GetScanLine(solution[0], y + 1);
+		const float *center = (float*)FreeImage_GetScanLine(solution[0], y);
+		const float *down = (float*)FreeImage_GetScanLine(solution[0], y - 1);
+		const float *f = (float*)FreeImage_GetScanLine(laplacian, y);
+		for(unsigned x = 1; x < width - 1; x++) {
+			const double l = (double)up[x] + down[x] + center[x - 1] + center[x + 1] - 4.0 * center[x];
+			lf += l * f[x];
+			ff += (double)f[x] * f[x];
+			ll += l * l;
+		}
+	}
+	const double scale = lf / ff;
+	assert(scale > 0);
+	// norm of (l - scale * f), relative to the norm of scale * f
+	const double residual = sqrt((ll - 2 * scale * lf + scale * scale * ff) / (scale * scale * ff));
+	assert(residual < 1e-3);
+
+	FreeImage_Unload(solution[0]);
+	FreeImage_Unload(solution[1]);
+	FreeImage_Unload(laplacian);
+}
+
+void testRotateInto(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testRotateInto ...\n");
+
+	// non square image, with a width not multiple of the SIMD blocks
+	const unsigned bpps[3] = { 8, 24, 32 };
+	for(int i = 0; i < 3; i++) {
+		FIBITMAP *src = createTestImage(width + 3, height / 2, bpps[i]);
+		assert(src != NULL);
+		const unsigned src_width = FreeImage_GetWidth(src);
+		const unsigned src_height = FreeImage_GetHeight(src);
+
+		// rotations into an existing image give the result of FreeImage_Rotate
+		for(int angle = -90; angle <= 270; angle += 90) {
+			const BOOL swap = (angle % 180) != 0;
+			FIBITMAP *ref = FreeImage_Rotate(src, angle);
+			assert(ref != NULL);
+			FIBITMAP *dst = FreeImage_Allocate(swap ? src_height : src_width, swap ? src_width : src_height, bpps[i]);
+			assert(dst != NULL);
+			bResult = FreeImage_RotateInto(dst, src, angle);
+			assert(bResult);
+			assert(isSameImage(ref, dst));
+			FreeImage_Unload(dst);
+			FreeImage_Unload(ref);
+		}
+
+		// the size of the target must be the size of the rotated image
+		FIBITMAP *dst = FreeImage_Allocate(src_width, src_height, bpps[i]);
+		assert(dst != NULL);
+		bResult = FreeImage_RotateInto(dst, src, 90);
+		assert(!bResult);
+		bResult = FreeImage_RotateInto(dst, src, 45);
+		assert(!bResult);
+		FreeImage_Unload(dst);
+
+		// two horizontal flips give the original image
+		dst = FreeImage_Clone(src);
+		assert(dst != NULL);
+		bResult = FreeImage_FlipHorizontal(dst);
+		assert(bResult);
+		bResult = FreeImage_FlipHorizontal(dst);
+		assert(bResult);
+		assert(isSameImage(src, dst));
+		FreeImage_Unload(dst);
+
+		FreeImage_Unload(src);
+	}
+}
+
+void testAffineWarp(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testAffineWarp ...\n");
+
+	const unsigned bpps[3] = { 8, 24, 32 };
+	for(int i = 0; i < 3; i++) {
+		FIBITMAP *src = createTestImage(width, height, bpps[i]);
+		assert(src != NULL);
+		const unsigned bytespp = bpps[i] / 8;
+
+		// the identity gives the source image, with any filter
+		const double identity[6] = { 1, 0, 0, 0, 1, 0 };
+		FIBITMAP *dst = FreeImage_AffineWarp(src, identity, width, height, FILTER_CATMULLROM);
+		assert(dst != NULL);
+		assert(isSameImage(src, dst));
+		FreeImage_Unload(dst);
+
+		// a translation by whole pixels moves the pixels, and fills the uncovered pixels with the background color
+		const int dx = 5;
+		const int dy = 3;
+		const double translation[6] = { 1, 0, dx, 0, 1, dy };
+		const BYTE bkcolor[4] = { 10, 20, 30, 40 };
+		dst = FreeImage_AffineWarp(src, translation, width, height, FILTER_BILINEAR, bkcolor);
+		assert(dst != NULL);
+		for(unsigned y = 0; y < height; y++) {
+			// rows are stored bottom up
+			const BYTE *dst_bits = FreeImage_GetScanLine(dst, height - 1 - y);
+			for(unsigned x = 0; x < width; x++) {
+				if((x < (unsigned)dx) || (y < (unsigned)dy)) {
+					assert(memcmp(dst_bits + x * bytespp, bkcolor, bytespp) == 0);
+				} else {
+					const BYTE *src_bits = FreeImage_GetScanLine(src, height - 1 - (y - dy));
+					assert(memcmp(dst_bits + x * bytespp, src_bits + (x - dx) * bytespp, bytespp) == 0);
+				}
+			}
+		}
+		FreeImage_Unload(dst);
+
+		// a rotation gives the same result whatever the number of threads
+		const double angle = 0.1;
+		const double cx = width / 2.0;
+		const double cy = height / 2.0;
+		const double rotation[6] = { 
+			cos(angle), sin(angle), cx - cos(angle) * cx - sin(angle) * cy, 
+			-sin(angle), cos(angle), cy + sin(angle) * cx - cos(angle) * cy };
+		for(int filter = FILTER_BICUBIC; filter <= FILTER_CATMULLROM; filter++) {
+			assertThreadIndependent([&]() {
+				return FreeImage_AffineWarp(src, rotation, width + 7, height - 5, (FREE_IMAGE_FILTER)filter, bkcolor);
+			});
+		}
+
+		// singular matrices, unsupported filters and different image types are rejected
+		const double singular[6] = { 1, 2, 0, 2, 4, 0 };
+		dst = FreeImage_AffineWarp(src, singular, width, height);
+		assert(dst == NULL);
+		dst = FreeImage_AffineWarp(src, rotation, width, height, FILTER_LANCZOS3);
+		assert(dst == NULL);
+		dst = FreeImage_Allocate(width, height, (bpps[i] == 8) ? 24 : 8);
+		assert(dst != NULL);
+		bResult = FreeImage_AffineWarpInto(dst, src, rotation);
+		assert(!bResult);
+		FreeImage_Unload(dst);
+
+		FreeImage_Unload(src);
+	}
+
+	// float images
+	FIBITMAP *zoneplate = createTestImage(width, height, 8);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = FreeImage_ConvertToType(zoneplate, FIT_FLOAT);
+	assert(src != NULL);
+	FreeImage_Unload(zoneplate);
+	const double identity[6] = { 1, 0, 0, 0, 1, 0 };
+	FIBITMAP *dst = FreeImage_AffineWarp(src, identity, width, height, FILTER_CATMULLROM);
+	assert(dst != NULL);
+	assert(isSameImage(src, dst));
+	FreeImage_Unload(dst);
+	FreeImage_Unload(src);
+}
+
+void testGetHistograms(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testGetHistograms ...\n");
+
+	// a 24-bit image with different channels
+	FIBITMAP *src = createTestImage(width, height, 24);
+	assert(src != NULL);
+
+	// one pass gives the histograms of FreeImage_GetHistogram, whatever the number of threads
+	const FREE_IMAGE_COLOR_CHANNEL channels[4] = { FICC_RED, FICC_GREEN, FICC_BLUE, FICC_BLACK };
+	assertThreadIndependent([&]() {
+		// one histogram per row
+		FIBITMAP *dib = FreeImage_AllocateT(FIT_UINT32, 256, 4);
+		assert(dib != NULL);
+		DWORD *dib_ptr[4];
+		for(int c = 0; c < 4; c++) {
+			dib_ptr[c] = (DWORD*)FreeImage_GetScanLine(dib, c);
+		}
+		bResult = FreeImage_GetHistograms(src, dib_ptr, channels, 4);
+		assert(bResult);
+		return dib;
+	});
+	DWORD histograms[4][256];
+	DWORD *histograms_ptr[4] = { histograms[0], histograms[1], histograms[2], histograms[3] };
+	bResult = FreeImage_GetHistograms(src, histograms_ptr, channels, 4);
+	assert(bResult);
+	for(int c = 0; c < 4; c++) {
+		DWORD histo[256];
+		bResult = FreeImage_GetHistogram(src, histo, channels[c]);
+		assert(bResult);
+		assert(memcmp(histo, histograms[c], sizeof(histo)) == 0);
+	}
+	// no alpha channel in a 24-bit image
+	const FREE_IMAGE_COLOR_CHANNEL alpha = FICC_ALPHA;
+	bResult = FreeImage_GetHistograms(src, histograms_ptr, &alpha, 1);
+	assert(!bResult);
+
+	// statistics, in R, G, B order
+	double min_value[4], max_value[4], mean[4], stddev[4];
+	int channel_count = FreeImage_GetStatistics(src, min_value, max_value, mean, stddev);
+	assert(channel_count == 3);
+	for(int c = 0; c < 3; c++) {
+		// statistics of the histogram
+		double sum = 0, sum2 = 0, count = 0;
+		int first = -1, last = -1;
+		for(int k = 0; k < 256; k++) {
+			if(histograms[c][k]) {
+				if(first < 0) first = k;
+				last = k;
+			}
+			count += histograms[c][k];
+			sum += (double)k * histograms[c][k];
+			sum2 += (double)k * k * histograms[c][k];
+		}
+		const double expected_mean = sum / count;
+		const double expected_stddev = sqrt(sum2 / count - expected_mean * expected_mean);
+		assert((min_value[c] == first) && (max_value[c] == last));
+		assert(fabs(mean[c] - expected_mean) < 1e-9);
+		assert(fabs(stddev[c] - expected_stddev) < 1e-6);
+	}
+
+	// float images give the statistics of the converted values
+	FIBITMAP *rgbf = FreeImage_ConvertToRGBF(src);
+	assert(rgbf != NULL);
+	double float_mean[3];
+	channel_count = FreeImage_GetStatistics(rgbf, NULL, NULL, float_mean, NULL);
+	assert(channel_count == 3);
+	for(int c = 0; c < 3; c++) {
+		assert(fabs(float_mean[c] - mean[c] / 255) < 1e-5);
+	}
+	FreeImage_Unload(rgbf);
+
+	FreeImage_Unload(src);
+}
+
+/**
+RGB565 value of a color
+*/
+static WORD colorTo565(const RGBQUAD& color) {
+	return (WORD)(((color.rgbBlue >> 3) << FI16_565_BLUE_SHIFT) | ((color.rgbGreen >> 2) << FI16_565_GREEN_SHIFT) | ((color.rgbRed >> 3) << FI16_565_RED_SHIFT));
+}
+
+void testApplyColorMapping(unsigned width, unsigned height) {
+	printf("testApplyColorMapping ...\n");
+
+	// 40 colors, mapped to each other : 32 RGB values, the first 8 of them with 2 alpha values
+	const unsigned max_count = 40;
+	RGBQUAD srccolors[max_count];
+	RGBQUAD dstcolors[max_count];
+	for(unsigned j = 0; j < max_count; j++) {
+		srccolors[j].rgbRed = (BYTE)((j & 3) * 85);
+		srccolors[j].rgbGreen = (BYTE)(((j >> 2) & 3) * 85);
+		srccolors[j].rgbBlue = (BYTE)(((j >> 4) & 1) * 255);
+		srccolors[j].rgbReserved = (BYTE)((j & 32) ? 0 : 255);
+		dstcolors[j] = srccolors[(j * 7 + 3) % max_count];
+	}
+
+	// 32-bit image, converted to 24-bit and RGB565
+	FIBITMAP *src32 = FreeImage_Allocate(width, height, 32);
+	assert(src32 != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		RGBQUAD *bits = (RGBQUAD*)FreeImage_GetScanLine(src32, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = srccolors[(x + 3 * y) % max_count];
+			bits[x].rgbBlue ^= (BYTE)(x & 1);
+		}
+	}
+
+	// a few colors are compared with each color, more colors use a table : 
+	// a direct table for 16-bit images, a hash table for 24-bit and 32-bit images
+	const unsigned counts[2] = { 2, max_count };
+	const unsigned bpps[3] = { 16, 24, 32 };
+	for(int i = 0; i < 3; i++) {
+		const unsigned bpp = bpps[i];
+		const unsigned bytespp = bpp / 8;
+		for(int c = 0; c < 2; c++) {
+			const unsigned count = counts[c];
+			for(int swap = 0; swap < 2; swap++) {
+				for(int ignore_alpha = 0; ignore_alpha < 2; ignore_alpha++) {
+					FIBITMAP *src = (bpp == 16) ? FreeImage_ConvertTo16Bits565(src32) : (bpp == 24) ? FreeImage_ConvertTo24Bits(src32) : FreeImage_Clone(src32);
+					assert(src != NULL);
+
+					// same result as comparing each pixel with each color, in order
+					FIBITMAP *expected = FreeImage_Clone(src);
+					assert(expected != NULL);
+					unsigned expected_changed = 0;
+					for(unsigned y = 0; y < height; y++) {
+						BYTE *bits = FreeImage_GetScanLine(expected, y);
+						for(unsigned x = 0; x < width; x++, bits += bytespp) {
+							for(unsigned k = 0; k < (swap ? 2 * count : count); k++) {
+								const RGBQUAD& a = swap ? ((k & 1) ? dstcolors[k / 2] : srccolors[k / 2]) : srccolors[k];
+								const RGBQUAD& b = swap ? ((k & 1) ? srccolors[k / 2] : dstcolors[k / 2]) : dstcolors[k];
+								if(bpp == 16) {
+									if(*(WORD*)bits == colorTo565(a)) {
+										*(WORD*)bits = colorTo565(b);
+										expected_changed++;
+										break;
+									}
+								} else if((bits[FI_RGBA_RED] == a.rgbRed) && (bits[FI_RGBA_GREEN] == a.rgbGreen) && (bits[FI_RGBA_BLUE] == a.rgbBlue) 
+									&& ((bpp == 24) || ignore_alpha || (bits[FI_RGBA_ALPHA] == a.rgbReserved))) {
+									// alpha is compared and mapped on 32-bit images only
+									bits[FI_RGBA_RED] = b.rgbRed;
+									bits[FI_RGBA_GREEN] = b.rgbGreen;
+									bits[FI_RGBA_BLUE] = b.rgbBlue;
+									if((bpp == 32) && !ignore_alpha) {
+										bits[FI_RGBA_ALPHA] = b.rgbReserved;
+									}
+									expected_changed++;
+									break;
+								}
+							}
+						}
+					}
+					assert(expected_changed > 0);
+
+					// whatever the number of threads
+					assertThreadIndependent([&]() {
+						FIBITMAP *dib = FreeImage_Clone(src);
+						assert(dib != NULL);
+						const unsigned changed = FreeImage_ApplyColorMapping(dib, srccolors, dstcolors, count, ignore_alpha, swap);
+						assert(changed == expected_changed);
+						return dib;
+					});
+					const unsigned changed = FreeImage_ApplyColorMapping(src, srccolors, dstcolors, count, ignore_alpha, swap);
+					assert(changed == expected_changed);
+					assert(isSameImage(src, expected));
+
+					FreeImage_Unload(expected);
+					FreeImage_Unload(src);
+				}
+			}
+		}
+	}
+
+	FreeImage_Unload(src32);
+}
+
+void testCompositeInto(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testCompositeInto ...\n");
+
+	// a 32-bit image with varying alpha
+	FIBITMAP *src = createTestImage(width, height, 32);
+	assert(src != NULL);
+
+	// unpremultiplying gives back the colors, within rounding errors
+	FIBITMAP *premultiplied = FreeImage_Clone(src);
+	assert(premultiplied != NULL);
+	bResult = FreeImage_PreMultiplyWithAlpha(premultiplied);
+	assert(bResult);
+	FIBITMAP *dib = FreeImage_Clone(premultiplied);
+	assert(dib != NULL);
+	bResult = FreeImage_UnPreMultiplyWithAlpha(dib);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *src_bits = FreeImage_GetScanLine(src, y);
+		const BYTE *dst_bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < 4 * width; x++) {
+			if(src_bits[(x & ~3) + FI_RGBA_ALPHA] >= 128) {
+				assert(abs(src_bits[x] - dst_bits[x]) <= 2);
+			}
+		}
+	}
+	FreeImage_Unload(dib);
+
+	// source over an opaque 24-bit image
+	FIBITMAP *background = FreeImage_Allocate(width + 10, height + 10, 24);
+	assert(background != NULL);
+	const RGBQUAD color = { 40, 80, 120, 255 };
+	bResult = FreeImage_FillBackground(background, &color);
+	assert(bResult);
+	assertThreadIndependent([&]() {
+		FIBITMAP *dst = FreeImage_Clone(background);
+		assert(dst != NULL);
+		bResult = FreeImage_CompositeInto(dst, premultiplied, 5, -3, FIBM_OVER, 200);
+		assert(bResult);
+		return dst;
+	});
+	dib = FreeImage_Clone(background);
+	assert(dib != NULL);
+	bResult = FreeImage_CompositeInto(dib, premultiplied, 5, -3, FIBM_OVER, 200);
+	assert(bResult);
+	const unsigned bkc[3] = { color.rgbRed, color.rgbGreen, color.rgbBlue };
+	const unsigned channel[3] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE };
+	for(unsigned y = 0; y < height + 10; y++) {
+		// rows are stored bottom up
+		const BYTE *dst_bits = FreeImage_GetScanLine(dib, height + 9 - y);
+		for(unsigned x = 0; x < width + 10; x++) {
+			for(int c = 0; c < 3; c++) {
+				double expected = bkc[c];
+				if((x >= 5) && (x < width + 5) && (y + 3 < height)) {
+					// straight alpha equation on the source pixel
+					const BYTE *src_bits = FreeImage_GetScanLine(src, height - 1 - (y + 3)) + 4 * (x - 5);
+					const double alpha = src_bits[FI_RGBA_ALPHA] / 255.0 * 200 / 255;
+					expected = alpha * src_bits[channel[c]] + (1 - alpha) * bkc[c];
+				}
+				assert(fabs(dst_bits[3 * x + channel[c]] - expected) <= 2);
+			}
+		}
+	}
+	FreeImage_Unload(dib);
+
+	// an opaque source replaces the destination in over mode, a zero opacity keeps it
+	dib = FreeImage_ConvertTo32Bits(background);
+	assert(dib != NULL);
+	bResult = FreeImage_CompositeInto(dib, premultiplied, 0, 0, FIBM_SCREEN, 0);
+	assert(bResult);
+	FIBITMAP *opaque = FreeImage_ConvertTo32Bits(background);
+	assert(opaque != NULL);
+	assert(isSameImage(dib, opaque));
+	bResult = FreeImage_CompositeInto(dib, opaque, 0, 0, FIBM_OVER);
+	assert(bResult);
+	assert(isSameImage(dib, opaque));
+	FreeImage_Unload(dib);
+
+	// FreeImage_Composite over a background image : (alpha * fg + (255 - alpha) * bg) >> 8, 
+	// the background for alpha = 0 and the foreground for alpha = 255. 
+	// The width leaves pixels to the scalar code
+	FIBITMAP *fg = createTestImage(width + 3, height, 32);
+	FIBITMAP *bg = createTestImage(width + 3, height, 24);
+	assert(fg && bg);
+	bResult = FreeImage_FlipHorizontal(bg);
+	assert(bResult);
+	dib = FreeImage_Composite(fg, FALSE, NULL, bg);
+	assert(dib != NULL);
+	assert(FreeImage_GetBPP(dib) == 24);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
+		const BYTE *bg_bits = FreeImage_GetScanLine(bg, y);
+		const BYTE *dst_bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < width + 3; x++) {
+			const unsigned alpha = fg_bits[4 * x + FI_RGBA_ALPHA];
+			for(int c = 0; c < 3; c++) {
+				const unsigned f = fg_bits[4 * x + channel[c]];
+				const unsigned b = bg_bits[3 * x + channel[c]];
+				const unsigned expected = (alpha == 0) ? b : (alpha == 255) ? f : (alpha * f + (255 - alpha) * b) >> 8;
+				assert(dst_bits[3 * x + channel[c]] == expected);
+			}
+		}
+	}
+	FreeImage_Unload(dib);
+	FreeImage_Unload(bg);
+	FreeImage_Unload(fg);
+
+	// FIT_RGBA16 images : the premultiplication is rounded to nearest
+	FIBITMAP *src16 = FreeImage_ConvertToType(src, FIT_RGBA16);
+	assert(src16 != NULL);
+	FIBITMAP *premultiplied16 = FreeImage_Clone(src16);
+	assert(premultiplied16 != NULL);
+	bResult = FreeImage_PreMultiplyWithAlpha(premultiplied16);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const FIRGBA16 *src_bits = (FIRGBA16*)FreeImage_GetScanLine(src16, y);
+		const FIRGBA16 *bits = (FIRGBA16*)FreeImage_GetScanLine(premultiplied16, y);
+		for(unsigned x = 0; x < width; x++) {
+			const unsigned alpha = src_bits[x].alpha;
+			assert(bits[x].alpha == alpha);
+			assert(bits[x].red == (alpha * src_bits[x].red + 32767) / 65535);
+			assert(bits[x].green == (alpha * src_bits[x].green + 32767) / 65535);
+			assert(bits[x].blue == (alpha * src_bits[x].blue + 32767) / 65535);
+		}
+	}
+	// unpremultiplying gives back the colors, within rounding errors
+	dib = FreeImage_Clone(premultiplied16);
+	assert(dib != NULL);
+	bResult = FreeImage_UnPreMultiplyWithAlpha(dib);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src16, y);
+		const WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < 4 * width; x++) {
+			if(src_bits[(x & ~3) + 3] >= 32768) {
+				assert(abs(src_bits[x] - dst_bits[x]) <= 2);
+			}
+		}
+	}
+	FreeImage_Unload(dib);
+	// source over an opaque image
+	dib = FreeImage_ConvertToType(opaque, FIT_RGBA16);
+	assert(dib != NULL);
+	const FIRGBA16 bk16 = ((FIRGBA16*)FreeImage_GetScanLine(dib, 0))[0];
+	const unsigned bkc16[3] = { bk16.red, bk16.green, bk16.blue };
+	bResult = FreeImage_CompositeInto(dib, premultiplied16, 5, -3, FIBM_OVER, 200);
+	assert(bResult);
+	for(unsigned y = 0; y < height + 10; y++) {
+		// rows are stored bottom up
+		const FIRGBA16 *dst_bits = (FIRGBA16*)FreeImage_GetScanLine(dib, height + 9 - y);
+		for(unsigned x = 0; x < width + 10; x++) {
+			const WORD dst_rgb[3] = { dst_bits[x].red, dst_bits[x].green, dst_bits[x].blue };
+			for(int c = 0; c < 3; c++) {
+				double expected = bkc16[c];
+				if((x >= 5) && (x < width + 5) && (y + 3 < height)) {
+					// straight alpha equation on the source pixel
+					const FIRGBA16& src_pixel = ((FIRGBA16*)FreeImage_GetScanLine(src16, height - 1 - (y + 3)))[x - 5];
+					const WORD src_rgb[3] = { src_pixel.red, src_pixel.green, src_pixel.blue };
+					const double alpha = src_pixel.alpha / 65535.0 * 200 / 255;
+					expected = alpha * src_rgb[c] + (1 - alpha) * bkc16[c];
+				}
+				assert(fabs(dst_rgb[c] - expected) <= 2);
+			}
+			assert(dst_bits[x].alpha >= bk16.alpha);
+		}
+	}
+	FreeImage_Unload(dib);
+	FreeImage_Unload(premultiplied16);
+	FreeImage_Unload(src16);
+
+	// float images
+	FIBITMAP *src_float = FreeImage_ConvertToType(opaque, FIT_RGBAF);
+	FIBITMAP *dst_float = FreeImage_ConvertToType(opaque, FIT_RGBAF);
+	assert(src_float && dst_float);
+	bResult = FreeImage_CompositeInto(dst_float, src_float, 0, 0, FIBM_MULTIPLY);
+	assert(bResult);
+	for(unsigned y = 0; y < height + 10; y++) {
+		const FIRGBAF *bits = (FIRGBAF*)FreeImage_GetScanLine(dst_float, y);
+		const FIRGBAF *src_bits = (FIRGBAF*)FreeImage_GetScanLine(src_float, y);
+		for(unsigned x = 0; x < width + 10; x++) {
+			assert(fabs(bits[x].red - src_bits[x].red * src_bits[x].red) < 1e-6);
+			assert(bits[x].alpha == 1);
+		}
+	}
+
+	// the source must have an alpha channel, and the images the same type
+	bResult = FreeImage_CompositeInto(dst_float, premultiplied, 0, 0);
+	assert(!bResult);
+	bResult = FreeImage_CompositeInto(opaque, background, 0, 0);
+	assert(!bResult);
+
+	FreeImage_Unload(src_float);
+	FreeImage_Unload(dst_float);
+	FreeImage_Unload(opaque);
+	FreeImage_Unload(background);
+	FreeImage_Unload(premultiplied);
+	FreeImage_Unload(src);
+}
+
+void testSplitChannels(unsigned width, unsigned height) {
+	BOOL bResult = FALSE;
+
+	printf("testSplitChannels ...\n");
+
+	FIBITMAP *src = createTestImage(width, height, 32);
+	assert(src != NULL);
+
+	// split gives the channels of FreeImage_GetChannel, merge gives back the image
+	const FREE_IMAGE_TYPE types[] = { FIT_BITMAP, FIT_RGBA16, FIT_RGBF, FIT_RGBAF };
+	const FREE_IMAGE_COLOR_CHANNEL color_channels[4] = { FICC_RED, FICC_GREEN, FICC_BLUE, FICC_ALPHA };
+	for(int i = 0; i < 4; i++) {
+		FIBITMAP *dib = FreeImage_ConvertToType(src, types[i]);
+		assert(dib != NULL);
+		FIBITMAP *channels[4] = { NULL, NULL, NULL, NULL };
+		const int count = FreeImage_SplitChannels(dib, channels);
+		assert(count == ((types[i] == FIT_RGBF) ? 3 : 4));
+		for(int c = 0; c < count; c++) {
+			FIBITMAP *channel = FreeImage_GetChannel(dib, color_channels[c]);
+			assert(channel != NULL);
+			assert(isSameImage(channel, channels[c]));
+			FreeImage_Unload(channel);
+		}
+		FIBITMAP *merged = FreeImage_MergeChannels(channels, count);
+		assert(merged != NULL);
+		assert(isSameImage(merged, dib));
+		FreeImage_Unload(merged);
+
+		// the channels must have the same type
+		if(types[i] != FIT_BITMAP) {
+			FIBITMAP *channel = channels[0];
+			channels[0] = FreeImage_GetChannel(src, FICC_RED);
+			FIBITMAP *mismatched = FreeImage_MergeChannels(channels, count);
+			assert(mismatched == NULL);
+			FreeImage_Unload(channels[0]);
+			channels[0] = channel;
+		}
+
+		for(int c = 0; c < count; c++) {
+			FreeImage_Unload(channels[c]);
+		}
+		FreeImage_Unload(dib);
+	}
+
+	// planar float export, with padded rows
+	FIBITMAP *channels[4];
+	const int channel_count = FreeImage_SplitChannels(src, channels);
+	assert(channel_count == 4);
+	const unsigned pitch = width * sizeof(float) + 12;
+	BYTE *planes = (BYTE*)malloc(3 * height * pitch);
+	assert(planes != NULL);
+	bResult = FreeImage_ExportPixels(src, planes, pitch, FIPL_RGB, FICT_FLOAT, FI_EXPORT_PLANAR);
+	assert(bResult);
+	for(unsigned c = 0; c < 3; c++) {
+		for(unsigned y = 0; y < height; y++) {
+			const float *plane_bits = (float*)(planes + (c * height + y) * pitch);
+			const BYTE *bits = FreeImage_GetScanLine(channels[c], y);
+			for(unsigned x = 0; x < width; x++) {
+				assert(fabs(plane_bits[x] - bits[x] / 255.0F) < 1e-6);
+			}
+		}
+	}
+	// planar 8-bit export
+	bResult = FreeImage_ExportPixels(src, planes, width, FIPL_ARGB, FICT_UINT8, FI_EXPORT_PLANAR);
+	assert(bResult);
+	for(unsigned y = 0; y < height; y++) {
+		assert(memcmp(planes + y * width, FreeImage_GetScanLine(channels[3], y), width) == 0);
+		assert(memcmp(planes + (height + y) * width, FreeImage_GetScanLine(channels[0], y), width) == 0);
+	}
+	// the pitch of a plane row
+	bResult = FreeImage_ExportPixels(src, planes, width - 1, FIPL_ARGB, FICT_UINT8, FI_EXPORT_PLANAR);
+	assert(!bResult);
+	free(planes);
+
+	for(int c = 0; c < 4; c++) {
+		FreeImage_Unload(channels[c]);
+	}
+	FreeImage_Unload(src);
+}
+
+void testConvolve(unsigned width, unsigned height) {
+	printf("testConvolve ...\n");
+
+	FIBITMAP *zoneplate = createTestImage(width, height, 8);
+	assert(zoneplate != NULL);
+	FIBITMAP *src = createTestImage(width, height, 24);
+	assert(src != NULL);
+
+	// an identity kernel gives back the image
+	const float identity[1] = { 1 };
+	FIBITMAP *dst = FreeImage_Convolve(src, identity, 1, identity, 1);
+	assert(dst != NULL);
+	assert(isSameImage(dst, src));
+	FreeImage_Unload(dst);
+
+	// a shift kernel moves the image right by one pixel, the edge pixels being replicated
+	const float shift[3] = { 0, 0, 1 };
+	dst = FreeImage_Convolve(zoneplate, shift, 3, NULL, 0);
+	assert(dst != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		const BYTE *src_bits = FreeImage_GetScanLine(zoneplate, y);
+		const BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(dst_bits[x] == src_bits[(x > 0) ? x - 1 : 0]);
+		}
+	}
+	FreeImage_Unload(dst);
+
+	// the blurs keep a constant image, and leave the mean of an impulse unchanged
+	FIBITMAP *flat = FreeImage_AllocateT(FIT_FLOAT, width, height);
+	assert(flat != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(flat, y);
+		for(unsigned x = 0; x < width; x++) {
+			bits[x] = 0.5F;
+		}
+	}
+	const double sigmas[3] = { 0.8, 3, 12 };
+	for(int i = 0; i < 3; i++) {
+		dst = FreeImage_GaussianBlur(flat, sigmas[i]);
+		assert(dst != NULL);
+		for(unsigned y = 0; y < height; y++) {
+			const float *bits = (float*)FreeImage_GetScanLine(dst, y);
+			for(unsigned x = 0; x < width; x++) {
+				assert(fabs(bits[x] - 0.5F) < 1e-4);
+			}
+		}
+		FreeImage_Unload(dst);
+	}
+	dst = FreeImage_BoxBlur(flat, 5, 2);
+	assert(dst != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		const float *bits = (float*)FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(fabs(bits[x] - 0.5F) < 1e-5);
+		}
+	}
+	FreeImage_Unload(dst);
+
+	FIBITMAP *impulse = FreeImage_AllocateT(FIT_FLOAT, 64, 64);
+	assert(impulse != NULL);
+	((float*)FreeImage_GetScanLine(impulse, 32))[32] = 1;
+	dst = FreeImage_GaussianBlur(impulse, 2);
+	assert(dst != NULL);
+	double sum = 0;
+	for(unsigned y = 0; y < 64; y++) {
+		const float *bits = (float*)FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < 64; x++) {
+			sum += bits[x];
+			// symmetric response
+			if((x > 0) && (y > 0)) {
+				assert(fabs(bits[x] - ((float*)FreeImage_GetScanLine(dst, 64 - y))[64 - x]) < 1e-6);
+			}
+		}
+	}
+	assert(fabs(sum - 1) < 1e-4);
+	FreeImage_Unload(dst);
+	FreeImage_Unload(impulse);
+
+	// an unsharp mask of a constant image is the image
+	dst = FreeImage_UnsharpMask(flat, 2, 1.5);
+	assert(dst != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		const float *bits = (float*)FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++) {
+			assert(fabs(bits[x] - 0.5F) < 1e-4);
+		}
+	}
+	FreeImage_Unload(dst);
+	FreeImage_Unload(flat);
+
+	// the box sums keep the small values added after a large one
+	FIBITMAP *spike = FreeImage_AllocateT(FIT_FLOAT, 32, 32);
+	assert(spike != NULL);
+	for(unsigned y = 0; y < 32; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(spike, y);
+		for(unsigned x = 0; x < 32; x++) {
+			bits[x] = ((x == 8) && (y == 8)) ? 1e6F : 0.001F;
+		}
+	}
+	dst = FreeImage_BoxBlur(spike, 2, 2);
+	assert(dst != NULL);
+	for(unsigned y = 0; y < 32; y++) {
+		const float *bits = (float*)FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < 32; x++) {
+			const bool inside = (abs((int)x - 8) <= 2) && (abs((int)y - 8) <= 2);
+			const double expected = inside ? (1e6 + 24 * 0.001) / 25 : 0.001;
+			assert(fabs(bits[x] - expected) <= 1e-6 * expected);
+		}
+	}
+	FreeImage_Unload(dst);
+	FreeImage_Unload(spike);
+
+	// box radii larger than the image average its replicated edges
+	FIBITMAP *small = FreeImage_Copy(zoneplate, 0, 0, 20, 12);
+	assert(small != NULL);
+	const int radius_x = 30, radius_y = 17;
+	dst = FreeImage_BoxBlur(small, radius_x, radius_y);
+	assert(dst != NULL);
+	for(int y = 0; y < 12; y++) {
+		for(int x = 0; x < 20; x++) {
+			double sum = 0;
+			for(int j = y - radius_y; j <= y + radius_y; j++) {
+				const BYTE *src_bits = FreeImage_GetScanLine(small, (j < 0) ? 0 : (j > 11) ? 11 : j);
+				for(int k = x - radius_x; k <= x + radius_x; k++) {
+					sum += src_bits[(k < 0) ? 0 : (k > 19) ? 19 : k];
+				}
+			}
+			const double expected = sum / ((2 * radius_x + 1) * (2 * radius_y + 1));
+			assert(fabs(FreeImage_GetScanLine(dst, y)[x] - expected) <= 1);
+		}
+	}
+	FreeImage_Unload(dst);
+	FreeImage_Unload(small);
+
+	// radii that would overflow the working buffers if they were replicated
+	FIBITMAP *wide = createTestImage(512, 4, 32);
+	assert(wide != NULL);
+	for(int vertical = 0; vertical < 2; vertical++) {
+		dst = vertical ? FreeImage_BoxBlur(wide, 0, 536870656) : FreeImage_BoxBlur(wide, 536870656, 0);
+		assert(dst != NULL);
+		for(unsigned y = 0; y < 4; y++) {
+			const BYTE *bits = FreeImage_GetScanLine(dst, y);
+			for(unsigned x = 0; x < 512; x++) {
+				// the mean of the edge pixels of the row or of the column
+				const BYTE *first = vertical ? FreeImage_GetScanLine(wide, 0) + 4 * x : FreeImage_GetScanLine(wide, y);
+				const BYTE *last = vertical ? FreeImage_GetScanLine(wide, 3) + 4 * x : FreeImage_GetScanLine(wide, y) + 4 * 511;
+				for(unsigned c = 0; c < 4; c++) {
+					assert(fabs(bits[4 * x + c] - (first[c] + last[c]) / 2.0) <= 1);
+				}
+			}
+		}
+		FreeImage_Unload(dst);
+	}
+	// Gaussian blurs are limited to a standard deviation of 100 pixels
+	dst = FreeImage_GaussianBlur(wide, 100);
+	assert(dst != NULL);
+	FreeImage_Unload(dst);
+	dst = FreeImage_GaussianBlur(wide, 1e9);
+	assert(dst == NULL);
+	dst = FreeImage_UnsharpMask(wide, 1e9, 1);
+	assert(dst == NULL);
+	FreeImage_Unload(wide);
+
+	// the result must be the same whatever the number of threads
+	assertThreadIndependent([&]() { return FreeImage_GaussianBlur(src, 6); });
+	assertThreadIndependent([&]() { return FreeImage_BoxBlur(src, 7, 3); });
+
+	// even kernel sizes and palettized images are rejected
+	const float even[2] = { 0.5F, 0.5F };
+	dst = FreeImage_Convolve(src, even, 2, NULL, 0);
+	assert(dst == NULL);
+	FIBITMAP *palettized = FreeImage_ConvertTo4Bits(src);
+	assert(palettized != NULL);
+	dst = FreeImage_GaussianBlur(palettized, 1);
+	assert(dst == NULL);
+	FreeImage_Unload(palettized);
+
+	FreeImage_Unload(src);
+	FreeImage_Unload(zoneplate);
+}
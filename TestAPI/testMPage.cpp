@@ -21,6 +21,7 @@
 
 
 #include "TestSuite.h"
+#include <string.h>
 
 void  
 testBuildMPage(const char *src_filename, const char *dst_filename, FREE_IMAGE_FORMAT dst_fif, unsigned bpp) {
@@ -174,6 +175,305 @@ void testLockDeleteMultiPage(const char *input) {
 
 // --------------------------------------------------------------------------
 
+static void setAnimationTag(FIBITMAP *dib, const char *key, FREE_IMAGE_MDTYPE type, DWORD length, const void *value) {
+	FITAG *tag = FreeImage_CreateTag();
+	assert(tag != NULL);
+	FreeImage_SetTagKey(tag, key);
+	FreeImage_SetTagType(tag, type);
+	FreeImage_SetTagCount(tag, 1);
+	FreeImage_SetTagLength(tag, length);
+	FreeImage_SetTagValue(tag, value);
+	FreeImage_SetMetadata(FIMD_ANIMATION, dib, key, tag);
+	FreeImage_DeleteTag(tag);
+}
+
+static const void* getAnimationTag(FIBITMAP *dib, const char *key) {
+	FITAG *tag = NULL;
+	BOOL bResult = FreeImage_GetMetadata(FIMD_ANIMATION, dib, key, &tag);
+	assert(bResult);
+	return FreeImage_GetTagValue(tag);
+}
+
+void testAnimatedWebP(const char *lpszPathName) {
+	// build a 3 frames animation
+	testBuildMPage(lpszPathName, "sample.webp", FIF_WEBP, 24);
+
+	FIMULTIBITMAP *src = FreeImage_OpenMultiBitmap(FIF_WEBP, "sample.webp", FALSE, TRUE, TRUE);
+	assert(src != NULL);
+
+	int count = FreeImage_GetPageCount(src);
+	assert(count == 3);
+
+	for(int page = 0; page < count; page++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, page);
+		assert(dib != NULL);
+		// frames were saved as 16x16, 32x32 and 48x48 images
+		assert(FreeImage_GetWidth(dib) == (unsigned)(16 * (page + 1)));
+		// each frame has a duration
+		FITAG *tag = NULL;
+		BOOL bResult = FreeImage_GetMetadata(FIMD_ANIMATION, dib, "FrameTime", &tag);
+		assert(bResult && (*(LONG*)FreeImage_GetTagValue(tag) == 100));
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// the frame offsets and blend methods are kept by a save / load round trip
+	FIMULTIBITMAP *out = FreeImage_OpenMultiBitmap(FIF_WEBP, "animation.webp", TRUE, FALSE, FALSE);
+	assert(out != NULL);
+	for(int page = 0; page < 3; page++) {
+		FIBITMAP *dib = FreeImage_Allocate(16, 16, 32);
+		assert(dib != NULL);
+		const WORD logical_size = 64;
+		const WORD left = (WORD)(2 * page);
+		const WORD top = (WORD)(4 * page);
+		const LONG frame_time = 50;
+		const BYTE blend_method = (BYTE)(page & 1);
+		setAnimationTag(dib, "LogicalWidth", FIDT_SHORT, 2, &logical_size);
+		setAnimationTag(dib, "LogicalHeight", FIDT_SHORT, 2, &logical_size);
+		setAnimationTag(dib, "FrameLeft", FIDT_SHORT, 2, &left);
+		setAnimationTag(dib, "FrameTop", FIDT_SHORT, 2, &top);
+		setAnimationTag(dib, "FrameTime", FIDT_LONG, 4, &frame_time);
+		setAnimationTag(dib, "BlendMethod", FIDT_BYTE, 1, &blend_method);
+		FreeImage_AppendPage(out, dib);
+		FreeImage_Unload(dib);
+	}
+	FreeImage_CloseMultiBitmap(out, 0);
+
+	src = FreeImage_OpenMultiBitmap(FIF_WEBP, "animation.webp", FALSE, TRUE, TRUE);
+	assert(src != NULL);
+	assert(FreeImage_GetPageCount(src) == 3);
+	for(int page = 0; page < 3; page++) {
+		FIBITMAP *dib = FreeImage_LockPage(src, page);
+		assert(dib != NULL);
+		assert(*(WORD*)getAnimationTag(dib, "FrameLeft") == 2 * page);
+		assert(*(WORD*)getAnimationTag(dib, "FrameTop") == 4 * page);
+		assert(*(BYTE*)getAnimationTag(dib, "BlendMethod") == (page & 1));
+		FreeImage_UnlockPage(src, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(src, 0);
+
+	// a GIF frame with odd offsets
+	FIBITMAP *dib = FreeImage_Allocate(16, 12, 8);
+	assert(dib != NULL);
+	RGBQUAD *pal = FreeImage_GetPalette(dib);
+	for(int i = 0; i < 256; i++) {
+		pal[i].rgbRed = (BYTE)i;
+		pal[i].rgbGreen = (BYTE)(255 - i);
+		pal[i].rgbBlue = (BYTE)(3 * i);
+	}
+	for(unsigned y = 0; y < 12; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < 16; x++) {
+			bits[x] = (BYTE)(16 * y + x);
+		}
+	}
+	const WORD odd_left = 3, odd_top = 5;
+	setAnimationTag(dib, "FrameLeft", FIDT_SHORT, 2, &odd_left);
+	setAnimationTag(dib, "FrameTop", FIDT_SHORT, 2, &odd_top);
+	FIMULTIBITMAP *gif = FreeImage_OpenMultiBitmap(FIF_GIF, "odd.gif", TRUE, FALSE, FALSE);
+	assert(gif != NULL);
+	FreeImage_AppendPage(gif, dib);
+	FreeImage_CloseMultiBitmap(gif, 0);
+	FreeImage_Unload(dib);
+
+	gif = FreeImage_OpenMultiBitmap(FIF_GIF, "odd.gif", FALSE, TRUE, FALSE);
+	assert(gif != NULL);
+	dib = FreeImage_LockPage(gif, 0);
+	assert(dib != NULL);
+	FIBITMAP *frame = FreeImage_ConvertTo32Bits(dib);
+	assert(frame != NULL);
+	// FreeImage_CloneMetadata skips the animation metadata
+	FITAG *tag = NULL;
+	FIMETADATA *mdhandle = FreeImage_FindFirstMetadata(FIMD_ANIMATION, dib, &tag);
+	assert(mdhandle != NULL);
+	do {
+		FreeImage_SetMetadata(FIMD_ANIMATION, frame, FreeImage_GetTagKey(tag), tag);
+	} while(FreeImage_FindNextMetadata(mdhandle, &tag));
+	FreeImage_FindCloseMetadata(mdhandle);
+	FreeImage_UnlockPage(gif, dib, FALSE);
+	FreeImage_CloseMultiBitmap(gif, 0);
+	assert(*(WORD*)getAnimationTag(frame, "FrameLeft") == odd_left);
+	assert(*(WORD*)getAnimationTag(frame, "FrameTop") == odd_top);
+
+	// saved alone, the frame is a single image
+	BOOL bResult = FreeImage_Save(FIF_WEBP, frame, "odd.webp", WEBP_LOSSLESS);
+	assert(bResult);
+	dib = FreeImage_Load(FIF_WEBP, "odd.webp", 0);
+	assert(dib != NULL);
+	assert((FreeImage_GetWidth(dib) == 16) && (FreeImage_GetHeight(dib) == 12));
+	assert(FreeImage_GetMetadataCount(FIMD_ANIMATION, dib) == 0);
+	FreeImage_Unload(dib);
+
+	// saved as an animation frame, its offsets are aligned down and it is padded with a transparent column and row
+	out = FreeImage_OpenMultiBitmap(FIF_WEBP, "odd_animation.webp", TRUE, FALSE, FALSE);
+	assert(out != NULL);
+	FreeImage_AppendPage(out, frame);
+	FreeImage_CloseMultiBitmap(out, WEBP_LOSSLESS);
+	src = FreeImage_OpenMultiBitmap(FIF_WEBP, "odd_animation.webp", FALSE, TRUE, TRUE);
+	assert(src != NULL);
+	assert(FreeImage_GetPageCount(src) == 1);
+	dib = FreeImage_LockPage(src, 0);
+	assert(dib != NULL);
+	assert(*(WORD*)getAnimationTag(dib, "FrameLeft") == odd_left - 1);
+	assert(*(WORD*)getAnimationTag(dib, "FrameTop") == odd_top - 1);
+	assert((FreeImage_GetWidth(dib) == 17) && (FreeImage_GetHeight(dib) == 13));
+	for(unsigned y = 0; y < 13; y++) {
+		const RGBQUAD *bits = (RGBQUAD*)FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < 17; x++) {
+			if((x == 0) || (y == 12)) {
+				assert(bits[x].rgbReserved == 0);
+			} else {
+				assert(memcmp(&bits[x], (RGBQUAD*)FreeImage_GetScanLine(frame, y) + x - 1, sizeof(RGBQUAD)) == 0);
+			}
+		}
+	}
+	FreeImage_UnlockPage(src, dib, FALSE);
+	FreeImage_CloseMultiBitmap(src, 0);
+	FreeImage_Unload(frame);
+}
+
+static void testPSDPages(const char *lpszPathName) {
+	// save a RLE compressed PSD (the writer doesn't write any layer)
+	FIBITMAP *src = FreeImage_Load(FreeImage_GetFileType(lpszPathName), lpszPathName, 0);
+	assert(src != NULL);
+	FIBITMAP *rgb = FreeImage_ConvertTo24Bits(src);
+	assert(rgb != NULL);
+	BOOL bResult = FreeImage_Save(FIF_PSD, rgb, "sample.psd", PSD_RLE);
+	assert(bResult);
+	FreeImage_Unload(rgb);
+	FreeImage_Unload(src);
+
+	FIBITMAP *composite = FreeImage_Load(FIF_PSD, "sample.psd", 0);
+	assert(composite != NULL);
+
+	// page 0 is the composite image, then come the layers
+	FIMULTIBITMAP *psd = FreeImage_OpenMultiBitmap(FIF_PSD, "sample.psd", FALSE, TRUE, TRUE);
+	assert(psd != NULL);
+	int count = FreeImage_GetPageCount(psd);
+	assert(count == 1);
+
+	FIBITMAP *dib = FreeImage_LockPage(psd, 0);
+	assert(dib != NULL);
+	assert(FreeImage_GetWidth(dib) == FreeImage_GetWidth(composite));
+	assert(FreeImage_GetHeight(dib) == FreeImage_GetHeight(composite));
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		assert(memcmp(FreeImage_GetScanLine(dib, y), FreeImage_GetScanLine(composite, y), FreeImage_GetLine(dib)) == 0);
+	}
+	FreeImage_UnlockPage(psd, dib, FALSE);
+
+	FreeImage_CloseMultiBitmap(psd, 0);
+	FreeImage_Unload(composite);
+}
+
+/**
+Sample value of the layered PSD files, see testPSDLayers
+*/
+static BYTE psdLayerValue(int layer, int channel, unsigned x, unsigned y) {
+	if((channel == 3) && (x < 4)) {
+		return 255;
+	}
+	return (BYTE)(layer * 37 + channel * 59 + x * 11 + y * 23);
+}
+
+static void checkPSDLayer(FIBITMAP *dib, unsigned bpc, int layer, unsigned width, unsigned height, int left, int top, BOOL bHasAlpha) {
+	char position[16];
+	FITAG *tag = NULL;
+
+	assert(dib != NULL);
+	assert(FreeImage_GetWidth(dib) == width);
+	assert(FreeImage_GetHeight(dib) == height);
+	const unsigned channels = bHasAlpha ? 4 : 3;
+	assert(FreeImage_GetBPP(dib) == bpc * channels);
+	sprintf(position, "%d", left);
+	assert(FreeImage_GetMetadata(FIMD_COMMENTS, dib, "Layer.Left", &tag) && (strcmp((char*)FreeImage_GetTagValue(tag), position) == 0));
+	sprintf(position, "%d", top);
+	assert(FreeImage_GetMetadata(FIMD_COMMENTS, dib, "Layer.Top", &tag) && (strcmp((char*)FreeImage_GetTagValue(tag), position) == 0));
+
+	// 8-bit channels are in the order of FreeImage bitmaps
+	const unsigned offsets[4] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE, FI_RGBA_ALPHA };
+
+	for(unsigned y = 0; y < height; y++) {
+		// PSD rows are top-down
+		const BYTE *bits = FreeImage_GetScanLine(dib, height - 1 - y);
+		for(unsigned x = 0; x < width; x++) {
+			for(unsigned c = 0; c < channels; c++) {
+				const BYTE value = psdLayerValue(layer, c, x, y);
+				switch(bpc) {
+					case 8:
+						assert(bits[x * channels + offsets[c]] == value);
+						break;
+					case 16:
+						assert(((WORD*)bits)[x * channels + c] == ((value * 257) ^ x));
+						break;
+					case 32:
+						assert(((float*)bits)[x * channels + c] == value / 256.0F + 0.5F);
+						break;
+				}
+			}
+		}
+	}
+}
+
+/**
+Test the layers of PSD files with raw, RLE, ZIP and ZIP with prediction channels
+*/
+static void testPSDLayers() {
+	// 8-bit layers are stored in the layer info section
+	FIMULTIBITMAP *psd = FreeImage_OpenMultiBitmap(FIF_PSD, "layers.psd", FALSE, TRUE, TRUE);
+	assert(psd != NULL);
+	assert(FreeImage_GetPageCount(psd) == 5);
+	FIBITMAP *dib = FreeImage_LockPage(psd, 1);
+	checkPSDLayer(dib, 8, 0, 16, 12, 0, 0, FALSE);	// raw
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	dib = FreeImage_LockPage(psd, 2);
+	checkPSDLayer(dib, 8, 1, 10, 8, 3, 2, TRUE);	// RLE
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	dib = FreeImage_LockPage(psd, 3);
+	checkPSDLayer(dib, 8, 2, 7, 5, 4, 1, FALSE);	// ZIP
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	dib = FreeImage_LockPage(psd, 4);
+	checkPSDLayer(dib, 8, 3, 9, 6, 2, 3, TRUE);		// ZIP with prediction
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	FreeImage_CloseMultiBitmap(psd, 0);
+
+	// 16-bit layers are stored in a 'Lr16' block
+	psd = FreeImage_OpenMultiBitmap(FIF_PSD, "layers16.psd", FALSE, TRUE, TRUE);
+	assert(psd != NULL);
+	assert(FreeImage_GetPageCount(psd) == 3);
+	dib = FreeImage_LockPage(psd, 1);
+	checkPSDLayer(dib, 16, 0, 16, 12, 0, 0, TRUE);	// RLE
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	dib = FreeImage_LockPage(psd, 2);
+	checkPSDLayer(dib, 16, 1, 9, 6, 2, 3, FALSE);	// ZIP with prediction
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	FreeImage_CloseMultiBitmap(psd, 0);
+
+	// 32-bit layers are stored in a 'Lr32' block
+	psd = FreeImage_OpenMultiBitmap(FIF_PSD, "layers32.psd", FALSE, TRUE, TRUE);
+	assert(psd != NULL);
+	assert(FreeImage_GetPageCount(psd) == 3);
+	dib = FreeImage_LockPage(psd, 1);
+	checkPSDLayer(dib, 32, 0, 16, 12, 0, 0, FALSE);	// raw
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	dib = FreeImage_LockPage(psd, 2);
+	checkPSDLayer(dib, 32, 1, 9, 6, 2, 3, TRUE);	// ZIP with prediction
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	FreeImage_CloseMultiBitmap(psd, 0);
+
+	// a layer with corrupted ZIP data fails, the other layers still load
+	psd = FreeImage_OpenMultiBitmap(FIF_PSD, "layers_corrupt.psd", FALSE, TRUE, TRUE);
+	assert(psd != NULL);
+	assert(FreeImage_GetPageCount(psd) == 3);
+	dib = FreeImage_LockPage(psd, 1);
+	checkPSDLayer(dib, 8, 0, 16, 12, 0, 0, FALSE);
+	FreeImage_UnlockPage(psd, dib, FALSE);
+	assert(FreeImage_LockPage(psd, 2) == NULL);
+	FreeImage_CloseMultiBitmap(psd, 0);
+}
+
+// --------------------------------------------------------------------------
+
 void testMultiPage(const char *lpszPathName) {
 	printf("testMultiPage ...\n");
 
@@ -182,6 +482,13 @@ void testMultiPage(const char *lpszPathName) {
 	testBuildMPage(lpszPathName, "sample.tif", FIF_TIFF, 24);
 	testBuildMPage(lpszPathName, "sample.gif", FIF_GIF, 8);
 
+	// test animated WebP
+	testAnimatedWebP(lpszPathName);
+
+	// test PSD pages
+	testPSDPages(lpszPathName);
+	testPSDLayers();
+
 	// test multipage copy
 	testCloneMultiPage(FIF_TIFF, "sample.tif", "clone.tif", TIFF_LZW);
 
@@ -21,6 +21,7 @@
 
 
 #include "TestSuite.h"
+#include <string.h>
 
 /**
 Test thumbnail loading
@@ -119,6 +120,49 @@ static BOOL testSaveThumbnail(const char *lpszPathName, int flags) {
 	return FALSE; 
 }
 
+/**
+Test loading of a reduced size image, using the requested size load flag
+*/
+static BOOL testLoadReducedSize(const char *lpszPathName, int flags) {
+	FIBITMAP *dib = NULL;
+	FIBITMAP *reduced = NULL;
+
+	try {
+		FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(lpszPathName);
+
+		dib = FreeImage_Load(fif, lpszPathName, flags); 
+		if(!dib) throw(1);
+
+		const unsigned width = FreeImage_GetWidth(dib);
+		const unsigned height = FreeImage_GetHeight(dib);
+		const unsigned size = (width > height) ? width : height;
+		const unsigned requested_size = size / 4;
+
+		reduced = FreeImage_Load(fif, lpszPathName, flags | (requested_size << 16)); 
+		if(!reduced) throw(1);
+
+		// the image is reduced, but never below the requested size
+		const unsigned r_width = FreeImage_GetWidth(reduced);
+		const unsigned r_height = FreeImage_GetHeight(reduced);
+		const unsigned r_size = (r_width > r_height) ? r_width : r_height;
+		printf("... %s loaded at %dx%d for a requested size of %d\n", lpszPathName, r_width, r_height, requested_size);
+		assert(r_size >= requested_size);
+		assert(r_size < size);
+		assert(FreeImage_GetBPP(reduced) == FreeImage_GetBPP(dib));
+		
+		FreeImage_Unload(reduced); 
+		FreeImage_Unload(dib); 
+
+		return TRUE;
+	} 
+	catch(int) {
+		if(reduced) FreeImage_Unload(reduced); 
+		if(dib) FreeImage_Unload(dib); 
+	}
+	
+	return FALSE; 
+}
+
 /**
 Test thumbnail functions
 */
@@ -137,3 +181,97 @@ void testThumbnail(const char *lpszPathName, int flags) {
 
 }
 
+/**
+Test reduced size loading
+*/
+void testReducedSize(const char *lpszPathName, int flags) {
+	BOOL bResult = FALSE;
+
+	printf("testReducedSize ...\n");
+
+	bResult = testLoadReducedSize(lpszPathName, flags);
+	assert(bResult);
+}
+
+/**
+Test the parallel decoding of a JPEG-XR image made of several rows of tiles
+*/
+void testTiledJXR(const char *lpszPathName) {
+	printf("testTiledJXR ...\n");
+
+	// the rows of tiles are decoded in parallel, the result must not depend on the number of threads
+	FreeImage_SetThreadCount(1);
+	FIBITMAP *serial = FreeImage_Load(FIF_JXR, lpszPathName, 0);
+	FreeImage_SetThreadCount(4);
+	FIBITMAP *parallel = FreeImage_Load(FIF_JXR, lpszPathName, 0);
+	assert(serial && parallel);
+	assert(FreeImage_GetWidth(serial) == FreeImage_GetWidth(parallel));
+	assert(FreeImage_GetHeight(serial) == FreeImage_GetHeight(parallel));
+	for(unsigned y = 0; y < FreeImage_GetHeight(serial); y++) {
+		assert(memcmp(FreeImage_GetScanLine(serial, y), FreeImage_GetScanLine(parallel, y), FreeImage_GetLine(serial)) == 0);
+	}
+	FreeImage_Unload(parallel);
+
+	// same thing from a memory stream
+	FILE *stream = fopen(lpszPathName, "rb");
+	assert(stream != NULL);
+	fseek(stream, 0, SEEK_END);
+	const long size = ftell(stream);
+	fseek(stream, 0, SEEK_SET);
+	BYTE *data = (BYTE*)malloc(size);
+	assert(data != NULL);
+	const size_t bytes_read = fread(data, 1, size, stream);
+	assert(bytes_read == (size_t)size);
+	fclose(stream);
+	FIMEMORY *hmem = FreeImage_OpenMemory(data, (DWORD)size);
+	parallel = FreeImage_LoadFromMemory(FIF_JXR, hmem, 0);
+	assert(parallel != NULL);
+	for(unsigned y = 0; y < FreeImage_GetHeight(serial); y++) {
+		assert(memcmp(FreeImage_GetScanLine(serial, y), FreeImage_GetScanLine(parallel, y), FreeImage_GetLine(serial)) == 0);
+	}
+	FreeImage_CloseMemory(hmem);
+	free(data);
+	FreeImage_SetThreadCount(0);
+
+	FreeImage_Unload(parallel);
+	FreeImage_Unload(serial);
+}
+
+void testRAWPreview(const char *lpszPathName) {
+	printf("testRAWPreview ...\n");
+
+	// a 112x80 DNG with a 64x48 JPEG preview
+	assert(FreeImage_GetFileType(lpszPathName) == FIF_RAW);
+
+	// the largest preview, loaded at a reduced size of at least 32 pixels
+	FIBITMAP *preview = FreeImage_Load(FIF_RAW, lpszPathName, RAW_PREVIEW_SIZE | (32 << 16));
+	assert(preview != NULL);
+	assert((FreeImage_GetBPP(preview) == 24) && (FreeImage_GetWidth(preview) >= 32) && (FreeImage_GetWidth(preview) <= 64));
+	assert(FreeImage_GetWidth(preview) * 48 == FreeImage_GetHeight(preview) * 64);
+
+	// no preview is large enough : half-size demosaicing
+	FIBITMAP *dib = FreeImage_Load(FIF_RAW, lpszPathName, RAW_PREVIEW_SIZE | (1000 << 16));
+	assert(dib != NULL);
+	assert((FreeImage_GetImageType(dib) == FIT_BITMAP) && (FreeImage_GetBPP(dib) == 24));
+	assert((FreeImage_GetWidth(dib) == 56) && (FreeImage_GetHeight(dib) == 40));
+	FreeImage_Unload(dib);
+
+	// the LibRaw processors are reused, with their default parameters restored (no half-size output)
+	for(int i = 0; i < 2; i++) {
+		dib = FreeImage_Load(FIF_RAW, lpszPathName, RAW_DEFAULT);
+		assert(dib != NULL);
+		assert(FreeImage_GetImageType(dib) == FIT_RGB16);
+		assert((FreeImage_GetWidth(dib) == 112) && (FreeImage_GetHeight(dib) == 80));
+		FreeImage_Unload(dib);
+
+		dib = FreeImage_Load(FIF_RAW, lpszPathName, RAW_PREVIEW_SIZE | (32 << 16));
+		assert(dib != NULL);
+		assert((FreeImage_GetWidth(dib) == FreeImage_GetWidth(preview)) && (FreeImage_GetHeight(dib) == FreeImage_GetHeight(preview)));
+		for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+			assert(memcmp(FreeImage_GetScanLine(dib, y), FreeImage_GetScanLine(preview, y), FreeImage_GetLine(dib)) == 0);
+		}
+		FreeImage_Unload(dib);
+	}
+
+	FreeImage_Unload(preview);
+}
@@ -80,3 +80,34 @@ FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale) {
 	return dst;
 }
 
+/**
+Create a test image from a zone plate : the 8-bit zone plate, or a 24-bit or 32-bit image whose 
+red and green channels are ramps (x * 3 and y * 5, modulo 256), the blue channel the zone plate 
+and the alpha channel of 32-bit images the x + y ramp, so that every channel is different
+*/
+FIBITMAP* createTestImage(unsigned width, unsigned height, unsigned bpp) {
+	FIBITMAP *zoneplate = createZonePlateImage(width, height, 128);
+	if(!zoneplate || (bpp == 8)) {
+		return zoneplate;
+	}
+	FIBITMAP *dst = (bpp == 24) ? FreeImage_ConvertTo24Bits(zoneplate) : FreeImage_ConvertTo32Bits(zoneplate);
+	FreeImage_Unload(zoneplate);
+	if(!dst) {
+		return NULL;
+	}
+
+	const unsigned bytespp = bpp / 8;
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dst, y);
+		for(unsigned x = 0; x < width; x++, bits += bytespp) {
+			bits[FI_RGBA_RED] = (BYTE)(x * 3);
+			bits[FI_RGBA_GREEN] = (BYTE)(y * 5);
+			if(bytespp == 4) {
+				bits[FI_RGBA_ALPHA] = (BYTE)(x + y);
+			}
+		}
+	}
+
+	return dst;
+}
+